@@ -14,6 +14,21 @@ is installed, then cardA is assigned channel 0 and cardD channel 1.
 The audio interface is numerical and the cv channel offset must be used
 to offset which channel to write to for each card.
 
+Cards may mark some channels slow (levels, switches).  Slow channels
+don't get a USB audio channel of their own: they're time-division
+multiplexed, TDM_SLOTS_PER_CHANNEL (8) to a channel.  A device with
+slow channels has a sync channel, and the channels just below it are
+TDM lanes.  The client counts frames sent to the device: on frame f
+the phase is f % 8, the sync channel carries phase / 16 (full scale 1.0,
+so phase * 2048 as a signed 16 bit sample), and lane n carries the slow
+channel with TDM index n * 8 + phase.  So lane 0 is the sync channel - 1.
+
+Fast channels of a card are packed starting at the cv channel offset,
+in card channel order, skipping the slow ones.  The card's slow
+channels, in card channel order, take TDM indexes starting at the
+card's TDM base.  With no slow channels on a card everything is as
+before: num channels starting at the cv channel offset.
+
 #  byte  desc
 -- ----  ----
 a  0xF0  sysex
@@ -43,13 +58,100 @@ x  0x??  cardG audio interface Id
 y  0x??  cardH id
 z  0x??  cardH cv channel offset
 a  0x??  cardH audio interface Id
+   0x??  cardA num channels
+   0x??  cardA TDM base
+   0x??  cardA slow channel mask bits 0-6
+   0x??  cardA slow channel mask bits 7-13
+   0x??  cardA slow channel mask bits 14-20
+   0x??  cardA slow channel mask bits 21-27
+   0x??  cardA slow channel mask bits 28-31
+   ...   same 7 bytes for cardB through cardH
+   0x??  audio interface 0 TDM sync channel, 0x7F if no slow channels
+   0x??  audio interface 1 TDM sync channel, 0x7F if no slow channels
+   0x??  audio interface 0 latency marker channel, 0x7F if none free
 b  0xF7  end sysex
 
+The report is 87 bytes.  The first 27 are unchanged from the original
+28 byte report, so a client only reading those still gets the channel
+offsets right as long as no card has slow channels.
+
+
+Latency Report is transmitted when the latency marker channel steps
+up: the client holds the channel at 0 and raises it to full scale to
+time the trip to the DACs.  A marker counts once it goes over half
+scale having been under a quarter, so the client should hold it high
+until the report arrives (or it gives up), then drop it back to 0.
+Times are from the frame the marker was in going out to the cards to
+the report being sent.
+
+#  byte  desc
+-- ----  ----
+a  0xF0  sysex
+b  0x7D  test manufacturer
+c  0x07  latency report
+d  0x??  marker count, low 7 bits
+   4 x   usec from the marker reaching the DACs to this report
+   4 x   audio interface 0 frame number of the marker, low 28 bits
+   4 x   frames captured after the marker, not yet at the DACs
+e  0xF7  end sysex
+
+4 x values are 28 bits as in the Stats Report.
+
+
+Stats Report is transmitted on request from a client (Stats Request).
+Values are 28 bit two's complement, four bytes of 7 bits, most
+significant first, and saturate rather than wrap.  PCM busy and the
+card loads cover the time since the previous report; everything else
+counts from start.  Card entries are in discovery order, so the nth
+entry is MIDI channel n.
+
+#  byte  desc
+-- ----  ----
+a  0xF0  sysex
+b  0x7D  test manufacturer
+c  0x06  stats report
+d  0x01  report version
+   4 x   uptime, seconds
+   4 x   sampling rate, Hz
+   4 x   period size, frames
+   4 x   audio interface 0 fill, frames x10 (captured, not yet at the DACs)
+   4 x   PCM thread busy, permille of the frame interval
+   4 x   sample clock wakeups that missed one frame
+   4 x   wakeups that missed 2 to 9 frames
+   4 x   wakeups that missed 10 frames or more
+   4 x   xruns, both audio interfaces
+   4 x   longest xrun recovery, usec
+   4 x   clock drift, ppm x10, signed
+   4 x   audio interface 1 net slipped frames, signed
+   4 x   MIDI errors: sysex overflowed or cut off, card messages dropped
+   4 x   log messages dropped on RT threads
+   0x??  number of cards, N
+         then N times:
+   0x??  card slot
+   2 x   card load, permille of the frame interval in process_samples
+   2 x   card longest process_samples, usec
+   0x??  card tune: 0 not tuned, 1 tuned, 2 tune failed
+e  0xF7  end sysex
+
+Card load and longest are 14 bits, two bytes of 7, most significant
+first.  The report is 6 * N + 62 bytes.
+
 
 
 Receive Data
 ------------
 
+Channel Messages
+Channel messages on a card's MIDI channel go to that card.  Running
+status is fine, and realtime bytes may be interleaved anywhere.  Note,
+controller, pressure and pitch bend messages are handed to the card
+between frames, in order, so everything that arrived before a frame
+applies to it.  14 bit controllers (MSB 0-31 then LSB 32-63) and
+NRPN/RPN data entry (CC 6/38, increment 96, decrement 97) are also
+assembled on the Pi for cards that take high resolution parameters.
+Program change goes straight to the card.  Sysex longer than 256 bytes
+is dropped.
+
 
 Discovery Request
 Client requests the above Discovery Report.
@@ -63,6 +165,72 @@ d  0xF7  end sysex
 
 
 
+Stats Request
+Client requests the above Stats Report.  Asking about once a second is
+plenty.
+
+#  byte  desc
+-- ----  ----
+a  0xF0  sysex
+b  0x7D  test manufacturer
+c  0x05  stats request
+d  0xF7  end sysex
+
+
+
+Heartbeat
+Once connected the client sends a heartbeat every 20 ms or so with its
+own 7 bit sequence number.  Each is answered with a Heartbeat Ack.  A
+client that hears no ack for 100 ms should consider the link down and
+rediscover.  Once the Pi has had a heartbeat it treats 100 ms without
+one the same way: the cards stop being fed from the audio stream and
+hold their last values until heartbeats resume.  A client that never
+sends a heartbeat is never timed out.
+
+#  byte  desc
+-- ----  ----
+a  0xF0  sysex
+b  0x7D  test manufacturer
+c  0x08  heartbeat
+d  0x??  client sequence number
+e  0xF7  end sysex
+
+
+Heartbeat Ack, transmitted for each heartbeat.  The Pi's sequence
+number goes up by one per ack, so a jump counts acks lost on the way
+back.  The session changes whenever the daemon restarts: unless it
+resumed the cards from a checkpoint they've lost whatever switch state
+the client sent before.  Either way the client should send it all again.
+
+#  byte  desc
+-- ----  ----
+a  0xF0  sysex
+b  0x7D  test manufacturer
+c  0x09  heartbeat ack
+d  0x??  client sequence number, echoed
+e  0x??  Pi sequence number
+f  0x??  session
+g  0xF7  end sysex
+
+
+Card State, transmitted by the client.  Every switch and selector
+setting of one card in a single message: the program numbers the card
+would otherwise get as program changes, applied in order.  The client
+sends it when a module attaches, when a patch or preset loads, and on
+reconnect.  Cards that support it write each I/O expander once instead
+of once per program.
+
+#  byte  desc
+-- ----  ----
+a  0xF0  sysex
+b  0x7D  test manufacturer
+c  0x0A  card state
+d  0x??  card MIDI channel
+e  0x??  program number, repeated for each switch/selector
+f  0xF7  end sysex
+
+
+
 Autotune Requst
 Client requests all cards tune
 #  byte  desc
@@ -87,3 +255,44 @@ a  0xF0  sysex
 b  0x7D  test manufacturer
 c  0x04  restart request
 d  0xF7  end sysex
+
+
+
+Card Generators
+Each card has ZCV_GEN_MAX_GENERATORS (4) generators run on the Pi at
+the sample rate: an LFO, envelope or glide on one of the card's
+channels.  They're set up with NRPNs on the card's MIDI channel:
+NRPN MSB is the generator number, NRPN LSB the parameter, data entry
+MSB (and optionally LSB) the 14 bit value.
+
+#  byte  desc
+-- ----  ----
+a  0xBn  controller change, card's channel
+b  0x63  NRPN MSB
+c  0x??  generator number, 0-3
+d  0x62  NRPN LSB
+e  0x??  parameter
+f  0x06  data entry MSB
+g  0x??  value bits 7-13
+h  0x26  data entry LSB (optional, running status ok)
+i  0x??  value bits 0-6
+
+param  value
+-----  -----
+0      type: 0 off, 1 LFO, 2 AD envelope, 3 ADSR envelope, 4 glide
+1      card channel the generator drives, 0x3FFF for none
+2      LFO shape: 0 sine, 1 triangle, 2 saw, 3 square
+3      LFO rate, 0.01 Hz
+4      LFO / envelope depth, 0x3FFF is full scale
+5      attack, ms
+6      decay, ms
+7      sustain level, 0x3FFF is full scale
+8      release, ms
+9      glide time, ms for a full scale move
+10     glide target, 0x3FFF is full scale
+
+An LFO or envelope adds to the channel's streamed value, so the client
+can still send the base level.  A glide replaces the streamed value,
+slewing to the target.  Note on (velocity > 0) triggers every envelope
+on the card's channel; note off, note on with velocity 0 or controller
+123 (all notes off) releases them.
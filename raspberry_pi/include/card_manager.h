@@ -18,10 +18,20 @@
 #define CARD_MANAGER_H
 
 #include <libconfig.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
+#include "tdm.h"
 #include "zoxnoxiousd.h"
 
 #define MAX_SLOTS 8
+#define MAX_PCM_DEVICES 2
+
+// no channel free on pcm device 0 for the latency marker
+#define LATENCY_NO_MARKER_CHANNEL -1
+
+// plugin_card tune_result until the card has been through an autotune
+#define CARD_NOT_TUNED -1
 
 
 /* properties of a plugin_card */
@@ -34,6 +44,23 @@ struct plugin_card {
   int pcm_device_num;
   int channel_offset;
   int num_channels;
+
+  // slow channels: card channel n is slow when bit n is set.  Fast
+  // channels are packed from channel_offset, slow ones are TDM indexes
+  // tdm_base onward on the device.  tdm_samples is the demuxed view of
+  // all the card's channels handed to process_samples.
+  uint32_t slow_channel_mask;
+  int num_slow_channels;
+  int tdm_base;
+  int16_t *tdm_samples;
+
+  // telemetry.  process_samples time is accumulated by the PCM thread
+  // and read (max reset) by whoever reports it.  tune_result is the
+  // last autotune's tune_status_t, or CARD_NOT_TUNED.
+  _Atomic uint64_t process_ns;
+  _Atomic uint32_t process_calls;
+  _Atomic uint32_t process_ns_max;
+  _Atomic int tune_result;
   
   // plugin interface function pointers:
   void *dl_plugin_lib;
@@ -42,11 +69,14 @@ struct plugin_card {
   process_samples_f process_samples;
   process_midi_f process_midi;
   process_midi_program_change_f process_midi_program_change;
+  process_midi_program_changes_f process_midi_program_changes;  // optional, may be NULL
   tunereq_save_state_f tunereq_save_state;
   tunereq_set_point_f tunereq_set_point;
   tunereq_measurement_f tunereq_measurement;
   tunereq_restore_state_f tunereq_restore_state;
   free_zcard_f free_zcard;
+  checkpoint_zcard_f checkpoint_zcard;  // optional, may be NULL
+  resume_zcard_f resume_zcard;  // optional, may be NULL
   void *plugin_object;
 };
 
@@ -59,6 +89,11 @@ struct card_manager {
   // 8-bit Id of cards, indexed by physical slot, or zero if no card present:
   uint8_t card_ids[MAX_SLOTS];
 
+  // start of each present card's ROM, read at discovery.  Size zero
+  // if not read.
+  uint8_t card_roms[MAX_SLOTS][ZCARD_ROM_BYTES];
+  unsigned int card_rom_sizes[MAX_SLOTS];
+
   // plugins- num_cards are used; index does not represent physical
   // ordering of slots.  This is populated in load_card_plugins().
   // (elsewhere this ends up getting used as MIDI channel)
@@ -68,6 +103,15 @@ struct card_manager {
   // update order for cards: order the cards to minimize latency- group cards by rules
   // such as their spi mode
   struct plugin_card *card_update_order[MAX_SLOTS];
+
+  // per pcm device: TDM sync channel or TDM_NO_SYNC_CHANNEL, and number
+  // of slow channels multiplexed on it
+  int tdm_sync_channel[MAX_PCM_DEVICES];
+  int tdm_num_slow[MAX_PCM_DEVICES];
+
+  // a channel on pcm device 0 no card uses, for the client's latency
+  // marker, or LATENCY_NO_MARKER_CHANNEL
+  int latency_marker_channel;
 };
 
 
@@ -101,7 +145,11 @@ void free_card_manager(struct card_manager *card_mgr);
  * Populates internal data structure:
  *   foreach card
  *     --> card_ids[slot] = Id byte from ROM if found otherwise zero
+ *     --> card_roms[slot] = first ZCARD_ROM_BYTES of the ROM
  *     --> number of cards in system
+ * Each ROM is read whole in one block read and compared with the
+ * cache file kept across boots, which is rewritten only when a card
+ * changed.
  * number of cards found set at int*
  */
 int discover_cards(struct card_manager *card_mgr);
@@ -139,9 +187,24 @@ void assign_update_order(struct card_manager *card_mgr);
  *
  * Take a pointer to an array of ints, representing the number of channels each hw device has available.
  * The num_devices is the size of the array.
+ *
+ * Slow channels (slow_channel_mask) don't get a channel of their own,
+ * they're packed TDM_SLOTS_PER_CHANNEL to a lane at the top of the
+ * device, below a sync channel carrying the rotation phase.
  */
 void assign_hw_audio_channels(struct card_manager *card_mgr, int *channels, int num_devices);
 
 
+/** tdm_demux_card_samples
+ *
+ * for a card with slow channels: assemble all of its channels from the
+ * device's current frame.  Fast channels are copied, slow channels
+ * update when the frame's phase is theirs and otherwise hold.  Returns
+ * the samples to pass to process_samples.
+ */
+const int16_t* tdm_demux_card_samples(struct card_manager *card_mgr, struct plugin_card *card,
+                                      const char **device_samples);
+
+
 
 #endif
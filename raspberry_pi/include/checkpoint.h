@@ -0,0 +1,96 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <libconfig.h>
+#include <stddef.h>
+
+#include "card_manager.h"
+
+// config lookup keys
+#define CHECKPOINT_PATH_KEY "zoxnoxiousd.checkpoint_path"
+#define CHECKPOINT_INTERVAL_KEY "zoxnoxiousd.checkpoint_interval_sec"
+
+// tmpfs: gone on reboot, same as the cards' state
+#define CHECKPOINT_DEFAULT_PATH "/dev/shm/zoxnoxiousd.checkpoint"
+#define CHECKPOINT_MAX_CARD_BYTES 65536
+#define CHECKPOINT_DEFAULT_INTERVAL_SEC 10
+
+
+/* card state left by a previous daemon, for the next one to resume
+ * from.  A card's data is whatever its checkpoint_zcard wrote;
+ * tune_result is the plugin_card's from that run.  size zero: the
+ * card has nothing to resume from.
+ */
+struct checkpoint_card {
+  int slot;
+  int card_id;
+  int tune_result;
+  size_t size;
+  void *data;
+};
+
+struct checkpoint {
+  struct checkpoint_card cards[MAX_SLOTS];
+  int num_cards;
+};
+
+
+/** checkpoint_save
+ *
+ * write every card that supports it to the configured checkpoint
+ * path.  Call with the PCM thread stopped, before the cards are
+ * freed.  Written to a temporary file and renamed into place.
+ * Returns zero on success or when disabled.
+ */
+int checkpoint_save(config_t *cfg, const struct card_manager *card_mgr);
+
+
+/** checkpoint_create / checkpoint_capture_card / checkpoint_write
+ *
+ * the same in steps, for the periodic checkpoint taken while the PCM
+ * thread runs.  checkpoint_create allocates a buffer per card up
+ * front.  checkpoint_capture_card copies one card (card_mgr->cards
+ * index) into its buffer; it doesn't allocate, block or log, so the
+ * PCM thread can call it between frames, the only time a card's state
+ * is settled.  checkpoint_write is the file write, off the RT threads.
+ */
+struct checkpoint* checkpoint_create(const struct card_manager *card_mgr);
+void checkpoint_capture_card(struct checkpoint *checkpoint, const struct card_manager *card_mgr, int card_num);
+int checkpoint_write(config_t *cfg, const struct checkpoint *checkpoint);
+
+
+/** checkpoint_load
+ *
+ * read the checkpoint the previous daemon left, if it was written
+ * since this boot.  The file is removed once read: a checkpoint is
+ * only good for the restart straight after the stop or crash that
+ * left it.  Returns NULL if there's nothing to resume from.
+ */
+struct checkpoint* checkpoint_load(config_t *cfg);
+
+
+/** checkpoint_find_card
+ *
+ * the checkpoint for slot, if the same card was there.  NULL otherwise.
+ */
+const struct checkpoint_card* checkpoint_find_card(const struct checkpoint *checkpoint, int slot, int card_id);
+
+
+void free_checkpoint(struct checkpoint *checkpoint);
+
+#endif // CHECKPOINT_H
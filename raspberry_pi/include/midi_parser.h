@@ -0,0 +1,104 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIDI_PARSER_H
+#define MIDI_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MIDI_CHANNELS 16
+#define MIDI_SYSEX_MAX_BYTES 256
+
+enum midi_status_byte {
+  MIDI_STATUS_NOT_SET = 0x00,
+  MIDI_NOTE_OFF = 0x80,
+  MIDI_NOTE_ON = 0x90,
+  MIDI_KEY_PRESSURE = 0xA0,
+  MIDI_CONTROLLER_CHANGE = 0xB0,
+  MIDI_PROGRAM_CHANGE = 0xC0,
+  MIDI_CHANNEL_PRESSURE = 0xD0,
+  MIDI_PITCH_BEND = 0xE0,
+  MIDI_SYSEX_START = 0xF0,
+  MIDI_TIME_CODE = 0xF1,
+  MIDI_SONG_POSITION = 0xF2,
+  MIDI_SONG_SELECT = 0xF3,
+  MIDI_TUNE_REQUEST = 0xF6,
+  MIDI_SYSEX_END = 0xF7,
+  MIDI_REALTIME = 0xF8     // 0xF8 and up: clock, start, stop etc
+};
+
+
+/** midi_message_f
+ *
+ * called for each complete message.  channel is 0-15 for channel
+ * messages and ZMIDI_PARAM, -1 for system messages.  Channel messages
+ * always have their status byte, whether or not it was sent (running
+ * status).  Sysex includes the 0xF0 and 0xF7.  Realtime bytes aren't
+ * passed on.
+ */
+typedef void (*midi_message_f)(void *arg, int channel, const uint8_t *message, size_t size);
+
+
+// controller and parameter number state for one channel
+struct midi_parser_channel {
+  uint8_t cc_msb[32];      // last MSB for controllers 0-31, for 14 bit pairs
+  uint8_t param_kind;      // ZMIDI_PARAM_NRPN or _RPN when one is selected, else 0xFF
+  uint8_t nrpn[2];         // MSB, LSB
+  uint8_t rpn[2];
+  uint16_t data_entry;     // value of the selected parameter
+};
+
+
+/* streaming MIDI 1.0 parser.  Fed whatever read() returns; keeps state
+ * across calls so messages may be split anywhere.
+ */
+struct midi_parser {
+  midi_message_f handler;
+  void *handler_arg;
+
+  uint8_t running_status;  // current channel or system common status, 0 for none
+  uint8_t data[2];
+  int data_count;
+  int data_needed;
+
+  int in_sysex;
+  int sysex_overflow;
+  size_t sysex_size;
+  uint8_t sysex[MIDI_SYSEX_MAX_BYTES];
+
+  struct midi_parser_channel channels[MIDI_CHANNELS];
+
+  // stats
+  uint64_t messages;
+  uint64_t realtime_bytes;
+  uint64_t stray_data_bytes;   // data with no status to go with it
+  uint64_t sysex_overflows;    // longer than MIDI_SYSEX_MAX_BYTES, dropped
+  uint64_t sysex_aborted;      // cut off by a status byte
+};
+
+
+void midi_parser_init(struct midi_parser *parser, midi_message_f handler, void *handler_arg);
+
+
+/** midi_parse
+ *
+ * run bytes through the parser, calling the handler for each message
+ * completed.
+ */
+void midi_parse(struct midi_parser *parser, const uint8_t *buffer, size_t size);
+
+
+#endif
@@ -0,0 +1,67 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIDI_QUEUE_H
+#define MIDI_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// power of two
+#define MIDI_QUEUE_SIZE 256
+#define MIDI_QUEUE_MESSAGE_MAX_BYTES 6
+
+
+struct midi_queue_entry {
+  int card_num;            // index into card_manager cards
+  uint8_t size;
+  uint8_t message[MIDI_QUEUE_MESSAGE_MAX_BYTES];
+};
+
+
+/* card MIDI from the event loop to the PCM thread.  Single producer,
+ * single consumer, lock free.  The PCM thread drains it between
+ * frames so a card's MIDI and samples never interleave mid-frame.
+ */
+struct midi_queue {
+  _Atomic uint32_t head;   // written by the producer
+  _Atomic uint32_t tail;   // written by the consumer
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t max_depth;
+  struct midi_queue_entry entries[MIDI_QUEUE_SIZE];
+};
+
+
+void midi_queue_init(struct midi_queue *queue);
+
+
+/** midi_queue_push
+ *
+ * producer side.  Returns 0, or -1 if the queue is full or the message
+ * too long; the message is dropped and counted.
+ */
+int midi_queue_push(struct midi_queue *queue, int card_num, const uint8_t *message, size_t size);
+
+
+/** midi_queue_pop
+ *
+ * consumer side.  Copies the oldest entry out; returns 0, or -1 when
+ * empty.
+ */
+int midi_queue_pop(struct midi_queue *queue, struct midi_queue_entry *entry);
+
+
+#endif
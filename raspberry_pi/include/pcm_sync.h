@@ -0,0 +1,123 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PCM_SYNC_H
+#define PCM_SYNC_H
+
+#include <libconfig.h>
+#include <stdint.h>
+
+#include "zalsa.h"
+
+// config lookup keys
+#define ZALSA_LINK_DEVICES_KEY "zalsa.link_devices"
+#define ZALSA_CLOCK_RECOVERY_KEY "zalsa.clock_recovery"
+
+#define PCM_SYNC_MAX_DEVICES 2
+// the sample clock is never pulled further than this from nominal
+#define PCM_SYNC_MAX_CORRECTION_PPM 1000.0
+// per period weight of a new fill measurement
+#define PCM_SYNC_FILL_SMOOTHING 0.05
+// controller gains: ppm per frame of fill error, and per frame per period
+#define PCM_SYNC_KP 20.0
+#define PCM_SYNC_KI 0.2
+// USB delivers a packet of frames at a time, never slip on less
+#define PCM_SYNC_MIN_SLIP_THRESHOLD 4
+
+
+struct pcm_sync_device {
+  uint64_t last_period;     // alsa_pcm_state periods_begun last seen
+  double fill_avg;          // frames captured but not yet consumed, smoothed
+  int measured;             // boolean: fill_avg has a sample
+  int pending_slip;         // +1 skip a frame, -1 repeat one, on the next advance
+  int64_t slips;            // net frames skipped (+) or repeated (-) since start
+  uint64_t frames;          // frames consumed since start, for drift
+};
+
+
+/* shared clock recovery for the pcm devices.  The sample clock timerfd
+ * is steered (a PI loop on device 0's buffer fill) so it consumes frames
+ * at the rate device 0 captures them.  Other devices run on their own
+ * clocks: their fill is compared to device 0's and a frame is skipped or
+ * repeated when they drift apart by more than the slip threshold, which
+ * keeps cards on every device frame aligned.
+ */
+struct pcm_sync {
+  int clock_recovery;       // boolean
+  int link;                 // boolean: try snd_pcm_link
+  int num_devices;
+
+  long nominal_interval_ns;
+  long interval_ns;
+  double correction_ppm;
+  double integral_ppm;
+  double target_fill;
+  double slip_threshold;
+
+  struct pcm_sync_device devices[PCM_SYNC_MAX_DEVICES];
+};
+
+
+/** init_pcm_sync
+ *
+ * set up for the initialized pcm devices (pcm_state[1] may be NULL).
+ * Devices must share a sampling rate.  Returns NULL if they don't.
+ */
+struct pcm_sync* init_pcm_sync(config_t *cfg, struct alsa_pcm_state *pcm_state[]);
+
+void free_pcm_sync(struct pcm_sync *sync);
+
+
+/** pcm_sync_link
+ *
+ * link the devices if configured and possible.  Call again whenever
+ * the devices are reopened.
+ */
+void pcm_sync_link(struct pcm_sync *sync, struct alsa_pcm_state *pcm_state[]);
+
+
+/** pcm_sync_reset
+ *
+ * forget the measurements, eg after the streams are restarted.  Keeps
+ * the clock correction, that's a property of the hardware.
+ */
+void pcm_sync_reset(struct pcm_sync *sync, struct alsa_pcm_state *pcm_state[]);
+
+
+/** pcm_sync_update
+ *
+ * call from the PCM thread after the streams are advanced by frames.
+ * Returns non-zero when sync->interval_ns changed and the sample clock
+ * should be reprogrammed.
+ */
+int pcm_sync_update(struct pcm_sync *sync, struct alsa_pcm_state *pcm_state[], int frames);
+
+
+/** pcm_sync_take_slip
+ *
+ * frames to add to the next advance of device dev: -1, 0 or 1.
+ */
+int pcm_sync_take_slip(struct pcm_sync *sync, int dev);
+
+
+/** pcm_sync_drift_ppm
+ *
+ * drift of device dev against the sample clock's nominal rate: the
+ * clock correction for device 0, that plus slips for the others.
+ */
+double pcm_sync_drift_ppm(const struct pcm_sync *sync, int dev);
+
+
+#endif
@@ -0,0 +1,112 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PERIOD_TUNER_H
+#define PERIOD_TUNER_H
+
+#include <alsa/asoundlib.h>
+#include <libconfig.h>
+#include <stdint.h>
+
+// config lookup keys
+#define ZALSA_AUTO_TUNE_KEY "zalsa.auto_tune"
+#define ZALSA_AUTO_TUNE_MIN_PERIOD_KEY "zalsa.auto_tune_min_period"
+#define ZALSA_AUTO_TUNE_WINDOW_SEC_KEY "zalsa.auto_tune_window_sec"
+#define ZALSA_AUTO_TUNE_MISS_THRESHOLD_KEY "zalsa.auto_tune_miss_threshold"
+
+#define PERIOD_TUNER_DEFAULT_MIN_PERIOD 8
+#define PERIOD_TUNER_DEFAULT_WINDOW_SEC 30
+#define PERIOD_TUNER_DEFAULT_MISS_THRESHOLD 16
+#define PERIOD_TUNER_MAX_HOLDOFF_WINDOWS 64
+// back off mid-window rather than wait it out once this many xruns seen
+#define PERIOD_TUNER_IMMEDIATE_BACKOFF_XRUNS 3
+
+
+/* searches for the smallest period that stays glitch free.  Starts at
+ * the configured (conservative) period, halving it after each clean
+ * window.  A window with xruns or too many missed timer deadlines
+ * doubles it again, and the failed size isn't retried until a holdoff
+ * of clean windows passes; the holdoff doubles with repeat failures.
+ * The buffer stays the same number of periods as configured.
+ */
+struct period_tuner {
+  int enabled;
+  unsigned int sampling_rate;
+
+  snd_pcm_sframes_t min_period;
+  snd_pcm_sframes_t max_period;
+  snd_pcm_sframes_t period;
+  int buffer_periods;
+
+  // current window
+  uint64_t window_frames;
+  uint64_t frames_in_window;
+  uint64_t window_misses;
+  int window_xrun_base;
+  int miss_threshold;
+
+  // search state
+  int probing;                // boolean: current period not yet proven
+  int holdoff_windows;
+  int holdoff_remaining;
+
+  // stats
+  int retune_count;
+  int backoff_count;
+};
+
+
+/** init_period_tuner
+ *
+ * start from the period and buffer size the devices were initialized
+ * with.  Always returns a tuner; when not enabled in config it never
+ * requests a change.
+ */
+struct period_tuner* init_period_tuner(config_t *cfg, unsigned int sampling_rate,
+                                       snd_pcm_sframes_t period_size, snd_pcm_uframes_t buffer_size);
+
+void free_period_tuner(struct period_tuner *tuner);
+
+
+/** period_tuner_update
+ *
+ * call from the PCM thread once per timer wakeup with the number of
+ * timer expirations and the running xrun count across devices.
+ * Returns non-zero when tuner->period changed and the devices should
+ * be re-initialized with period_tuner_buffer_size().
+ */
+int period_tuner_update(struct period_tuner *tuner, uint64_t expirations, int xrun_count);
+
+
+/** period_tuner_window_reset
+ *
+ * start a fresh measurement window, eg after devices are restarted.
+ */
+void period_tuner_window_reset(struct period_tuner *tuner, int xrun_count);
+
+
+/** period_tuner_reject
+ *
+ * the device refused tuner->period: go back to previous_period, the
+ * size the devices were running at, and don't search past it toward
+ * the refused size again.
+ */
+void period_tuner_reject(struct period_tuner *tuner, snd_pcm_sframes_t previous_period);
+
+
+snd_pcm_uframes_t period_tuner_buffer_size(const struct period_tuner *tuner);
+
+
+#endif
@@ -0,0 +1,106 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RT_PROFILE_H
+#define RT_PROFILE_H
+
+#include <libconfig.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// config lookup keys
+#define RT_PROFILE_MLOCK_KEY "rt_profile.mlock"
+#define RT_PROFILE_PREFAULT_STACK_KB_KEY "rt_profile.prefault_stack_kb"
+#define RT_PROFILE_THREADS_KEY "rt_profile.threads"
+
+#define RT_PROFILE_DEFAULT_PREFAULT_STACK_KB 64
+#define RT_PROFILE_MAX_CPUS 64
+
+// policy value meaning "leave whatever was inherited alone"
+#define RT_POLICY_INHERIT -1
+
+
+enum rt_thread_role {
+  RT_THREAD_PCM,
+  RT_THREAD_MIDI,     // the main thread's event loop, incl. card I2C writes
+  RT_THREAD_LOGGER,
+  RT_THREAD_NUM_ROLES
+};
+
+
+struct rt_thread_profile {
+  int policy;         // SCHED_FIFO, SCHED_RR, SCHED_OTHER or RT_POLICY_INHERIT
+  int priority;
+  uint64_t cpus;      // affinity bitmask, zero when not pinned
+};
+
+
+struct rt_profile {
+  // libconfig handle
+  config_t *cfg;
+
+  int mlock;          // boolean
+  int prefault_stack_kb;
+  struct rt_thread_profile threads[RT_THREAD_NUM_ROLES];
+};
+
+
+/** init_rt_profile
+ *
+ * read the rt_profile section of the config.  Anything not configured
+ * is left as inherited from the process (eg chrt), so an empty section
+ * keeps the old behavior.  Returns NULL on allocation failure only.
+ */
+struct rt_profile* init_rt_profile(config_t *cfg);
+
+void free_rt_profile(struct rt_profile *rt_profile);
+
+
+/** rt_profile_lock_memory
+ *
+ * mlockall and keep malloc from giving memory back to the OS, if
+ * configured.  Must run as root or with a sufficient RLIMIT_MEMLOCK.
+ * Return zero for success (or not configured), non-zero on failure.
+ */
+int rt_profile_lock_memory(struct rt_profile *rt_profile);
+
+
+/** rt_profile_apply
+ *
+ * set scheduling policy/priority and CPU affinity on a thread for the
+ * given role.  Return zero for success, non-zero on failure.
+ */
+int rt_profile_apply(struct rt_profile *rt_profile, pthread_t thread, enum rt_thread_role role);
+
+
+/** rt_profile_enter
+ *
+ * called by a thread on itself as it starts: rt_profile_apply plus
+ * prefaulting the configured amount of stack.
+ */
+int rt_profile_enter(struct rt_profile *rt_profile, enum rt_thread_role role);
+
+
+/** rt_profile_self_check
+ *
+ * report whether the system is set up for the profile: permissions
+ * and limits, isolcpus for the PCM thread's CPUs, cpufreq governor and
+ * RT throttling.  Only reads /proc and /sys so it runs on any Linux
+ * box.  Returns the number of problems found.
+ */
+int rt_profile_self_check(struct rt_profile *rt_profile);
+
+
+#endif
@@ -0,0 +1,71 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TDM_H
+#define TDM_H
+
+#include <stdint.h>
+
+// slow channel time-division multiplexing.  A device carrying slow
+// channels reserves its top channel for the rotation phase (phase *
+// TDM_PHASE_SCALE) and the channels below it as TDM lanes; lane n
+// carries slow channel index n * TDM_SLOTS_PER_CHANNEL + phase.
+#define TDM_SLOTS_PER_CHANNEL 8
+#define TDM_PHASE_SCALE 2048
+#define TDM_NO_SYNC_CHANNEL -1
+
+
+/** tdm_num_lanes
+ *
+ * lanes needed for num_slow slow channels, not counting the sync channel.
+ */
+static inline int tdm_num_lanes(int num_slow) {
+  return (num_slow + TDM_SLOTS_PER_CHANNEL - 1) / TDM_SLOTS_PER_CHANNEL;
+}
+
+
+/** tdm_phase
+ *
+ * the rotation phase a sync channel sample carries.  Rounds, so a
+ * client's float to int16 conversion being off an LSB doesn't matter.
+ */
+static inline int tdm_phase(int16_t sync) {
+  return (sync + TDM_PHASE_SCALE / 2) / TDM_PHASE_SCALE;
+}
+
+
+/** tdm_lane_channel
+ *
+ * device channel of the lane carrying slow index slow_index.
+ */
+static inline int tdm_lane_channel(int sync_channel, int slow_index) {
+  return sync_channel - 1 - slow_index / TDM_SLOTS_PER_CHANNEL;
+}
+
+
+/** tdm_demux
+ *
+ * assemble a card's num_channels samples from one device frame.  Card
+ * channels with their bit set in slow_channel_mask are slow: they take
+ * device slow indexes tdm_base onward and are only written when the
+ * frame's phase is theirs, otherwise samples keeps the held value.  The
+ * rest are fast and copied from channel_offset up.
+ */
+void tdm_demux(const char **device_samples, int sync_channel,
+               uint32_t slow_channel_mask, int num_channels,
+               int channel_offset, int tdm_base, int16_t *samples);
+
+
+#endif
@@ -14,6 +14,8 @@
  */
 
 #include <libconfig.h>
+#include <stdint.h>
+#include <time.h>
 
 #ifndef ZALSA_H
 #define ZALSA_H
@@ -27,6 +29,17 @@
 #define ZALSA_DEFAULT_BUFFER_SIZE 64
 #define ABSOLUTE_MAX_CHANNELS 32  // we'll never have greater than this number of channels
 
+// why a stream needed recovery; indexes xrun_cause_count
+enum zalsa_xrun_cause {
+  XRUN_CAUSE_OVERRUN,          // capture buffer overran (EPIPE / XRUN state)
+  XRUN_CAUSE_SUSPEND,          // ESTRPIPE / SUSPENDED
+  XRUN_CAUSE_DISCONNECT,       // device went away
+  XRUN_CAUSE_COMMIT_MISMATCH,  // mmap_commit committed fewer frames than mapped
+  XRUN_NUM_CAUSES
+};
+
+extern const char *zalsa_xrun_cause_names[XRUN_NUM_CAUSES];
+
 struct alsa_pcm_state {
   // libconfig handle
   config_t *cfg;
@@ -54,8 +67,23 @@ struct alsa_pcm_state {
   const snd_pcm_channel_area_t *mmap_area;
   const char **samples; // pointer per-channel to sample data: allocated during 
 
+  // capture fill, for clock recovery: frames avail as each period is mapped
+  snd_pcm_sframes_t period_avail;
+  uint64_t periods_begun;
+  int linked;                     // boolean: start/stop/prepare shared with device 0
+
+  // xrun recovery: set when the stream is restarting, cleared by
+  // alsa_recover_stream (or alsa_start_stream) once a period is mapped
+  int recovering;
+  struct timespec recovery_start;
+
   // stats
   int xrun_recovery_count;
+  int xrun_cause_count[XRUN_NUM_CAUSES];
+  int recoveries_completed;
+  int64_t last_recovery_ns;
+  int64_t max_recovery_ns;
+  int64_t total_recovery_ns;
   int skiped_samples;
 };
 
@@ -69,6 +97,17 @@ struct alsa_pcm_state {
 struct alsa_pcm_state* init_alsa_device(config_t *cfg, int device_num);
 
 
+/** alsa_reinit_device
+ *
+ * close and reopen an initialized device with a new period and buffer
+ * size.  The stream needs starting again (alsa_start_stream) after.
+ * Blocks in ALSA, so not for the PCM thread; logs through rt_log.
+ * Return zero for success, non-zero on failure.
+ */
+int alsa_reinit_device(struct alsa_pcm_state *pcm_state,
+                       snd_pcm_sframes_t period_size, snd_pcm_uframes_t buffer_size);
+
+
 /** alsa_start_stream
  *
  * Wrap calls to snd_pcm_state, snd_pcm_avail_update, snd_pcm_mmap_begin.
@@ -82,11 +121,33 @@ int alsa_start_stream(struct alsa_pcm_state *pcm_state);
  * If the request is greater than current period the next
  * period is requested.  There's likely a bug in there.
  * This wraps calls to snd_pcm_mmap_commit, snd_pcm_state, snd_pcm_avail_update, snd_pcm_mmap_begin.
- * Return zero for success, non-zero on failure.
+ * Return zero for success, -EPIPE if the stream hit an xrun and is
+ * restarting (samples aren't valid until alsa_recover_stream
+ * succeeds), other non-zero on failure.
  */
 int alsa_advance_stream_by_frames(struct alsa_pcm_state *pcm_state, int frames);
 
 
+/** alsa_link_devices
+ *
+ * snd_pcm_link the second device to the first so they start, stop and
+ * xrun together.  Not every pair of devices can be linked; returns
+ * non-zero (and leaves them unlinked) if not.
+ */
+int alsa_link_devices(struct alsa_pcm_state *pcm_state0, struct alsa_pcm_state *pcm_state1);
+
+
+/** alsa_recover_stream
+ *
+ * non-blocking step toward restarting a stream after an xrun: resume
+ * or prepare, start, and once a full period is captured map it.  Call
+ * once per frame while pcm_state->recovering.  Return zero when the
+ * stream is back with valid samples, -EAGAIN when not yet, other
+ * negative on unrecoverable failure.
+ */
+int alsa_recover_stream(struct alsa_pcm_state *pcm_state);
+
+
 
 /** alsa_pcm_ensure_ready
  * check the state to make sure the pcm_handle is good then call snd_pcm_avail_update to make sure
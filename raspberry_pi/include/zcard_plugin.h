@@ -18,6 +18,7 @@
 
 #include <alsa/asoundlib.h>
 #include <pigpio.h>
+#include <pthread.h>
 #include <zlog.h>
 #include "zoxnoxiousd.h"
 
@@ -32,6 +33,39 @@
 #define FATAL(...) zlog_fatal(zlog_c, __VA_ARGS__)
 extern zlog_category_t *zlog_c;
 
+/* RT-safe logging: use these from process_samples and anything else
+ * running on the PCM or MIDI threads.  The format and arguments are
+ * queued to a lock-free ring and written out by a low priority logger
+ * thread.  Never blocks: when the ring is full the message is dropped
+ * and counted.  The format must be a string literal; %s arguments are
+ * copied (64 bytes total per message), '*' width/precision isn't
+ * supported.
+ */
+#define RT_DEBUG(...) rt_log(ZLOG_LEVEL_DEBUG, __FILE__, __func__, __LINE__, __VA_ARGS__)
+#define RT_INFO(...)  rt_log(ZLOG_LEVEL_INFO, __FILE__, __func__, __LINE__, __VA_ARGS__)
+#define RT_WARN(...)  rt_log(ZLOG_LEVEL_WARN, __FILE__, __func__, __LINE__, __VA_ARGS__)
+#define RT_ERROR(...) rt_log(ZLOG_LEVEL_ERROR, __FILE__, __func__, __LINE__, __VA_ARGS__)
+
+void rt_log(int level, const char *file, const char *func, long line, const char *format, ...)
+  __attribute__((format(printf, 5, 6)));
+
+/* rt_log_start / rt_log_stop
+ *
+ * daemon starts the logger thread before the RT threads and stops it
+ * after they're joined.  Until started (and after stopped) the RT_*
+ * macros log synchronously.
+ */
+int rt_log_start();
+void rt_log_stop();
+uint64_t rt_log_dropped_count();
+
+/* rt_log_get_thread
+ *
+ * logger thread handle, eg for setting its scheduling.  Returns zero
+ * and sets thread if the logger is running.
+ */
+int rt_log_get_thread(pthread_t *thread);
+
 
 
 /* this is intended to be the interface for cards.  Library functions
@@ -54,6 +88,23 @@ struct zhost* zhost_create();
  */
 int set_spi_interface(struct zhost *zhost, unsigned int spi_channel, unsigned int spi_mode, int slot);
 
+/* zhost_get_sample_rate
+ * rate process_samples is called at, frames per second.  Zero until
+ * the daemon has set it (before any init_zcard).
+ */
+unsigned int zhost_get_sample_rate(const struct zhost *zhost);
+void zhost_set_sample_rate(struct zhost *zhost, unsigned int sample_rate);
+
+/* zhost_get_card_rom
+ * the start of the slot's I2C EEPROM (id byte first), as read at
+ * discovery, so cards needn't read it again.  Up to ZCARD_ROM_BYTES;
+ * NULL with size zero if discovery didn't get it.  The daemon sets it
+ * before any init_zcard.
+ */
+#define ZCARD_ROM_BYTES 32
+const uint8_t* zhost_get_card_rom(const struct zhost *zhost, int slot, unsigned int *size);
+void zhost_set_card_rom(struct zhost *zhost, int slot, const uint8_t *rom, unsigned int size);
+
 
 /** init the plugin.
  * Input: slot number for the card (0-7).
@@ -70,6 +121,25 @@ typedef void* (*init_zcard_f)(struct zhost *zhost, int slot);
  */
 typedef void (*free_zcard_f)(void *zcard_plugin);
 
+/** checkpoint_zcard / resume_zcard
+ *
+ * optional, both or neither: warm restart of the daemon.  The
+ * expanders and DACs hold their outputs while the daemon restarts, so
+ * the new daemon can pick up where the old one left off rather than
+ * init_zcard resetting everything.
+ * checkpoint_zcard is called on the PCM thread between frames, and
+ * again after it has stopped: copy what the card needs to carry on
+ * (expander shadows, last DAC words, calibration) into buffer, without
+ * allocating or blocking.  Return the bytes used, zero if it doesn't
+ * fit.
+ * resume_zcard is init_zcard from such a checkpoint: set up the plugin
+ * object and its handles without writing the expanders or DACs.
+ * Return NULL if the checkpoint isn't usable, init_zcard is called
+ * instead.
+ */
+typedef size_t (*checkpoint_zcard_f)(void *zcard_plugin, void *buffer, size_t size);
+typedef void* (*resume_zcard_f)(struct zhost *zhost, int slot, const void *checkpoint, size_t size);
+
 
 /** get_plugin_name
  *
@@ -83,6 +153,7 @@ typedef char* (*get_plugin_name_f)();
 struct zcard_properties {
   int num_channels;  // number of channles the card/plugin requires.
   int spi_mode;  // spi mode used. if >1 mode, plugin should set most latency sensitive mode.
+  uint32_t slow_channel_mask;  // bit n set: channel n is slow (levels, switches) and may be time multiplexed
 };
 
 /** get_zcard_properties
@@ -92,6 +163,10 @@ struct zcard_properties {
  * num_channels is used for allocating where the card goes in channel mapping.
  * spi_mode is used to optimize calling plugins that have the same spi_mode in sequence.
  * 0,1,2,3 are valid spi modes.
+ * slow_channel_mask marks channels that don't need the full sample
+ * rate.  These may share a USB audio channel with other slow channels,
+ * each updated every TDM_SLOTS_PER_CHANNEL frames.  process_samples
+ * still sees all num_channels, slow ones holding their last value.
  */
 typedef struct zcard_properties* (*get_zcard_properties_f)();
 
@@ -114,9 +189,23 @@ typedef int (*process_samples_f)(void *zcard_plugin, const int16_t *samples);
  *
  * process a midi message for the card.  Message is filtered to be for this plugin.
  * This interface is for non-program change messages.
+ * Called from the PCM thread between frames, before process_samples:
+ * whatever arrived since the last frame takes effect on this one.
+ * Messages are complete with their status byte.  Besides the channel
+ * messages, 14 bit controller pairs and NRPN/RPN data entry also come
+ * assembled as a ZMIDI_PARAM message:
+ *   ZMIDI_PARAM, kind, number MSB, number LSB, value MSB, value LSB
+ * with 7 bits in each byte.  For ZMIDI_PARAM_CC14 the number is the MSB
+ * controller (0-31) and it's sent once the LSB controller arrives.
  */
 typedef int (*process_midi_f)(void *zcard_plugin, uint8_t *midi_message, size_t size);
 
+#define ZMIDI_PARAM 0xF4  // undefined system common status in MIDI 1.0
+#define ZMIDI_PARAM_SIZE 6
+#define ZMIDI_PARAM_CC14 0
+#define ZMIDI_PARAM_NRPN 1
+#define ZMIDI_PARAM_RPN 2
+
 
 /** process_midi_program_change
  *
@@ -125,6 +214,39 @@ typedef int (*process_midi_f)(void *zcard_plugin, uint8_t *midi_message, size_t
 typedef int (*process_midi_program_change_f)(void *zcard_plugin, uint8_t program_number);
 
 
+/** process_midi_program_changes
+ *
+ * optional.  The card's whole switch state at once, from a Card State
+ * sysex: apply the programs in order.  Update any I/O expander bits in
+ * memory and write each expander once.  A card without it gets
+ * process_midi_program_change for each program.
+ */
+typedef int (*process_midi_program_changes_f)(void *zcard_plugin, const uint8_t *program_numbers, size_t count);
+
+
+/* PCA9555 I/O expander helpers for cards that map program numbers to
+ * output bits: OR in set_bits then AND clear_bits on the port shadow,
+ * and write it to gpio_reg.
+ */
+struct midi_program_to_gpio {
+  int port;
+  uint8_t gpio_reg; // gpio register zero or one?
+  uint8_t set_bits;  // mask to OR
+  uint8_t clear_bits; // mask to AND
+};
+
+/** pca9555_apply_programs
+ *
+ * apply count programs from the table to the two port shadows, then
+ * write the expander once: both output ports in one transaction when
+ * both changed.  Unknown programs are skipped with a warning.
+ * Returns non-zero on I2C error.
+ */
+int pca9555_apply_programs(int i2c_handle, uint8_t pca9555_port[2],
+                           const struct midi_program_to_gpio *table, size_t table_size,
+                           const uint8_t *program_numbers, size_t count);
+
+
 /** Tuning
 
  * tuning is done in parallel across all cards.
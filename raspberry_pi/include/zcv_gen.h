@@ -0,0 +1,154 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZCV_GEN_H
+#define ZCV_GEN_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "zcard_plugin.h"
+
+/* CV generators run on the Pi: LFOs, envelopes and glides computed per
+ * frame in process_samples, set up over MIDI rather than streamed as
+ * samples.  A card creates a bank in init_zcard, hands its MIDI to
+ * zcv_gen_process_midi and runs its samples through zcv_gen_process
+ * before writing the DACs.  See midi.spec for the NRPN parameters.
+ *
+ * LFOs and envelopes add to the channel's incoming sample; a glide
+ * replaces it.  Output clips to 0..32767, what the DACs take.
+ */
+
+#define ZCV_GEN_MAX_GENERATORS 4
+#define ZCV_GEN_MAX_CHANNELS 32
+#define ZCV_GEN_NO_CHANNEL 0x3FFF
+
+enum zcv_gen_type {
+  ZCV_GEN_OFF = 0,
+  ZCV_GEN_LFO = 1,
+  ZCV_GEN_ENV_AD = 2,
+  ZCV_GEN_ENV_ADSR = 3,
+  ZCV_GEN_GLIDE = 4
+};
+
+enum zcv_gen_shape {
+  ZCV_GEN_SINE = 0,
+  ZCV_GEN_TRIANGLE = 1,
+  ZCV_GEN_SAW = 2,
+  ZCV_GEN_SQUARE = 3
+};
+
+// NRPN LSB; the NRPN MSB is the generator number.  Values are 14 bit.
+enum zcv_gen_param {
+  ZCV_GEN_PARAM_TYPE = 0,
+  ZCV_GEN_PARAM_CHANNEL = 1,     // card channel, ZCV_GEN_NO_CHANNEL for none
+  ZCV_GEN_PARAM_SHAPE = 2,
+  ZCV_GEN_PARAM_RATE = 3,        // LFO rate in 0.01 Hz
+  ZCV_GEN_PARAM_DEPTH = 4,       // LFO/envelope amount, 16383 is full scale
+  ZCV_GEN_PARAM_ATTACK = 5,      // ms
+  ZCV_GEN_PARAM_DECAY = 6,       // ms
+  ZCV_GEN_PARAM_SUSTAIN = 7,     // 16383 is full scale
+  ZCV_GEN_PARAM_RELEASE = 8,     // ms
+  ZCV_GEN_PARAM_GLIDE_TIME = 9,  // ms to slew full scale
+  ZCV_GEN_PARAM_TARGET = 10,     // glide target, 16383 is full scale
+  ZCV_GEN_NUM_PARAMS
+};
+
+enum zcv_env_stage {
+  ZCV_ENV_IDLE,
+  ZCV_ENV_ATTACK,
+  ZCV_ENV_DECAY,
+  ZCV_ENV_SUSTAIN,
+  ZCV_ENV_RELEASE
+};
+
+
+/* parameters and gates are written from process_midi and picked up
+ * in process_samples.  Those are the same thread now, but params stay
+ * atomics with a dirty flag and triggers a counter, so a card calling
+ * from elsewhere is still safe and a note on/off pair between frames
+ * isn't lost.
+ */
+struct zcv_generator {
+  _Atomic uint16_t params[ZCV_GEN_NUM_PARAMS];
+  _Atomic int dirty;
+  _Atomic int gate;
+  _Atomic uint32_t triggers;
+
+  // PCM thread only below here
+  int type;
+  int channel;
+  int shape;
+  int32_t depth;
+  uint32_t triggers_seen;
+
+  uint32_t phase;
+  uint32_t phase_inc;
+
+  int stage;
+  int32_t level;
+  int32_t sustain_level;
+  int32_t attack_inc;
+  int32_t decay_inc;
+  int32_t release_inc;
+
+  int32_t glide_value;
+  int32_t glide_target;
+  int32_t glide_inc;
+  int glide_started;
+};
+
+
+struct zcv_gen_bank {
+  struct zhost *zhost;
+  int num_channels;
+  unsigned int sample_rate;
+
+  int active;  // PCM thread: any generator with a type and channel
+  struct zcv_generator generators[ZCV_GEN_MAX_GENERATORS];
+  int16_t samples[ZCV_GEN_MAX_CHANNELS];
+};
+
+
+/** zcv_gen_create
+ *
+ * bank for a card with num_channels channels.  All generators start
+ * off.  Returns NULL on allocation failure.
+ */
+struct zcv_gen_bank* zcv_gen_create(struct zhost *zhost, int num_channels);
+
+void zcv_gen_free(struct zcv_gen_bank *bank);
+
+
+/** zcv_gen_process_midi
+ *
+ * call from process_midi.  Handles NRPN parameters (ZMIDI_PARAM), note
+ * on/off as the envelope gate and all notes off.
+ * Returns 0, also for messages it has no use for.
+ */
+int zcv_gen_process_midi(struct zcv_gen_bank *bank, const uint8_t *midi_message, size_t size);
+
+
+/** zcv_gen_process
+ *
+ * call from process_samples once per frame.  Steps every generator one
+ * frame and returns the samples to write: the input itself when no
+ * generator is active, otherwise the bank's copy with generators applied.
+ */
+const int16_t* zcv_gen_process(struct zcv_gen_bank *bank, const int16_t *samples);
+
+
+#endif
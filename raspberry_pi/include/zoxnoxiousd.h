@@ -25,5 +25,6 @@
 #define CONFIG_FILENAME "zoxnoxiousd.cfg"
 
 #define MIDI_DEVICE_KEY "zmidi.device"
+#define ZOXNOXIOUSD_STATS_INTERVAL_KEY "zoxnoxiousd.stats_interval_sec"
 
 #endif
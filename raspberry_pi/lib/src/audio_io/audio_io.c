@@ -14,6 +14,7 @@
  */
 
 #include "zcard_plugin.h"
+#include "zcv_gen.h"
 
 
 // GPIO: PCA9555
@@ -31,6 +32,7 @@ struct audio_out_card {
   int i2c_handle;
   uint8_t pca9555_port[2];
   int16_t previous_samples[2];
+  struct zcv_gen_bank *cv_gen;
 };
 
 static const uint8_t port0_addr = 0x02;
@@ -77,11 +79,77 @@ void* init_zcard(struct zhost *zhost, int slot) {
     return NULL;
   }
 
+  audio_out->cv_gen = zcv_gen_create(zhost, 2);
+
   return audio_out;
 }
 
 
 void free_zcard(void *zcard_plugin) {
+  struct audio_out_card *audio_out = (struct audio_out_card*)zcard_plugin;
+
+  if (zcard_plugin) {
+    zcv_gen_free(audio_out->cv_gen);
+  }
+}
+
+
+
+/* warm restart: the expander shadows and last DAC words, see
+ * checkpoint_zcard_f.  size stands in for a version.
+ */
+struct audio_out_checkpoint {
+  uint32_t size;
+  uint8_t pca9555_port[2];
+  int16_t previous_samples[2];
+};
+
+
+size_t checkpoint_zcard(void *zcard_plugin, void *buffer, size_t size) {
+  struct audio_out_card *audio_out = (struct audio_out_card*)zcard_plugin;
+  struct audio_out_checkpoint *checkpoint = (struct audio_out_checkpoint*)buffer;
+
+  if (size < sizeof(struct audio_out_checkpoint)) {
+    return 0;
+  }
+
+  checkpoint->size = sizeof(struct audio_out_checkpoint);
+  memcpy(checkpoint->pca9555_port, audio_out->pca9555_port, sizeof(checkpoint->pca9555_port));
+  memcpy(checkpoint->previous_samples, audio_out->previous_samples, sizeof(checkpoint->previous_samples));
+  return sizeof(struct audio_out_checkpoint);
+}
+
+
+void* resume_zcard(struct zhost *zhost, int slot, const void *checkpoint_data, size_t size) {
+  const struct audio_out_checkpoint *checkpoint = (const struct audio_out_checkpoint*)checkpoint_data;
+  int i2c_addr = slot + PCA9555_BASE_I2C_ADDRESS;
+
+  assert(slot >= 0 && slot < 8);
+  if (size != sizeof(struct audio_out_checkpoint) || checkpoint->size != size) {
+    return NULL;
+  }
+
+  struct audio_out_card *audio_out = (struct audio_out_card*)calloc(1, sizeof(struct audio_out_card));
+  if (audio_out == NULL) {
+    return NULL;
+  }
+
+  audio_out->zhost = zhost;
+  audio_out->slot = slot;
+
+  // expander is already configured and driving these: no writes
+  audio_out->i2c_handle = i2cOpen(I2C_BUS, i2c_addr, 0);
+  if (audio_out->i2c_handle < 0) {
+    ERROR("audio_io: unable to open i2c for address %d\n", i2c_addr);
+    free(audio_out);
+    return NULL;
+  }
+  memcpy(audio_out->pca9555_port, checkpoint->pca9555_port, sizeof(audio_out->pca9555_port));
+  memcpy(audio_out->previous_samples, checkpoint->previous_samples, sizeof(audio_out->previous_samples));
+
+  audio_out->cv_gen = zcv_gen_create(zhost, 2);
+
+  return audio_out;
 }
 
 
@@ -93,6 +161,7 @@ struct zcard_properties* get_zcard_properties() {
   struct zcard_properties *props = (struct zcard_properties*) malloc(sizeof(struct zcard_properties));
   props->num_channels = 2;
   props->spi_mode = SPI_MODE;
+  props->slow_channel_mask = 0;
   return props;
 }
 
@@ -102,6 +171,7 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
   char samples_to_dac[2];
   int spi_channel;
 
+  samples = zcv_gen_process(zcard->cv_gen, samples);
   spi_channel = set_spi_interface(zcard->zhost, SPI_CHANNEL, SPI_MODE, zcard->slot);
 
   for (int i = 0; i < 2; ++i) {
@@ -118,10 +188,10 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
       }
       spiWrite(spi_channel, samples_to_dac, 2);
       /*
-      WARN("audio out: channel %d 0x%4X : 0x%2X 0x%2X",
-           i,
-           samples[i],
-           samples_to_dac[0], samples_to_dac[1]);
+      RT_WARN("audio out: channel %d 0x%4X : 0x%2X 0x%2X",
+              i,
+              samples[i],
+              samples_to_dac[0], samples_to_dac[1]);
       */
     }
   }
@@ -131,17 +201,11 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
 
 
 int process_midi(void *zcard_plugin, uint8_t *midi_message, size_t size) {
-  return 0;
+  struct audio_out_card *zcard = (struct audio_out_card*)zcard_plugin;
+  return zcv_gen_process_midi(zcard->cv_gen, midi_message, size);
 }
 
 
-struct midi_program_to_gpio {
-  int port;
-  uint8_t gpio_reg; // gpio register zero or one?
-  uint8_t set_bits;  // mask to OR
-  uint8_t clear_bits; // mask to AND
-};
-
 // array indexed by MIDI program number
 static const struct midi_program_to_gpio midi_program_to_gpio[] = {
 // reg, reg addr,   or-mask,    and-mask
@@ -177,7 +241,7 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
   int error = 0;
   struct audio_out_card *zcard = (struct audio_out_card*)zcard_plugin;
 
-  INFO("audio out: received program change to 0x%X", program_number);
+  RT_INFO("audio out: received program change to 0x%X", program_number);
 
   if (program_number < ( sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio) ) ) {
     const struct midi_program_to_gpio *prog_gpio_entry = &midi_program_to_gpio[program_number];
@@ -188,18 +252,28 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
                              prog_gpio_entry->gpio_reg,
                              zcard->pca9555_port[ prog_gpio_entry->port ]);
 
-    INFO("audio out: prog 0x%X: wrote 0x%X to port %d",
-         program_number, zcard->pca9555_port[ prog_gpio_entry->port ],
-         prog_gpio_entry->gpio_reg);
+    RT_INFO("audio out: prog 0x%X: wrote 0x%X to port %d",
+            program_number, zcard->pca9555_port[ prog_gpio_entry->port ],
+            prog_gpio_entry->gpio_reg);
   }
   else {
-    WARN("audio out: unexpected midi program number: 0x%X", program_number);
+    RT_WARN("audio out: unexpected midi program number: 0x%X", program_number);
   }
 
   return error;
 }
 
 
+int process_midi_program_changes(void *zcard_plugin, const uint8_t *program_numbers, size_t count) {
+  struct audio_out_card *zcard = (struct audio_out_card*)zcard_plugin;
+
+  return pca9555_apply_programs(zcard->i2c_handle, zcard->pca9555_port,
+                                midi_program_to_gpio,
+                                sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio),
+                                program_numbers, count);
+}
+
+
 
 int tunereq_save_state(void *zcard_plugin) {
   return TUNE_COMPLETE_SUCCESS;
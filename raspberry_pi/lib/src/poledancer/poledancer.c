@@ -56,7 +56,8 @@ static const uint8_t channel_map_cs1[] = { 0x70, 0x40, 0x20, 0x30, 0x10, 0x60 };
 const uint8_t cutoff_cv_channel = 0;
 
 static void create_linear_tuning(int, int, int16_t*);
-static void calibrate_vca2190_dac(struct poledancer_card*, int i2c_rom_handle);
+static int read_calibration_rom(struct poledancer_card*, char *rom_data);
+static void calibrate_vca2190_dac(struct poledancer_card*, const char *rom_data);
 
 // I2C EEPROM layout
 // address zero, like all z-cards, has the board identifier.
@@ -80,7 +81,7 @@ static void calibrate_vca2190_dac(struct poledancer_card*, int i2c_rom_handle);
 static const unsigned int load_rom_address = 0x01;
 static const int8_t min_board_version = 1;
 #define NUM_VCA_CHANNEL_DESCRIPTORS 6
-#define ROM_READ_SIZE_BYTES NUM_VCA_CHANNEL_DESCRIPTORS * 4 + 1
+#define ROM_READ_SIZE_BYTES (NUM_VCA_CHANNEL_DESCRIPTORS * 4 + 1)
 
 
 static const struct dac_channel_descriptor dac_channel_descriptors_template[NUM_VCA_CHANNEL_DESCRIPTORS] = {
@@ -138,16 +139,12 @@ void* init_zcard(struct zhost *zhost, int slot) {
   }
 
 
-  // VCA calibration call - needs ROM i2c handle
-  int i2c_rom = i2cOpen(I2C_BUS, slot + EEPROM_BASE_I2C_ADDRESS, 0);
-  if (i2c_rom < 0) {
-    ERROR("poledancer: unable to open i2c for address %d\n",
-          slot + EEPROM_BASE_I2C_ADDRESS);
+  // VCA calibration call - needs the ROM contents
+  char rom_data[ROM_READ_SIZE_BYTES];
+  if (read_calibration_rom(poledancer, rom_data)) {
     return NULL;
   }
-  calibrate_vca2190_dac(poledancer, i2c_rom);
-
-  i2cClose(i2c_rom);
+  calibrate_vca2190_dac(poledancer, rom_data);
 
 
   // configure DAC
@@ -188,6 +185,7 @@ void* init_zcard(struct zhost *zhost, int slot) {
                        poledancer->tunable.dac_size,
                        poledancer->tunable.dac_calibration_table);
 
+  poledancer->cv_gen = zcv_gen_create(zhost, DAC_CHANNELS_CS0 + DAC_CHANNELS_CS1);
 
   return poledancer;
 }
@@ -208,10 +206,93 @@ void free_zcard(void *zcard_plugin) {
       free_vca_dac_calibration(poledancer->dac_characterization);
     }
 
+    zcv_gen_free(poledancer->cv_gen);
+    free(poledancer);
+  }
+}
+
+
+/* warm restart: expander shadows, last DAC words and the cutoff
+ * calibration table, see checkpoint_zcard_f.  The VCA calibration is
+ * rebuilt from the ROM as on init.  size stands in for a version.
+ */
+struct poledancer_checkpoint {
+  uint32_t size;
+  uint8_t pca9555_port[2];
+  int16_t previous_samples_cs0[DAC_CHANNELS_CS0];
+  int16_t previous_samples_cs1[DAC_CHANNELS_CS1];
+  int16_t dac_calibration_table[TWELVE_BITS];
+};
+
+
+size_t checkpoint_zcard(void *zcard_plugin, void *buffer, size_t size) {
+  struct poledancer_card *poledancer = (struct poledancer_card*)zcard_plugin;
+  struct poledancer_checkpoint *checkpoint = (struct poledancer_checkpoint*)buffer;
+
+  if (size < sizeof(struct poledancer_checkpoint)) {
+    return 0;
+  }
+
+  checkpoint->size = sizeof(struct poledancer_checkpoint);
+  memcpy(checkpoint->pca9555_port, poledancer->pca9555_port, sizeof(checkpoint->pca9555_port));
+  memcpy(checkpoint->previous_samples_cs0, poledancer->previous_samples_cs0, sizeof(checkpoint->previous_samples_cs0));
+  memcpy(checkpoint->previous_samples_cs1, poledancer->previous_samples_cs1, sizeof(checkpoint->previous_samples_cs1));
+  memcpy(checkpoint->dac_calibration_table, poledancer->tunable.dac_calibration_table,
+         sizeof(checkpoint->dac_calibration_table));
+  return sizeof(struct poledancer_checkpoint);
+}
+
+
+void* resume_zcard(struct zhost *zhost, int slot, const void *checkpoint_data, size_t size) {
+  const struct poledancer_checkpoint *checkpoint = (const struct poledancer_checkpoint*)checkpoint_data;
+  int i2c_addr = slot + PCA9555_BASE_I2C_ADDRESS;
+
+  assert(slot >= 0 && slot < 8);
+  if (size != sizeof(struct poledancer_checkpoint) || checkpoint->size != size) {
+    return NULL;
+  }
+
+  struct poledancer_card *poledancer = (struct poledancer_card*)calloc(1, sizeof(struct poledancer_card));
+  if (poledancer == NULL) {
+    return NULL;
+  }
+
+  poledancer->zhost = zhost;
+  poledancer->slot = slot;
+
+  // expander, DACs and ctrl ref are already set and driving these: no writes
+  poledancer->i2c_handle = i2cOpen(I2C_BUS, i2c_addr, 0);
+  if (poledancer->i2c_handle < 0) {
+    ERROR("poledancer: unable to open i2c for address %d\n", i2c_addr);
+    free(poledancer);
+    return NULL;
+  }
+  memcpy(poledancer->pca9555_port, checkpoint->pca9555_port, sizeof(poledancer->pca9555_port));
+  memcpy(poledancer->previous_samples_cs0, checkpoint->previous_samples_cs0, sizeof(poledancer->previous_samples_cs0));
+  memcpy(poledancer->previous_samples_cs1, checkpoint->previous_samples_cs1, sizeof(poledancer->previous_samples_cs1));
+
+  // the VCA level codes, from the ROM: only reads
+  char rom_data[ROM_READ_SIZE_BYTES];
+  if (read_calibration_rom(poledancer, rom_data)) {
+    i2cClose(poledancer->i2c_handle);
     free(poledancer);
+    return NULL;
   }
+  calibrate_vca2190_dac(poledancer, rom_data);
+
+  poledancer->tunable.dac_size = TWELVE_BITS;
+  poledancer->tunable.dac_calibration_table = (int16_t*)calloc(TWELVE_BITS, sizeof(int16_t));
+  poledancer->tunable.tune_points = (struct tune_point*)calloc(NUM_TUNING_POINTS, sizeof(struct tune_point));
+  poledancer->tunable.tune_points_size = NUM_TUNING_POINTS;
+  memcpy(poledancer->tunable.dac_calibration_table, checkpoint->dac_calibration_table,
+         sizeof(checkpoint->dac_calibration_table));
+
+  poledancer->cv_gen = zcv_gen_create(zhost, DAC_CHANNELS_CS0 + DAC_CHANNELS_CS1);
+
+  return poledancer;
 }
 
+
 char* get_plugin_name() {
   return "Zoxnoxious Pole Dancer";
 }
@@ -221,6 +302,7 @@ struct zcard_properties* get_zcard_properties() {
   struct zcard_properties *props = (struct zcard_properties*) malloc(sizeof(struct zcard_properties));
   props->num_channels = DAC_CHANNELS_CS0 + DAC_CHANNELS_CS1;
   props->spi_mode = SPI_MODE;
+  props->slow_channel_mask = 0;
   return props;
 }
 
@@ -232,6 +314,7 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
   int spi_channel;
 
 
+  samples = zcv_gen_process(zcard->cv_gen, samples);
   spi_channel = set_spi_interface(zcard->zhost, spi_channel_cs0, SPI_MODE, zcard->slot);
 
   for (int i = 0; i < DAC_CHANNELS_CS0; ++i) {
@@ -271,9 +354,9 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
           zcard->previous_samples_cs1[i] = samples_cs1[i];
 #ifdef USE_VCACALIBRATION
           /*
-          INFO("channel %d : %hx",
-               i + DAC_CHANNELS_CS0,
-               zcard->dac_characterization->calibrated_codes[i][ samples_cs1[i] >> 3 ]);
+          RT_INFO("channel %d : %hx",
+                  i + DAC_CHANNELS_CS0,
+                  zcard->dac_characterization->calibrated_codes[i][ samples_cs1[i] >> 3 ]);
           */
           spiWrite(spi_channel,
                    (char*) &zcard->dac_characterization->calibrated_codes[i][ samples_cs1[i] >> 3 ],
@@ -311,17 +394,11 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
 
 
 int process_midi(void *zcard_plugin, uint8_t *midi_message, size_t size) {
-  return 0;
+  struct poledancer_card *zcard = (struct poledancer_card*)zcard_plugin;
+  return zcv_gen_process_midi(zcard->cv_gen, midi_message, size);
 }
 
 
-struct midi_program_to_gpio {
-  int port;
-  uint8_t gpio_reg; // gpio register zero or one?
-  uint8_t set_bits;  // mask to OR
-  uint8_t clear_bits; // mask to AND
-};
-
 // array indexed by MIDI program number
 static const struct midi_program_to_gpio midi_program_to_gpio[] = {
   // muxes: these are wired same as the z3372, in reverse.  That is, the low number
@@ -374,7 +451,7 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
   int error = 0;
   struct poledancer_card *zcard = (struct poledancer_card*)zcard_plugin;
 
-  INFO("Poledancer: received program change to 0x%X", program_number);
+  RT_INFO("Poledancer: received program change to 0x%X", program_number);
 
   if (program_number < ( sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio) ) ) {
     const struct midi_program_to_gpio *prog_gpio_entry = &midi_program_to_gpio[program_number];
@@ -387,13 +464,23 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
 
   }
   else {
-    WARN("Poledancer: unexpected midi program number: 0x%X", program_number);
+    RT_WARN("Poledancer: unexpected midi program number: 0x%X", program_number);
   }
 
   return error;
 }
 
 
+int process_midi_program_changes(void *zcard_plugin, const uint8_t *program_numbers, size_t count) {
+  struct poledancer_card *zcard = (struct poledancer_card*)zcard_plugin;
+
+  return pca9555_apply_programs(zcard->i2c_handle, zcard->pca9555_port,
+                                midi_program_to_gpio,
+                                sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio),
+                                program_numbers, count);
+}
+
+
 
 /** create_linear_tuning
  * create a linear tuning table - no corrections.  Create it for the passed in DAC channel such that
@@ -410,8 +497,36 @@ static void create_linear_tuning(int dac_channel, int num_elements, int16_t *tab
 
 
 
-static void calibrate_vca2190_dac(struct poledancer_card *zcard, int i2c_rom_handle) {
-  char rom_data[ROM_READ_SIZE_BYTES];
+/** read_calibration_rom
+ *
+ * ROM_READ_SIZE_BYTES from load_rom_address: the copy the daemon took
+ * at discovery if it has them, otherwise read from the ROM.
+ */
+static int read_calibration_rom(struct poledancer_card *zcard, char *rom_data) {
+  unsigned int rom_size;
+  const uint8_t *rom = zhost_get_card_rom(zcard->zhost, zcard->slot, &rom_size);
+
+  if (rom && rom_size >= load_rom_address + ROM_READ_SIZE_BYTES) {
+    memcpy(rom_data, &rom[load_rom_address], ROM_READ_SIZE_BYTES);
+    return 0;
+  }
+
+  int i2c_rom = i2cOpen(I2C_BUS, zcard->slot + EEPROM_BASE_I2C_ADDRESS, 0);
+  if (i2c_rom < 0) {
+    ERROR("poledancer: unable to open i2c for address %d\n",
+          zcard->slot + EEPROM_BASE_I2C_ADDRESS);
+    return -1;
+  }
+  i2cReadI2CBlockData(i2c_rom,
+                      load_rom_address,
+                      rom_data,
+                      ROM_READ_SIZE_BYTES);
+  i2cClose(i2c_rom);
+  return 0;
+}
+
+
+static void calibrate_vca2190_dac(struct poledancer_card *zcard, const char *rom_data) {
   int8_t board_version_number;
 
 
@@ -423,11 +538,6 @@ static void calibrate_vca2190_dac(struct poledancer_card *zcard, int i2c_rom_han
   struct dac_channel_descriptor dac_channel_descriptors[NUM_VCA_CHANNEL_DESCRIPTORS];
   memcpy(&dac_channel_descriptors, &dac_channel_descriptors_template, sizeof(struct dac_channel_descriptor[NUM_VCA_CHANNEL_DESCRIPTORS]));
 
-  i2cReadI2CBlockData(i2c_rom_handle,
-                      load_rom_address,
-                      rom_data,
-                      sizeof(rom_data));
-
   board_version_number = (int8_t)rom_data[0];
 
   if (board_version_number >= min_board_version) {
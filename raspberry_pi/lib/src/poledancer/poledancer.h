@@ -18,6 +18,7 @@
 
 #include "vca_dac_calibration.h"
 #include "zcard_plugin.h"
+#include "zcv_gen.h"
 #include "tune_utils.h"
 
 
@@ -40,6 +41,7 @@ struct poledancer_card {
   uint8_t pca9555_port[2];  // gpio registers
   int16_t previous_samples_cs0[DAC_CHANNELS_CS0];
   int16_t previous_samples_cs1[DAC_CHANNELS_CS1];
+  struct zcv_gen_bank *cv_gen;
 
   // vcf tuning params
   struct tunable tunable;
@@ -18,6 +18,7 @@
 #include <unistd.h>
 
 #include "zcard_plugin.h"
+#include "zcv_gen.h"
 #include "tune_utils.h"
 
 
@@ -38,6 +39,7 @@ struct z3340_card {
   int i2c_handle;
   uint8_t pca9555_port[2];  // gpio registers
   int16_t previous_samples[NUM_DAC_CHANNELS];
+  struct zcv_gen_bank *cv_gen;
 
   // tuning params
   int tuning_point; // maintain state between tuning calls
@@ -158,6 +160,8 @@ void* init_zcard(struct zhost *zhost, int slot) {
   // tuning -- start with untuned / linear
   create_linear_tuning(freq_cv_dac_channel, TWELVE_BITS, z3340->freq_tuned);
 
+  z3340->cv_gen = zcv_gen_create(zhost, NUM_DAC_CHANNELS);
+
   return z3340;
 }
 
@@ -171,10 +175,77 @@ void free_zcard(void *zcard_plugin) {
       // TODO: turn off LED
       i2cClose(z3340->i2c_handle);
     }
+    zcv_gen_free(z3340->cv_gen);
+    free(z3340);
+  }
+}
+
+
+/* warm restart: expander shadows, last DAC words and the frequency
+ * tuning, see checkpoint_zcard_f.  size stands in for a version.
+ */
+struct z3340_checkpoint {
+  uint32_t size;
+  uint8_t pca9555_port[2];
+  int16_t previous_samples[NUM_DAC_CHANNELS];
+  int tuning_complete;
+  int16_t freq_tuned[TWELVE_BITS];
+};
+
+
+size_t checkpoint_zcard(void *zcard_plugin, void *buffer, size_t size) {
+  struct z3340_card *z3340 = (struct z3340_card*)zcard_plugin;
+  struct z3340_checkpoint *checkpoint = (struct z3340_checkpoint*)buffer;
+
+  if (size < sizeof(struct z3340_checkpoint)) {
+    return 0;
+  }
+
+  checkpoint->size = sizeof(struct z3340_checkpoint);
+  memcpy(checkpoint->pca9555_port, z3340->pca9555_port, sizeof(checkpoint->pca9555_port));
+  memcpy(checkpoint->previous_samples, z3340->previous_samples, sizeof(checkpoint->previous_samples));
+  checkpoint->tuning_complete = z3340->tuning_complete;
+  memcpy(checkpoint->freq_tuned, z3340->freq_tuned, sizeof(checkpoint->freq_tuned));
+  return sizeof(struct z3340_checkpoint);
+}
+
+
+void* resume_zcard(struct zhost *zhost, int slot, const void *checkpoint_data, size_t size) {
+  const struct z3340_checkpoint *checkpoint = (const struct z3340_checkpoint*)checkpoint_data;
+  int i2c_addr = slot + PCA9555_BASE_I2C_ADDRESS;
+
+  assert(slot >= 0 && slot < 8);
+  if (size != sizeof(struct z3340_checkpoint) || checkpoint->size != size) {
+    return NULL;
+  }
+
+  struct z3340_card *z3340 = (struct z3340_card*)calloc(1, sizeof(struct z3340_card));
+  if (z3340 == NULL) {
+    return NULL;
+  }
+
+  z3340->zhost = zhost;
+  z3340->slot = slot;
+
+  // expander and DAC are already configured and driving these: no writes
+  z3340->i2c_handle = i2cOpen(I2C_BUS, i2c_addr, 0);
+  if (z3340->i2c_handle < 0) {
+    ERROR("z3340: unable to open i2c for address %d\n", i2c_addr);
     free(z3340);
+    return NULL;
   }
+  memcpy(z3340->pca9555_port, checkpoint->pca9555_port, sizeof(z3340->pca9555_port));
+  memcpy(z3340->previous_samples, checkpoint->previous_samples, sizeof(z3340->previous_samples));
+  z3340->tuning_complete = checkpoint->tuning_complete;
+  memcpy(z3340->freq_tuned, checkpoint->freq_tuned, sizeof(z3340->freq_tuned));
+
+  z3340->cv_gen = zcv_gen_create(zhost, NUM_DAC_CHANNELS);
+
+  return z3340;
 }
 
+
+
 char* get_plugin_name() {
   return "Zoxnoxious 3340";
 }
@@ -184,6 +255,7 @@ struct zcard_properties* get_zcard_properties() {
   struct zcard_properties *props = (struct zcard_properties*) malloc(sizeof(struct zcard_properties));
   props->num_channels = NUM_DAC_CHANNELS;
   props->spi_mode = SPI_MODE;
+  props->slow_channel_mask = 0;
   return props;
 }
 
@@ -195,6 +267,7 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
   int spi_channel;
   int dac_channel = 0;
 
+  samples = zcv_gen_process(zcard->cv_gen, samples);
   spi_channel = set_spi_interface(zcard->zhost, SPI_CHANNEL, SPI_MODE, zcard->slot);
 
   // this is broken up, rather crudely, to filter the freq CV and
@@ -246,17 +319,11 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
 
 
 int process_midi(void *zcard_plugin, uint8_t *midi_message, size_t size) {
-  return 0;
+  struct z3340_card *zcard = (struct z3340_card*)zcard_plugin;
+  return zcv_gen_process_midi(zcard->cv_gen, midi_message, size);
 }
 
 
-struct midi_program_to_gpio {
-  int port;
-  uint8_t gpio_reg; // gpio register zero or one?
-  uint8_t set_bits;  // mask to OR
-  uint8_t clear_bits; // mask to AND
-};
-
 // array indexed by MIDI program number
 static const struct midi_program_to_gpio midi_program_to_gpio[] = {
   { 0, port0_addr, 0b00000000, 0b11111110 }, // prog 0 - sync hard off
@@ -296,7 +363,7 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
   int error = 0;
   struct z3340_card *zcard = (struct z3340_card*)zcard_plugin;
 
-  INFO("Z3340: received program change to 0x%X", program_number);
+  RT_INFO("Z3340: received program change to 0x%X", program_number);
 
   if (program_number < ( sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio) ) ) {
     const struct midi_program_to_gpio *prog_gpio_entry = &midi_program_to_gpio[program_number];
@@ -309,13 +376,23 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
 
   }
   else {
-    WARN("Z3340: unexpected midi program number: 0x%X", program_number);
+    RT_WARN("Z3340: unexpected midi program number: 0x%X", program_number);
   }
 
   return error;
 }
 
 
+int process_midi_program_changes(void *zcard_plugin, const uint8_t *program_numbers, size_t count) {
+  struct z3340_card *zcard = (struct z3340_card*)zcard_plugin;
+
+  return pca9555_apply_programs(zcard->i2c_handle, zcard->pca9555_port,
+                                midi_program_to_gpio,
+                                sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio),
+                                program_numbers, count);
+}
+
+
 //
 // Tuning!
 //
@@ -109,6 +109,8 @@ void* init_zcard(struct zhost *zhost, int slot) {
                        z3372->tunable.dac_size,
                        z3372->tunable.dac_calibration_table);
 
+  z3372->cv_gen = zcv_gen_create(zhost, NUM_CHANNELS);
+
   return z3372;
 }
 
@@ -124,10 +126,81 @@ void free_zcard(void *zcard_plugin) {
       // TODO: turn off LED
       i2cClose(z3372->i2c_handle);
     }
+    zcv_gen_free(z3372->cv_gen);
     free(z3372);
   }
 }
 
+
+/* warm restart: expander shadows, last DAC words and the cutoff
+ * calibration table, see checkpoint_zcard_f.  size stands in for a
+ * version.
+ */
+struct z3372_checkpoint {
+  uint32_t size;
+  uint8_t pca9555_port[2];
+  int16_t previous_samples[NUM_CHANNELS];
+  int16_t dac_calibration_table[TWELVE_BITS];
+};
+
+
+size_t checkpoint_zcard(void *zcard_plugin, void *buffer, size_t size) {
+  struct z3372_card *z3372 = (struct z3372_card*)zcard_plugin;
+  struct z3372_checkpoint *checkpoint = (struct z3372_checkpoint*)buffer;
+
+  if (size < sizeof(struct z3372_checkpoint)) {
+    return 0;
+  }
+
+  checkpoint->size = sizeof(struct z3372_checkpoint);
+  memcpy(checkpoint->pca9555_port, z3372->pca9555_port, sizeof(checkpoint->pca9555_port));
+  memcpy(checkpoint->previous_samples, z3372->previous_samples, sizeof(checkpoint->previous_samples));
+  memcpy(checkpoint->dac_calibration_table, z3372->tunable.dac_calibration_table,
+         sizeof(checkpoint->dac_calibration_table));
+  return sizeof(struct z3372_checkpoint);
+}
+
+
+void* resume_zcard(struct zhost *zhost, int slot, const void *checkpoint_data, size_t size) {
+  const struct z3372_checkpoint *checkpoint = (const struct z3372_checkpoint*)checkpoint_data;
+  int i2c_addr = slot + PCA9555_BASE_I2C_ADDRESS;
+
+  assert(slot >= 0 && slot < 8);
+  if (size != sizeof(struct z3372_checkpoint) || checkpoint->size != size) {
+    return NULL;
+  }
+
+  struct z3372_card *z3372 = (struct z3372_card*)calloc(1, sizeof(struct z3372_card));
+  if (z3372 == NULL) {
+    return NULL;
+  }
+
+  z3372->zhost = zhost;
+  z3372->slot = slot;
+
+  // expander and DAC are already configured and driving these: no writes
+  z3372->i2c_handle = i2cOpen(I2C_BUS, i2c_addr, 0);
+  if (z3372->i2c_handle < 0) {
+    ERROR("z3372: unable to open i2c for address %d\n", i2c_addr);
+    free(z3372);
+    return NULL;
+  }
+  memcpy(z3372->pca9555_port, checkpoint->pca9555_port, sizeof(z3372->pca9555_port));
+  memcpy(z3372->previous_samples, checkpoint->previous_samples, sizeof(z3372->previous_samples));
+
+  z3372->tunable.dac_size = TWELVE_BITS;
+  z3372->tunable.dac_calibration_table = (int16_t*)calloc(TWELVE_BITS, sizeof(int16_t));
+  z3372->tunable.tune_points = (struct tune_point*)calloc(NUM_TUNING_POINTS, sizeof(struct tune_point));
+  z3372->tunable.tune_points_size = NUM_TUNING_POINTS;
+  memcpy(z3372->tunable.dac_calibration_table, checkpoint->dac_calibration_table,
+         sizeof(checkpoint->dac_calibration_table));
+
+  z3372->cv_gen = zcv_gen_create(zhost, NUM_CHANNELS);
+
+  return z3372;
+}
+
+
 char* get_plugin_name() {
   return "Zoxnoxious 3372 VCF";
 }
@@ -137,6 +210,7 @@ struct zcard_properties* get_zcard_properties() {
   struct zcard_properties *props = (struct zcard_properties*) malloc(sizeof(struct zcard_properties));
   props->num_channels = NUM_CHANNELS;
   props->spi_mode = SPI_MODE;
+  props->slow_channel_mask = SLOW_CHANNEL_MASK;
   return props;
 }
 
@@ -147,6 +221,7 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
   char samples_to_dac[2];
   int spi_channel;
 
+  samples = zcv_gen_process(zcard->cv_gen, samples);
   spi_channel = set_spi_interface(zcard->zhost, SPI_CHANNEL, SPI_MODE, zcard->slot);
 
   for (int i = 0; i < NUM_CHANNELS; ++i) {
@@ -184,17 +259,11 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
 
 
 int process_midi(void *zcard_plugin, uint8_t *midi_message, size_t size) {
-  return 0;
+  struct z3372_card *zcard = (struct z3372_card*)zcard_plugin;
+  return zcv_gen_process_midi(zcard->cv_gen, midi_message, size);
 }
 
 
-struct midi_program_to_gpio {
-  int port;
-  uint8_t gpio_reg; // gpio register zero or one?
-  uint8_t set_bits;  // mask to OR
-  uint8_t clear_bits; // mask to AND
-};
-
 // array indexed by MIDI program number
 static const struct midi_program_to_gpio midi_program_to_gpio[] = {
   { 0, port0_addr, 0b00000000, 0b11111011 }, // prog 0 - filter fm off
@@ -232,7 +301,7 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
   int error = 0;
   struct z3372_card *zcard = (struct z3372_card*)zcard_plugin;
 
-  INFO("Z3372: received program change to 0x%X", program_number);
+  RT_INFO("Z3372: received program change to 0x%X", program_number);
 
   if (program_number < ( sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio) ) ) {
     const struct midi_program_to_gpio *prog_gpio_entry = &midi_program_to_gpio[program_number];
@@ -245,13 +314,23 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
 
   }
   else {
-    WARN("Z3372: unexpected midi program number: 0x%X", program_number);
+    RT_WARN("Z3372: unexpected midi program number: 0x%X", program_number);
   }
 
   return error;
 }
 
 
+int process_midi_program_changes(void *zcard_plugin, const uint8_t *program_numbers, size_t count) {
+  struct z3372_card *zcard = (struct z3372_card*)zcard_plugin;
+
+  return pca9555_apply_programs(zcard->i2c_handle, zcard->pca9555_port,
+                                midi_program_to_gpio,
+                                sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio),
+                                program_numbers, count);
+}
+
+
 
 /** create_linear_tuning
  * create a linear tuning table - no corrections.  Create it for the passed in DAC channel such that
@@ -17,6 +17,7 @@
 #define Z3372_H
 
 #include "zcard_plugin.h"
+#include "zcv_gen.h"
 #include "tune_utils.h"
 
 
@@ -30,6 +31,9 @@
 #define SPI_MODE 1
 #define SPI_CHANNEL 0
 #define NUM_CHANNELS 8
+// the mixer levels (noise, source one, source two) are slow: they ride
+// the TDM lanes and are updated every TDM_SLOTS_PER_CHANNEL frames
+#define SLOW_CHANNEL_MASK 0x61
 
 
 struct z3372_card {
@@ -38,6 +42,7 @@ struct z3372_card {
   int i2c_handle;
   uint8_t pca9555_port[2];  // gpio registers
   int16_t previous_samples[NUM_CHANNELS];
+  struct zcv_gen_bank *cv_gen;
 
   // tuning
   struct tunable tunable;
@@ -136,6 +136,8 @@ void* init_zcard(struct zhost *zhost, int slot) {
   z5524->pca9555_port[1] = 0x00; // disable hard sync
   i2cWriteByteData(z5524->i2c_handle, port1_addr, z5524->pca9555_port[1]);
 
+  z5524->cv_gen = zcv_gen_create(zhost, CHIP_SELECTS * DAC_CHANNELS);
+
   return z5524;
 }
 
@@ -153,10 +155,85 @@ void free_zcard(void *zcard_plugin) {
       // TODO: turn off LED
       i2cClose(z5524->i2c_handle);
     }
+    zcv_gen_free(z5524->cv_gen);
+    free(z5524);
+  }
+}
+
+
+/* warm restart: expander shadows, last DAC words and the calibration
+ * tables, see checkpoint_zcard_f.  size stands in for a version.
+ */
+struct z5524_checkpoint {
+  uint32_t size;
+  uint8_t pca9555_port[2];
+  int16_t previous_samples[CHIP_SELECTS][DAC_CHANNELS];
+  int16_t dac_calibration_tables[TUNE_TARGET_LENGTH][TWELVE_BITS];
+};
+
+
+size_t checkpoint_zcard(void *zcard_plugin, void *buffer, size_t size) {
+  struct z5524_card *z5524 = (struct z5524_card*)zcard_plugin;
+  struct z5524_checkpoint *checkpoint = (struct z5524_checkpoint*)buffer;
+
+  if (size < sizeof(struct z5524_checkpoint)) {
+    return 0;
+  }
+
+  checkpoint->size = sizeof(struct z5524_checkpoint);
+  memcpy(checkpoint->pca9555_port, z5524->pca9555_port, sizeof(checkpoint->pca9555_port));
+  memcpy(checkpoint->previous_samples, z5524->previous_samples, sizeof(checkpoint->previous_samples));
+  for (int i = TUNE_SSI2130_VCO; i < TUNE_TARGET_LENGTH; ++i) {
+    memcpy(checkpoint->dac_calibration_tables[i], z5524->tunables[i].dac_calibration_table,
+           sizeof(checkpoint->dac_calibration_tables[i]));
+  }
+  return sizeof(struct z5524_checkpoint);
+}
+
+
+void* resume_zcard(struct zhost *zhost, int slot, const void *checkpoint_data, size_t size) {
+  const struct z5524_checkpoint *checkpoint = (const struct z5524_checkpoint*)checkpoint_data;
+  int i2c_addr = slot + PCA9555_BASE_I2C_ADDRESS;
+
+  assert(slot >= 0 && slot < 8);
+  if (size != sizeof(struct z5524_checkpoint) || checkpoint->size != size) {
+    return NULL;
+  }
+
+  struct z5524_card *z5524 = (struct z5524_card*)calloc(1, sizeof(struct z5524_card));
+  if (z5524 == NULL) {
+    return NULL;
+  }
+
+  z5524->zhost = zhost;
+  z5524->slot = slot;
+
+  // expander and DACs are already configured and driving these, and
+  // the SSI2130 is long since synced: no writes
+  z5524->i2c_handle = i2cOpen(I2C_BUS, i2c_addr, 0);
+  if (z5524->i2c_handle < 0) {
+    ERROR("z5524: unable to open i2c for address %d\n", i2c_addr);
     free(z5524);
+    return NULL;
+  }
+  memcpy(z5524->pca9555_port, checkpoint->pca9555_port, sizeof(z5524->pca9555_port));
+  memcpy(z5524->previous_samples, checkpoint->previous_samples, sizeof(z5524->previous_samples));
+
+  for (int i = TUNE_SSI2130_VCO; i < TUNE_TARGET_LENGTH; ++i) {
+    z5524->tunables[i].dac_size = TWELVE_BITS;
+    z5524->tunables[i].dac_calibration_table = (int16_t*)calloc(TWELVE_BITS, sizeof(int16_t));
+    z5524->tunables[i].tune_points = (struct tune_point*)calloc(NUM_TUNING_POINTS, sizeof(struct tune_point));
+    z5524->tunables[i].tune_points_size = NUM_TUNING_POINTS;
+    memcpy(z5524->tunables[i].dac_calibration_table, checkpoint->dac_calibration_tables[i],
+           sizeof(checkpoint->dac_calibration_tables[i]));
   }
+
+  z5524->cv_gen = zcv_gen_create(zhost, CHIP_SELECTS * DAC_CHANNELS);
+
+  return z5524;
 }
 
+
 char* get_plugin_name() {
   return "Zoxnoxious 5524";
 }
@@ -166,6 +243,7 @@ struct zcard_properties* get_zcard_properties() {
   struct zcard_properties *props = (struct zcard_properties*) malloc(sizeof(struct zcard_properties));
   props->num_channels = 16;
   props->spi_mode = SPI_MODE;
+  props->slow_channel_mask = 0;
   return props;
 }
 
@@ -178,6 +256,8 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
   int i;
   char samples_to_dac[2];
 
+  samples = zcv_gen_process(zcard->cv_gen, samples);
+
   // dac output samples
   spi_channel = set_spi_interface(zcard->zhost, spi_channel_as3394, SPI_MODE, zcard->slot);
 
@@ -244,17 +324,11 @@ int process_samples(void *zcard_plugin, const int16_t *samples) {
 
 
 int process_midi(void *zcard_plugin, uint8_t *midi_message, size_t size) {
-  return 0;
+  struct z5524_card *zcard = (struct z5524_card*)zcard_plugin;
+  return zcv_gen_process_midi(zcard->cv_gen, midi_message, size);
 }
 
 
-struct midi_program_to_gpio {
-  int port;
-  uint8_t gpio_reg; // gpio register zero or one?
-  uint8_t set_bits;  // mask to OR
-  uint8_t clear_bits; // mask to AND
-};
-
 // VCO1 == SSI2130
 // VCO2 == AS3394
 
@@ -287,7 +361,7 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
   int error = 0;
   struct z5524_card *zcard = (struct z5524_card*)zcard_plugin;
 
-  INFO("Z5524: received program change to 0x%X", program_number);
+  RT_INFO("Z5524: received program change to 0x%X", program_number);
 
   if (program_number < ( sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio) ) ) {
     const struct midi_program_to_gpio *prog_gpio_entry = &midi_program_to_gpio[program_number];
@@ -300,13 +374,23 @@ int process_midi_program_change(void *zcard_plugin, uint8_t program_number) {
 
   }
   else {
-    WARN("Z5524: unexpected midi program number: 0x%X", program_number);
+    RT_WARN("Z5524: unexpected midi program number: 0x%X", program_number);
   }
 
   return error;
 }
 
 
+int process_midi_program_changes(void *zcard_plugin, const uint8_t *program_numbers, size_t count) {
+  struct z5524_card *zcard = (struct z5524_card*)zcard_plugin;
+
+  return pca9555_apply_programs(zcard->i2c_handle, zcard->pca9555_port,
+                                midi_program_to_gpio,
+                                sizeof(midi_program_to_gpio) / sizeof(struct midi_program_to_gpio),
+                                program_numbers, count);
+}
+
+
 // DAC write:
 // bits 15-0:
 // 0 A2 A1 A0 D11 D10 D9 D8 D7 D6 D5 D4 D3 D2 D1 D0
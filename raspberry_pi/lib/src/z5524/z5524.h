@@ -17,6 +17,7 @@
 #define Z5524_H
 
 #include "zcard_plugin.h"
+#include "zcv_gen.h"
 #include "tune_utils.h"
 
 
@@ -44,6 +45,7 @@ struct z5524_card {
   int i2c_handle;
   uint8_t pca9555_port[2];  // gpio registers
   int16_t previous_samples[CHIP_SELECTS][DAC_CHANNELS];
+  struct zcv_gen_bank *cv_gen;
 
   // tuning params
   struct tunable tunables[TUNE_TARGET_LENGTH];
@@ -0,0 +1,452 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* RT-safe logging.  Producers (PCM thread, MIDI thread, card plugins)
+ * store the format string pointer and the raw arguments in a bounded
+ * lock-free ring; a SCHED_OTHER logger thread formats and hands them
+ * to zlog.  Producers never block or allocate: a full ring drops the
+ * message and bumps a counter.
+ *
+ * The ring is a bounded multi-producer single-consumer queue: each
+ * entry carries a sequence number telling producers and the consumer
+ * whose turn it is.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "zcard_plugin.h"
+
+// must be a power of two
+#define RT_LOG_RING_SIZE 512
+#define RT_LOG_RING_MASK (RT_LOG_RING_SIZE - 1)
+#define RT_LOG_MAX_ARGS 8
+#define RT_LOG_STRING_SPACE 64
+#define RT_LOG_MESSAGE_SIZE 512
+#define RT_LOG_DRAIN_INTERVAL_NS 20000000L
+
+
+enum rt_log_arg_type {
+  ARG_INT,
+  ARG_LONG,
+  ARG_LLONG,
+  ARG_SIZE,
+  ARG_INTMAX,
+  ARG_PTRDIFF,
+  ARG_DOUBLE,
+  ARG_LDOUBLE,
+  ARG_STRING,
+  ARG_POINTER,
+  ARG_PERCENT,
+  ARG_UNSUPPORTED
+};
+
+union rt_log_arg {
+  long long i;
+  double d;
+  const void *p;
+};
+
+struct rt_log_entry {
+  _Atomic size_t sequence;
+  int level;
+  const char *file;
+  const char *func;
+  long line;
+  const char *format;
+  union rt_log_arg args[RT_LOG_MAX_ARGS];
+  char strings[RT_LOG_STRING_SPACE];
+};
+
+static struct rt_log_entry ring[RT_LOG_RING_SIZE];
+static _Atomic size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0;
+
+static _Atomic int logger_run = 0;
+static _Atomic uint64_t dropped_count = 0;
+static pthread_t logger_thread;
+
+
+static const char* parse_conversion(const char *spec, enum rt_log_arg_type *type);
+static void format_entry(const struct rt_log_entry *entry, char *message, size_t message_size);
+static int drain_ring();
+static void* logger_thread_main(void *arg);
+
+
+
+void rt_log(int level, const char *file, const char *func, long line, const char *format, ...) {
+  va_list ap;
+
+  // not started or already stopped: nothing time critical is running, log directly
+  if (!atomic_load_explicit(&logger_run, memory_order_acquire)) {
+    char message[RT_LOG_MESSAGE_SIZE];
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+    zlog(zlog_c, file, strlen(file), func, strlen(func), line, level, "%s", message);
+    return;
+  }
+
+  // claim an entry
+  struct rt_log_entry *entry;
+  size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+  for (;;) {
+    entry = &ring[pos & RT_LOG_RING_MASK];
+    size_t sequence = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      // ring full
+      atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+      return;
+    }
+    else {
+      pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    }
+  }
+
+  entry->level = level;
+  entry->file = file;
+  entry->func = func;
+  entry->line = line;
+  entry->format = format;
+
+  // walk the format pulling each argument off as its conversion says
+  int num_args = 0;
+  size_t strings_used = 0;
+  va_start(ap, format);
+  for (const char *f = format; *f != '\0' && num_args < RT_LOG_MAX_ARGS; ) {
+    if (*f++ != '%') {
+      continue;
+    }
+
+    enum rt_log_arg_type type;
+    f = parse_conversion(f, &type);
+    union rt_log_arg *arg = &entry->args[num_args];
+
+    switch (type) {
+    case ARG_INT:     arg->i = va_arg(ap, int); break;
+    case ARG_LONG:    arg->i = va_arg(ap, long); break;
+    case ARG_LLONG:   arg->i = va_arg(ap, long long); break;
+    case ARG_SIZE:    arg->i = va_arg(ap, size_t); break;
+    case ARG_INTMAX:  arg->i = va_arg(ap, intmax_t); break;
+    case ARG_PTRDIFF: arg->i = va_arg(ap, ptrdiff_t); break;
+    case ARG_DOUBLE:  arg->d = va_arg(ap, double); break;
+    case ARG_LDOUBLE: arg->d = va_arg(ap, long double); break;
+    case ARG_POINTER: arg->p = va_arg(ap, void*); break;
+    case ARG_STRING: {
+      // copy: the caller's buffer may not outlive the call
+      const char *s = va_arg(ap, const char*);
+      char *dest = &entry->strings[strings_used];
+      size_t space = RT_LOG_STRING_SPACE - strings_used;
+      if (s == NULL) {
+        s = "(null)";
+      }
+      if (space > 0) {
+        size_t len = strnlen(s, space - 1);
+        memcpy(dest, s, len);
+        dest[len] = '\0';
+        strings_used += len + 1;
+        arg->p = dest;
+      }
+      else {
+        arg->p = "";
+      }
+      break;
+    }
+    case ARG_PERCENT:
+      continue;
+    case ARG_UNSUPPORTED:
+      // formatter stops at the same spot
+      goto args_done;
+    }
+    ++num_args;
+  }
+ args_done:
+  va_end(ap);
+
+  atomic_store_explicit(&entry->sequence, pos + 1, memory_order_release);
+}
+
+
+
+int rt_log_start() {
+  for (size_t i = 0; i < RT_LOG_RING_SIZE; ++i) {
+    atomic_init(&ring[i].sequence, i);
+  }
+  atomic_store(&enqueue_pos, 0);
+  dequeue_pos = 0;
+
+  // explicitly SCHED_OTHER: don't inherit an RT policy from the creator
+  pthread_attr_t attr;
+  struct sched_param param = { .sched_priority = 0 };
+  pthread_attr_init(&attr);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+  pthread_attr_setschedparam(&attr, &param);
+
+  atomic_store_explicit(&logger_run, 1, memory_order_release);
+  if (pthread_create(&logger_thread, &attr, logger_thread_main, NULL)) {
+    atomic_store_explicit(&logger_run, 0, memory_order_release);
+    pthread_attr_destroy(&attr);
+    ERROR("rt_log: failed to start logger thread");
+    return -1;
+  }
+
+  pthread_attr_destroy(&attr);
+  INFO("rt_log: logger thread started");
+  return 0;
+}
+
+
+void rt_log_stop() {
+  if (!atomic_exchange(&logger_run, 0)) {
+    return;
+  }
+
+  pthread_join(logger_thread, NULL);
+
+  // anything a producer finished after the thread's last pass
+  drain_ring();
+
+  uint64_t dropped = atomic_load(&dropped_count);
+  if (dropped) {
+    WARN("rt_log: %" PRIu64 " messages dropped on ring overflow", dropped);
+  }
+}
+
+
+uint64_t rt_log_dropped_count() {
+  return atomic_load_explicit(&dropped_count, memory_order_relaxed);
+}
+
+
+int rt_log_get_thread(pthread_t *thread) {
+  if (!atomic_load_explicit(&logger_run, memory_order_acquire)) {
+    return -1;
+  }
+  *thread = logger_thread;
+  return 0;
+}
+
+
+
+static void* logger_thread_main(void *arg) {
+  const struct timespec drain_interval = { 0, RT_LOG_DRAIN_INTERVAL_NS };
+  uint64_t reported_dropped = 0;
+
+  while (atomic_load_explicit(&logger_run, memory_order_acquire)) {
+    drain_ring();
+
+    uint64_t dropped = atomic_load_explicit(&dropped_count, memory_order_relaxed);
+    if (dropped != reported_dropped) {
+      WARN("rt_log: ring overflow, %" PRIu64 " messages dropped", dropped - reported_dropped);
+      reported_dropped = dropped;
+    }
+
+    nanosleep(&drain_interval, NULL);
+  }
+
+  return NULL;
+}
+
+
+/** drain_ring
+ *
+ * single consumer: only the logger thread, or rt_log_stop once the
+ * thread is joined.  Returns number of entries written.
+ */
+static int drain_ring() {
+  char message[RT_LOG_MESSAGE_SIZE];
+  int drained = 0;
+
+  for (;;) {
+    struct rt_log_entry *entry = &ring[dequeue_pos & RT_LOG_RING_MASK];
+    size_t sequence = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(dequeue_pos + 1) < 0) {
+      break;  // empty, or producer not done filling in
+    }
+
+    format_entry(entry, message, sizeof(message));
+    zlog(zlog_c, entry->file, strlen(entry->file), entry->func, strlen(entry->func),
+         entry->line, entry->level, "%s", message);
+
+    // hand the entry back to producers for the next lap
+    atomic_store_explicit(&entry->sequence, dequeue_pos + RT_LOG_RING_SIZE, memory_order_release);
+    ++dequeue_pos;
+    ++drained;
+  }
+
+  return drained;
+}
+
+
+/** format_entry
+ *
+ * rebuild the message one conversion at a time, each printed with its
+ * original spec and the argument cast back to its original type.
+ */
+static void format_entry(const struct rt_log_entry *entry, char *message, size_t message_size) {
+  size_t used = 0;
+  int num_args = 0;
+  const char *f = entry->format;
+
+  message[0] = '\0';
+  while (*f != '\0' && used < message_size - 1) {
+    if (*f != '%') {
+      message[used++] = *f++;
+      continue;
+    }
+
+    const char *spec_start = f++;
+    enum rt_log_arg_type type;
+    f = parse_conversion(f, &type);
+
+    if (type == ARG_PERCENT) {
+      message[used++] = '%';
+      continue;
+    }
+    if (type == ARG_UNSUPPORTED || num_args == RT_LOG_MAX_ARGS) {
+      // emit the remainder verbatim
+      snprintf(message + used, message_size - used, "%s", spec_start);
+      used = strlen(message);
+      break;
+    }
+
+    char spec[32];
+    size_t spec_len = f - spec_start;
+    if (spec_len >= sizeof(spec)) {
+      spec_len = sizeof(spec) - 1;
+    }
+    memcpy(spec, spec_start, spec_len);
+    spec[spec_len] = '\0';
+
+    const union rt_log_arg *arg = &entry->args[num_args++];
+    char *dest = message + used;
+    size_t space = message_size - used;
+    int written = 0;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    switch (type) {
+    case ARG_INT:     written = snprintf(dest, space, spec, (int)arg->i); break;
+    case ARG_LONG:    written = snprintf(dest, space, spec, (long)arg->i); break;
+    case ARG_LLONG:   written = snprintf(dest, space, spec, (long long)arg->i); break;
+    case ARG_SIZE:    written = snprintf(dest, space, spec, (size_t)arg->i); break;
+    case ARG_INTMAX:  written = snprintf(dest, space, spec, (intmax_t)arg->i); break;
+    case ARG_PTRDIFF: written = snprintf(dest, space, spec, (ptrdiff_t)arg->i); break;
+    case ARG_DOUBLE:  written = snprintf(dest, space, spec, arg->d); break;
+    case ARG_LDOUBLE: written = snprintf(dest, space, spec, (long double)arg->d); break;
+    case ARG_STRING:
+    case ARG_POINTER: written = snprintf(dest, space, spec, arg->p); break;
+    default: break;
+    }
+#pragma GCC diagnostic pop
+
+    if (written < 0) {
+      break;
+    }
+    used += ((size_t)written < space) ? (size_t)written : space - 1;
+  }
+  message[used] = '\0';
+}
+
+
+/** parse_conversion
+ *
+ * spec points just past a '%'.  Figure out the argument type for the
+ * conversion and return a pointer just past it.  '*' width/precision
+ * and %n are unsupported.
+ */
+static const char* parse_conversion(const char *spec, enum rt_log_arg_type *type) {
+  enum { LEN_NONE, LEN_L, LEN_LL, LEN_Z, LEN_J, LEN_T, LEN_BIG_L } length = LEN_NONE;
+
+  if (*spec == '%') {
+    *type = ARG_PERCENT;
+    return spec + 1;
+  }
+
+  // flags, width, precision
+  while (*spec != '\0' && strchr("-+ #0123456789.'", *spec)) {
+    ++spec;
+  }
+
+  // length modifier
+  switch (*spec) {
+  case 'h':
+    ++spec;
+    if (*spec == 'h') {
+      ++spec;
+    }
+    break;
+  case 'l':
+    ++spec;
+    length = LEN_L;
+    if (*spec == 'l') {
+      ++spec;
+      length = LEN_LL;
+    }
+    break;
+  case 'q': ++spec; length = LEN_LL; break;
+  case 'z': ++spec; length = LEN_Z; break;
+  case 'j': ++spec; length = LEN_J; break;
+  case 't': ++spec; length = LEN_T; break;
+  case 'L': ++spec; length = LEN_BIG_L; break;
+  default: break;
+  }
+
+  switch (*spec) {
+  case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+    switch (length) {
+    case LEN_L:  *type = ARG_LONG; break;
+    case LEN_LL: *type = ARG_LLONG; break;
+    case LEN_Z:  *type = ARG_SIZE; break;
+    case LEN_J:  *type = ARG_INTMAX; break;
+    case LEN_T:  *type = ARG_PTRDIFF; break;
+    default:     *type = ARG_INT; break;
+    }
+    break;
+  case 'c':
+    *type = ARG_INT;
+    break;
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    *type = (length == LEN_BIG_L) ? ARG_LDOUBLE : ARG_DOUBLE;
+    break;
+  case 's':
+    *type = ARG_STRING;
+    break;
+  case 'p':
+    *type = ARG_POINTER;
+    break;
+  default:
+    *type = ARG_UNSUPPORTED;
+    return spec;
+  }
+
+  return spec + 1;
+}
@@ -41,6 +41,9 @@ struct spi_device {
 struct zhost {
     struct spi_device spi_devices[NUM_SPI_CHIP_SELECTS];
     int active_slot;
+    unsigned int sample_rate;
+    uint8_t card_roms[8][ZCARD_ROM_BYTES];
+    unsigned int card_rom_sizes[8];
 //    int spi_flags;
 //    int spi_handle;
 };
@@ -97,6 +100,8 @@ struct zhost* zhost_create() {
 
 
   zhost->active_slot = INITIAL_SLOT;
+  zhost->sample_rate = 0;
+  memset(zhost->card_rom_sizes, 0, sizeof(zhost->card_rom_sizes));
   for (int i = 0; i < NUM_SPI_CHIP_SELECTS; ++i) {
       zhost->spi_devices[i].spi_flags = INITIAL_SPI_FLAGS;
       if ((zhost->spi_devices[i].spi_handle = spiOpen(i, SPI_RATE, zhost->spi_devices[i].spi_flags)) < 0) {
@@ -144,5 +149,72 @@ int set_spi_interface(struct zhost *zhost, unsigned int spi_channel, unsigned in
 }
 
 
+unsigned int zhost_get_sample_rate(const struct zhost *zhost) {
+    return zhost->sample_rate;
+}
+
+
+void zhost_set_sample_rate(struct zhost *zhost, unsigned int sample_rate) {
+    zhost->sample_rate = sample_rate;
+}
+
+
+const uint8_t* zhost_get_card_rom(const struct zhost *zhost, int slot, unsigned int *size) {
+    if (slot < 0 || slot >= 8 || zhost->card_rom_sizes[slot] == 0) {
+        *size = 0;
+        return NULL;
+    }
+    *size = zhost->card_rom_sizes[slot];
+    return zhost->card_roms[slot];
+}
+
+
+void zhost_set_card_rom(struct zhost *zhost, int slot, const uint8_t *rom, unsigned int size) {
+    if (slot < 0 || slot >= 8) {
+        return;
+    }
+    if (size > ZCARD_ROM_BYTES) {
+        size = ZCARD_ROM_BYTES;
+    }
+    memcpy(zhost->card_roms[slot], rom, size);
+    zhost->card_rom_sizes[slot] = size;
+}
+
+
+int pca9555_apply_programs(int i2c_handle, uint8_t pca9555_port[2],
+                           const struct midi_program_to_gpio *table, size_t table_size,
+                           const uint8_t *program_numbers, size_t count) {
+  uint8_t port_reg[2] = { 0, 0 };
+  int dirty[2] = { 0, 0 };
+  int error = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (program_numbers[i] >= table_size) {
+      RT_WARN("pca9555: unexpected midi program number: 0x%X", program_numbers[i]);
+      continue;
+    }
+    const struct midi_program_to_gpio *entry = &table[ program_numbers[i] ];
+    pca9555_port[ entry->port ] |= entry->set_bits;
+    pca9555_port[ entry->port ] &= entry->clear_bits;
+    port_reg[ entry->port ] = entry->gpio_reg;
+    dirty[ entry->port ] = 1;
+  }
+
+  // the PCA9555 takes register pairs: port 1 follows port 0 in one write
+  if (dirty[0] && dirty[1] && port_reg[1] == port_reg[0] + 1) {
+    error = i2cWriteWordData(i2c_handle, port_reg[0], pca9555_port[0] | (pca9555_port[1] << 8));
+  }
+  else {
+    for (int port = 0; port < 2; ++port) {
+      if (dirty[port]) {
+        error += i2cWriteByteData(i2c_handle, port_reg[port], pca9555_port[port]);
+      }
+    }
+  }
+
+  return error;
+}
+
+
 const int gpio_id_by_slot[] = { 17, 27, 22, 23, 24, 25 };
 const int gpio_id_by_slot_size = sizeof(gpio_id_by_slot) / sizeof(int);
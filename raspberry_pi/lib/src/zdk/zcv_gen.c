@@ -0,0 +1,385 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* LFO, envelope and glide generators for cards, run per frame on the
+ * PCM thread.  All fixed point: no floats or libm on the RT path.
+ */
+
+#include <stdlib.h>
+
+#include "zcv_gen.h"
+
+// envelope level full scale, and the fraction bits kept on glide values
+#define ENV_FULL (1 << 24)
+#define GLIDE_SHIFT 8
+#define SAMPLE_MAX 32767
+
+#define MIDI_NOTE_OFF 0x80
+#define MIDI_NOTE_ON 0x90
+#define MIDI_CONTROLLER_CHANGE 0xB0
+#define CC_ALL_NOTES_OFF 123
+
+static const uint16_t default_params[ZCV_GEN_NUM_PARAMS] = {
+  [ZCV_GEN_PARAM_TYPE] = ZCV_GEN_OFF,
+  [ZCV_GEN_PARAM_CHANNEL] = ZCV_GEN_NO_CHANNEL,
+  [ZCV_GEN_PARAM_SHAPE] = ZCV_GEN_SINE,
+  [ZCV_GEN_PARAM_RATE] = 100,
+  [ZCV_GEN_PARAM_DEPTH] = 16383,
+  [ZCV_GEN_PARAM_ATTACK] = 10,
+  [ZCV_GEN_PARAM_DECAY] = 200,
+  [ZCV_GEN_PARAM_SUSTAIN] = 16383,
+  [ZCV_GEN_PARAM_RELEASE] = 200,
+  [ZCV_GEN_PARAM_GLIDE_TIME] = 100,
+  [ZCV_GEN_PARAM_TARGET] = 0
+};
+
+static void set_param(struct zcv_gen_bank *bank, const uint8_t *param_message);
+static void set_gates(struct zcv_gen_bank *bank, int gate);
+static void apply_params(struct zcv_gen_bank *bank, struct zcv_generator *gen);
+static int32_t lfo_step(struct zcv_generator *gen);
+static int32_t env_step(struct zcv_generator *gen);
+static int32_t glide_step(struct zcv_generator *gen);
+
+
+
+struct zcv_gen_bank* zcv_gen_create(struct zhost *zhost, int num_channels) {
+  struct zcv_gen_bank *bank = calloc(1, sizeof(struct zcv_gen_bank));
+
+  if (bank == NULL) {
+    return NULL;
+  }
+
+  bank->zhost = zhost;
+  bank->num_channels = num_channels < ZCV_GEN_MAX_CHANNELS ? num_channels : ZCV_GEN_MAX_CHANNELS;
+
+  for (int g = 0; g < ZCV_GEN_MAX_GENERATORS; ++g) {
+    struct zcv_generator *gen = &bank->generators[g];
+    for (int p = 0; p < ZCV_GEN_NUM_PARAMS; ++p) {
+      atomic_init(&gen->params[p], default_params[p]);
+    }
+    atomic_init(&gen->dirty, 1);
+    atomic_init(&gen->gate, 0);
+    atomic_init(&gen->triggers, 0);
+    gen->channel = ZCV_GEN_NO_CHANNEL;
+  }
+
+  return bank;
+}
+
+
+void zcv_gen_free(struct zcv_gen_bank *bank) {
+  free(bank);
+}
+
+
+
+int zcv_gen_process_midi(struct zcv_gen_bank *bank, const uint8_t *midi_message, size_t size) {
+  if (bank == NULL || size < 3) {
+    return 0;
+  }
+
+  // the daemon assembles NRPN data entry
+  if (midi_message[0] == ZMIDI_PARAM) {
+    if (size == ZMIDI_PARAM_SIZE && midi_message[1] == ZMIDI_PARAM_NRPN) {
+      set_param(bank, midi_message);
+    }
+    return 0;
+  }
+
+  switch (midi_message[0] & 0xF0) {
+  case MIDI_NOTE_ON:
+    set_gates(bank, midi_message[2] != 0);
+    break;
+  case MIDI_NOTE_OFF:
+    set_gates(bank, 0);
+    break;
+  case MIDI_CONTROLLER_CHANGE:
+    if (midi_message[1] == CC_ALL_NOTES_OFF) {
+      set_gates(bank, 0);
+    }
+    break;
+  }
+
+  return 0;
+}
+
+
+
+const int16_t* zcv_gen_process(struct zcv_gen_bank *bank, const int16_t *samples) {
+  unsigned int sample_rate;
+  int active = 0;
+
+  if (bank == NULL) {
+    return samples;
+  }
+
+  sample_rate = zhost_get_sample_rate(bank->zhost);
+  if (sample_rate == 0) {
+    return samples;
+  }
+  if (sample_rate != bank->sample_rate) {
+    bank->sample_rate = sample_rate;
+    for (int g = 0; g < ZCV_GEN_MAX_GENERATORS; ++g) {
+      atomic_store_explicit(&bank->generators[g].dirty, 1, memory_order_relaxed);
+    }
+  }
+
+  for (int g = 0; g < ZCV_GEN_MAX_GENERATORS; ++g) {
+    struct zcv_generator *gen = &bank->generators[g];
+    if (atomic_exchange_explicit(&gen->dirty, 0, memory_order_acquire)) {
+      apply_params(bank, gen);
+    }
+    if (gen->type == ZCV_GEN_OFF) {
+      // notes while off don't count once it's turned on
+      gen->triggers_seen = atomic_load_explicit(&gen->triggers, memory_order_relaxed);
+    }
+    else if (gen->channel < bank->num_channels) {
+      active = 1;
+    }
+  }
+
+  // nothing to do: skip the copy and keep writing what came in
+  bank->active = active;
+  if (!active) {
+    return samples;
+  }
+
+  for (int channel = 0; channel < bank->num_channels; ++channel) {
+    bank->samples[channel] = samples[channel];
+  }
+
+  for (int g = 0; g < ZCV_GEN_MAX_GENERATORS; ++g) {
+    struct zcv_generator *gen = &bank->generators[g];
+    int32_t value;
+
+    if (gen->type == ZCV_GEN_OFF || gen->channel >= bank->num_channels) {
+      continue;
+    }
+
+    switch (gen->type) {
+    case ZCV_GEN_LFO:
+      value = bank->samples[gen->channel] + lfo_step(gen);
+      break;
+    case ZCV_GEN_ENV_AD:
+    case ZCV_GEN_ENV_ADSR:
+      value = bank->samples[gen->channel] + env_step(gen);
+      break;
+    case ZCV_GEN_GLIDE:
+      value = glide_step(gen);
+      break;
+    default:
+      continue;
+    }
+
+    if (value < 0) {
+      value = 0;
+    }
+    else if (value > SAMPLE_MAX) {
+      value = SAMPLE_MAX;
+    }
+    bank->samples[gen->channel] = (int16_t)value;
+  }
+
+  return bank->samples;
+}
+
+
+
+/** set_param
+ * store an NRPN value, if the number is one of ours: MSB generator,
+ * LSB parameter
+ */
+static void set_param(struct zcv_gen_bank *bank, const uint8_t *param_message) {
+  uint8_t generator = param_message[2];
+  uint8_t param = param_message[3];
+  uint16_t value = ((uint16_t)param_message[4] << 7) | param_message[5];
+
+  if (generator >= ZCV_GEN_MAX_GENERATORS || param >= ZCV_GEN_NUM_PARAMS) {
+    return;
+  }
+
+  struct zcv_generator *gen = &bank->generators[generator];
+  atomic_store_explicit(&gen->params[param], value, memory_order_relaxed);
+  atomic_store_explicit(&gen->dirty, 1, memory_order_release);
+}
+
+
+static void set_gates(struct zcv_gen_bank *bank, int gate) {
+  for (int g = 0; g < ZCV_GEN_MAX_GENERATORS; ++g) {
+    struct zcv_generator *gen = &bank->generators[g];
+    if (gate) {
+      atomic_fetch_add_explicit(&gen->triggers, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&gen->gate, gate, memory_order_relaxed);
+  }
+}
+
+
+/** frames_for_ms
+ * at least one, so a zero time is an immediate step
+ */
+static int32_t frames_for_ms(const struct zcv_gen_bank *bank, uint16_t ms) {
+  uint64_t frames = (uint64_t)ms * bank->sample_rate / 1000;
+  return frames > 0 ? (int32_t)frames : 1;
+}
+
+
+/** apply_params
+ * pick up the MIDI side's parameters and work out per frame increments
+ */
+static void apply_params(struct zcv_gen_bank *bank, struct zcv_generator *gen) {
+  uint16_t params[ZCV_GEN_NUM_PARAMS];
+  int previous_type = gen->type;
+
+  for (int p = 0; p < ZCV_GEN_NUM_PARAMS; ++p) {
+    params[p] = atomic_load_explicit(&gen->params[p], memory_order_relaxed);
+  }
+
+  gen->type = params[ZCV_GEN_PARAM_TYPE] <= ZCV_GEN_GLIDE ? params[ZCV_GEN_PARAM_TYPE] : ZCV_GEN_OFF;
+  gen->channel = params[ZCV_GEN_PARAM_CHANNEL];
+  gen->shape = params[ZCV_GEN_PARAM_SHAPE];
+  gen->depth = params[ZCV_GEN_PARAM_DEPTH];
+
+  // rate is in 0.01 Hz: phase_inc is the fraction of 2^32 per frame
+  gen->phase_inc = (uint32_t)(((uint64_t)params[ZCV_GEN_PARAM_RATE] << 32) /
+                              (100ULL * bank->sample_rate));
+
+  gen->attack_inc = ENV_FULL / frames_for_ms(bank, params[ZCV_GEN_PARAM_ATTACK]);
+  gen->decay_inc = ENV_FULL / frames_for_ms(bank, params[ZCV_GEN_PARAM_DECAY]);
+  gen->release_inc = ENV_FULL / frames_for_ms(bank, params[ZCV_GEN_PARAM_RELEASE]);
+  gen->sustain_level = (int32_t)params[ZCV_GEN_PARAM_SUSTAIN] << 10;
+
+  gen->glide_inc = (SAMPLE_MAX << GLIDE_SHIFT) / frames_for_ms(bank, params[ZCV_GEN_PARAM_GLIDE_TIME]);
+  if (gen->glide_inc < 1) {
+    gen->glide_inc = 1;
+  }
+  gen->glide_target = ((int32_t)params[ZCV_GEN_PARAM_TARGET] << 1) << GLIDE_SHIFT;
+
+  // a generator changing type starts fresh
+  if (gen->type != previous_type) {
+    gen->phase = 0;
+    gen->stage = ZCV_ENV_IDLE;
+    gen->level = 0;
+    gen->glide_started = 0;
+  }
+}
+
+
+/** lfo_step
+ * bipolar wave scaled by depth.  The sine is a parabola pieced from the
+ * saw, within a percent or so of the real thing.
+ */
+static int32_t lfo_step(struct zcv_generator *gen) {
+  int32_t saw = (int32_t)(gen->phase >> 16) - 32768;
+  int32_t wave;
+
+  gen->phase += gen->phase_inc;
+
+  switch (gen->shape) {
+  case ZCV_GEN_TRIANGLE:
+    wave = saw < 0 ? 2 * saw + 32767 : 32767 - 2 * saw;
+    break;
+  case ZCV_GEN_SAW:
+    wave = saw;
+    break;
+  case ZCV_GEN_SQUARE:
+    wave = saw < 0 ? 32767 : -32768;
+    break;
+  case ZCV_GEN_SINE:
+  default:
+    wave = -((saw * (32768 - (saw < 0 ? -saw : saw))) >> 13);
+    break;
+  }
+
+  return (wave * gen->depth) >> 14;
+}
+
+
+/** env_step
+ * linear segments.  A trigger restarts the attack from wherever the
+ * level is; AD envelopes run through regardless of the gate.
+ */
+static int32_t env_step(struct zcv_generator *gen) {
+  uint32_t triggers = atomic_load_explicit(&gen->triggers, memory_order_relaxed);
+  int gate = atomic_load_explicit(&gen->gate, memory_order_relaxed);
+
+  if (triggers != gen->triggers_seen) {
+    gen->triggers_seen = triggers;
+    gen->stage = ZCV_ENV_ATTACK;
+  }
+  else if (!gate && gen->type == ZCV_GEN_ENV_ADSR &&
+           gen->stage != ZCV_ENV_IDLE && gen->stage != ZCV_ENV_RELEASE) {
+    gen->stage = ZCV_ENV_RELEASE;
+  }
+
+  switch (gen->stage) {
+  case ZCV_ENV_ATTACK:
+    gen->level += gen->attack_inc;
+    if (gen->level >= ENV_FULL) {
+      gen->level = ENV_FULL;
+      gen->stage = ZCV_ENV_DECAY;
+    }
+    break;
+  case ZCV_ENV_DECAY: {
+    int32_t floor = gen->type == ZCV_GEN_ENV_ADSR ? gen->sustain_level : 0;
+    gen->level -= gen->decay_inc;
+    if (gen->level <= floor) {
+      gen->level = floor;
+      gen->stage = gen->type == ZCV_GEN_ENV_ADSR ? ZCV_ENV_SUSTAIN : ZCV_ENV_IDLE;
+    }
+    break;
+  }
+  case ZCV_ENV_SUSTAIN:
+    gen->level = gen->sustain_level;
+    break;
+  case ZCV_ENV_RELEASE:
+    gen->level -= gen->release_inc;
+    if (gen->level <= 0) {
+      gen->level = 0;
+      gen->stage = ZCV_ENV_IDLE;
+    }
+    break;
+  case ZCV_ENV_IDLE:
+  default:
+    break;
+  }
+
+  return ((gen->level >> 9) * gen->depth) >> 14;
+}
+
+
+/** glide_step
+ * slew toward the target at a fixed rate; the first value jumps there
+ */
+static int32_t glide_step(struct zcv_generator *gen) {
+  if (!gen->glide_started) {
+    gen->glide_value = gen->glide_target;
+    gen->glide_started = 1;
+  }
+  else if (gen->glide_value < gen->glide_target) {
+    gen->glide_value += gen->glide_inc;
+    if (gen->glide_value > gen->glide_target) {
+      gen->glide_value = gen->glide_target;
+    }
+  }
+  else if (gen->glide_value > gen->glide_target) {
+    gen->glide_value -= gen->glide_inc;
+    if (gen->glide_value < gen->glide_target) {
+      gen->glide_value = gen->glide_target;
+    }
+  }
+
+  return gen->glide_value >> GLIDE_SHIFT;
+}
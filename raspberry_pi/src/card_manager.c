@@ -21,7 +21,9 @@
 #include <dlfcn.h>
 #include <libconfig.h>
 #include <pigpio.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "zoxnoxiousd.h"
 #include "card_manager.h"
@@ -30,6 +32,27 @@
 // config keys
 #define CARD_MANAGER_KEY_NAME_PREFIX "card_manager."
 static const char *config_lookup_eeprom_base_i2c_address = CARD_MANAGER_KEY_NAME_PREFIX "eeprom_base_i2c_address";
+static const char *config_lookup_rom_cache_path = CARD_MANAGER_KEY_NAME_PREFIX "rom_cache_path";
+
+// card ROMs from the last discovery.  Not tmpfs: it's for the next boot.
+#define DEFAULT_ROM_CACHE_PATH "/var/tmp/zoxnoxiousd.roms"
+#define ROM_CACHE_MAGIC 0x5a524f4dU  // "ZROM"
+#define ROM_CACHE_VERSION 2
+
+struct rom_cache {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t rom_sizes[MAX_SLOTS];
+  uint32_t rom_checksums[MAX_SLOTS];
+  uint8_t roms[MAX_SLOTS][ZCARD_ROM_BYTES];
+};
+
+static const char* rom_cache_path(config_t *cfg);
+static void load_rom_cache(const char *path, struct rom_cache *cache);
+static void save_rom_cache(const char *path, const struct card_manager *card_mgr);
+static uint32_t rom_checksum(const uint8_t *rom, unsigned int size);
+static int rom_cache_matches(const struct rom_cache *cache, int slot_num,
+                             const uint8_t *rom, unsigned int size);
 
 
 // symbols to load from the dynamic library
@@ -40,10 +63,13 @@ static const char *config_lookup_eeprom_base_i2c_address = CARD_MANAGER_KEY_NAME
 #define PROCESS_SAMPLES "process_samples"
 #define PROCESS_MIDI "process_midi"
 #define PROCESS_MIDI_PROGRAM_CHANGE "process_midi_program_change"
+#define PROCESS_MIDI_PROGRAM_CHANGES "process_midi_program_changes"
 #define TUNEREQ_SAVE_STATE "tunereq_save_state"
 #define TUNEREQ_SET_POINT "tunereq_set_point"
 #define TUNEREQ_MEASUREMENT "tunereq_measurement"
 #define TUNEREQ_RESTORE_STATE "tunereq_restore_state"
+#define CHECKPOINT_ZCARD "checkpoint_zcard"
+#define RESUME_ZCARD "resume_zcard"
 
 
 // uninitialized memory on the EEPROM comes back with this value
@@ -61,6 +87,9 @@ struct card_manager* init_card_manager(config_t *cfg) {
   }
 
   mgr->cfg = cfg;
+  for (int dev = 0; dev < MAX_PCM_DEVICES; ++dev) {
+    mgr->tdm_sync_channel[dev] = TDM_NO_SYNC_CHANNEL;
+  }
   return mgr;
 }
 
@@ -78,6 +107,8 @@ void free_card_manager(struct card_manager *card_mgr) {
         INFO("called free_zcard %d slot %d", card_num, card_mgr->cards[card_num].slot);
       }
 
+      free(card_mgr->cards[card_num].tdm_samples);
+
       // close dl lib plugin
       if (card_mgr->cards[card_num].dl_plugin_lib) {
         dlclose(card_mgr->cards[card_num].dl_plugin_lib);
@@ -123,8 +154,15 @@ int discover_cards(struct card_manager *card_mgr) {
   return 0;
 #endif
 
+  const char *cache_path = rom_cache_path(card_mgr->cfg);
+  struct rom_cache cache;
+  int cache_hits = 0;
+  int cache_dirty = 0;
+  load_rom_cache(cache_path, &cache);
+
   for (int slot_num = 0; slot_num < MAX_SLOTS; ++slot_num) {
     i2c_handle = i2cOpen(1, i2c_base_address + slot_num, 0);
+    card_mgr->card_rom_sizes[slot_num] = 0;
 
     if (i2c_handle >= 0) {
       // this needs to be a 32 bit type, not 8 bit
@@ -146,6 +184,23 @@ int discover_cards(struct card_manager *card_mgr) {
         INFO("Found card in slot %d (I2C 0x%x) with id 0x%x",
              slot_num, i2c_base_address + slot_num, i2c_read);
         card_mgr->num_cards++;
+
+        // the whole ROM in one block read: a card re-calibrated or
+        // swapped for another of the same type keeps its header, so
+        // nothing short of the full contents says the cache is current
+        int rom_read = i2cReadI2CBlockData(i2c_handle, 0, (char*)card_mgr->card_roms[slot_num], ZCARD_ROM_BYTES);
+        if (rom_read > 0 && card_mgr->card_roms[slot_num][0] == i2c_read) {
+          card_mgr->card_rom_sizes[slot_num] = rom_read;
+          if (rom_cache_matches(&cache, slot_num, card_mgr->card_roms[slot_num], rom_read)) {
+            cache_hits++;
+          }
+          else {
+            cache_dirty = 1;
+          }
+        }
+        else {
+          WARN("slot %d ROM read failed (%d)", slot_num, rom_read);
+        }
       }
       card_mgr->card_ids[slot_num] = i2c_read;
 
@@ -156,15 +211,132 @@ int discover_cards(struct card_manager *card_mgr) {
       card_mgr->card_ids[slot_num] = 0;
     }
 
+    if (card_mgr->card_rom_sizes[slot_num] != cache.rom_sizes[slot_num]) {
+      cache_dirty = 1;
+    }
+
     i2cClose(i2c_handle);
   }
 
+  INFO("card ROMs: %d unchanged since the cache was saved", cache_hits);
+  if (cache_dirty && cache_path) {
+    save_rom_cache(cache_path, card_mgr);
+  }
+
   INFO("found %d cards", card_mgr->num_cards);
   return 0;
 }
 
 
 
+/** rom_cache_path
+ *
+ * configured path, the default if unset, NULL if set empty (disabled)
+ */
+static const char* rom_cache_path(config_t *cfg) {
+  const char *path = DEFAULT_ROM_CACHE_PATH;
+
+  config_lookup_string(cfg, config_lookup_rom_cache_path, &path);
+  return path[0] != '\0' ? path : NULL;
+}
+
+
+/** load_rom_cache
+ *
+ * cache as saved, or all sizes zero if there isn't a good one.  A slot
+ * whose contents don't match its checksum is dropped.
+ */
+static void load_rom_cache(const char *path, struct rom_cache *cache) {
+  FILE *file;
+  int valid = 0;
+
+  if (path && (file = fopen(path, "r")) != NULL) {
+    valid = fread(cache, sizeof(struct rom_cache), 1, file) == 1 &&
+      cache->magic == ROM_CACHE_MAGIC &&
+      cache->version == ROM_CACHE_VERSION;
+    fclose(file);
+  }
+
+  if (valid) {
+    for (int slot_num = 0; slot_num < MAX_SLOTS; ++slot_num) {
+      if (cache->rom_sizes[slot_num] > ZCARD_ROM_BYTES) {
+        valid = 0;
+      }
+      else if (cache->rom_checksums[slot_num] !=
+               rom_checksum(cache->roms[slot_num], cache->rom_sizes[slot_num])) {
+        WARN("ROM cache: slot %d checksum mismatch, reading the ROM", slot_num);
+        cache->rom_sizes[slot_num] = 0;
+      }
+    }
+  }
+
+  if (!valid) {
+    memset(cache, 0, sizeof(struct rom_cache));
+  }
+}
+
+
+/** rom_cache_matches
+ *
+ * true if the ROM as read is byte for byte the cached copy.
+ */
+static int rom_cache_matches(const struct rom_cache *cache, int slot_num,
+                             const uint8_t *rom, unsigned int size) {
+  return cache->rom_sizes[slot_num] == size &&
+    memcmp(cache->roms[slot_num], rom, size) == 0;
+}
+
+
+/** rom_checksum
+ *
+ * FNV-1a over the ROM bytes, for the cache file.
+ */
+static uint32_t rom_checksum(const uint8_t *rom, unsigned int size) {
+  uint32_t hash = 2166136261U;
+  for (unsigned int i = 0; i < size; ++i) {
+    hash = (hash ^ rom[i]) * 16777619U;
+  }
+  return hash;
+}
+
+
+/** save_rom_cache
+ *
+ * this discovery's ROMs, written aside and renamed into place
+ */
+static void save_rom_cache(const char *path, const struct card_manager *card_mgr) {
+  char tmp_path[256];
+  struct rom_cache cache = {
+    .magic = ROM_CACHE_MAGIC,
+    .version = ROM_CACHE_VERSION
+  };
+  FILE *file;
+  int error;
+
+  memcpy(cache.roms, card_mgr->card_roms, sizeof(cache.roms));
+  for (int slot_num = 0; slot_num < MAX_SLOTS; ++slot_num) {
+    cache.rom_sizes[slot_num] = card_mgr->card_rom_sizes[slot_num];
+    cache.rom_checksums[slot_num] = rom_checksum(cache.roms[slot_num], cache.rom_sizes[slot_num]);
+  }
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  if ( (file = fopen(tmp_path, "w")) == NULL ) {
+    WARN("can't write ROM cache %s", tmp_path);
+    return;
+  }
+  error = fwrite(&cache, sizeof(cache), 1, file) != 1;
+  error |= fclose(file) != 0;
+
+  if (error || rename(tmp_path, path) != 0) {
+    WARN("failed writing ROM cache %s", path);
+    remove(tmp_path);
+    return;
+  }
+  INFO("card ROMs cached to %s", path);
+}
+
+
+
 #define KEY_NAME_LENGTH 32
 
 int load_card_plugins(struct card_manager *card_mgr) {
@@ -183,6 +355,7 @@ int load_card_plugins(struct card_manager *card_mgr) {
       card->slot = slot_num;
       // card_id ends up getting stored twice
       card->card_id = card_mgr->card_ids[slot_num];
+      card->tune_result = CARD_NOT_TUNED;
       
       snprintf(key_name, KEY_NAME_LENGTH, CARD_MANAGER_KEY_NAME_PREFIX "plugin_ids.*%d", card_mgr->card_ids[slot_num]);
 
@@ -243,6 +416,12 @@ int load_card_plugins(struct card_manager *card_mgr) {
         return 1;
       }
 
+      // optional: without it Card State is applied a program at a time
+      card->process_midi_program_changes = dlsym(card->dl_plugin_lib, PROCESS_MIDI_PROGRAM_CHANGES);
+      if (card->process_midi_program_changes == NULL) {
+        INFO("no " PROCESS_MIDI_PROGRAM_CHANGES " for slot %d, card state applied per program", slot_num);
+      }
+
       card->tunereq_save_state = dlsym(card->dl_plugin_lib, TUNEREQ_SAVE_STATE);
       if (card->tunereq_save_state == NULL) {
         ERROR("failed find symbol " TUNEREQ_SAVE_STATE ", %s", dlerror());
@@ -267,6 +446,15 @@ int load_card_plugins(struct card_manager *card_mgr) {
         return 1;
       }
 
+      // optional: without both the card always starts cold from init_zcard
+      card->checkpoint_zcard = dlsym(card->dl_plugin_lib, CHECKPOINT_ZCARD);
+      card->resume_zcard = dlsym(card->dl_plugin_lib, RESUME_ZCARD);
+      if (card->checkpoint_zcard == NULL || card->resume_zcard == NULL) {
+        INFO("no " CHECKPOINT_ZCARD "/" RESUME_ZCARD " for slot %d, no warm restart", slot_num);
+        card->checkpoint_zcard = NULL;
+        card->resume_zcard = NULL;
+      }
+
       card->plugin_name = (*get_plugin_name)();
       INFO("loaded plugin for %s", card->plugin_name);
     }
@@ -319,6 +507,11 @@ void assign_update_order(struct card_manager *card_mgr) {
     cards[i].spi_mode = zcard_props->spi_mode;
     cards[i].num_channels = zcard_props->num_channels;
     card_mgr->cards[i].num_channels = zcard_props->num_channels; // refactor to just use this
+    card_mgr->cards[i].slow_channel_mask = zcard_props->slow_channel_mask;
+    if (zcard_props->num_channels < 32) {
+      card_mgr->cards[i].slow_channel_mask &= (1u << zcard_props->num_channels) - 1;
+    }
+    card_mgr->cards[i].num_slow_channels = __builtin_popcount(card_mgr->cards[i].slow_channel_mask);
     cards[i].card = &card_mgr->cards[i];
     free(zcard_props);
   }
@@ -348,26 +541,63 @@ void assign_hw_audio_channels(struct card_manager *card_mgr, int *channels, int
   int card_idx, bin_num;
 
   for (card_idx = 0; card_idx < card_mgr->num_cards; ++card_idx) {
-    for (bin_num = 0; bin_num < num_devices; ++bin_num) {
-      if (bin_current_index[bin_num] + card_mgr->card_update_order[card_idx]->num_channels <= channels[bin_num]) {
+    struct plugin_card *card = card_mgr->card_update_order[card_idx];
+    int num_fast = card->num_channels - card->num_slow_channels;
+
+    for (bin_num = 0; bin_num < num_devices && bin_num < MAX_PCM_DEVICES; ++bin_num) {
+      // slow channels need the sync channel plus enough lanes at the top
+      int num_slow = card_mgr->tdm_num_slow[bin_num] + card->num_slow_channels;
+      int tdm_reserved = num_slow ? 1 + tdm_num_lanes(num_slow) : 0;
+
+      if (bin_current_index[bin_num] + num_fast + tdm_reserved <= channels[bin_num]) {
         // store current pcm device (bin_num) as where control voltages come from.
         // store the offset to the channels there too.
-        card_mgr->card_update_order[card_idx]->pcm_device_num = bin_num;
-        card_mgr->card_update_order[card_idx]->channel_offset = bin_current_index[bin_num];
-        bin_current_index[bin_num] += card_mgr->card_update_order[card_idx]->num_channels;
-        INFO("allocated %d channels on dev %d for %s at start %d (new idx %d)",
-             card_mgr->card_update_order[card_idx]->num_channels,
-             bin_num, card_mgr->card_update_order[card_idx]->plugin_name,
-             card_mgr->card_update_order[card_idx]->channel_offset,
-             bin_current_index[bin_num]);
+        card->pcm_device_num = bin_num;
+        card->channel_offset = bin_current_index[bin_num];
+        card->tdm_base = card_mgr->tdm_num_slow[bin_num];
+        bin_current_index[bin_num] += num_fast;
+        card_mgr->tdm_num_slow[bin_num] = num_slow;
+        INFO("allocated %d channels on dev %d for %s at start %d (new idx %d), %d slow at tdm index %d",
+             num_fast, bin_num, card->plugin_name, card->channel_offset,
+             bin_current_index[bin_num], card->num_slow_channels, card->tdm_base);
+
+        if (card->num_slow_channels) {
+          card->tdm_samples = (int16_t*)calloc(card->num_channels, sizeof(int16_t));
+        }
         break;
       }
     }
     if (bin_num == num_devices) {
-      INFO("unable to find an allocation for %d %s", card_idx, card_mgr->card_update_order[card_idx]->plugin_name);
+      INFO("unable to find an allocation for %d %s", card_idx, card->plugin_name);
     }
   }
 
+  for (bin_num = 0; bin_num < num_devices && bin_num < MAX_PCM_DEVICES; ++bin_num) {
+    if (card_mgr->tdm_num_slow[bin_num]) {
+      card_mgr->tdm_sync_channel[bin_num] = channels[bin_num] - 1;
+      INFO("dev %d: %d slow channels multiplexed, sync on channel %d", bin_num,
+           card_mgr->tdm_num_slow[bin_num], card_mgr->tdm_sync_channel[bin_num]);
+    }
+  }
+
+  // latency marker: the highest channel on dev 0 below any TDM lanes
+  int marker_channel = channels[0] - 1;
+  if (card_mgr->tdm_num_slow[0]) {
+    marker_channel -= 1 + tdm_num_lanes(card_mgr->tdm_num_slow[0]);
+  }
+  card_mgr->latency_marker_channel = marker_channel >= bin_current_index[0] ?
+    marker_channel : LATENCY_NO_MARKER_CHANNEL;
+  INFO("dev 0: latency marker on channel %d", card_mgr->latency_marker_channel);
 
   free(bin_current_index);
 }
+
+
+
+const int16_t* tdm_demux_card_samples(struct card_manager *card_mgr, struct plugin_card *card,
+                                      const char **device_samples) {
+  tdm_demux(device_samples, card_mgr->tdm_sync_channel[card->pcm_device_num],
+            card->slow_channel_mask, card->num_channels,
+            card->channel_offset, card->tdm_base, card->tdm_samples);
+  return card->tdm_samples;
+}
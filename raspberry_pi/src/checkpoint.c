@@ -0,0 +1,307 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* card state checkpoint for a warm restart of the daemon: the cards
+ * keep running on their last expander and DAC values while the daemon
+ * is down, so the next one resumes them instead of resetting them.
+ * Written on a clean stop, and periodically while running so a crash
+ * leaves one too.
+ *
+ * File layout, native endianness (it never leaves the Pi):
+ *   header
+ *   then num_cards times: card header, size bytes of card data
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "zoxnoxiousd.h"
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAGIC 0x5a43504bU  // "ZCPK"
+#define CHECKPOINT_VERSION 1
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+#define BOOT_ID_LENGTH 40
+
+struct checkpoint_file_header {
+  uint32_t magic;
+  uint32_t version;
+  char boot_id[BOOT_ID_LENGTH];
+  int32_t num_cards;
+};
+
+struct checkpoint_file_card {
+  int32_t slot;
+  int32_t card_id;
+  int32_t tune_result;
+  uint32_t size;
+};
+
+
+static const char* checkpoint_path(config_t *cfg);
+static void read_boot_id(char boot_id[BOOT_ID_LENGTH]);
+
+
+
+int checkpoint_save(config_t *cfg, const struct card_manager *card_mgr) {
+  struct checkpoint *checkpoint;
+  int result;
+
+  if (checkpoint_path(cfg) == NULL) {
+    return 0;
+  }
+  if ( (checkpoint = checkpoint_create(card_mgr)) == NULL ) {
+    return -1;
+  }
+
+  for (int i = 0; i < checkpoint->num_cards; ++i) {
+    checkpoint_capture_card(checkpoint, card_mgr, i);
+    if (checkpoint->cards[i].size == 0 && card_mgr->cards[i].checkpoint_zcard) {
+      WARN("checkpoint: slot %d has no checkpoint, it'll start cold", card_mgr->cards[i].slot);
+    }
+  }
+
+  if ( (result = checkpoint_write(cfg, checkpoint)) == 0 ) {
+    INFO("checkpoint: cards saved to %s", checkpoint_path(cfg));
+  }
+  free_checkpoint(checkpoint);
+  return result;
+}
+
+
+
+struct checkpoint* checkpoint_create(const struct card_manager *card_mgr) {
+  struct checkpoint *checkpoint;
+
+  if ( (checkpoint = calloc(1, sizeof(struct checkpoint))) == NULL ) {
+    return NULL;
+  }
+  for (int i = 0; i < card_mgr->num_cards; ++i) {
+    if ( (checkpoint->cards[i].data = malloc(CHECKPOINT_MAX_CARD_BYTES)) == NULL ) {
+      free_checkpoint(checkpoint);
+      return NULL;
+    }
+    // counted as they're allocated so free_checkpoint sees them
+    checkpoint->num_cards = i + 1;
+  }
+  return checkpoint;
+}
+
+
+
+void checkpoint_capture_card(struct checkpoint *checkpoint, const struct card_manager *card_mgr, int card_num) {
+  const struct plugin_card *card = &card_mgr->cards[card_num];
+  struct checkpoint_card *captured = &checkpoint->cards[card_num];
+
+  captured->slot = card->slot;
+  captured->card_id = card->card_id;
+  captured->tune_result = card->tune_result;
+  captured->size = 0;
+  if (card->checkpoint_zcard && card->plugin_object) {
+    captured->size = card->checkpoint_zcard(card->plugin_object, captured->data, CHECKPOINT_MAX_CARD_BYTES);
+  }
+}
+
+
+
+int checkpoint_write(config_t *cfg, const struct checkpoint *checkpoint) {
+  const char *path = checkpoint_path(cfg);
+  char tmp_path[PATH_MAX];
+  struct checkpoint_file_header header = {
+    .magic = CHECKPOINT_MAGIC,
+    .version = CHECKPOINT_VERSION,
+    .num_cards = 0
+  };
+  FILE *file;
+  int error = 0;
+
+  if (path == NULL) {
+    return 0;
+  }
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  if ( (file = fopen(tmp_path, "w")) == NULL ) {
+    ERROR("checkpoint: can't open %s: %s", tmp_path, strerror(errno));
+    return -1;
+  }
+
+  // header is rewritten with the card count at the end
+  read_boot_id(header.boot_id);
+  error |= fwrite(&header, sizeof(header), 1, file) != 1;
+
+  for (int i = 0; i < checkpoint->num_cards; ++i) {
+    const struct checkpoint_card *card = &checkpoint->cards[i];
+    if (card->size == 0) {
+      continue;
+    }
+
+    struct checkpoint_file_card card_header = {
+      .slot = card->slot,
+      .card_id = card->card_id,
+      .tune_result = card->tune_result,
+      .size = card->size
+    };
+    error |= fwrite(&card_header, sizeof(card_header), 1, file) != 1;
+    error |= fwrite(card->data, card->size, 1, file) != 1;
+    ++header.num_cards;
+  }
+
+  error |= fseek(file, 0, SEEK_SET) != 0;
+  error |= fwrite(&header, sizeof(header), 1, file) != 1;
+  error |= fclose(file) != 0;
+
+  if (error || rename(tmp_path, path) != 0) {
+    ERROR("checkpoint: failed writing %s", path);
+    unlink(tmp_path);
+    return -1;
+  }
+
+  DEBUG("checkpoint: %d cards saved to %s", header.num_cards, path);
+  return 0;
+}
+
+
+
+struct checkpoint* checkpoint_load(config_t *cfg) {
+  const char *path = checkpoint_path(cfg);
+  struct checkpoint_file_header header;
+  char boot_id[BOOT_ID_LENGTH];
+  struct checkpoint *checkpoint;
+  FILE *file;
+
+  if (path == NULL) {
+    return NULL;
+  }
+
+  if ( (file = fopen(path, "r")) == NULL ) {
+    INFO("checkpoint: none at %s, cold start", path);
+    return NULL;
+  }
+  // whatever happens it's not to be used twice: the next one is
+  // written once these cards are running
+  unlink(path);
+
+  read_boot_id(boot_id);
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != CHECKPOINT_MAGIC ||
+      header.version != CHECKPOINT_VERSION ||
+      header.num_cards < 0 || header.num_cards > MAX_SLOTS) {
+    WARN("checkpoint: %s not usable, cold start", path);
+    fclose(file);
+    return NULL;
+  }
+  if (strncmp(header.boot_id, boot_id, BOOT_ID_LENGTH) != 0) {
+    INFO("checkpoint: from a previous boot, cold start");
+    fclose(file);
+    return NULL;
+  }
+
+  if ( (checkpoint = calloc(1, sizeof(struct checkpoint))) == NULL ) {
+    fclose(file);
+    return NULL;
+  }
+  for (int i = 0; i < header.num_cards; ++i) {
+    struct checkpoint_file_card card_header;
+    struct checkpoint_card *card = &checkpoint->cards[i];
+
+    if (fread(&card_header, sizeof(card_header), 1, file) != 1 ||
+        card_header.size == 0 || card_header.size > CHECKPOINT_MAX_CARD_BYTES) {
+      break;
+    }
+    if ( (card->data = malloc(card_header.size)) == NULL ) {
+      break;
+    }
+    if (fread(card->data, card_header.size, 1, file) != 1) {
+      free(card->data);
+      card->data = NULL;
+      break;
+    }
+
+    card->slot = card_header.slot;
+    card->card_id = card_header.card_id;
+    card->tune_result = card_header.tune_result;
+    card->size = card_header.size;
+    ++checkpoint->num_cards;
+  }
+  fclose(file);
+
+  if (checkpoint->num_cards != header.num_cards) {
+    WARN("checkpoint: truncated, %d of %d cards read", checkpoint->num_cards, header.num_cards);
+  }
+
+  return checkpoint;
+}
+
+
+
+const struct checkpoint_card* checkpoint_find_card(const struct checkpoint *checkpoint, int slot, int card_id) {
+  if (checkpoint == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < checkpoint->num_cards; ++i) {
+    if (checkpoint->cards[i].slot == slot) {
+      return checkpoint->cards[i].card_id == card_id ? &checkpoint->cards[i] : NULL;
+    }
+  }
+  return NULL;
+}
+
+
+
+void free_checkpoint(struct checkpoint *checkpoint) {
+  if (checkpoint) {
+    for (int i = 0; i < checkpoint->num_cards; ++i) {
+      free(checkpoint->cards[i].data);
+    }
+    free(checkpoint);
+  }
+}
+
+
+
+/** checkpoint_path
+ *
+ * configured path, the default if unset, NULL if set empty (disabled)
+ */
+static const char* checkpoint_path(config_t *cfg) {
+  const char *path = CHECKPOINT_DEFAULT_PATH;
+
+  config_lookup_string(cfg, CHECKPOINT_PATH_KEY, &path);
+  return path[0] != '\0' ? path : NULL;
+}
+
+
+/** read_boot_id
+ *
+ * the kernel's id for this boot.  A checkpoint from another boot is
+ * for cards that have since been power cycled.  Empty if unreadable.
+ */
+static void read_boot_id(char boot_id[BOOT_ID_LENGTH]) {
+  FILE *file;
+
+  memset(boot_id, 0, BOOT_ID_LENGTH);
+  if ( (file = fopen(BOOT_ID_PATH, "r")) != NULL ) {
+    if (fgets(boot_id, BOOT_ID_LENGTH, file) == NULL) {
+      boot_id[0] = '\0';
+    }
+    fclose(file);
+  }
+}
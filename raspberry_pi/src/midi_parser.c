@@ -0,0 +1,249 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* MIDI 1.0 byte stream to messages: running status, realtime bytes
+ * anywhere, bounded sysex, and 14 bit controller / NRPN assembly.
+ */
+
+#include <string.h>
+
+#include "zoxnoxiousd.h"
+#include "midi_parser.h"
+
+#define CC_DATA_ENTRY_MSB 6
+#define CC_LSB_OFFSET 32
+#define CC_DATA_ENTRY_LSB 38
+#define CC_DATA_INCREMENT 96
+#define CC_DATA_DECREMENT 97
+#define CC_NRPN_LSB 98
+#define CC_NRPN_MSB 99
+#define CC_RPN_LSB 100
+#define CC_RPN_MSB 101
+#define PARAM_NONE 0xFF
+#define RPN_NULL 0x7F
+#define DATA_ENTRY_MAX 0x3FFF
+
+static void status_byte(struct midi_parser *parser, uint8_t byte);
+static void data_byte(struct midi_parser *parser, uint8_t byte);
+static void sysex_end(struct midi_parser *parser, uint8_t byte);
+static void message_complete(struct midi_parser *parser);
+static void controller_change(struct midi_parser *parser, int channel, uint8_t controller, uint8_t value);
+static void send_param(struct midi_parser *parser, int channel, uint8_t kind, const uint8_t number[2], uint16_t value);
+
+
+
+void midi_parser_init(struct midi_parser *parser, midi_message_f handler, void *handler_arg) {
+  memset(parser, 0, sizeof(struct midi_parser));
+  parser->handler = handler;
+  parser->handler_arg = handler_arg;
+
+  for (int channel = 0; channel < MIDI_CHANNELS; ++channel) {
+    parser->channels[channel].param_kind = PARAM_NONE;
+    parser->channels[channel].rpn[0] = RPN_NULL;
+    parser->channels[channel].rpn[1] = RPN_NULL;
+  }
+}
+
+
+
+void midi_parse(struct midi_parser *parser, const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t byte = buffer[i];
+
+    if (byte >= MIDI_REALTIME) {
+      // clock and friends may land between any two bytes and change nothing
+      parser->realtime_bytes++;
+    }
+    else if (byte == MIDI_SYSEX_END) {
+      sysex_end(parser, byte);
+    }
+    else if (byte & 0x80) {
+      status_byte(parser, byte);
+    }
+    else if (parser->in_sysex) {
+      if (parser->sysex_size < MIDI_SYSEX_MAX_BYTES - 1) {
+        parser->sysex[parser->sysex_size++] = byte;
+      }
+      else {
+        parser->sysex_overflow = 1;
+      }
+    }
+    else {
+      data_byte(parser, byte);
+    }
+  }
+}
+
+
+
+static void status_byte(struct midi_parser *parser, uint8_t byte) {
+  if (parser->in_sysex) {
+    // anything but realtime ends sysex; without the F7 it's incomplete
+    parser->in_sysex = 0;
+    parser->sysex_aborted++;
+  }
+
+  parser->data_count = 0;
+
+  if (byte < MIDI_SYSEX_START) {
+    uint8_t type = byte & 0xF0;
+    parser->running_status = byte;
+    parser->data_needed = (type == MIDI_PROGRAM_CHANGE || type == MIDI_CHANNEL_PRESSURE) ? 1 : 2;
+    return;
+  }
+
+  // system common cancels running status
+  parser->running_status = MIDI_STATUS_NOT_SET;
+
+  switch (byte) {
+  case MIDI_SYSEX_START:
+    parser->in_sysex = 1;
+    parser->sysex_overflow = 0;
+    parser->sysex[0] = byte;
+    parser->sysex_size = 1;
+    break;
+  case MIDI_TIME_CODE:
+  case MIDI_SONG_SELECT:
+    parser->running_status = byte;
+    parser->data_needed = 1;
+    break;
+  case MIDI_SONG_POSITION:
+    parser->running_status = byte;
+    parser->data_needed = 2;
+    break;
+  case MIDI_TUNE_REQUEST:
+    parser->messages++;
+    parser->handler(parser->handler_arg, -1, &byte, 1);
+    break;
+  default:
+    // 0xF4 and 0xF5 are undefined
+    break;
+  }
+}
+
+
+static void data_byte(struct midi_parser *parser, uint8_t byte) {
+  if (parser->running_status == MIDI_STATUS_NOT_SET) {
+    parser->stray_data_bytes++;
+    return;
+  }
+
+  parser->data[parser->data_count++] = byte;
+  if (parser->data_count == parser->data_needed) {
+    message_complete(parser);
+    parser->data_count = 0;
+    // system common messages don't run
+    if (parser->running_status >= MIDI_SYSEX_START) {
+      parser->running_status = MIDI_STATUS_NOT_SET;
+    }
+  }
+}
+
+
+static void sysex_end(struct midi_parser *parser, uint8_t byte) {
+  if (!parser->in_sysex) {
+    parser->stray_data_bytes++;
+    return;
+  }
+
+  parser->in_sysex = 0;
+  if (parser->sysex_overflow) {
+    parser->sysex_overflows++;
+    return;
+  }
+
+  parser->sysex[parser->sysex_size++] = byte;
+  parser->messages++;
+  parser->handler(parser->handler_arg, -1, parser->sysex, parser->sysex_size);
+}
+
+
+static void message_complete(struct midi_parser *parser) {
+  uint8_t message[3] = { parser->running_status, parser->data[0], parser->data[1] };
+  size_t size = 1 + parser->data_needed;
+  int channel = parser->running_status < MIDI_SYSEX_START ? (parser->running_status & 0x0F) : -1;
+
+  parser->messages++;
+  parser->handler(parser->handler_arg, channel, message, size);
+
+  if ((parser->running_status & 0xF0) == MIDI_CONTROLLER_CHANGE) {
+    controller_change(parser, channel, parser->data[0], parser->data[1]);
+  }
+}
+
+
+/** controller_change
+ * after the raw CC is passed on, assemble 14 bit values: a controller
+ * 32-63 LSB completes the pair with its 0-31 MSB, data entry completes
+ * the selected NRPN/RPN
+ */
+static void controller_change(struct midi_parser *parser, int channel, uint8_t controller, uint8_t value) {
+  struct midi_parser_channel *ch = &parser->channels[channel];
+  const uint8_t *param_number = ch->param_kind == ZMIDI_PARAM_NRPN ? ch->nrpn : ch->rpn;
+
+  switch (controller) {
+  case CC_NRPN_MSB:
+  case CC_NRPN_LSB:
+    ch->nrpn[controller == CC_NRPN_MSB ? 0 : 1] = value;
+    ch->param_kind = ZMIDI_PARAM_NRPN;
+    ch->data_entry = 0;
+    return;
+  case CC_RPN_MSB:
+  case CC_RPN_LSB:
+    ch->rpn[controller == CC_RPN_MSB ? 0 : 1] = value;
+    ch->param_kind = (ch->rpn[0] == RPN_NULL && ch->rpn[1] == RPN_NULL) ? PARAM_NONE : ZMIDI_PARAM_RPN;
+    ch->data_entry = 0;
+    return;
+  case CC_DATA_ENTRY_MSB:
+    if (ch->param_kind != PARAM_NONE) {
+      ch->data_entry = (uint16_t)value << 7;
+      send_param(parser, channel, ch->param_kind, param_number, ch->data_entry);
+    }
+    return;
+  case CC_DATA_ENTRY_LSB:
+    if (ch->param_kind != PARAM_NONE) {
+      ch->data_entry = (ch->data_entry & 0x3F80) | value;
+      send_param(parser, channel, ch->param_kind, param_number, ch->data_entry);
+    }
+    return;
+  case CC_DATA_INCREMENT:
+    if (ch->param_kind != PARAM_NONE && ch->data_entry < DATA_ENTRY_MAX) {
+      send_param(parser, channel, ch->param_kind, param_number, ++ch->data_entry);
+    }
+    return;
+  case CC_DATA_DECREMENT:
+    if (ch->param_kind != PARAM_NONE && ch->data_entry > 0) {
+      send_param(parser, channel, ch->param_kind, param_number, --ch->data_entry);
+    }
+    return;
+  }
+
+  if (controller < CC_LSB_OFFSET) {
+    ch->cc_msb[controller] = value;
+  }
+  else if (controller < 2 * CC_LSB_OFFSET) {
+    uint8_t number[2] = { 0, controller - CC_LSB_OFFSET };
+    send_param(parser, channel, ZMIDI_PARAM_CC14, number,
+               ((uint16_t)ch->cc_msb[controller - CC_LSB_OFFSET] << 7) | value);
+  }
+}
+
+
+static void send_param(struct midi_parser *parser, int channel, uint8_t kind, const uint8_t number[2], uint16_t value) {
+  uint8_t message[ZMIDI_PARAM_SIZE] = {
+    ZMIDI_PARAM, kind, number[0], number[1], (value >> 7) & 0x7F, value & 0x7F
+  };
+  parser->handler(parser->handler_arg, channel, message, ZMIDI_PARAM_SIZE);
+}
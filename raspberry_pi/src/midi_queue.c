@@ -0,0 +1,65 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "midi_queue.h"
+
+
+void midi_queue_init(struct midi_queue *queue) {
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->dropped, 0);
+  atomic_init(&queue->max_depth, 0);
+}
+
+
+
+int midi_queue_push(struct midi_queue *queue, int card_num, const uint8_t *message, size_t size) {
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  uint32_t depth = head - tail;
+
+  if (depth >= MIDI_QUEUE_SIZE || size > MIDI_QUEUE_MESSAGE_MAX_BYTES) {
+    atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+    return -1;
+  }
+
+  struct midi_queue_entry *entry = &queue->entries[head & (MIDI_QUEUE_SIZE - 1)];
+  entry->card_num = card_num;
+  entry->size = size;
+  memcpy(entry->message, message, size);
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+  if (depth + 1 > atomic_load_explicit(&queue->max_depth, memory_order_relaxed)) {
+    atomic_store_explicit(&queue->max_depth, depth + 1, memory_order_relaxed);
+  }
+  return 0;
+}
+
+
+
+int midi_queue_pop(struct midi_queue *queue, struct midi_queue_entry *entry) {
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  if (tail == head) {
+    return -1;
+  }
+
+  *entry = queue->entries[tail & (MIDI_QUEUE_SIZE - 1)];
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return 0;
+}
@@ -0,0 +1,210 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* keep the sample clock and multiple pcm devices frame aligned */
+
+#include <stdlib.h>
+
+#include "zoxnoxiousd.h"
+#include "pcm_sync.h"
+
+
+static void pcm_sync_set_targets(struct pcm_sync *sync, const struct alsa_pcm_state *pcm_state0);
+static void steer_clock(struct pcm_sync *sync);
+static void check_alignment(struct pcm_sync *sync, int dev);
+
+
+
+struct pcm_sync* init_pcm_sync(config_t *cfg, struct alsa_pcm_state *pcm_state[]) {
+  struct pcm_sync *sync;
+
+  if (pcm_state[1] && pcm_state[1]->sampling_rate != pcm_state[0]->sampling_rate) {
+    ERROR("pcm sync: devices must have the same sampling rate: %s (%d) and %s (%d)",
+          pcm_state[0]->device_name, pcm_state[0]->sampling_rate,
+          pcm_state[1]->device_name, pcm_state[1]->sampling_rate);
+    return NULL;
+  }
+
+  sync = calloc(1, sizeof(struct pcm_sync));
+  sync->num_devices = pcm_state[1] ? 2 : 1;
+  sync->clock_recovery = 1;
+  sync->link = 1;
+  config_lookup_bool(cfg, ZALSA_CLOCK_RECOVERY_KEY, &sync->clock_recovery);
+  config_lookup_bool(cfg, ZALSA_LINK_DEVICES_KEY, &sync->link);
+
+  sync->nominal_interval_ns = 1000000000L / pcm_state[0]->sampling_rate;
+  sync->interval_ns = sync->nominal_interval_ns;
+
+  pcm_sync_reset(sync, pcm_state);
+
+  INFO("pcm sync: %d device(s), clock recovery %s, target fill %.1f frames",
+       sync->num_devices, sync->clock_recovery ? "on" : "off", sync->target_fill);
+  return sync;
+}
+
+
+void free_pcm_sync(struct pcm_sync *sync) {
+  free(sync);
+}
+
+
+
+void pcm_sync_link(struct pcm_sync *sync, struct alsa_pcm_state *pcm_state[]) {
+  if (sync->link && sync->num_devices > 1 && !pcm_state[1]->linked) {
+    alsa_link_devices(pcm_state[0], pcm_state[1]);
+  }
+}
+
+
+
+void pcm_sync_reset(struct pcm_sync *sync, struct alsa_pcm_state *pcm_state[]) {
+  for (int dev = 0; dev < sync->num_devices; ++dev) {
+    struct pcm_sync_device *device = &sync->devices[dev];
+    device->last_period = pcm_state[dev]->periods_begun;
+    device->measured = 0;
+    device->pending_slip = 0;
+  }
+  pcm_sync_set_targets(sync, pcm_state[0]);
+}
+
+
+
+int pcm_sync_update(struct pcm_sync *sync, struct alsa_pcm_state *pcm_state[], int frames) {
+  long previous_interval_ns = sync->interval_ns;
+
+  for (int dev = 0; dev < sync->num_devices; ++dev) {
+    struct pcm_sync_device *device = &sync->devices[dev];
+    device->frames += frames;
+
+    // measure once per period, when a fresh one has just been mapped
+    if (pcm_state[dev]->periods_begun == device->last_period) {
+      continue;
+    }
+    device->last_period = pcm_state[dev]->periods_begun;
+
+    if (device->measured) {
+      device->fill_avg += PCM_SYNC_FILL_SMOOTHING * (pcm_state[dev]->period_avail - device->fill_avg);
+    }
+    else {
+      device->fill_avg = pcm_state[dev]->period_avail;
+      device->measured = 1;
+    }
+
+    if (dev == 0) {
+      steer_clock(sync);
+    }
+    else {
+      check_alignment(sync, dev);
+    }
+  }
+
+  return sync->interval_ns != previous_interval_ns;
+}
+
+
+
+int pcm_sync_take_slip(struct pcm_sync *sync, int dev) {
+  int slip = sync->devices[dev].pending_slip;
+  sync->devices[dev].pending_slip = 0;
+  return slip;
+}
+
+
+
+double pcm_sync_drift_ppm(const struct pcm_sync *sync, int dev) {
+  const struct pcm_sync_device *device = &sync->devices[dev];
+
+  if (dev == 0) {
+    return sync->correction_ppm;
+  }
+  return sync->correction_ppm +
+    (device->frames ? 1e6 * device->slips / (double)device->frames : 0.0);
+}
+
+
+
+/** pcm_sync_set_targets
+ * aim to have half a period in hand beyond the period being processed
+ */
+static void pcm_sync_set_targets(struct pcm_sync *sync, const struct alsa_pcm_state *pcm_state0) {
+  sync->target_fill = 1.5 * pcm_state0->period_size;
+  sync->slip_threshold = pcm_state0->period_size / 4.0;
+  if (sync->slip_threshold < PCM_SYNC_MIN_SLIP_THRESHOLD) {
+    sync->slip_threshold = PCM_SYNC_MIN_SLIP_THRESHOLD;
+  }
+}
+
+
+/** steer_clock
+ * more frames waiting than targeted means the device is ahead of the
+ * sample clock: shorten the interval
+ */
+static void steer_clock(struct pcm_sync *sync) {
+  double error;
+
+  if (!sync->clock_recovery) {
+    return;
+  }
+
+  error = sync->devices[0].fill_avg - sync->target_fill;
+
+  sync->integral_ppm += PCM_SYNC_KI * error;
+  if (sync->integral_ppm > PCM_SYNC_MAX_CORRECTION_PPM) {
+    sync->integral_ppm = PCM_SYNC_MAX_CORRECTION_PPM;
+  }
+  else if (sync->integral_ppm < -PCM_SYNC_MAX_CORRECTION_PPM) {
+    sync->integral_ppm = -PCM_SYNC_MAX_CORRECTION_PPM;
+  }
+
+  sync->correction_ppm = PCM_SYNC_KP * error + sync->integral_ppm;
+  if (sync->correction_ppm > PCM_SYNC_MAX_CORRECTION_PPM) {
+    sync->correction_ppm = PCM_SYNC_MAX_CORRECTION_PPM;
+  }
+  else if (sync->correction_ppm < -PCM_SYNC_MAX_CORRECTION_PPM) {
+    sync->correction_ppm = -PCM_SYNC_MAX_CORRECTION_PPM;
+  }
+
+  sync->interval_ns = (long)(sync->nominal_interval_ns / (1.0 + sync->correction_ppm * 1e-6) + 0.5);
+}
+
+
+/** check_alignment
+ * a device running fast relative to device 0 builds up more fill: skip
+ * a frame.  Running slow: repeat one.
+ */
+static void check_alignment(struct pcm_sync *sync, int dev) {
+  struct pcm_sync_device *device = &sync->devices[dev];
+  double offset;
+
+  if (!sync->devices[0].measured) {
+    return;
+  }
+
+  offset = device->fill_avg - sync->devices[0].fill_avg;
+  if (offset > sync->slip_threshold) {
+    device->pending_slip = 1;
+  }
+  else if (offset < -sync->slip_threshold) {
+    device->pending_slip = -1;
+  }
+  else {
+    return;
+  }
+
+  // the slip moves the fill right away, don't wait on the average
+  device->fill_avg -= device->pending_slip;
+  device->slips += device->pending_slip;
+  RT_DEBUG("pcm sync: device %d offset %.1f frames, slip %d", dev, offset, device->pending_slip);
+}
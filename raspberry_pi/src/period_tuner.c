@@ -0,0 +1,186 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* adaptive ALSA period size: step the period down toward the lowest
+ * latency that holds up, back off when it doesn't.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "zoxnoxiousd.h"
+#include "period_tuner.h"
+
+
+static void period_tuner_backoff(struct period_tuner *tuner);
+
+
+
+struct period_tuner* init_period_tuner(config_t *cfg, unsigned int sampling_rate,
+                                       snd_pcm_sframes_t period_size, snd_pcm_uframes_t buffer_size) {
+  struct period_tuner *tuner = calloc(1, sizeof(struct period_tuner));
+  int cfg_int_value;
+
+  tuner->sampling_rate = sampling_rate;
+  tuner->period = period_size;
+  tuner->max_period = period_size;
+  tuner->buffer_periods = period_size > 0 ? buffer_size / period_size : 2;
+  if (tuner->buffer_periods < 2) {
+    tuner->buffer_periods = 2;
+  }
+
+  tuner->min_period = PERIOD_TUNER_DEFAULT_MIN_PERIOD;
+  if (config_lookup_int(cfg, ZALSA_AUTO_TUNE_MIN_PERIOD_KEY, &cfg_int_value) == CONFIG_TRUE &&
+      cfg_int_value > 0) {
+    tuner->min_period = cfg_int_value;
+  }
+  if (tuner->min_period > tuner->max_period) {
+    tuner->min_period = tuner->max_period;
+  }
+
+  int window_sec = PERIOD_TUNER_DEFAULT_WINDOW_SEC;
+  if (config_lookup_int(cfg, ZALSA_AUTO_TUNE_WINDOW_SEC_KEY, &cfg_int_value) == CONFIG_TRUE &&
+      cfg_int_value > 0) {
+    window_sec = cfg_int_value;
+  }
+  tuner->window_frames = (uint64_t)window_sec * sampling_rate;
+
+  tuner->miss_threshold = PERIOD_TUNER_DEFAULT_MISS_THRESHOLD;
+  config_lookup_int(cfg, ZALSA_AUTO_TUNE_MISS_THRESHOLD_KEY, &tuner->miss_threshold);
+
+  tuner->holdoff_windows = 1;
+
+  config_lookup_bool(cfg, ZALSA_AUTO_TUNE_KEY, &tuner->enabled);
+  if (tuner->enabled) {
+    INFO("period tuner: starting at period %ld, buffer %d periods, searching down to %ld over %d sec windows",
+         tuner->period, tuner->buffer_periods, tuner->min_period, window_sec);
+  }
+
+  return tuner;
+}
+
+
+void free_period_tuner(struct period_tuner *tuner) {
+  free(tuner);
+}
+
+
+
+int period_tuner_update(struct period_tuner *tuner, uint64_t expirations, int xrun_count) {
+  if (!tuner->enabled) {
+    return 0;
+  }
+
+  tuner->frames_in_window += expirations;
+  if (expirations > 1) {
+    tuner->window_misses += expirations - 1;
+  }
+
+  int window_xruns = xrun_count - tuner->window_xrun_base;
+  int glitched = window_xruns > 0 || tuner->window_misses > tuner->miss_threshold;
+
+  // under load, don't sit through the rest of a bad window
+  if (window_xruns >= PERIOD_TUNER_IMMEDIATE_BACKOFF_XRUNS && tuner->period < tuner->max_period) {
+    period_tuner_backoff(tuner);
+    return 1;
+  }
+
+  if (tuner->frames_in_window < tuner->window_frames) {
+    return 0;
+  }
+
+  // end of window: decide
+  if (glitched) {
+    if (tuner->period < tuner->max_period) {
+      period_tuner_backoff(tuner);
+      return 1;
+    }
+    RT_WARN("period tuner: %d xruns, %" PRIu64 " missed deadlines at the largest period %ld",
+            window_xruns, tuner->window_misses, tuner->period);
+    period_tuner_window_reset(tuner, xrun_count);
+    return 0;
+  }
+
+  if (tuner->probing) {
+    // survived a full window at the smaller size: it's the new known good
+    tuner->probing = 0;
+    tuner->holdoff_windows = 1;
+    RT_INFO("period tuner: period %ld stable", tuner->period);
+  }
+
+  if (tuner->holdoff_remaining > 0) {
+    tuner->holdoff_remaining--;
+    period_tuner_window_reset(tuner, xrun_count);
+    return 0;
+  }
+
+  if (tuner->period / 2 >= tuner->min_period) {
+    tuner->period /= 2;
+    tuner->probing = 1;
+    tuner->retune_count++;
+    RT_INFO("period tuner: probing period %ld", tuner->period);
+    return 1;
+  }
+
+  period_tuner_window_reset(tuner, xrun_count);
+  return 0;
+}
+
+
+void period_tuner_window_reset(struct period_tuner *tuner, int xrun_count) {
+  tuner->frames_in_window = 0;
+  tuner->window_misses = 0;
+  tuner->window_xrun_base = xrun_count;
+}
+
+
+void period_tuner_reject(struct period_tuner *tuner, snd_pcm_sframes_t previous_period) {
+  RT_WARN("period tuner: device rejected period %ld, back to %ld", tuner->period, previous_period);
+  if (tuner->period < previous_period) {
+    tuner->min_period = previous_period;
+  }
+  else {
+    tuner->max_period = previous_period;
+  }
+  tuner->period = previous_period;
+  tuner->probing = 0;
+}
+
+
+snd_pcm_uframes_t period_tuner_buffer_size(const struct period_tuner *tuner) {
+  return tuner->period * tuner->buffer_periods;
+}
+
+
+
+static void period_tuner_backoff(struct period_tuner *tuner) {
+  // a failed probe means the size didn't hold; failing at a proven
+  // size means load went up.  Either way wait longer before retrying.
+  if (tuner->holdoff_windows < PERIOD_TUNER_MAX_HOLDOFF_WINDOWS) {
+    tuner->holdoff_windows *= 2;
+  }
+  tuner->holdoff_remaining = tuner->holdoff_windows;
+
+  tuner->period *= 2;
+  if (tuner->period > tuner->max_period) {
+    tuner->period = tuner->max_period;
+  }
+  tuner->probing = 0;
+  tuner->backoff_count++;
+  tuner->retune_count++;
+
+  RT_WARN("period tuner: backing off to period %ld, holding for %d windows",
+          tuner->period, tuner->holdoff_remaining);
+}
@@ -0,0 +1,397 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* per-thread real-time execution profile: scheduling policy, priority
+ * and CPU pinning for each daemon thread, memory locking and stack
+ * prefault.  Replaces launching the whole process under chrt.
+ */
+
+#define _GNU_SOURCE
+#include <alloca.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "zoxnoxiousd.h"
+#include "rt_profile.h"
+
+
+#define SYSFS_CPU_ISOLATED "/sys/devices/system/cpu/isolated"
+#define SYSFS_CPU_ONLINE "/sys/devices/system/cpu/online"
+#define SYSFS_CPU_GOVERNOR_FORMAT "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor"
+#define PROC_SCHED_RT_RUNTIME "/proc/sys/kernel/sched_rt_runtime_us"
+#define PROC_SCHED_RT_PERIOD "/proc/sys/kernel/sched_rt_period_us"
+
+
+// config names for each role under rt_profile.threads
+static const char *role_names[RT_THREAD_NUM_ROLES] = {
+  [RT_THREAD_PCM] = "pcm",
+  [RT_THREAD_MIDI] = "midi",
+  [RT_THREAD_LOGGER] = "logger"
+};
+
+static const struct {
+  const char *name;
+  int policy;
+} policy_names[] = {
+  { "fifo", SCHED_FIFO },
+  { "rr", SCHED_RR },
+  { "other", SCHED_OTHER },
+  { "inherit", RT_POLICY_INHERIT }
+};
+
+
+static void read_thread_profile(config_setting_t *thread_setting, struct rt_thread_profile *profile);
+static int parse_cpu_list(const char *cpu_list, uint64_t *cpus);
+static int read_sysfs_line(const char *path, char *buffer, size_t buffer_size);
+static void prefault_stack(size_t bytes);
+
+
+
+struct rt_profile* init_rt_profile(config_t *cfg) {
+  struct rt_profile *rt_profile = calloc(1, sizeof(struct rt_profile));
+  if (rt_profile == NULL) {
+    ERROR("rt_profile: calloc failed");
+    return NULL;
+  }
+
+  rt_profile->cfg = cfg;
+  rt_profile->mlock = 1;
+  rt_profile->prefault_stack_kb = RT_PROFILE_DEFAULT_PREFAULT_STACK_KB;
+
+  config_lookup_bool(cfg, RT_PROFILE_MLOCK_KEY, &rt_profile->mlock);
+  config_lookup_int(cfg, RT_PROFILE_PREFAULT_STACK_KB_KEY, &rt_profile->prefault_stack_kb);
+
+  config_setting_t *threads_setting = config_lookup(cfg, RT_PROFILE_THREADS_KEY);
+
+  for (int role = 0; role < RT_THREAD_NUM_ROLES; ++role) {
+    struct rt_thread_profile *profile = &rt_profile->threads[role];
+    profile->policy = RT_POLICY_INHERIT;
+    profile->priority = 0;
+    profile->cpus = 0;
+
+    if (threads_setting) {
+      read_thread_profile(config_setting_get_member(threads_setting, role_names[role]), profile);
+    }
+
+    INFO("rt_profile: %s thread: policy %d priority %d%s",
+         role_names[role], profile->policy, profile->priority,
+         profile->cpus ? " pinned" : "");
+  }
+
+  return rt_profile;
+}
+
+
+void free_rt_profile(struct rt_profile *rt_profile) {
+  free(rt_profile);
+}
+
+
+
+int rt_profile_lock_memory(struct rt_profile *rt_profile) {
+  if (!rt_profile->mlock) {
+    INFO("rt_profile: memory locking not configured");
+    return 0;
+  }
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+    ERROR("mlockall failed: %s. Continuing without memory locking.", strerror(errno));
+    return 1;
+  }
+
+  // freed memory stays with the process (and locked) rather than
+  // being trimmed or unmapped and faulted in again later
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  INFO("Successfully locked memory into main memory");
+  return 0;
+}
+
+
+
+int rt_profile_apply(struct rt_profile *rt_profile, pthread_t thread, enum rt_thread_role role) {
+  const struct rt_thread_profile *profile = &rt_profile->threads[role];
+  int retval = 0;
+  int err;
+
+  if (profile->policy != RT_POLICY_INHERIT) {
+    struct sched_param param = { .sched_priority = profile->priority };
+    if ( (err = pthread_setschedparam(thread, profile->policy, &param)) != 0 ) {
+      ERROR("rt_profile: %s thread: failed to set policy %d priority %d: %s",
+            role_names[role], profile->policy, profile->priority, strerror(err));
+      retval = 1;
+    }
+  }
+
+  if (profile->cpus) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < RT_PROFILE_MAX_CPUS; ++cpu) {
+      if (profile->cpus & (1ull << cpu)) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    if ( (err = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpus)) != 0 ) {
+      ERROR("rt_profile: %s thread: failed to set cpu affinity: %s",
+            role_names[role], strerror(err));
+      retval = 1;
+    }
+  }
+
+  if (retval == 0) {
+    INFO("rt_profile: %s thread profile applied", role_names[role]);
+  }
+  return retval;
+}
+
+
+int rt_profile_enter(struct rt_profile *rt_profile, enum rt_thread_role role) {
+  int retval = rt_profile_apply(rt_profile, pthread_self(), role);
+
+  if (rt_profile->prefault_stack_kb > 0) {
+    prefault_stack((size_t)rt_profile->prefault_stack_kb * 1024);
+  }
+
+  return retval;
+}
+
+
+
+int rt_profile_self_check(struct rt_profile *rt_profile) {
+  char buffer[256];
+  int problems = 0;
+  int max_priority = 0;
+  struct rlimit limit;
+
+  // permissions: root, or rlimits covering what's configured
+  for (int role = 0; role < RT_THREAD_NUM_ROLES; ++role) {
+    const struct rt_thread_profile *profile = &rt_profile->threads[role];
+    if ((profile->policy == SCHED_FIFO || profile->policy == SCHED_RR) &&
+        profile->priority > max_priority) {
+      max_priority = profile->priority;
+    }
+  }
+
+  if (geteuid() != 0) {
+    if (max_priority > 0 && getrlimit(RLIMIT_RTPRIO, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < (rlim_t)max_priority) {
+      WARN("rt check: not root and RLIMIT_RTPRIO %ld below configured priority %d",
+           (long)limit.rlim_cur, max_priority);
+      ++problems;
+    }
+    if (rt_profile->mlock && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      WARN("rt check: not root and RLIMIT_MEMLOCK is %ld KB; mlockall likely to fail",
+           (long)(limit.rlim_cur / 1024));
+      ++problems;
+    }
+  }
+
+  // the PCM thread's CPUs should be isolated from the scheduler
+  const struct rt_thread_profile *pcm = &rt_profile->threads[RT_THREAD_PCM];
+  uint64_t check_cpus;
+  if (pcm->cpus) {
+    uint64_t isolated;
+    check_cpus = pcm->cpus;
+    if (read_sysfs_line(SYSFS_CPU_ISOLATED, buffer, sizeof(buffer)) == 0 &&
+        parse_cpu_list(buffer, &isolated) == 0) {
+      for (int cpu = 0; cpu < RT_PROFILE_MAX_CPUS; ++cpu) {
+        if ((pcm->cpus & (1ull << cpu)) && !(isolated & (1ull << cpu))) {
+          WARN("rt check: pcm thread cpu %d is not in isolcpus (isolated: \"%s\")", cpu, buffer);
+          ++problems;
+        }
+      }
+    }
+    else {
+      WARN("rt check: unable to read " SYSFS_CPU_ISOLATED);
+      ++problems;
+    }
+  }
+  else {
+    INFO("rt check: pcm thread not pinned to a cpu; checking governor on all online cpus");
+    if (read_sysfs_line(SYSFS_CPU_ONLINE, buffer, sizeof(buffer)) != 0 ||
+        parse_cpu_list(buffer, &check_cpus) != 0) {
+      check_cpus = 1;
+    }
+  }
+
+  // cpufreq governor: anything but performance adds frequency transition latency
+  for (int cpu = 0; cpu < RT_PROFILE_MAX_CPUS; ++cpu) {
+    if (!(check_cpus & (1ull << cpu))) {
+      continue;
+    }
+    char path[128];
+    snprintf(path, sizeof(path), SYSFS_CPU_GOVERNOR_FORMAT, cpu);
+    if (read_sysfs_line(path, buffer, sizeof(buffer)) != 0) {
+      INFO("rt check: cpu %d has no cpufreq governor", cpu);
+    }
+    else if (strcmp(buffer, "performance") != 0) {
+      WARN("rt check: cpu %d governor is \"%s\", expected \"performance\"", cpu, buffer);
+      ++problems;
+    }
+  }
+
+  // RT throttling: a runaway RT thread is throttled, but so is a legit busy one
+  if (read_sysfs_line(PROC_SCHED_RT_RUNTIME, buffer, sizeof(buffer)) == 0) {
+    long runtime_us = strtol(buffer, NULL, 10);
+    if (runtime_us >= 0) {
+      long period_us = 0;
+      if (read_sysfs_line(PROC_SCHED_RT_PERIOD, buffer, sizeof(buffer)) == 0) {
+        period_us = strtol(buffer, NULL, 10);
+      }
+      WARN("rt check: RT throttling enabled: RT tasks limited to %ld of every %ld usec",
+           runtime_us, period_us);
+      ++problems;
+    }
+  }
+  else {
+    WARN("rt check: unable to read " PROC_SCHED_RT_RUNTIME);
+    ++problems;
+  }
+
+  if (problems) {
+    WARN("rt check: %d problem(s) found", problems);
+  }
+  else {
+    INFO("rt check: system configured for rt profile");
+  }
+  return problems;
+}
+
+
+
+/** read_thread_profile
+ *
+ * policy = "fifo" | "rr" | "other" | "inherit"; priority = int; cpus = [ int, ... ];
+ */
+static void read_thread_profile(config_setting_t *thread_setting, struct rt_thread_profile *profile) {
+  const char *policy_name;
+  config_setting_t *cpus_setting;
+
+  if (thread_setting == NULL) {
+    return;
+  }
+
+  if (config_setting_lookup_string(thread_setting, "policy", &policy_name) == CONFIG_TRUE) {
+    int found = 0;
+    for (int i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); ++i) {
+      if (strcmp(policy_name, policy_names[i].name) == 0) {
+        profile->policy = policy_names[i].policy;
+        found = 1;
+        break;
+      }
+    }
+    if (!found) {
+      WARN("cfg: rt_profile: unknown policy \"%s\", leaving as inherited", policy_name);
+    }
+  }
+
+  config_setting_lookup_int(thread_setting, "priority", &profile->priority);
+  if (profile->policy != RT_POLICY_INHERIT) {
+    int min = sched_get_priority_min(profile->policy);
+    int max = sched_get_priority_max(profile->policy);
+    if (profile->priority < min || profile->priority > max) {
+      WARN("cfg: rt_profile: priority %d out of range [%d, %d], clamping",
+           profile->priority, min, max);
+      profile->priority = profile->priority < min ? min : max;
+    }
+  }
+
+  if ( (cpus_setting = config_setting_get_member(thread_setting, "cpus")) != NULL ) {
+    int num_cpus = config_setting_length(cpus_setting);
+    for (int i = 0; i < num_cpus; ++i) {
+      int cpu = config_setting_get_int_elem(cpus_setting, i);
+      if (cpu >= 0 && cpu < RT_PROFILE_MAX_CPUS) {
+        profile->cpus |= 1ull << cpu;
+      }
+      else {
+        WARN("cfg: rt_profile: cpu %d out of range, ignored", cpu);
+      }
+    }
+  }
+}
+
+
+/** parse_cpu_list
+ *
+ * kernel cpu list format: "0-2,5".  Empty is valid (no cpus).
+ */
+static int parse_cpu_list(const char *cpu_list, uint64_t *cpus) {
+  const char *p = cpu_list;
+  *cpus = 0;
+
+  while (*p != '\0') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p) {
+      return 1;
+    }
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1) {
+        return 1;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last && cpu < RT_PROFILE_MAX_CPUS; ++cpu) {
+      *cpus |= 1ull << cpu;
+    }
+    if (*p == ',') {
+      ++p;
+    }
+    else if (*p != '\0') {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+// read the first line of a sysfs/procfs file without the newline
+static int read_sysfs_line(const char *path, char *buffer, size_t buffer_size) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return 1;
+  }
+
+  if (fgets(buffer, buffer_size, file) == NULL) {
+    buffer[0] = '\0';
+  }
+  fclose(file);
+  buffer[strcspn(buffer, "\n")] = '\0';
+  return 0;
+}
+
+
+// touch each page of stack below the caller so it's resident (and with
+// mlockall MCL_FUTURE, locked) before the thread's loop starts
+static __attribute__((noinline)) void prefault_stack(size_t bytes) {
+  volatile unsigned char *stack = alloca(bytes);
+  long page_size = sysconf(_SC_PAGESIZE);
+
+  for (size_t i = 0; i < bytes; i += page_size) {
+    stack[i] = 0;
+  }
+}
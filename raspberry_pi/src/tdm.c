@@ -0,0 +1,39 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tdm.h"
+
+
+void tdm_demux(const char **device_samples, int sync_channel,
+               uint32_t slow_channel_mask, int num_channels,
+               int channel_offset, int tdm_base, int16_t *samples) {
+  int phase = tdm_phase(*(const int16_t*)device_samples[sync_channel]);
+  int fast_index = 0;
+  int slow_index = tdm_base;
+
+  for (int channel = 0; channel < num_channels; ++channel) {
+    if (slow_channel_mask & (1u << channel)) {
+      // only this phase's slot of each lane is current
+      if (slow_index % TDM_SLOTS_PER_CHANNEL == phase) {
+        samples[channel] = *(const int16_t*)device_samples[tdm_lane_channel(sync_channel, slow_index)];
+      }
+      ++slow_index;
+    }
+    else {
+      samples[channel] = *(const int16_t*)device_samples[channel_offset + fast_index];
+      ++fast_index;
+    }
+  }
+}
@@ -70,6 +70,7 @@ int autotune_all_cards(struct card_manager *card_mgr) {
     tune_status = (this_card->tunereq_save_state)(this_card->plugin_object);
     if (tune_status != TUNE_CONTINUE) {
       cards_to_tune = SET_CARD_TUNED(cards_to_tune, card_num);
+      this_card->tune_result = tune_status;
       INFO("autotune: tunereq_save_state: card %d reports tuned", card_num);
     }
   }
@@ -95,6 +96,7 @@ int autotune_all_cards(struct card_manager *card_mgr) {
 
         if (tune_status != TUNE_CONTINUE) {
           cards_to_tune = SET_CARD_TUNED(cards_to_tune, card_num);
+          this_card->tune_result = tune_status;
           INFO("tunereq_set_point: card %d reports tuned", card_num);
         }
         else {
@@ -150,11 +152,20 @@ int autotune_all_cards(struct card_manager *card_mgr) {
         if (tune_status != TUNE_CONTINUE) {
           INFO("autotune: tunereq_measurement: card %d reports tuned", card_num);
           cards_to_tune = SET_CARD_TUNED(cards_to_tune, card_num);
+          this_card->tune_result = tune_status;
         }
       }
     }
   }
 
+  // out of iterations: whoever is still tuning didn't make it
+  for (int card_num = 0; card_num < card_mgr->num_cards; ++card_num) {
+    if (TEST_CARD_TUNED(cards_to_tune, card_num)) {
+      INFO("autotune: card %d did not finish in %d iterations", card_num, MAX_TUNING_ITERATIONS);
+      card_mgr->card_update_order[card_num]->tune_result = TUNE_COMPLETE_FAILED;
+    }
+  }
+
   // restore state
   for (int card_num = 0; card_num < card_mgr->num_cards; ++card_num) {
     (card_mgr->card_update_order[card_num]->tunereq_restore_state)(card_mgr->card_update_order[card_num]->plugin_object);
@@ -25,16 +25,30 @@
 /* wait up to 100ms timeout for the PCM stream */
 #define SND_PCM_WAIT_TIMEOUT 100
 
-static int xrun_recovery(struct alsa_pcm_state *pcm_state, int err);
+// configure_pcm_device runs at startup before rt_log is going, and on
+// a retune from the FIFO event loop where zlog mustn't be called
+#define CFG_INFO(rt, ...)  do { if (rt) { RT_INFO(__VA_ARGS__); } else { INFO(__VA_ARGS__); } } while (0)
+#define CFG_ERROR(rt, ...) do { if (rt) { RT_ERROR(__VA_ARGS__); } else { ERROR(__VA_ARGS__); } } while (0)
+
+static int xrun_recovery(struct alsa_pcm_state *pcm_state, int err, enum zalsa_xrun_cause cause);
+static enum zalsa_xrun_cause xrun_cause_for_error(int err);
+static void recovery_begin(struct alsa_pcm_state *pcm_state);
+static void recovery_complete(struct alsa_pcm_state *pcm_state);
+static int configure_pcm_device(struct alsa_pcm_state *pcm_state, int rt);
 
 static const snd_pcm_format_t default_snd_pcm_format = SND_PCM_FORMAT_S16_LE;
 
+const char *zalsa_xrun_cause_names[XRUN_NUM_CAUSES] = {
+  [XRUN_CAUSE_OVERRUN] = "overrun",
+  [XRUN_CAUSE_SUSPEND] = "suspend",
+  [XRUN_CAUSE_DISCONNECT] = "disconnect",
+  [XRUN_CAUSE_COMMIT_MISMATCH] = "commit mismatch"
+};
+
 
 
 struct alsa_pcm_state* init_alsa_device(config_t *cfg, int device_num) {
   struct alsa_pcm_state *pcm_state;
-  snd_pcm_hw_params_t *hw_params;
-  int err;
   int cfg_int_value;
   const char *device_name;
 
@@ -87,86 +101,129 @@ struct alsa_pcm_state* init_alsa_device(config_t *cfg, int device_num) {
   pcm_state->format = default_snd_pcm_format;
   pcm_state->first_period = 1;
 
+  if (configure_pcm_device(pcm_state, 0)) {
+    return NULL;
+  }
+
+  return pcm_state;
+}
+
+
+
+int alsa_reinit_device(struct alsa_pcm_state *pcm_state,
+                       snd_pcm_sframes_t period_size, snd_pcm_uframes_t buffer_size) {
+  if (pcm_state->pcm_handle) {
+    snd_pcm_drop(pcm_state->pcm_handle);
+    snd_pcm_close(pcm_state->pcm_handle);
+    pcm_state->pcm_handle = NULL;
+  }
+
+  pcm_state->period_size = period_size;
+  pcm_state->buffer_size = buffer_size;
+  pcm_state->first_period = 1;
+  pcm_state->frames_provided = 0;
+  pcm_state->frames_remaining = 0;
+  pcm_state->linked = 0;  // closing the handle unlinked it
+
+  RT_INFO("alsa_reinit: %s period %ld buffer %lu", pcm_state->device_name,
+          pcm_state->period_size, pcm_state->buffer_size);
+
+  return configure_pcm_device(pcm_state, 1);
+}
 
 
+
+/** configure_pcm_device
+ *
+ * open the pcm named in pcm_state and set hw params from it:
+ * period_size and buffer_size in, sampling_rate and channels out.
+ * rt selects rt_log for callers on an RT thread.  Return zero for
+ * success, non-zero on failure.
+ */
+static int configure_pcm_device(struct alsa_pcm_state *pcm_state, int rt) {
+  snd_pcm_hw_params_t *hw_params;
+  int err;
+
   // Now open the actual stream
   if ((err = snd_pcm_open(&pcm_state->pcm_handle, pcm_state->device_name, SND_PCM_STREAM_CAPTURE, 0)) < 0) {
-    ERROR("cannot open audio device %s (%s)",  pcm_state->device_name, snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot open audio device %s (%s)",  pcm_state->device_name, snd_strerror(err));
+    return 1;
   }
 
   if ((err = snd_pcm_hw_params_malloc(&hw_params)) < 0) {
-    ERROR("cannot allocate hardware parameter structure (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot allocate hardware parameter structure (%s)", snd_strerror(err));
+    return 1;
   }
 				 
   if ((err = snd_pcm_hw_params_any(pcm_state->pcm_handle, hw_params)) < 0) {
-    ERROR("cannot initialize hardware parameter structure (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot initialize hardware parameter structure (%s)", snd_strerror(err));
+    return 1;
   }
 
   if ((err = snd_pcm_hw_params_set_access(pcm_state->pcm_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
-    ERROR("cannot set access type (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set access type (%s)", snd_strerror(err));
+    return 1;
   }
 
   if ((err = snd_pcm_hw_params_set_format(pcm_state->pcm_handle, hw_params, pcm_state->format)) < 0) {
-    ERROR("cannot set sample format (%s)", snd_strerror (err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set sample format (%s)", snd_strerror (err));
+    return 1;
   }
 
   // get min sampling rate and set based on that
   if ((err = snd_pcm_hw_params_get_rate_min(hw_params, &pcm_state->sampling_rate, 0)) < 0) {
-    ERROR("cannot get min sampling rate (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot get min sampling rate (%s)", snd_strerror(err));
+    return 1;
   }
   if ((err = snd_pcm_hw_params_set_rate_near(pcm_state->pcm_handle, hw_params, &pcm_state->sampling_rate, 0)) < 0) {
-    ERROR("cannot set sample rate to %d (%s)", pcm_state->sampling_rate, snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set sample rate to %d (%s)", pcm_state->sampling_rate, snd_strerror(err));
+    return 1;
   }
-  INFO("set %s sampling rate to %d Hz", pcm_state->device_name, pcm_state->sampling_rate);
+  CFG_INFO(rt, "set %s sampling rate to %d Hz", pcm_state->device_name, pcm_state->sampling_rate);
 	
   if ((err = snd_pcm_hw_params_set_period_size(pcm_state->pcm_handle, hw_params, pcm_state->period_size, 0)) < 0) {
-    ERROR("cannot set period size (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set period size (%s)", snd_strerror(err));
+    return 1;
   }
 
   if ((err = snd_pcm_hw_params_set_buffer_size_near(pcm_state->pcm_handle, hw_params, &pcm_state->buffer_size)) < 0) {
-    ERROR("cannot set buffer size (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set buffer size (%s)", snd_strerror(err));
+    return 1;
   }
 
   // pull in the maximum channels
   if ((err = snd_pcm_hw_params_get_channels_max(hw_params, &pcm_state->channels)) < 0) {
-    ERROR("cannot get channel count on %s (%s)", pcm_state->device_name, snd_strerror(err));
+    CFG_ERROR(rt, "cannot get channel count on %s (%s)", pcm_state->device_name, snd_strerror(err));
   }
   if ((err = snd_pcm_hw_params_set_channels(pcm_state->pcm_handle, hw_params, pcm_state->channels)) < 0) {
-    ERROR("cannot set channel count on %s to %d (%s)", pcm_state->device_name,
-          pcm_state->channels, snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set channel count on %s to %d (%s)", pcm_state->device_name,
+              pcm_state->channels, snd_strerror(err));
+    return 1;
   }
-  INFO("set %s : maximum %d channels set", pcm_state->device_name, pcm_state->channels);
+  CFG_INFO(rt, "set %s : maximum %d channels set", pcm_state->device_name, pcm_state->channels);
 
-  pcm_state->samples = (const char**)calloc(pcm_state->channels, sizeof(char*));
+  if (pcm_state->samples == NULL) {
+    pcm_state->samples = (const char**)calloc(pcm_state->channels, sizeof(char*));
+  }
 
 
   if ((err = snd_pcm_hw_params(pcm_state->pcm_handle, hw_params)) < 0) {
-    ERROR("cannot set parameters (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot set parameters (%s)", snd_strerror(err));
+    return 1;
   }
 
-  INFO("alsa_init: %s (device num %d) hardware params set", pcm_state->device_name, pcm_state->device_num);
+  CFG_INFO(rt, "alsa_init: %s (device num %d) hardware params set", pcm_state->device_name, pcm_state->device_num);
 	
   snd_pcm_hw_params_free(hw_params);
 
   if ((err = snd_pcm_prepare(pcm_state->pcm_handle)) < 0) {
-    ERROR("cannot prepare audio interface for use (%s)", snd_strerror(err));
-    return NULL;
+    CFG_ERROR(rt, "cannot prepare audio interface for use (%s)", snd_strerror(err));
+    return 1;
   }
 
-  INFO("alsa_init: %s prepared", pcm_state->device_name);
+  CFG_INFO(rt, "alsa_init: %s prepared", pcm_state->device_name);
 
-  return pcm_state;
+  return 0;
 }
 
 
@@ -175,7 +232,8 @@ struct alsa_pcm_state* init_alsa_device(config_t *cfg, int device_num) {
 int alsa_start_stream(struct alsa_pcm_state *pcm_state) {
   int err;
   err = alsa_pcm_ensure_ready(pcm_state);
-  if (err == -EAGAIN) {
+  if (err == -EAGAIN || err == -EPIPE) {
+    // xrun while starting: stream was re-prepared, try again
     return -EAGAIN;
   }
   else if (err) {
@@ -183,11 +241,16 @@ int alsa_start_stream(struct alsa_pcm_state *pcm_state) {
     return 1;
   }
 
-  if ( alsa_mmap_begin_with_step_calc(pcm_state) ) {
+  err = alsa_mmap_begin_with_step_calc(pcm_state);
+  if (err == -EPIPE) {
+    return -EAGAIN;
+  }
+  else if (err) {
     ERROR("zalsa: %s alsa_pcm_mmap_begin error", pcm_state->device_name);
     return 1;
   }
 
+  recovery_complete(pcm_state);
   return 0;
 }
 
@@ -206,23 +269,33 @@ int alsa_advance_stream_by_frames(struct alsa_pcm_state *pcm_state, int frames)
   }
   else {
     if ( alsa_mmap_end(pcm_state) ) {
-      ERROR("alsa_mmap_end returned non-zero");
+      RT_ERROR("alsa_mmap_end returned non-zero");
       retval = 1;
     }
+    if (pcm_state->recovering) {
+      return -EPIPE;
+    }
 
     err = alsa_pcm_ensure_ready(pcm_state);
-    if (err == -EAGAIN) {
-      return -EAGAIN;
+    if (err == -EAGAIN || err == -EPIPE) {
+      return err;
     }
     else if (err) {
-      ERROR("alsa_pcm_ensure_ready returned non-zero");
+      RT_ERROR("alsa_pcm_ensure_ready returned non-zero");
       retval += 2;
     }
 
-    if ( alsa_mmap_begin(pcm_state) ) {
-      ERROR("alsa_mmap_begin returned non-zero");
+    err = alsa_mmap_begin(pcm_state);
+    if (err == -EPIPE) {
+      return -EPIPE;
+    }
+    else if (err) {
+      RT_ERROR("alsa_mmap_begin returned non-zero");
       retval += 4;
     }
+    else {
+      pcm_state->periods_begun++;
+    }
   }
 
   return retval;
@@ -231,30 +304,33 @@ int alsa_advance_stream_by_frames(struct alsa_pcm_state *pcm_state, int frames)
 
 
 /* alsa_pcm_ensure_ready
- * get things ready for a snd_pcm_mmap_begin() call
+ * get things ready for a snd_pcm_mmap_begin() call.
+ * Returns -EPIPE, without waiting, if an xrun had to be recovered:
+ * the stream has been re-prepared and the caller should hold.
  */
 int alsa_pcm_ensure_ready(struct alsa_pcm_state *pcm_state) {
   int ret, snd_state;
   snd_pcm_sframes_t avail;
-  int xrun = 0;
 
   while (1) {
     snd_state = snd_pcm_state(pcm_state->pcm_handle);
     switch (snd_state) {
     case SND_PCM_STATE_XRUN:
+      ret = xrun_recovery(pcm_state, EPIPE, XRUN_CAUSE_OVERRUN);
+      return ret < 0 ? ret : -EPIPE;
     case SND_PCM_STATE_DISCONNECTED:
-      ret = xrun_recovery(pcm_state, EPIPE);
-      xrun = 1;
-      if (ret < 0) {
-        return ret;
-      }
-      break;
+      ret = xrun_recovery(pcm_state, EPIPE, XRUN_CAUSE_DISCONNECT);
+      return ret < 0 ? ret : -EPIPE;
     case SND_PCM_STATE_SUSPENDED:
-      ret = xrun_recovery(pcm_state, ESTRPIPE);
-      if (ret < 0)
-        return ret;
-      break;
+      ret = xrun_recovery(pcm_state, ESTRPIPE, XRUN_CAUSE_SUSPEND);
+      return ret < 0 ? ret : -EPIPE;
     case SND_PCM_STATE_PREPARED:
+      if (!pcm_state->first_period) {
+        // a linked device recovered from an xrun and re-prepared us too
+        recovery_begin(pcm_state);
+        return -EPIPE;
+      }
+      break;
     case SND_PCM_STATE_RUNNING:
     default:
       break;
@@ -262,24 +338,17 @@ int alsa_pcm_ensure_ready(struct alsa_pcm_state *pcm_state) {
 
     avail = snd_pcm_avail_update(pcm_state->pcm_handle);
 
-    if (xrun) {
-      WARN("alsa_pcm_ensure_ready: xrun snd_pcm_avail_update returned %ld", avail);
-    }
-
     if (avail < 0) {
-      ret = xrun_recovery(pcm_state, -avail);
-      if (ret < 0) {
-        return ret;
-      }
-      pcm_state->first_period = 1;
-      continue;
+      ret = xrun_recovery(pcm_state, -avail, xrun_cause_for_error(-avail));
+      return ret < 0 ? ret : -EPIPE;
     }
     else if (avail < pcm_state->period_size) {
       if (pcm_state->first_period) {
         pcm_state->first_period = 0;
-        ret = snd_pcm_start(pcm_state->pcm_handle);
-        if (ret < 0) {
-          ERROR("snd_pcm_start: %s", snd_strerror(errno));
+        // a linked stream may already have been started with its partner
+        if (snd_state == SND_PCM_STATE_PREPARED &&
+            (ret = snd_pcm_start(pcm_state->pcm_handle)) < 0) {
+          RT_ERROR("snd_pcm_start: %s", snd_strerror(ret));
           return ret;
         }
       }
@@ -289,19 +358,15 @@ int alsa_pcm_ensure_ready(struct alsa_pcm_state *pcm_state) {
           return -EAGAIN;
         }
         else if (ret < 0) {
-          ret = xrun_recovery(pcm_state, -ret);
-          if (ret < 0) {
-            return ret;
-          }
-        }
-        if (xrun) {
-          WARN("alsa_pcm_ensure_ready: setting first period");
+          ret = xrun_recovery(pcm_state, -ret, xrun_cause_for_error(-ret));
+          return ret < 0 ? ret : -EPIPE;
         }
         pcm_state->first_period = 1;
       }
       continue;
     }
     else {
+      pcm_state->period_avail = avail;
       break;
     }
   }
@@ -325,11 +390,13 @@ int alsa_mmap_begin_with_step_calc(struct alsa_pcm_state *pcm_state) {
   INFO("alsa mmap begin requested %ld frames received %ld frames", pcm_state->period_size, pcm_state->frames_provided);
 
   if (ret < 0) {
-    ret = xrun_recovery(pcm_state, -ret);
+    ret = xrun_recovery(pcm_state, -ret, xrun_cause_for_error(-ret));
     if (ret < 0) {
       ERROR("alsa: mmap begin avail error: %s", snd_strerror(ret));
       return ret;
     }
+    // nothing mapped: mmap_area can't be trusted for the step calc
+    return -EPIPE;
   }
 
   // calculate the base address for each channelnum and step size
@@ -366,15 +433,15 @@ int alsa_mmap_begin(struct alsa_pcm_state *pcm_state) {
   ret = snd_pcm_mmap_begin(pcm_state->pcm_handle, &pcm_state->mmap_area, &pcm_state->offset, &pcm_state->frames_provided);
 
   if (ret < 0) {
-    ret = xrun_recovery(pcm_state, -ret);
+    ret = xrun_recovery(pcm_state, -ret, xrun_cause_for_error(-ret));
     if (ret < 0) {
-      ERROR("alsa: mmap begin avail error: %s", snd_strerror(ret));
+      RT_ERROR("alsa: mmap begin avail error: %s", snd_strerror(ret));
       return ret;
     }
+    // stream is restarting; samples stay where they were until recovered
+    return -EPIPE;
   }
-  else {
-      pcm_state->frames_remaining = pcm_state->frames_provided;
-  }
+  pcm_state->frames_remaining = pcm_state->frames_provided;
 
   // calculate samples address for each channel
   for (int channelnum = 0; channelnum < pcm_state->channels; ++channelnum) {
@@ -396,8 +463,9 @@ int alsa_mmap_end(struct alsa_pcm_state *pcm_state) {
 
   committed = snd_pcm_mmap_commit(pcm_state->pcm_handle, pcm_state->offset, pcm_state->frames_provided);
   if (committed < 0 || committed != pcm_state->frames_provided) {
-    WARN("alsa_mmap_end commit: xrun_recovery");
-    ret = xrun_recovery(pcm_state, committed >= 0 ? EPIPE : -committed);
+    RT_WARN("alsa_mmap_end commit: xrun_recovery");
+    ret = xrun_recovery(pcm_state, committed >= 0 ? EPIPE : -committed,
+                        committed >= 0 ? XRUN_CAUSE_COMMIT_MISMATCH : xrun_cause_for_error(-committed));
     if (ret < 0) {
       return ret;
     }
@@ -408,35 +476,115 @@ int alsa_mmap_end(struct alsa_pcm_state *pcm_state) {
 
 
 
+int alsa_link_devices(struct alsa_pcm_state *pcm_state0, struct alsa_pcm_state *pcm_state1) {
+  int err;
+
+  if ((err = snd_pcm_link(pcm_state0->pcm_handle, pcm_state1->pcm_handle)) < 0) {
+    INFO("zalsa: %s and %s can't be linked (%s), starting them separately",
+         pcm_state0->device_name, pcm_state1->device_name, snd_strerror(err));
+    pcm_state0->linked = pcm_state1->linked = 0;
+    return 1;
+  }
+
+  INFO("zalsa: linked %s to %s", pcm_state1->device_name, pcm_state0->device_name);
+  pcm_state0->linked = pcm_state1->linked = 1;
+  return 0;
+}
+
+
+
+int alsa_recover_stream(struct alsa_pcm_state *pcm_state) {
+  snd_pcm_sframes_t avail;
+  int ret;
+
+  switch (snd_pcm_state(pcm_state->pcm_handle)) {
+  case SND_PCM_STATE_SUSPENDED:
+    ret = snd_pcm_resume(pcm_state->pcm_handle);
+    if (ret == -EAGAIN) {
+      // suspend flag not yet released
+      return -EAGAIN;
+    }
+    if (ret < 0 && (ret = snd_pcm_prepare(pcm_state->pcm_handle)) < 0) {
+      return ret;
+    }
+    return -EAGAIN;
+  case SND_PCM_STATE_XRUN:
+    // overran again before the restart got going
+    if ((ret = snd_pcm_prepare(pcm_state->pcm_handle)) < 0) {
+      return ret;
+    }
+    return -EAGAIN;
+  case SND_PCM_STATE_DISCONNECTED:
+    return -ENODEV;
+  case SND_PCM_STATE_PREPARED:
+    if ((ret = snd_pcm_start(pcm_state->pcm_handle)) < 0) {
+      return ret;
+    }
+    pcm_state->first_period = 0;
+    return -EAGAIN;
+  default:
+    break;
+  }
+
+  avail = snd_pcm_avail_update(pcm_state->pcm_handle);
+  pcm_state->period_avail = avail;
+  if (avail == -EPIPE || avail == -ESTRPIPE) {
+    // state is picked up on the next call
+    return -EAGAIN;
+  }
+  else if (avail < 0) {
+    return avail;
+  }
+  else if (avail < pcm_state->period_size) {
+    return -EAGAIN;
+  }
+
+  ret = alsa_mmap_begin(pcm_state);
+  if (ret == -EPIPE) {
+    return -EAGAIN;
+  }
+  else if (ret) {
+    return ret;
+  }
+
+  pcm_state->first_period = 0;
+  recovery_complete(pcm_state);
+  return 0;
+}
+
+
+
+
 /** xrun_recovery
- * take the error as a positive int
+ * take the error as a positive int.  Doesn't wait: a suspended stream
+ * that can't resume yet is left for alsa_recover_stream to retry.
  */
-static int xrun_recovery(struct alsa_pcm_state *pcm_state, int err) {
+static int xrun_recovery(struct alsa_pcm_state *pcm_state, int err, enum zalsa_xrun_cause cause) {
 
   pcm_state->xrun_recovery_count++;
+  pcm_state->xrun_cause_count[cause]++;
+  recovery_begin(pcm_state);
 
-  INFO("stream recovery: error %d", err);
+  RT_INFO("%s stream recovery: %s, error %d",
+          pcm_state->device_name, zalsa_xrun_cause_names[cause], err);
+
+  // reset to processing first period
+  pcm_state->first_period = 1;
 
   if (err == EPIPE) {    /* under-run */
     err = snd_pcm_prepare(pcm_state->pcm_handle);
-
-    // reset to processing first period
-    pcm_state->first_period = 1;
-
     if (err < 0) {
-      WARN("Can't recovery from underrun, prepare failed: %s", snd_strerror(err));
+      RT_WARN("Can't recovery from underrun, prepare failed: %s", snd_strerror(err));
     }
 
     return 0;
   }
   else if (err == ESTRPIPE) {
-    while ((err = snd_pcm_resume(pcm_state->pcm_handle)) == -EAGAIN) {
-      sleep(1);   /* wait until the suspend flag is released */
-    }
-    if (err < 0) {
+    err = snd_pcm_resume(pcm_state->pcm_handle);
+    if (err < 0 && err != -EAGAIN) {
       err = snd_pcm_prepare(pcm_state->pcm_handle);
       if (err < 0) {
-        WARN("Can't recover from suspend, prepare failed: %s", snd_strerror(err));
+        RT_WARN("Can't recover from suspend, prepare failed: %s", snd_strerror(err));
       }
     }
 
@@ -445,3 +593,49 @@ static int xrun_recovery(struct alsa_pcm_state *pcm_state, int err) {
   return err;
 }
 
+
+static enum zalsa_xrun_cause xrun_cause_for_error(int err) {
+  switch (err) {
+  case ESTRPIPE:
+    return XRUN_CAUSE_SUSPEND;
+  case ENODEV:
+  case EBADFD:
+    return XRUN_CAUSE_DISCONNECT;
+  default:
+    return XRUN_CAUSE_OVERRUN;
+  }
+}
+
+
+static void recovery_begin(struct alsa_pcm_state *pcm_state) {
+  if (!pcm_state->recovering) {
+    pcm_state->recovering = 1;
+    clock_gettime(CLOCK_MONOTONIC, &pcm_state->recovery_start);
+  }
+}
+
+
+/** recovery_complete
+ * stream is back: record how long it was out
+ */
+static void recovery_complete(struct alsa_pcm_state *pcm_state) {
+  struct timespec now;
+  int64_t elapsed_ns;
+
+  if (!pcm_state->recovering) {
+    return;
+  }
+  pcm_state->recovering = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed_ns = (int64_t)(now.tv_sec - pcm_state->recovery_start.tv_sec) * 1000000000 +
+    (now.tv_nsec - pcm_state->recovery_start.tv_nsec);
+
+  pcm_state->last_recovery_ns = elapsed_ns;
+  pcm_state->total_recovery_ns += elapsed_ns;
+  if (elapsed_ns > pcm_state->max_recovery_ns) {
+    pcm_state->max_recovery_ns = elapsed_ns;
+  }
+  pcm_state->recoveries_completed++;
+}
+
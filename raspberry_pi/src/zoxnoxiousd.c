@@ -16,7 +16,10 @@
 /* main file for zoxnoxiousd server application.  Handle basic setup of components,
  * init, get things going.
  * run it something like this with LD_LIBRARY_PATH set to /usr/local/zoxnoxiousd/lib
- * sudo env LD_LIBRARY_PATH=$LD_LIBRARY_PATH chrt -f 40 ./zoxnoxiousd -i /home/kaf/git/zoxnoxious/raspberry_pi/etc/zoxnoxiousd.cfg
+ * sudo env LD_LIBRARY_PATH=$LD_LIBRARY_PATH ./zoxnoxiousd -i /home/kaf/git/zoxnoxious/raspberry_pi/etc/zoxnoxiousd.cfg
+ * Thread priorities/affinity come from the rt_profile config section, so
+ * chrt isn't needed.  Check the system's RT setup with:
+ * ./zoxnoxiousd -i <config_file> --rt-check
  */
 
 #include <alsa/asoundlib.h>
@@ -27,10 +30,14 @@
 #include <pigpio.h>
 #include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/timerfd.h>
@@ -42,6 +49,12 @@
 #include "zoxnoxiousd.h"
 #include "tune_mgr.h"
 #include "card_manager.h"
+#include "checkpoint.h"
+#include "midi_parser.h"
+#include "midi_queue.h"
+#include "pcm_sync.h"
+#include "period_tuner.h"
+#include "rt_profile.h"
 #include "zalsa.h"
 #include "zcard_plugin.h"
 
@@ -52,45 +65,155 @@
 #define EXPIRATIONS_MISSED_ONE 1
 #define EXPIRATIONS_MISSED_LT_TEN 2
 #define EXPIRATIONS_MISSED_GTE_TEN 3
-#define DISCOVERY_REPORT_SIZE_BYTES 28
-
-// midi thread polls with a timeout to check for thread termination condition
-#define MIDI_TIMEOUT_MS 10
+#define DISCOVERY_REPORT_SIZE_BYTES 87
+// offsets into the discovery report, see midi.spec
+#define DISCOVERY_REPORT_CARD_BYTES 3
+#define DISCOVERY_REPORT_TDM_OFFSET 27
+#define DISCOVERY_REPORT_TDM_CARD_BYTES 7
+#define DISCOVERY_REPORT_TDM_SYNC_OFFSET 83
+#define DISCOVERY_REPORT_TDM_NO_SYNC 0x7F
+#define DISCOVERY_REPORT_LATENCY_MARKER_OFFSET 85
+#define DISCOVERY_REPORT_NO_LATENCY_MARKER 0x7F
+// stats report, see midi.spec: header, 28 bit values, then the cards
+#define STATS_REPORT_VERSION 1
+#define STATS_REPORT_HEADER_BYTES 4
+#define STATS_REPORT_VALUE_BYTES 4
+#define STATS_REPORT_CARD_BYTES 6
+#define STATS_REPORT_MAX_BYTES (STATS_REPORT_HEADER_BYTES + STATS_NUM_VALUES * STATS_REPORT_VALUE_BYTES + \
+                                1 + MAX_SLOTS * STATS_REPORT_CARD_BYTES + 1)
+#define STATS_VALUE_MAX ((1 << 27) - 1)
+#define STATS_VALUE_MIN (-(1 << 27))
+#define STATS_CARD_VALUE_MAX 0x3FFF
+#define LATENCY_REPORT_SIZE_BYTES 17
+#define HEARTBEAT_ACK_SIZE_BYTES 7
+
+// cards hold their last values when a client that sends heartbeats
+// hasn't for this long
+#define CLIENT_HEARTBEAT_TIMEOUT_NS 100000000LL
+
+// latency marker levels: a rising edge through high after being below low
+#define LATENCY_MARKER_HIGH 16384
+#define LATENCY_MARKER_LOW 8192
+
+// requests to the event loop from other threads, see request_control
+#define CONTROL_REQUEST_SHUTDOWN 0x1
+#define CONTROL_REQUEST_TUNE 0x2
+#define CONTROL_REQUEST_LATENCY_REPORT 0x4
+#define CONTROL_REQUEST_RETUNE 0x8
+#define CONTROL_REQUEST_CHECKPOINT 0x10
+
+#define EVENT_LOOP_MAX_EVENTS 8
+// card MIDI messages handed over per frame, at most
+#define MIDI_MESSAGES_PER_FRAME 32
+
+// values in the stats report, in order
+enum stats_report_value {
+  STATS_UPTIME_SEC,
+  STATS_SAMPLING_RATE,
+  STATS_PERIOD_SIZE,
+  STATS_PCM0_FILL_X10,        // frames captured not yet consumed, x10
+  STATS_PCM_BUSY_PERMILLE,    // of the frame interval, since last report
+  STATS_MISSED_ONE,
+  STATS_MISSED_FEW,           // 2 to 9
+  STATS_MISSED_MANY,          // 10 or more
+  STATS_XRUNS,
+  STATS_MAX_RECOVERY_USEC,
+  STATS_DRIFT_PPM_X10,
+  STATS_PCM1_SLIPS,
+  STATS_MIDI_ERRORS,
+  STATS_RT_LOG_DROPPED,
+  STATS_NUM_VALUES
+};
 
 /* globals-  mainly so they can be accessed by signal handler  */
 static struct card_manager *card_mgr = NULL;
+static struct rt_profile *rt_profile = NULL;
 static struct alsa_pcm_state *pcm_state[2] = { NULL, NULL };
+static struct period_tuner *period_tuner = NULL;
+static struct pcm_sync *pcm_sync = NULL;
 static snd_rawmidi_t *midi_in = NULL;
 static snd_rawmidi_t *midi_out = NULL;
 static pthread_mutex_t midi_out_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct midi_parser midi_parser;
+static struct midi_queue card_midi_queue;
 
 static _Atomic int alsa_thread_run = 1;
 static _Atomic uint64_t missed_expirations[NUM_MISSED_EXPIRATIONS_STATS] = { 0 };
 static _Atomic time_t sec_pcm_write_idle = 0;
 static _Atomic long nsec_pcm_write_idle = 0;
+static struct timespec daemon_start_time;
+// start of main, for time to first frame
+static struct timespec daemon_launch_time;
+// identifies this run of the daemon to the client, in heartbeat acks
+static uint8_t session_id;
+// CLOCK_MONOTONIC ns of the last client heartbeat, 0 before the first
+static _Atomic int64_t last_heartbeat_ns = 0;
+
+// latency marker seen by the PCM thread, for the event loop to report.
+// Fields are written before count is bumped; the client waits for a
+// report before sending the next marker.
+struct latency_marker {
+  _Atomic uint32_t count;
+  struct timespec detected;
+  uint64_t frame;       // pcm0 frames consumed when the marker was written out
+  int32_t backlog;      // frames captured after it, not yet consumed
+};
+static struct latency_marker latency_marker;
 
 static _Atomic int system_tune_requested = 0;
 static _Atomic int system_tune_in_progress = 0;
 static _Atomic int midi_request_shutdown = 0;
 static _Atomic int midi_request_restart = 0;
 
+// period retune handoff: the PCM thread parks and the event loop
+// reopens the devices, which blocks in ALSA
+enum pcm_retune_state {
+  RETUNE_IDLE,
+  RETUNE_REQUESTED,     // PCM thread parked, event loop to reopen devices
+  RETUNE_DONE,          // streams restarted, PCM thread to re-arm its clock
+  RETUNE_FAILED         // devices down, PCM thread asks again later
+};
+static _Atomic int pcm_retune_state = RETUNE_IDLE;
+
+// periodic checkpoint handoff: the PCM thread copies the cards out
+// between frames, one a frame, and the event loop writes the file
+enum checkpoint_capture_state {
+  CAPTURE_IDLE,
+  CAPTURE_REQUESTED,    // PCM thread to copy the cards
+  CAPTURE_DONE          // event loop to write them out
+};
+static _Atomic int checkpoint_capture_state = CAPTURE_IDLE;
+static struct checkpoint *running_checkpoint = NULL;
 
-// Signal handling: handlers just set flags and return
-static volatile sig_atomic_t sig_cleanup_received = 0;
-static volatile sig_atomic_t sig_dump_stats_received = 0;
+// eventfd wakes the event loop; control_requests says what for
+static int control_eventfd = -1;
+static _Atomic unsigned int control_requests = 0;
 
 
 // static functions
 static void help();
-static void sig_cleanup_and_exit(int signum);
-static void sig_dump_stats(int signum);
+static void dump_stats();
+static void request_control(unsigned int request);
+static int run_event_loop(config_t *cfg, const sigset_t *signal_set);
 static int open_midi_device(config_t *cfg);
+static void* init_pcm_devices(void *cfg);
 static void* read_pcm_and_call_plugins(void *);
-static void* midi_in_to_plugins(void *);
 static void generate_discovery_report(uint8_t discovery_report_sysex[]);
-static int z_midi_write(uint8_t *buffer, int buffer_size);
+static int generate_stats_report(uint8_t stats_report_sysex[]);
+static void send_latency_report();
+static int z_midi_write(const uint8_t *buffer, int buffer_size);
 static int get_midi_input_fd();
+static int handle_midi_input();
+static void midi_message_received(void *arg, int channel, const uint8_t *message, size_t size);
+static void handle_sysex(const uint8_t *message, size_t size, const uint8_t discovery_report_sysex[]);
+static void apply_card_state(const uint8_t *message, size_t size);
 static int start_pcm(struct alsa_pcm_state *pcm, int *err_var, const char *name);
+static int start_pcm_streams();
+static int retune_pcm_streams();
+static int reinit_pcm_devices();
+static int recover_pcm_streams(int timerfd_sample_clock, const struct itimerspec *sample_clock, int frames_to_advance);
+static void steer_sample_clock(int timerfd_sample_clock, struct itimerspec *sample_clock);
+static inline int64_t timespec_diff_ns(const struct timespec *start, const struct timespec *end);
 
 
 
@@ -98,11 +221,12 @@ int main(int argc, char **argv, char **envp) {
   config_t *cfg;
   char *midi_device_name = NULL;
   char config_filename[128] = { '\0' };
-  char *opt_string = "hi:v";
+  char *opt_string = "hi:vc";
+  int rt_check_only = 0;
   pthread_t alsa_pcm_to_plugin_thread;
-  pthread_t midi_in_plugin_thread;
   sigset_t signal_set;
-  struct sigaction signal_action_cleanup, signal_action_stats;
+
+  clock_gettime(CLOCK_MONOTONIC, &daemon_launch_time);
 
 
   /* bookkeeping stuff before getting to the important stuff:
@@ -119,6 +243,7 @@ int main(int argc, char **argv, char **envp) {
     {"help", no_argument, NULL, 'h'},
     {"config", required_argument, NULL, 'i'},
     {"verbose", required_argument, NULL, 'v'},
+    {"rt-check", no_argument, NULL, 'c'},
     {NULL, 0, NULL, 0},
   };
 
@@ -137,6 +262,9 @@ int main(int argc, char **argv, char **envp) {
       strncpy(config_filename, optarg, sizeof(config_filename) - 1);
       config_filename[127] = '\0';
       break;
+    case 'c':
+      rt_check_only = 1;
+      break;
     default:
       printf("unknown option\n");
       help();
@@ -145,6 +273,16 @@ int main(int argc, char **argv, char **envp) {
   }
 
 
+  // signals are blocked in every thread and read from a signalfd by the
+  // event loop.  Block before any threads (pigpio's too) are created.
+  sigemptyset(&signal_set);
+  sigaddset(&signal_set, SIGUSR1);
+  sigaddset(&signal_set, SIGHUP);
+  sigaddset(&signal_set, SIGINT);
+  sigaddset(&signal_set, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
+
+
   // TODO: hardcoded directory
   if (zlog_init("/home/kaf/git/zoxnoxious/raspberry_pi/etc/log.cfg")) {
     printf("zlog_init failed");
@@ -187,9 +325,27 @@ int main(int argc, char **argv, char **envp) {
   }
 
 
+  // RT profile: report how well the system is set up for it
+  if ( (rt_profile = init_rt_profile(cfg)) == NULL ) {
+    FATAL("init_rt_profile failed");
+    abort();
+  }
+
+  int rt_problems = rt_profile_self_check(rt_profile);
+  if (rt_check_only) {
+    free_rt_profile(rt_profile);
+    zlog_fini();
+    config_destroy(cfg);
+    free(cfg);
+    return rt_problems ? 1 : 0;
+  }
+
+
   // SPI, pigpio start
 #ifndef MOCK_DATA
   gpioCfgClock(4, 1, 1);
+  // signals are ours to handle via the event loop
+  gpioCfgSetInternals(gpioCfgGetInternals() | PI_CFG_NOSIGHANDLER);
   if (gpioInitialise() < 0) {
     ERROR("gpioInitialise failed, bye!");
     return -1;
@@ -201,42 +357,62 @@ int main(int argc, char **argv, char **envp) {
 
 
 
-  // init alsa pcm devices
-  pcm_state[0] = init_alsa_device(cfg, 0);
-  int num_hw_channels[2] = { 0 };
-
-  // only init the second if the first is valid
-  if (pcm_state[0]) {
-    INFO("pcm initialized for %s", pcm_state[0]->device_name);
-    num_hw_channels[0] = pcm_state[0]->channels;
-
-    pcm_state[1] = init_alsa_device(cfg, 1);
-
-    if (pcm_state[1]) {
-      INFO("pcm initialized for %s", pcm_state[1]->device_name);
-      num_hw_channels[1] = pcm_state[1]->channels;
-    }
-
-    if (pcm_state[1] && pcm_state[0]->channels != pcm_state[1]->channels) {
-      FATAL("devices must have same number of channels: %s (%d) and %s (%d)",
-            pcm_state[0]->device_name, pcm_state[0]->channels,
-            pcm_state[1]->device_name, pcm_state[1]->channels);
-      abort();
-    }
+  // init alsa pcm devices.  Opening the USB gadget devices is mostly
+  // waiting, so it runs alongside card discovery and plugin loading.
+  // The cards themselves share one I2C bus and the SPI mux, they're
+  // done one at a time.
+  struct timespec startup_mark, pcm_ready, cards_found;
+  pthread_t pcm_init_thread;
+  int pcm_init_threaded = pthread_create(&pcm_init_thread, NULL, init_pcm_devices, cfg) == 0;
+  if (!pcm_init_threaded) {
+    WARN("pcm init thread not started, initializing pcm devices first");
+    init_pcm_devices(cfg);
   }
 
-
   // init alsa midi device
   if (open_midi_device(cfg) != 0) {
     ERROR("fail to open MIDI device");
     abort();
   }
 
-  
   // detect installed cards- get the card manager going
+  clock_gettime(CLOCK_MONOTONIC, &startup_mark);
   card_mgr = init_card_manager(cfg);
   discover_cards(card_mgr);
   load_card_plugins(card_mgr);
+  clock_gettime(CLOCK_MONOTONIC, &cards_found);
+
+  if (pcm_init_threaded) {
+    pthread_join(pcm_init_thread, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &pcm_ready);
+  INFO("startup: cards found in %" PRId64 " usec, pcm devices ready %" PRId64 " usec after launch",
+       timespec_diff_ns(&startup_mark, &cards_found) / 1000,
+       timespec_diff_ns(&daemon_launch_time, &pcm_ready) / 1000);
+
+  int num_hw_channels[2] = { 0 };
+  if (pcm_state[0]) {
+    INFO("pcm initialized for %s", pcm_state[0]->device_name);
+    num_hw_channels[0] = pcm_state[0]->channels;
+  }
+  if (pcm_state[1]) {
+    INFO("pcm initialized for %s", pcm_state[1]->device_name);
+    num_hw_channels[1] = pcm_state[1]->channels;
+  }
+
+
+  if (pcm_state[0]) {
+    period_tuner = init_period_tuner(cfg, pcm_state[0]->sampling_rate,
+                                     pcm_state[0]->period_size, pcm_state[0]->buffer_size);
+
+    if ( (pcm_sync = init_pcm_sync(cfg, pcm_state)) == NULL) {
+      FATAL("pcm devices can't be run together");
+      abort();
+    }
+    pcm_sync_link(pcm_sync, pcm_state);
+  }
+
+
   assign_update_order(card_mgr);
   assign_hw_audio_channels(card_mgr, num_hw_channels, 2);
 
@@ -245,39 +421,64 @@ int main(int argc, char **argv, char **envp) {
     FATAL("zhost_create failed");
     abort();
   }
+  // cards' on board generators step once per frame
+  if (pcm_state[0]) {
+    zhost_set_sample_rate(zhost, pcm_state[0]->sampling_rate);
+  }
+  // and the ROM contents discovery read, so cards needn't read them again
+  for (int slot = 0; slot < MAX_SLOTS; ++slot) {
+    if (card_mgr->card_rom_sizes[slot]) {
+      zhost_set_card_rom(zhost, slot, card_mgr->card_roms[slot], card_mgr->card_rom_sizes[slot]);
+    }
+  }
 
-  // init all the plugin cards
+  // init all the plugin cards.  Cards a previous daemon left a
+  // checkpoint for are resumed as they are, the rest are reset.
+  struct timespec cards_start, cards_done;
+  struct checkpoint *checkpoint = checkpoint_load(cfg);
+  clock_gettime(CLOCK_MONOTONIC, &cards_start);
   for (int card_num = 0; card_num < card_mgr->num_cards; ++card_num) {
     // alias
     struct plugin_card *this_card = card_mgr->card_update_order[card_num];
-    // the index isn't the slot num-- but we can look it up on the card
-    INFO("init card slot %d", card_mgr->cards[card_num].slot);
-    this_card->plugin_object =
-      (this_card->init_zcard)(zhost, card_mgr->cards[card_num].slot);
-    if (this_card->plugin_object == NULL) {
-      WARN("plugin card slot %d returned NULL for init", card_mgr->cards[card_num].slot);
+    const struct checkpoint_card *card_checkpoint =
+      checkpoint_find_card(checkpoint, this_card->slot, this_card->card_id);
+
+    this_card->plugin_object = NULL;
+    if (card_checkpoint && this_card->resume_zcard) {
+      this_card->plugin_object =
+        (this_card->resume_zcard)(zhost, this_card->slot, card_checkpoint->data, card_checkpoint->size);
+      if (this_card->plugin_object) {
+        INFO("resumed card slot %d from checkpoint", this_card->slot);
+        this_card->tune_result = card_checkpoint->tune_result;
+      }
+      else {
+        WARN("card slot %d checkpoint not usable, starting it cold", this_card->slot);
+      }
     }
-  }
 
-
-  // lock memory to prevent swapping.  Must run as root for this to work (pigpio already has this requirement).
-  // This may be of dubious value: the amount of memory available is pretty huge and swap isn't ever used.
-  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
-    char error[256];
-    strerror_r(errno, error, 256);
-    ERROR("mlockall failed: %s. Continuing without memory locking.", error);
+    if (this_card->plugin_object == NULL) {
+      INFO("init card slot %d", this_card->slot);
+      this_card->plugin_object = (this_card->init_zcard)(zhost, this_card->slot);
+      if (this_card->plugin_object == NULL) {
+        WARN("plugin card slot %d returned NULL for init", this_card->slot);
+      }
+    }
   }
-  else {
-    INFO("Successfully locked memory into main memory");
+  clock_gettime(CLOCK_MONOTONIC, &cards_done);
+  INFO("cards ready in %" PRId64 " usec", timespec_diff_ns(&cards_start, &cards_done) / 1000);
+  free_checkpoint(checkpoint);
+
+  // buffers for the periodic checkpoint, so a crash leaves one too
+  int checkpoint_interval_sec = CHECKPOINT_DEFAULT_INTERVAL_SEC;
+  config_lookup_int(cfg, CHECKPOINT_INTERVAL_KEY, &checkpoint_interval_sec);
+  if (checkpoint_interval_sec > 0 && (running_checkpoint = checkpoint_create(card_mgr)) == NULL) {
+    WARN("checkpoint buffers not allocated, checkpoint only on a clean stop");
   }
 
 
-  sigemptyset(&signal_set);
-  sigaddset(&signal_set, SIGUSR1);
-  sigaddset(&signal_set, SIGHUP);
-  sigaddset(&signal_set, SIGINT);
-  sigaddset(&signal_set, SIGTERM);
-  pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
+  // lock memory so the RT threads don't take page faults on code or
+  // data that hasn't been touched yet, or was paged out.
+  rt_profile_lock_memory(rt_profile);
 
 
   // cpu tune request for all cards:
@@ -285,70 +486,32 @@ int main(int argc, char **argv, char **envp) {
   // future: give user option via frontend to use linear or corrected tables.
   //autotune_all_cards(card_mgr);
 
-  // start threads
-  if ( pthread_create(&alsa_pcm_to_plugin_thread, NULL, read_pcm_and_call_plugins, NULL) ) {
-    ERROR("failed to start thread for read_pcm_and_call_plugins");
-    abort();
+  // start threads: logger first so the RT threads never log synchronously
+  pthread_t logger_thread;
+  if (rt_log_start()) {
+    WARN("rt_log not started, RT threads will log synchronously");
   }
-
-  if ( pthread_create(&midi_in_plugin_thread, NULL, midi_in_to_plugins, NULL) ) {
-    ERROR("failed to start thread for midi_in_to_plugins");
-    abort();
+  else if (rt_log_get_thread(&logger_thread) == 0) {
+    rt_profile_apply(rt_profile, logger_thread, RT_THREAD_LOGGER);
   }
 
-
-  // setup signal handling
-  signal_action_cleanup.sa_handler = sig_cleanup_and_exit;
-  sigaction(SIGHUP, &signal_action_cleanup, NULL);
-  sigaction(SIGINT, &signal_action_cleanup, NULL);
-  sigaction(SIGTERM, &signal_action_cleanup, NULL);
-
-  signal_action_stats.sa_handler = sig_dump_stats;
-  sigaction(SIGUSR1, &signal_action_stats, NULL);
-
-  // main loop thread: check if we need to respond to signals, sleep, loop
-  while (alsa_thread_run) {
-    if (sig_cleanup_received) {
-      INFO("Signal received, initiating shutdown...");
-      alsa_thread_run = 0; // Signal worker threads to exit
-
-      if (munlockall() == -1) {
-        char error[256];
-        strerror_r(errno, error, 256);
-        ERROR("munlockall failed in main loop: %s", error);
-      } else {
-        INFO("Memory unlocked in main loop.");
-      }
-      sig_cleanup_received = 0; // reset - best practice
-      break;
-    }
-
-    if (sig_dump_stats_received) {
-      INFO("requested stats: %ld.%.9ld / %" PRId64 "; pcm[0] xrun recovery: %d; pcm[1] xrun recovery: %d",
-           sec_pcm_write_idle, nsec_pcm_write_idle,
-           missed_expirations[EXPIRATIONS_ONTIME],
-           pcm_state[0] ? pcm_state[0]->xrun_recovery_count : -1,
-           pcm_state[1] ? pcm_state[1]->xrun_recovery_count : -1);
-
-      for (int i = 1; i < NUM_MISSED_EXPIRATIONS_STATS; ++i) {
-        if (missed_expirations[i]) {
-          INFO("  missed %d expirations %" PRId64 " times", i, missed_expirations[i]);
-        }
-      }
-
-      if (missed_expirations[NUM_MISSED_EXPIRATIONS_STATS -1]) {
-        INFO("  missed at least %d expirations %" PRId64 " times", NUM_MISSED_EXPIRATIONS_STATS - 1, missed_expirations[NUM_MISSED_EXPIRATIONS_STATS -1]);
-      }
-      sig_dump_stats_received = 0;
-    }
-
-    sleep(1);
+  midi_queue_init(&card_midi_queue);
+  clock_gettime(CLOCK_MONOTONIC, &daemon_start_time);
+  session_id = (daemon_start_time.tv_sec ^ (daemon_start_time.tv_nsec >> 10)) & 0x7F;
+  if ( pthread_create(&alsa_pcm_to_plugin_thread, NULL, read_pcm_and_call_plugins, rt_profile) ) {
+    ERROR("failed to start thread for read_pcm_and_call_plugins");
+    abort();
   }
 
+  // main thread: signals, MIDI in, control requests and stats until shutdown
+  rt_profile_enter(rt_profile, RT_THREAD_MIDI);
+  run_event_loop(cfg, &signal_set);
+  alsa_thread_run = 0;
 
   int retval;
   pthread_join(alsa_pcm_to_plugin_thread, (void**)&retval);
-  pthread_join(midi_in_plugin_thread, (void**)&retval);
+  rt_log_stop();
+  free_checkpoint(running_checkpoint);
 
   // close pcm handles
   if (pcm_state[0] && pcm_state[0]->pcm_handle) {
@@ -361,6 +524,12 @@ int main(int argc, char **argv, char **envp) {
     snd_pcm_close(pcm_state[1]->pcm_handle);
   }
 
+  // the cards carry on as they are; leave their state for the next
+  // daemon unless the Pi is going down with them
+  if (card_mgr && !midi_request_shutdown && !midi_request_restart) {
+    checkpoint_save(cfg, card_mgr);
+  }
+
   // card mgr closes all plugins
   if (card_mgr) {
     free_card_manager(card_mgr);
@@ -379,6 +548,13 @@ int main(int argc, char **argv, char **envp) {
   }
 
   // fall through to exit
+  if (period_tuner) {
+    free_period_tuner(period_tuner);
+  }
+  if (pcm_sync) {
+    free_pcm_sync(pcm_sync);
+  }
+  free_rt_profile(rt_profile);
   zlog_fini();
   config_destroy(cfg);
   free(cfg);
@@ -401,18 +577,93 @@ int main(int argc, char **argv, char **envp) {
 
 static void help() {
   printf("Usage: zoxnoxiousd <options>\n"
-         "  -i <config_file>\n");
+         "  -i <config_file>\n"
+         "  -c, --rt-check  report on the system's real-time configuration and exit\n");
 }
 
 
 
-// this isn't a very safe signal handler...
-void sig_cleanup_and_exit(int signum) {
-  sig_cleanup_received = 1;
+static void dump_stats() {
+  RT_INFO("requested stats: %ld.%.9ld / %" PRId64 "; pcm[0] xrun recovery: %d; pcm[1] xrun recovery: %d; rt_log dropped: %" PRIu64,
+       sec_pcm_write_idle, nsec_pcm_write_idle,
+       missed_expirations[EXPIRATIONS_ONTIME],
+       pcm_state[0] ? pcm_state[0]->xrun_recovery_count : -1,
+       pcm_state[1] ? pcm_state[1]->xrun_recovery_count : -1,
+       rt_log_dropped_count());
+
+  for (int i = 1; i < NUM_MISSED_EXPIRATIONS_STATS; ++i) {
+    if (missed_expirations[i]) {
+      RT_INFO("  missed %d expirations %" PRId64 " times", i, missed_expirations[i]);
+    }
+  }
+
+  if (missed_expirations[NUM_MISSED_EXPIRATIONS_STATS -1]) {
+    RT_INFO("  missed at least %d expirations %" PRId64 " times", NUM_MISSED_EXPIRATIONS_STATS - 1, missed_expirations[NUM_MISSED_EXPIRATIONS_STATS -1]);
+  }
+
+  if (pcm_state[0]) {
+    RT_INFO("  pcm latency: period %ld frames (%.2f ms), buffer %lu frames (%.2f ms)",
+         pcm_state[0]->period_size, 1000.0 * pcm_state[0]->period_size / pcm_state[0]->sampling_rate,
+         pcm_state[0]->buffer_size, 1000.0 * pcm_state[0]->buffer_size / pcm_state[0]->sampling_rate);
+  }
+  for (int dev = 0; dev < 2; ++dev) {
+    struct alsa_pcm_state *pcm = pcm_state[dev];
+    if (pcm && pcm->xrun_recovery_count) {
+      RT_INFO("  pcm[%d] xruns: %d overrun, %d suspend, %d disconnect, %d commit mismatch; "
+           "recovery usec last %" PRId64 " max %" PRId64 " avg %" PRId64,
+           dev,
+           pcm->xrun_cause_count[XRUN_CAUSE_OVERRUN],
+           pcm->xrun_cause_count[XRUN_CAUSE_SUSPEND],
+           pcm->xrun_cause_count[XRUN_CAUSE_DISCONNECT],
+           pcm->xrun_cause_count[XRUN_CAUSE_COMMIT_MISMATCH],
+           pcm->last_recovery_ns / 1000, pcm->max_recovery_ns / 1000,
+           pcm->recoveries_completed ? pcm->total_recovery_ns / 1000 / pcm->recoveries_completed : 0);
+    }
+  }
+  for (int dev = 0; pcm_sync && dev < pcm_sync->num_devices; ++dev) {
+    RT_INFO("  pcm[%d] sync: fill %.1f frames (target %.1f), drift %+.1f ppm, %" PRId64 " slips%s",
+         dev, pcm_sync->devices[dev].fill_avg, pcm_sync->target_fill,
+         pcm_sync_drift_ppm(pcm_sync, dev), pcm_sync->devices[dev].slips,
+         pcm_state[dev]->linked ? ", linked" : "");
+  }
+  RT_INFO("  midi: %" PRIu64 " messages, %" PRIu64 " realtime, %" PRIu64 " stray data bytes, "
+       "sysex %" PRIu64 " overflowed %" PRIu64 " aborted; card queue max depth %" PRIu64 ", %" PRIu64 " dropped",
+       midi_parser.messages, midi_parser.realtime_bytes, midi_parser.stray_data_bytes,
+       midi_parser.sysex_overflows, midi_parser.sysex_aborted,
+       atomic_load(&card_midi_queue.max_depth), atomic_load(&card_midi_queue.dropped));
+  if (period_tuner && period_tuner->enabled) {
+    RT_INFO("  period auto-tune: %d retunes, %d backoffs, %s",
+         period_tuner->retune_count, period_tuner->backoff_count,
+         period_tuner->probing ? "probing" : "settled");
+  }
+}
+
+
+/** request_control
+ *
+ * ask the event loop to act on a CONTROL_REQUEST_* from any thread.
+ * Lock free, a single eventfd write.
+ */
+static void request_control(unsigned int request) {
+  const uint64_t one = 1;
+  atomic_fetch_or(&control_requests, request);
+  if (write(control_eventfd, &one, sizeof(one)) != sizeof(one)) {
+    RT_WARN("control request 0x%X: eventfd write failed", request);
+  }
 }
 
-static void sig_dump_stats(int signum) {
-  sig_dump_stats_received = 1;
+
+/** init_pcm_devices
+ *
+ * open and configure the ALSA devices into pcm_state.  The second is
+ * only tried if the first is good.
+ */
+static void* init_pcm_devices(void *cfg) {
+  pcm_state[0] = init_alsa_device((config_t*)cfg, 0);
+  if (pcm_state[0]) {
+    pcm_state[1] = init_alsa_device((config_t*)cfg, 1);
+  }
+  return NULL;
 }
 
 
@@ -444,6 +695,71 @@ static int open_midi_device(config_t *cfg) {
 
 
 // add timespec in t1 to accumulator storing in accumulator
+static inline int64_t timespec_ns(const struct timespec *t) {
+  return (int64_t)t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+
+static inline int64_t timespec_diff_ns(const struct timespec *start, const struct timespec *end) {
+  return (int64_t)(end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+
+// charge a process_samples call to the card, for the stats report
+static inline void account_card_time(struct plugin_card *card, const struct timespec *start, const struct timespec *end) {
+  uint32_t ns = timespec_diff_ns(start, end);
+  atomic_fetch_add_explicit(&card->process_ns, ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&card->process_calls, 1, memory_order_relaxed);
+  if (ns > atomic_load_explicit(&card->process_ns_max, memory_order_relaxed)) {
+    atomic_store_explicit(&card->process_ns_max, ns, memory_order_relaxed);
+  }
+}
+
+
+/** check_latency_marker
+ *
+ * the client steps its latency marker channel to full scale and holds
+ * it there until the report arrives.  Note the frame the step reached
+ * the DACs with and have the event loop report it.  Returns the new
+ * marker_high state.
+ */
+static inline int check_latency_marker(int marker_high) {
+  int16_t level = *(const int16_t*)pcm_state[0]->samples[card_mgr->latency_marker_channel];
+
+  if (!marker_high && level > LATENCY_MARKER_HIGH) {
+    clock_gettime(CLOCK_MONOTONIC, &latency_marker.detected);
+    latency_marker.frame = pcm_sync->devices[0].frames;
+    latency_marker.backlog = pcm_state[0]->period_avail -
+      (pcm_state[0]->frames_provided - pcm_state[0]->frames_remaining);
+    atomic_fetch_add_explicit(&latency_marker.count, 1, memory_order_release);
+    request_control(CONTROL_REQUEST_LATENCY_REPORT);
+    return 1;
+  }
+  return marker_high && level >= LATENCY_MARKER_LOW;
+}
+
+
+/** check_client_heartbeat
+ *
+ * once a client has sent heartbeats, losing them means it went away
+ * (Rack quit, USB dropped).  What's in the stream then is silence or
+ * stale, so the cards aren't fed and hold their last values until the
+ * heartbeats come back.  Returns the new client_lost state.
+ */
+static inline int check_client_heartbeat(int client_lost, const struct timespec *now) {
+  int64_t heartbeat_ns = atomic_load_explicit(&last_heartbeat_ns, memory_order_relaxed);
+  int lost = heartbeat_ns != 0 && timespec_ns(now) - heartbeat_ns > CLIENT_HEARTBEAT_TIMEOUT_NS;
+
+  if (lost && !client_lost) {
+    RT_WARN("client heartbeat lost, holding cards");
+  }
+  else if (!lost && client_lost) {
+    RT_INFO("client heartbeat back, feeding cards");
+  }
+  return lost;
+}
+
+
 static inline void timespec_accumulate(const struct timespec *t1, struct timespec *accumulator) {
   accumulator->tv_sec += t1->tv_sec;
   accumulator->tv_nsec += t1->tv_nsec;
@@ -470,25 +786,42 @@ static inline void timespec_accumulate(const struct timespec *t1, struct timespe
 //   if (!frames stream 2): commit, ensure ready, mmap
 // } while (running flag)
 
+// PCM_HOLDING: a stream is restarting after an xrun.  Cards aren't fed
+// so they hold their last DAC values rather than seeing stale samples.
+// PCM_RETUNING: the same, while the event loop reopens the devices at
+// a new period.
+enum pcm_run_state {
+  PCM_RUNNING,
+  PCM_HOLDING,
+  PCM_RETUNING
+};
+
 static void* read_pcm_and_call_plugins(void *arg) {
   int timerfd_sample_clock;
   uint64_t expirations = 0;
   int frames_to_advance;
+  enum pcm_run_state pcm_run_state = PCM_RUNNING;
+  int latency_marker_high = 0;
+  int client_lost = 0;
+  int first_frame_logged = 0;
+  uint64_t retune_wait_frames = 0;
+  int checkpoint_card_num = 0;
 
-  // do a couple dumb things:
   // compute timer dynamically... but this is really designed
-  // for 4khz.  Even worse, assume that pcm[0] and [1] have
-  // the same sampling rate.
+  // for 4khz.  pcm_sync insists pcm[0] and [1] have the same sampling
+  // rate and steers the interval to match the devices' actual clock.
   struct itimerspec itimerspec_sample_clock = {
     .it_interval.tv_sec = 0,
-    .it_interval.tv_nsec = 1000000000 / pcm_state[0]->sampling_rate,
+    .it_interval.tv_nsec = pcm_sync->interval_ns,
     .it_value.tv_sec = 0,
-    .it_value.tv_nsec = 1000000000 / pcm_state[0]->sampling_rate,
+    .it_value.tv_nsec = pcm_sync->interval_ns,
   };
   struct itimerspec itimerspec_remaining_time;
   struct timespec accumulated_idle_time = { 0 };
   int valid_gettime;
 
+  // scheduling, pinning and stack prefault before anything time sensitive
+  rt_profile_enter((struct rt_profile*)arg, RT_THREAD_PCM);
 
   if ( (timerfd_sample_clock = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
     char error[256];
@@ -501,28 +834,10 @@ static void* read_pcm_and_call_plugins(void *arg) {
        pcm_state[0]->sampling_rate);
   // logging from here forward may be tricky / time sensitive
 
-  int err_pcm0 = -EAGAIN, err_pcm1 = -EAGAIN;
-  while (alsa_thread_run && (err_pcm0 == -EAGAIN || err_pcm1 == -EAGAIN)) {
-    if (start_pcm(pcm_state[0], &err_pcm0, "pcm0")) {
-      break;
-    }
-    if (pcm_state[1]) {
-      if (start_pcm(pcm_state[1], &err_pcm1, "pcm1")) {
-        break;
-      }
-    }
-    else {
-      err_pcm1 = 0;
-    }
-
-    if (err_pcm0 == -EAGAIN || err_pcm1 == -EAGAIN) {
-      usleep(1000); // 1 millisecond, don't get greedy and keep it too busy
-    }
+  if (start_pcm_streams()) {
+    alsa_thread_run = 0;
   }
 
-  if (err_pcm0) alsa_thread_run = 0;
-  if (err_pcm1 && pcm_state[1]) alsa_thread_run = 0;
-
   // all PCM streams should be good now
 
   if ( (timerfd_settime(timerfd_sample_clock, 0, &itimerspec_sample_clock, 0) ) == -1) {
@@ -534,8 +849,22 @@ static void* read_pcm_and_call_plugins(void *arg) {
 
   while (alsa_thread_run) {
 
+    // card MIDI that arrived since the last frame applies to this one.
+    // Bounded so a flood can't eat the frame; the rest waits a frame.
+    struct midi_queue_entry midi_entry;
+    for (int m = 0; pcm_run_state == PCM_RUNNING && m < MIDI_MESSAGES_PER_FRAME &&
+           midi_queue_pop(&card_midi_queue, &midi_entry) == 0; ++m) {
+      struct plugin_card *card = &card_mgr->cards[ midi_entry.card_num ];
+      if (card->plugin_object) {
+        card->process_midi(card->plugin_object, midi_entry.message, midi_entry.size);
+      }
+    }
+
     // Business Section
-    for (int card_num = 0; card_num < card_mgr->num_cards; ++card_num) {
+    struct timespec card_start, card_end;
+    clock_gettime(CLOCK_MONOTONIC, &card_start);
+    client_lost = check_client_heartbeat(client_lost, &card_start);
+    for (int card_num = 0; pcm_run_state == PCM_RUNNING && !client_lost && card_num < card_mgr->num_cards; ++card_num) {
       // alias for the deeply nested structure to the plugin card / readability
       struct plugin_card *plugin_card = card_mgr->card_update_order[card_num];
       int channel_offset = plugin_card->channel_offset;
@@ -543,22 +872,51 @@ static void* read_pcm_and_call_plugins(void *arg) {
       // the samples relevant for this card are at the channel offset on the approp pcm device
       const int16_t *samples = (const int16_t*) ( plugin_card->pcm_device_num == 0 ?
                                                   pcm_state[0]->samples[channel_offset] : pcm_state[1]->samples[channel_offset] );
+      if (plugin_card->num_slow_channels) {
+        samples = tdm_demux_card_samples(card_mgr, plugin_card, pcm_state[plugin_card->pcm_device_num]->samples);
+      }
 
       // then call the card's plugin with the samples via function pointer
       if ( (plugin_card->process_samples)(plugin_card->plugin_object, samples) != 0) {
-        INFO("card error");
+        RT_INFO("card error");
       }
+
+      clock_gettime(CLOCK_MONOTONIC, &card_end);
+      account_card_time(plugin_card, &card_start, &card_end);
+      card_start = card_end;
+    }
+
+    if (!first_frame_logged && pcm_run_state == PCM_RUNNING && !client_lost) {
+      first_frame_logged = 1;
+      RT_INFO("first frame to the cards %" PRId64 " msec after launch",
+              timespec_diff_ns(&daemon_launch_time, &card_start) / 1000000);
+    }
+
+    if (pcm_run_state == PCM_RUNNING && card_mgr->latency_marker_channel != LATENCY_NO_MARKER_CHANNEL) {
+      latency_marker_high = check_latency_marker(latency_marker_high);
     }
 
 
-    if (system_tune_requested) {
+    if (system_tune_requested && pcm_run_state == PCM_RUNNING) {
       system_tune_in_progress = 1;
-      INFO("MIDI tune starting");
+      RT_INFO("MIDI tune starting");
       autotune_all_cards(card_mgr);
       system_tune_in_progress = 0;
       system_tune_requested = 0;
     }
 
+    // periodic checkpoint: a card's state is only settled between
+    // frames, so copy it here, one card a frame
+    if (pcm_run_state == PCM_RUNNING &&
+        atomic_load_explicit(&checkpoint_capture_state, memory_order_acquire) == CAPTURE_REQUESTED) {
+      checkpoint_capture_card(running_checkpoint, card_mgr, checkpoint_card_num);
+      if (++checkpoint_card_num == card_mgr->num_cards) {
+        checkpoint_card_num = 0;
+        atomic_store_explicit(&checkpoint_capture_state, CAPTURE_DONE, memory_order_release);
+        request_control(CONTROL_REQUEST_CHECKPOINT);
+      }
+    }
+
     // check on remaining time-- though we don't know if it's remaining time until we check the expirations
     valid_gettime = timerfd_gettime(timerfd_sample_clock, &itimerspec_remaining_time);
     read(timerfd_sample_clock, &expirations, sizeof(expirations));
@@ -572,7 +930,7 @@ static void* read_pcm_and_call_plugins(void *arg) {
         nsec_pcm_write_idle = accumulated_idle_time.tv_nsec;
       }
       else {
-        WARN("timerfd_gettime returned %d", valid_gettime);
+        RT_WARN("timerfd_gettime returned %d", valid_gettime);
       }
     }
     else if (expirations < NUM_MISSED_EXPIRATIONS_STATS - 1) {
@@ -585,17 +943,77 @@ static void* read_pcm_and_call_plugins(void *arg) {
     // downcast
     frames_to_advance = expirations > INT_MAX ? INT_MAX : expirations;
 
-    // get new set of frames or advance sample pointers
+    if (pcm_run_state == PCM_HOLDING) {
+      int recover_return = recover_pcm_streams(timerfd_sample_clock, &itimerspec_sample_clock, frames_to_advance);
+      if (recover_return < 0) {
+        request_control(CONTROL_REQUEST_SHUTDOWN);
+        break;
+      }
+      else if (recover_return == 0) {
+        pcm_sync_reset(pcm_sync, pcm_state);
+        pcm_run_state = PCM_RUNNING;
+      }
+      continue;
+    }
+
+    if (pcm_run_state == PCM_RETUNING) {
+      int retune = atomic_load_explicit(&pcm_retune_state, memory_order_acquire);
+      if (retune == RETUNE_DONE) {
+        timerfd_settime(timerfd_sample_clock, 0, &itimerspec_sample_clock, NULL);
+        pcm_sync_reset(pcm_sync, pcm_state);
+        period_tuner_window_reset(period_tuner,
+                                  pcm_state[0]->xrun_recovery_count +
+                                  (pcm_state[1] ? pcm_state[1]->xrun_recovery_count : 0));
+        atomic_store_explicit(&pcm_retune_state, RETUNE_IDLE, memory_order_relaxed);
+        pcm_run_state = PCM_RUNNING;
+      }
+      else if (retune == RETUNE_FAILED) {
+        // give the devices a second before trying again
+        retune_wait_frames += frames_to_advance;
+        if (retune_wait_frames >= pcm_state[0]->sampling_rate) {
+          retune_wait_frames = 0;
+          atomic_store_explicit(&pcm_retune_state, RETUNE_REQUESTED, memory_order_release);
+          request_control(CONTROL_REQUEST_RETUNE);
+        }
+      }
+      continue;
+    }
+
+    // get new set of frames or advance sample pointers.  pcm1 may slip a
+    // frame either way to stay aligned with pcm0.
+    int pcm1_return = 0;
     if (pcm_state[1]) {
-      int pcm1_return = alsa_advance_stream_by_frames(pcm_state[1], frames_to_advance);
-      if (pcm1_return) {
-        INFO("pcm1: alsa_advance_stream_by_frames: %d", pcm1_return);
+      pcm1_return = alsa_advance_stream_by_frames(pcm_state[1],
+                                                  frames_to_advance + pcm_sync_take_slip(pcm_sync, 1));
+      if (pcm1_return && pcm1_return != -EPIPE) {
+        RT_INFO("pcm1: alsa_advance_stream_by_frames: %d", pcm1_return);
       }
     }
 
     int pcm0_return = alsa_advance_stream_by_frames(pcm_state[0], frames_to_advance);
-    if (pcm0_return) {
-      INFO("pcm0: alsa_advance_stream_by_frames: %d", pcm0_return);
+    if (pcm0_return && pcm0_return != -EPIPE) {
+      RT_INFO("pcm0: alsa_advance_stream_by_frames: %d", pcm0_return);
+    }
+
+    if (pcm0_return == -EPIPE || pcm1_return == -EPIPE) {
+      RT_WARN("pcm: xrun, holding cards until the stream restarts");
+      pcm_run_state = PCM_HOLDING;
+      continue;
+    }
+
+    // clock recovery: keep the sample clock at pcm0's actual rate
+    if (pcm_sync_update(pcm_sync, pcm_state, frames_to_advance)) {
+      steer_sample_clock(timerfd_sample_clock, &itimerspec_sample_clock);
+    }
+
+    // period auto-tune: step latency down, or back off under load
+    int xrun_count = pcm_state[0]->xrun_recovery_count +
+      (pcm_state[1] ? pcm_state[1]->xrun_recovery_count : 0);
+    if (period_tuner_update(period_tuner, expirations, xrun_count)) {
+      pcm_run_state = PCM_RETUNING;
+      retune_wait_frames = 0;
+      atomic_store_explicit(&pcm_retune_state, RETUNE_REQUESTED, memory_order_release);
+      request_control(CONTROL_REQUEST_RETUNE);
     }
 
   }
@@ -613,40 +1031,23 @@ static void* read_pcm_and_call_plugins(void *arg) {
 
 
 
-// Stuff for midi_in_to_plugins.  Parse the midi stream and determine what to send to the cards.
-
-// this is all the first nibble stuff- 0xFx stuff is more complex, but it's to be ignored
-enum midi_status_byte {
-  MIDI_STATUS_NOT_SET = 0x00,
-  MIDI_NOTE_OFF = 0x80,
-  MIDI_NOTE_ON = 0x90,
-  MIDI_KEY_PRESSURE = 0xA0,
-  MIDI_CONTROLLER_CHANGE = 0xB0,
-  MIDI_PROGRAM_CHANGE = 0xC0,
-  MIDI_CHANNEL_PRESSURE = 0xD0,
-  MIDI_PITCH_BEND = 0xE0,
-  MIDI_SYSEX_START = 0xF0,
-  MIDI_TUNE_REQUEST = 0xF6,
-  MIDI_SYSEX_END = 0xF7
-};
+// Stuff for handle_midi_input.  midi_parser frames the stream, midi_message_received
+// decides where each message goes.
 
 enum sysex_message_type {
-  TYPE_UNSET = 0,
   DISCOVERY_RESPONSE = 0x01,
   DISCOVERY_REQUEST = 0x02,
   SHUTDOWN_REQUEST = 0x03,
   RESTART_REQUEST = 0x04,
+  STATS_REQUEST = 0x05,
+  STATS_REPORT = 0x06,
+  LATENCY_REPORT = 0x07,
+  HEARTBEAT = 0x08,
+  HEARTBEAT_ACK = 0x09,
+  CARD_STATE = 0x0A,
   VALID_MANUFACTURER_ID = 0x7D
 };
 
-struct midi_state {
-  enum midi_status_byte status;
-  uint8_t channel;
-  enum sysex_message_type sysex_message_type;
-  int sysex_buffer_size;
-  uint8_t sysex_buffer[32];
-};
-
 // Discovered card number maps to MIDI channel number.  Not actual slot number.
 
 
@@ -690,181 +1091,574 @@ static int get_midi_input_fd() {
 }
 
 
-// read the midi stream, pass along to cards.  To be called as a thread.
-// Poll the MIDI in stream with a timeout of MIDI_TIMEOUT_MS.  Timeout allows
-// periodic checking of whether the thread should terminate or not.
-static void* midi_in_to_plugins(void *arg) {
-  int midi_fd = get_midi_input_fd();
-  int midi_read_status = 0;
+// read what's available on the midi stream, pass along to cards.  Called
+// from the event loop when the rawmidi fd is readable.
+// Return <0 on a read error the stream won't recover from.
+static int handle_midi_input() {
   uint8_t buffer[256];
-  struct midi_state midi_state = { 0 };
+  int midi_read_status = snd_rawmidi_read(midi_in, buffer, sizeof(buffer));
+
+  if (midi_read_status < 0) {
+    if (midi_read_status == -EAGAIN) {
+      return 0;
+    }
+    RT_ERROR("Error reading MIDI input: %s", snd_strerror(midi_read_status));
+    return midi_read_status;
+  }
+
+  RT_DEBUG("MIDI read received %d bytes", midi_read_status);
+
+  // the parser keeps state across reads; messages come back through
+  // midi_message_received
+  midi_parse(&midi_parser, buffer, midi_read_status);
+  return 0;
+}
+
+
+/** midi_message_received
+ *
+ * midi_parser handler.  Sysex and tune requests are for the daemon.
+ * Program changes go straight to the card: they're I2C writes, kept off
+ * the PCM thread.  Everything else for a card is queued for the PCM
+ * thread to hand over between frames.
+ */
+static void midi_message_received(void *arg, int channel, const uint8_t *message, size_t size) {
+  const uint8_t *discovery_report_sysex = arg;
+
+  if (message[0] == MIDI_SYSEX_START) {
+    handle_sysex(message, size, discovery_report_sysex);
+    return;
+  }
+
+  if (message[0] == MIDI_TUNE_REQUEST) {
+    RT_INFO("MIDI tune requested");
+    request_control(CONTROL_REQUEST_TUNE);
+    return;
+  }
+
+  if (channel < 0) {
+    // time code, song position/select: nothing here uses them
+    return;
+  }
+
+  // card numbering maps to midi channel.  So check we've got a valid
+  // midi channel against how many cards we've got to ensure we can
+  // dispatch the midi message.
+  if (channel >= card_mgr->num_cards) {
+    RT_DEBUG("Expected midi message on channel 0x%X to map to a user card", channel);
+    return;
+  }
+
+  if ((message[0] & 0xF0) == MIDI_PROGRAM_CHANGE) {
+    struct plugin_card *card = &card_mgr->cards[ channel ];
+    RT_INFO("MIDI: channel 0x%X program change: 0x%X", channel, message[1]);
+    // leap of faith into the function
+    card->process_midi_program_change(card->plugin_object, message[1]);
+    return;
+  }
+
+  if (midi_queue_push(&card_midi_queue, channel, message, size)) {
+    RT_WARN("MIDI: card queue full, dropped message 0x%X for channel 0x%X", message[0], channel);
+  }
+}
+
+
+/** handle_sysex
+ *
+ * complete sysex from the parser, F0 through F7
+ */
+static void handle_sysex(const uint8_t *message, size_t size, const uint8_t discovery_report_sysex[]) {
+  if (size < 4 || message[1] != VALID_MANUFACTURER_ID) {
+    RT_DEBUG("MIDI: sysex for someone else, %zu bytes", size);
+    return;
+  }
+
+  switch (message[2]) {
+  case DISCOVERY_REQUEST:
+    // no additional data required for a discovery request
+    // action is to send a discovery response
+    RT_INFO("MIDI: discovery sysex request received, sending %d bytes",
+            DISCOVERY_REPORT_SIZE_BYTES);
+    z_midi_write(discovery_report_sysex, DISCOVERY_REPORT_SIZE_BYTES);
+    break;
+  case SHUTDOWN_REQUEST:
+    // set flag, main thread will handle
+    RT_INFO("Shutdown request received");
+    midi_request_shutdown = 1;
+    request_control(CONTROL_REQUEST_SHUTDOWN);
+    break;
+  case RESTART_REQUEST:
+    RT_INFO("Restart request received");
+    midi_request_restart = 1;
+    request_control(CONTROL_REQUEST_SHUTDOWN);
+    break;
+  case HEARTBEAT: {
+    // ack with the client's sequence number, ours and the session
+    static uint8_t heartbeat_seq = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    atomic_store_explicit(&last_heartbeat_ns, timespec_ns(&now), memory_order_relaxed);
+
+    uint8_t ack[HEARTBEAT_ACK_SIZE_BYTES] = {
+      0xF0, 0x7D, HEARTBEAT_ACK, size > 4 ? message[3] & 0x7F : 0, heartbeat_seq++ & 0x7F, session_id, 0xF7
+    };
+    z_midi_write(ack, HEARTBEAT_ACK_SIZE_BYTES);
+    break;
+  }
+  case CARD_STATE:
+    apply_card_state(message, size);
+    break;
+  case STATS_REQUEST: {
+    uint8_t stats_report_sysex[STATS_REPORT_MAX_BYTES];
+    int stats_report_size = generate_stats_report(stats_report_sysex);
+    RT_DEBUG("MIDI: stats sysex request received, sending %d bytes", stats_report_size);
+    z_midi_write(stats_report_sysex, stats_report_size);
+    break;
+  }
+  default:
+    RT_INFO("MIDI: sysex unknown request 0x%X received", message[2]);
+    break;
+  }
+}
+
+
+/** apply_card_state
+ *
+ * Card State sysex: F0 7D 0A, MIDI channel, then the program number of
+ * every switch and selector on the card, F7.  Same effect as the program
+ * changes one by one, but the card can write its expanders once.
+ * Runs where program changes do, off the PCM thread.
+ */
+static void apply_card_state(const uint8_t *message, size_t size) {
+  const size_t header_bytes = 4;  // F0 7D 0A channel
+  if (size < header_bytes + 1) {
+    RT_WARN("MIDI: card state sysex of %zu bytes", size);
+    return;
+  }
+
+  int channel = message[3];
+  if (channel >= card_mgr->num_cards) {
+    RT_DEBUG("MIDI: card state for channel 0x%X, no such card", channel);
+    return;
+  }
+
+  struct plugin_card *card = &card_mgr->cards[ channel ];
+  const uint8_t *programs = &message[header_bytes];
+  size_t count = size - header_bytes - 1;
+  RT_INFO("MIDI: channel 0x%X card state, %zu programs", channel, count);
+
+  if (card->process_midi_program_changes) {
+    card->process_midi_program_changes(card->plugin_object, programs, count);
+  }
+  else {
+    for (size_t i = 0; i < count; ++i) {
+      card->process_midi_program_change(card->plugin_object, programs[i]);
+    }
+  }
+}
+
+
+// event loop sources, tagged in epoll_event.data
+enum event_source {
+  EVENT_SIGNAL,
+  EVENT_CONTROL,
+  EVENT_MIDI_IN,
+  EVENT_STATS_TIMER,
+  EVENT_CHECKPOINT_TIMER
+};
+
+static int epoll_add_source(int epoll_fd, int fd, enum event_source source) {
+  struct epoll_event event = { .events = EPOLLIN, .data.u32 = source };
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    ERROR("epoll_ctl add source %d: %s", source, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+
+/** run_event_loop
+ *
+ * everything non-RT waits on one epoll: signals via signalfd, control
+ * requests via eventfd, the rawmidi input fd, and optionally timerfds
+ * for periodic stats and checkpoints.  Blocks indefinitely between
+ * events so there's no idle wakeup; returns when shutdown is requested.
+ */
+static int run_event_loop(config_t *cfg, const sigset_t *signal_set) {
+  struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
   uint8_t discovery_report_sysex[DISCOVERY_REPORT_SIZE_BYTES] = { 0 };
+  int stats_interval_sec = 0;
+  int checkpoint_interval_sec = CHECKPOINT_DEFAULT_INTERVAL_SEC;
+  int epoll_fd, signal_fd, midi_fd, stats_timer_fd = -1, checkpoint_timer_fd = -1;
+  int running = 1;
+
+  if ( (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1 ) {
+    ERROR("epoll_create1: %s", strerror(errno));
+    return -1;
+  }
+
+  if ( (signal_fd = signalfd(-1, signal_set, SFD_NONBLOCK | SFD_CLOEXEC)) == -1 ||
+       epoll_add_source(epoll_fd, signal_fd, EVENT_SIGNAL) ) {
+    ERROR("signalfd setup failed: %s", strerror(errno));
+    close(epoll_fd);
+    return -1;
+  }
 
-  if (midi_fd < 0) {
+  if ( (control_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ||
+       epoll_add_source(epoll_fd, control_eventfd, EVENT_CONTROL) ) {
+    ERROR("eventfd setup failed: %s", strerror(errno));
+    close(signal_fd);
+    close(epoll_fd);
+    return -1;
+  }
+
+  if ( (midi_fd = get_midi_input_fd()) < 0 ||
+       epoll_add_source(epoll_fd, midi_fd, EVENT_MIDI_IN) ) {
     ERROR("Failed to obtain MIDI input file descriptor. MIDI input will not be processed.");
-    return NULL; // Or handle how exactly?
+    midi_fd = -1;
   }
 
-  generate_discovery_report(discovery_report_sysex);
+  config_lookup_int(cfg, ZOXNOXIOUSD_STATS_INTERVAL_KEY, &stats_interval_sec);
+  if (stats_interval_sec > 0) {
+    struct itimerspec stats_interval = {
+      .it_interval = { stats_interval_sec, 0 },
+      .it_value = { stats_interval_sec, 0 }
+    };
+    if ( (stats_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+         timerfd_settime(stats_timer_fd, 0, &stats_interval, NULL) == -1 ||
+         epoll_add_source(epoll_fd, stats_timer_fd, EVENT_STATS_TIMER) ) {
+      WARN("stats timer setup failed, periodic stats disabled");
+    }
+    else {
+      INFO("logging stats every %d seconds", stats_interval_sec);
+    }
+  }
 
-  INFO("starting MIDI In event loop");
+  config_lookup_int(cfg, CHECKPOINT_INTERVAL_KEY, &checkpoint_interval_sec);
+  if (running_checkpoint && checkpoint_interval_sec > 0) {
+    struct itimerspec checkpoint_interval = {
+      .it_interval = { checkpoint_interval_sec, 0 },
+      .it_value = { checkpoint_interval_sec, 0 }
+    };
+    if ( (checkpoint_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+         timerfd_settime(checkpoint_timer_fd, 0, &checkpoint_interval, NULL) == -1 ||
+         epoll_add_source(epoll_fd, checkpoint_timer_fd, EVENT_CHECKPOINT_TIMER) ) {
+      WARN("checkpoint timer setup failed, checkpoint only on a clean stop");
+    }
+    else {
+      INFO("checkpoint every %d seconds", checkpoint_interval_sec);
+    }
+  }
 
-  while (alsa_thread_run) {
+  generate_discovery_report(discovery_report_sysex);
+  midi_parser_init(&midi_parser, midi_message_received, (void*)discovery_report_sysex);
 
-    struct pollfd fds[1];
-    fds[0].fd = midi_fd;
-    fds[0].events = POLLIN;
-    fds[0].revents = 0;
+  INFO("starting event loop");
 
-    int retval = poll(fds, 1, MIDI_TIMEOUT_MS);
+  while (running) {
+    int num_events = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_EVENTS, -1);
 
-    if (retval == -1) {
+    if (num_events == -1) {
       if (errno == EINTR) {
         continue;
       }
-      else {
-        ERROR("Error in poll(): %s", strerror(errno));
-        break;
-      }
+      RT_ERROR("epoll_wait: %s", strerror(errno));
+      break;
     }
-    else if (retval > 0) {
-      if (fds[0].revents & POLLIN) {
-
-        midi_read_status = snd_rawmidi_read(midi_in, buffer, sizeof(buffer));
-        if (midi_read_status > 0) {
-          INFO("MIDI read received %d bytes", midi_read_status);
-
-          // read the midi stream. could be starting anywhere in the stream,
-          // account for that by tracking stream state. This makes the stream parsing a
-          // bit obtuse but we need to account for fragmented reads and such.
-          for (int i = 0; i < midi_read_status; ++i) {
-
-            if ( (buffer[i] & 0xF0) == MIDI_PROGRAM_CHANGE) {
-              midi_state.status = MIDI_PROGRAM_CHANGE;
-              midi_state.channel = buffer[i] & 0x0F;
-            }
-            else if (midi_state.status == MIDI_PROGRAM_CHANGE) {
-              // get program change and call plugin
-              INFO("MIDI: channel 0x%X program change: 0x%X",
-                   midi_state.channel,
-                   buffer[i]);
-              // card numbering maps to midi channel.  So check we've got a valid
-              // midi channel against how many cards we've got to ensure we can
-              // dispatch the midi message.
-              if (midi_state.channel < card_mgr->num_cards) {
-                struct plugin_card *card = &card_mgr->cards[ midi_state.channel ];
-                // leap of faith into the function
-                card->process_midi_program_change(card->plugin_object, buffer[i]);
-              }
-              else {
-                WARN("Expected midi message on channel 0x%X to map to a user card",
-                     midi_state.channel);
-              }
-
-              // then clear state
-              midi_state.status = MIDI_STATUS_NOT_SET;
-            }
-            else if (buffer[i] == MIDI_SYSEX_START) {  // no channel for sysex
-              midi_state.status = MIDI_SYSEX_START;
-              INFO("MIDI: sysex start received");
-              midi_state.channel = 0;
-              midi_state.sysex_message_type = TYPE_UNSET;
-              midi_state.sysex_buffer_size = 0;
-            }
-            else if (midi_state.status == MIDI_SYSEX_START &&
-                     midi_state.sysex_message_type == TYPE_UNSET) {
-              if (buffer[i] == VALID_MANUFACTURER_ID) {
-                midi_state.sysex_message_type = VALID_MANUFACTURER_ID;
-                INFO("MIDI: sysex manufacturer message correct");
-              }
-              else {
-                midi_state.status = MIDI_STATUS_NOT_SET;
-              }
-            }
-            else if (midi_state.status == MIDI_SYSEX_START &&
-                     midi_state.sysex_message_type == VALID_MANUFACTURER_ID) {
-              if (buffer[i] == DISCOVERY_REQUEST) {
-                // no additional data required for a discovery request
-                // action is to send a discovery response
-                INFO("MIDI: discovery sysex request received, sending %d bytes",
-                     sizeof(discovery_report_sysex) / sizeof(uint8_t));
-                z_midi_write(discovery_report_sysex, sizeof(discovery_report_sysex) / sizeof(uint8_t));
-              }
-              else if (buffer[i] == SHUTDOWN_REQUEST) {
-                // set flag, main thread will handle
-                INFO("Shutdown request received");
-                midi_request_shutdown = 1;
-                alsa_thread_run = 0;
-              }
-              else if (buffer[i] == RESTART_REQUEST) {
-                INFO("Restart request received");
-                midi_request_restart = 1;
-                alsa_thread_run = 0;
-              }
-              else {
-                INFO("MIDI: sysex unknown request received");
-              }
-
-              midi_state.status = MIDI_STATUS_NOT_SET;
-            }
-            else if (buffer[i] == MIDI_TUNE_REQUEST) {  // no channel for sysex
-              INFO("MIDI tune requested");
-              if (!system_tune_in_progress) {
-                system_tune_requested = 1;
-              }
-            }
-            // future: check for other status messages
+
+    for (int i = 0; i < num_events; ++i) {
+      switch (events[i].data.u32) {
+      case EVENT_SIGNAL: {
+        struct signalfd_siginfo siginfo;
+        while (read(signal_fd, &siginfo, sizeof(siginfo)) == sizeof(siginfo)) {
+          if (siginfo.ssi_signo == SIGUSR1) {
+            dump_stats();
+          }
+          else {
+            RT_INFO("Signal %d received, initiating shutdown...", siginfo.ssi_signo);
+            running = 0;
           }
         }
-        else if (midi_read_status < 0 && midi_read_status != -EAGAIN) {
-          ERROR("Error reading MIDI input: %s", snd_strerror(midi_read_status));
+        break;
+      }
+
+      case EVENT_CONTROL: {
+        uint64_t count;
+        if (read(control_eventfd, &count, sizeof(count)) != sizeof(count)) {
           break;
         }
+        unsigned int requests = atomic_exchange(&control_requests, 0);
+        if (requests & CONTROL_REQUEST_SHUTDOWN) {
+          running = 0;
+        }
+        if ((requests & CONTROL_REQUEST_TUNE) && !system_tune_in_progress) {
+          system_tune_requested = 1;
+        }
+        if (requests & CONTROL_REQUEST_LATENCY_REPORT) {
+          send_latency_report();
+        }
+        if ((requests & CONTROL_REQUEST_RETUNE) &&
+            atomic_load_explicit(&pcm_retune_state, memory_order_acquire) == RETUNE_REQUESTED) {
+          atomic_store_explicit(&pcm_retune_state,
+                                retune_pcm_streams() ? RETUNE_FAILED : RETUNE_DONE,
+                                memory_order_release);
+        }
+        if ((requests & CONTROL_REQUEST_CHECKPOINT) &&
+            atomic_load_explicit(&checkpoint_capture_state, memory_order_acquire) == CAPTURE_DONE) {
+          checkpoint_write(cfg, running_checkpoint);
+          atomic_store_explicit(&checkpoint_capture_state, CAPTURE_IDLE, memory_order_relaxed);
+        }
+        break;
+      }
+
+      case EVENT_MIDI_IN:
+        if ( (events[i].events & (EPOLLERR | EPOLLHUP)) ||
+             handle_midi_input() < 0 ) {
+          RT_ERROR("MIDI input failed, no longer processing MIDI");
+          epoll_ctl(epoll_fd, EPOLL_CTL_DEL, midi_fd, NULL);
+        }
+        break;
+
+      case EVENT_STATS_TIMER: {
+        uint64_t expirations;
+        if (read(stats_timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+          dump_stats();
+        }
+        break;
+      }
+
+      case EVENT_CHECKPOINT_TIMER: {
+        uint64_t expirations;
+        // a capture still pending (PCM thread holding) just carries on
+        if (read(checkpoint_timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations) &&
+            card_mgr->num_cards > 0) {
+          int idle = CAPTURE_IDLE;
+          atomic_compare_exchange_strong(&checkpoint_capture_state, &idle, CAPTURE_REQUESTED);
+        }
+        break;
       }
-    } // else - Can do other non-MIDI related tasks here if needed
+
+      default:
+        break;
+      }
+    }
   }
-  INFO("Exiting MIDI input thread.");
-  return NULL;
+
+  INFO("Exiting event loop.");
+
+  if (stats_timer_fd != -1) {
+    close(stats_timer_fd);
+  }
+  if (checkpoint_timer_fd != -1) {
+    close(checkpoint_timer_fd);
+  }
+  close(signal_fd);
+  close(epoll_fd);
+  // control_eventfd stays open: the PCM thread may still request_control
+  return 0;
 }
 
 
+
 // simple function to produce the static discovery report in midi sysex.
-// Assumes that 28 bytes are available in the buffer.
+// Assumes that DISCOVERY_REPORT_SIZE_BYTES are available in the buffer.
 // Discovery report spec is documented in the "midi.spec" file.
 static void generate_discovery_report(uint8_t discovery_report_sysex[]) {
   discovery_report_sysex[0] = 0xF0; // sysex start
   discovery_report_sysex[1] = 0x7D; // test manufacturer
   discovery_report_sysex[2] = 0x01; // sysex discovery report
-  discovery_report_sysex[27] = 0xF7; // end sysex
+  discovery_report_sysex[DISCOVERY_REPORT_SIZE_BYTES - 1] = 0xF7; // end sysex
 
   for (int i = 0; i < card_mgr->num_cards; ++i) {
-    discovery_report_sysex[3 + card_mgr->cards[i].slot * 3] = card_mgr->cards[i].card_id;
-    discovery_report_sysex[4 + card_mgr->cards[i].slot * 3] = card_mgr->cards[i].channel_offset;
-    discovery_report_sysex[5 + card_mgr->cards[i].slot * 3] = card_mgr->cards[i].pcm_device_num;
+    const struct plugin_card *card = &card_mgr->cards[i];
+    discovery_report_sysex[3 + card->slot * DISCOVERY_REPORT_CARD_BYTES] = card->card_id;
+    discovery_report_sysex[4 + card->slot * DISCOVERY_REPORT_CARD_BYTES] = card->channel_offset;
+    discovery_report_sysex[5 + card->slot * DISCOVERY_REPORT_CARD_BYTES] = card->pcm_device_num;
+
+    // slow channel TDM: channel count, TDM index and slow mask 7 bits a byte
+    uint8_t *tdm = &discovery_report_sysex[DISCOVERY_REPORT_TDM_OFFSET + card->slot * DISCOVERY_REPORT_TDM_CARD_BYTES];
+    tdm[0] = card->num_channels & 0x7F;
+    tdm[1] = card->tdm_base & 0x7F;
+    for (int b = 0; b < 5; ++b) {
+      tdm[2 + b] = (card->slow_channel_mask >> (7 * b)) & 0x7F;
+    }
+  }
+
+  for (int dev = 0; dev < MAX_PCM_DEVICES; ++dev) {
+    discovery_report_sysex[DISCOVERY_REPORT_TDM_SYNC_OFFSET + dev] =
+      card_mgr->tdm_sync_channel[dev] == TDM_NO_SYNC_CHANNEL ?
+      DISCOVERY_REPORT_TDM_NO_SYNC : card_mgr->tdm_sync_channel[dev];
+  }
+
+  discovery_report_sysex[DISCOVERY_REPORT_LATENCY_MARKER_OFFSET] =
+    card_mgr->latency_marker_channel == LATENCY_NO_MARKER_CHANNEL ?
+    DISCOVERY_REPORT_NO_LATENCY_MARKER : card_mgr->latency_marker_channel;
+}
+
+
+
+// low 28 bits, MSB first, 7 bits a byte
+static void put_sysex_28(uint8_t *report, uint32_t bits) {
+  for (int b = 0; b < STATS_REPORT_VALUE_BYTES; ++b) {
+    report[b] = (bits >> (7 * (STATS_REPORT_VALUE_BYTES - 1 - b))) & 0x7F;
+  }
+}
+
+
+// 28 bit two's complement.  Saturates.
+static void put_stats_value(uint8_t *report, int64_t value) {
+  if (value > STATS_VALUE_MAX) {
+    value = STATS_VALUE_MAX;
+  }
+  else if (value < STATS_VALUE_MIN) {
+    value = STATS_VALUE_MIN;
+  }
+  put_sysex_28(report, (uint32_t)value);
+}
+
+
+// 14 bit unsigned in two bytes, MSB first.  Saturates.
+static void put_stats_card_value(uint8_t *report, uint64_t value) {
+  if (value > STATS_CARD_VALUE_MAX) {
+    value = STATS_CARD_VALUE_MAX;
+  }
+  report[0] = (value >> 7) & 0x7F;
+  report[1] = value & 0x7F;
+}
+
+
+/** generate_stats_report
+ *
+ * runtime health for the client, spec in "midi.spec".  Busy time and
+ * card loads cover the time since the previous report, the rest is
+ * since start.  Called from the event loop only: it keeps the last
+ * report's totals.  Returns the size of the report; the buffer must
+ * hold STATS_REPORT_MAX_BYTES.
+ */
+static int generate_stats_report(uint8_t stats_report_sysex[]) {
+  static uint64_t last_frames = 0;
+  static int64_t last_idle_ns = 0;
+  int64_t values[STATS_NUM_VALUES] = { 0 };
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  values[STATS_UPTIME_SEC] = now.tv_sec - daemon_start_time.tv_sec;
+  if (pcm_state[0]) {
+    values[STATS_SAMPLING_RATE] = pcm_state[0]->sampling_rate;
+    values[STATS_PERIOD_SIZE] = pcm_state[0]->period_size;
+  }
+
+  // frame interval less the average idle of on time frames
+  long interval_ns = pcm_sync ? pcm_sync->interval_ns : 0;
+  uint64_t frames = missed_expirations[EXPIRATIONS_ONTIME];
+  int64_t idle_ns = (int64_t)sec_pcm_write_idle * 1000000000LL + nsec_pcm_write_idle;
+  if (frames > last_frames && interval_ns > 0) {
+    int64_t busy = 1000 - (idle_ns - last_idle_ns) * 1000 / ((int64_t)(frames - last_frames) * interval_ns);
+    values[STATS_PCM_BUSY_PERMILLE] = busy < 0 ? 0 : busy;
+  }
+  last_frames = frames;
+  last_idle_ns = idle_ns;
+
+  // histogram of missed expirations, summarized: missed_expirations is
+  // indexed by expirations per wakeup, so 2 is missing one
+  values[STATS_MISSED_ONE] = missed_expirations[2];
+  for (int i = 3; i < NUM_MISSED_EXPIRATIONS_STATS; ++i) {
+    values[i <= 10 ? STATS_MISSED_FEW : STATS_MISSED_MANY] += missed_expirations[i];
+  }
+
+  for (int dev = 0; dev < 2; ++dev) {
+    if (pcm_state[dev]) {
+      values[STATS_XRUNS] += pcm_state[dev]->xrun_recovery_count;
+      if (pcm_state[dev]->max_recovery_ns / 1000 > values[STATS_MAX_RECOVERY_USEC]) {
+        values[STATS_MAX_RECOVERY_USEC] = pcm_state[dev]->max_recovery_ns / 1000;
+      }
+    }
+  }
+
+  values[STATS_PCM0_FILL_X10] = pcm_sync->devices[0].fill_avg * 10;
+  values[STATS_DRIFT_PPM_X10] = pcm_sync_drift_ppm(pcm_sync, 0) * 10;
+  values[STATS_PCM1_SLIPS] = pcm_sync->num_devices > 1 ? pcm_sync->devices[1].slips : 0;
+  values[STATS_MIDI_ERRORS] = midi_parser.sysex_overflows + midi_parser.sysex_aborted +
+    atomic_load(&card_midi_queue.dropped);
+  values[STATS_RT_LOG_DROPPED] = rt_log_dropped_count();
+
+  stats_report_sysex[0] = 0xF0; // sysex start
+  stats_report_sysex[1] = 0x7D; // test manufacturer
+  stats_report_sysex[2] = STATS_REPORT;
+  stats_report_sysex[3] = STATS_REPORT_VERSION;
+
+  uint8_t *report = &stats_report_sysex[STATS_REPORT_HEADER_BYTES];
+  for (int i = 0; i < STATS_NUM_VALUES; ++i, report += STATS_REPORT_VALUE_BYTES) {
+    put_stats_value(report, values[i]);
   }
 
+  *report++ = card_mgr->num_cards;
+  for (int i = 0; i < card_mgr->num_cards; ++i, report += STATS_REPORT_CARD_BYTES) {
+    struct plugin_card *card = &card_mgr->cards[i];
+    uint64_t process_ns = atomic_exchange(&card->process_ns, 0);
+    uint32_t process_calls = atomic_exchange(&card->process_calls, 0);
+    uint32_t process_ns_max = atomic_exchange(&card->process_ns_max, 0);
+    int tune_result = card->tune_result;
+
+    report[0] = card->slot;
+    // share of the frame interval spent in process_samples
+    put_stats_card_value(&report[1], process_calls && interval_ns > 0 ?
+                         process_ns * 1000 / ((uint64_t)process_calls * interval_ns) : 0);
+    put_stats_card_value(&report[3], process_ns_max / 1000);
+    report[5] = tune_result == CARD_NOT_TUNED ? 0 :
+      tune_result == TUNE_COMPLETE_SUCCESS ? 1 : 2;
+  }
+
+  *report++ = 0xF7; // end sysex
+  return report - stats_report_sysex;
+}
+
+
+
+/** send_latency_report
+ *
+ * answer the client's latency marker, see "midi.spec".  Event loop only.
+ */
+static void send_latency_report() {
+  uint8_t report[LATENCY_REPORT_SIZE_BYTES];
+  struct timespec now;
+
+  uint32_t count = atomic_load_explicit(&latency_marker.count, memory_order_acquire);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  report[0] = 0xF0; // sysex start
+  report[1] = 0x7D; // test manufacturer
+  report[2] = LATENCY_REPORT;
+  report[3] = count & 0x7F;
+  put_stats_value(&report[4], timespec_diff_ns(&latency_marker.detected, &now) / 1000);
+  put_sysex_28(&report[8], latency_marker.frame);
+  put_stats_value(&report[12], latency_marker.backlog);
+  report[16] = 0xF7; // end sysex
+
+  RT_DEBUG("MIDI: latency marker %u at frame %" PRIu64 ", sending report", count, latency_marker.frame);
+  z_midi_write(report, LATENCY_REPORT_SIZE_BYTES);
 }
 
 
 
 // z_midi_write
-static int z_midi_write(uint8_t *buffer, int buffer_size) {
+static int z_midi_write(const uint8_t *buffer, int buffer_size) {
   int midi_write_status = -1;
   pthread_mutex_lock(&midi_out_mutex);
   if (midi_out != NULL) {
     midi_write_status = snd_rawmidi_write(midi_out, buffer, buffer_size);
   }
   else {
-    ERROR("MIDI: midi out is NULL");
+    RT_ERROR("MIDI: midi out is NULL");
   }
 
   pthread_mutex_unlock(&midi_out_mutex);
 
   if (midi_write_status < 0) {
-    ERROR("Error writing to midi output: %s", snd_strerror(midi_write_status));
+    RT_ERROR("Error writing to midi output: %s", snd_strerror(midi_write_status));
   }
   else if (midi_write_status != buffer_size) {
-    ERROR("Error writing to midi output: wrote %d of %d bytes",
+    RT_ERROR("Error writing to midi output: wrote %d of %d bytes",
           midi_write_status, buffer_size);
   }
 
@@ -883,3 +1677,148 @@ static int start_pcm(struct alsa_pcm_state *pcm, int *err_var, const char *name)
   }
   return 0; // Success or still -EAGAIN
 }
+
+
+// start_pcm_streams: get all pcm streams running, waiting out -EAGAIN.
+// Return zero for success, non-zero on failure.
+static int start_pcm_streams() {
+  int err_pcm0 = -EAGAIN, err_pcm1 = -EAGAIN;
+  while (alsa_thread_run && (err_pcm0 == -EAGAIN || err_pcm1 == -EAGAIN)) {
+    if (start_pcm(pcm_state[0], &err_pcm0, "pcm0")) {
+      break;
+    }
+    if (pcm_state[1]) {
+      if (start_pcm(pcm_state[1], &err_pcm1, "pcm1")) {
+        break;
+      }
+    }
+    else {
+      err_pcm1 = 0;
+    }
+
+    if (err_pcm0 == -EAGAIN || err_pcm1 == -EAGAIN) {
+      usleep(1000); // 1 millisecond, don't get greedy and keep it too busy
+    }
+  }
+
+  if (err_pcm0 || (err_pcm1 && pcm_state[1])) {
+    return 1;
+  }
+  return 0;
+}
+
+
+/** retune_pcm_streams
+ *
+ * event loop side of a period change, called with the PCM thread
+ * parked: reopen the pcm devices at the period tuner's new size and
+ * restart the streams.  If a device rejects the size fall back to the
+ * period they were running at.  The PCM thread re-arms its sample
+ * clock once this returns zero; non-zero means the devices couldn't be
+ * brought back and the PCM thread stays parked and asks again.
+ */
+static int retune_pcm_streams() {
+  snd_pcm_sframes_t previous_period = pcm_state[0]->period_size;
+
+  int err = reinit_pcm_devices();
+  if (err && period_tuner->period != previous_period) {
+    period_tuner_reject(period_tuner, previous_period);
+    err = reinit_pcm_devices();
+  }
+  if (err) {
+    RT_ERROR("period tuner: unable to reopen pcm devices at period %ld, retrying", period_tuner->period);
+    return 1;
+  }
+
+  pcm_sync_link(pcm_sync, pcm_state);
+  if (start_pcm_streams()) {
+    RT_ERROR("period tuner: pcm streams didn't restart, retrying");
+    return 1;
+  }
+
+  RT_INFO("pcm: running with period %ld, buffer %lu (%.2f ms)",
+          pcm_state[0]->period_size, pcm_state[0]->buffer_size,
+          1000.0 * pcm_state[0]->period_size / pcm_state[0]->sampling_rate);
+  return 0;
+}
+
+
+static int reinit_pcm_devices() {
+  for (int dev = 0; dev < 2; ++dev) {
+    if (pcm_state[dev] &&
+        alsa_reinit_device(pcm_state[dev], period_tuner->period, period_tuner_buffer_size(period_tuner))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+
+/** recover_pcm_streams
+ *
+ * one non-blocking step of bringing the pcm devices back after an xrun,
+ * called once per sample clock tick while holding.  Devices that didn't
+ * xrun keep being advanced by the frames the clock says have passed,
+ * as in the running loop, so they don't overrun in the meantime.  Once
+ * every device has a fresh period mapped the sample clock is re-armed
+ * so its phase matches the restarted streams.  Returns 0 when running
+ * again, 1 while still recovering, -1 if a device can't be recovered.
+ */
+static int recover_pcm_streams(int timerfd_sample_clock, const struct itimerspec *sample_clock, int frames_to_advance) {
+  int pending = 0;
+  int err;
+
+  for (int dev = 0; dev < 2; ++dev) {
+    if (pcm_state[dev] == NULL) {
+      continue;
+    }
+
+    if (pcm_state[dev]->recovering) {
+      err = alsa_recover_stream(pcm_state[dev]);
+      if (err == -EAGAIN) {
+        pending = 1;
+      }
+      else if (err) {
+        RT_ERROR("pcm%d: unable to recover stream: %s", dev, snd_strerror(err));
+        return -1;
+      }
+    }
+    else if (alsa_advance_stream_by_frames(pcm_state[dev], frames_to_advance) == -EPIPE) {
+      pending = 1;
+    }
+  }
+
+  if (pending) {
+    return 1;
+  }
+
+  timerfd_settime(timerfd_sample_clock, 0, sample_clock, NULL);
+  RT_INFO("pcm: streams recovered in %" PRId64 " usec",
+          (pcm_state[1] && pcm_state[1]->last_recovery_ns > pcm_state[0]->last_recovery_ns ?
+           pcm_state[1]->last_recovery_ns : pcm_state[0]->last_recovery_ns) / 1000);
+  return 0;
+}
+
+
+
+/** steer_sample_clock
+ *
+ * reprogram the sample clock interval from pcm_sync without disturbing
+ * its phase: the time to the next expiration is kept.
+ */
+static void steer_sample_clock(int timerfd_sample_clock, struct itimerspec *sample_clock) {
+  struct itimerspec current;
+
+  sample_clock->it_interval.tv_nsec = pcm_sync->interval_ns;
+  sample_clock->it_value.tv_nsec = pcm_sync->interval_ns;
+
+  if (timerfd_gettime(timerfd_sample_clock, &current) == 0 &&
+      (current.it_value.tv_sec || current.it_value.tv_nsec)) {
+    current.it_interval = sample_clock->it_interval;
+    timerfd_settime(timerfd_sample_clock, 0, &current, NULL);
+  }
+  else {
+    timerfd_settime(timerfd_sample_clock, 0, sample_clock, NULL);
+  }
+}
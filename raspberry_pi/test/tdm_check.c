@@ -0,0 +1,230 @@
+/* Copyright 2025 Kyle Farrell
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* slow CV TDM: mux frames the way the Rack audio port does and check
+ * the daemon's demux hands each card the right channels.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tdm.h"
+
+#define DEVICE_CHANNELS 16
+#define SYNC_CHANNEL (DEVICE_CHANNELS - 1)
+#define HELD -1
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {                   \
+    if (!(cond)) {                              \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);                      \
+      printf("\n");                             \
+      ++failures;                               \
+    }                                           \
+  } while (0)
+
+
+struct test_card {
+  int num_channels;
+  uint32_t slow_channel_mask;
+  int channel_offset;
+  int tdm_base;
+  int16_t samples[32];
+};
+
+
+// card A: 6 channels, 0 2 3 5 slow, fast on device 0-1, slow indexes 0-3
+// card B: 10 channels, 4-9 slow, fast on device 2-5, slow indexes 4-9
+// which crosses into the second lane
+static struct test_card cards[] = {
+  { .num_channels = 6, .slow_channel_mask = 0x2D, .channel_offset = 0, .tdm_base = 0 },
+  { .num_channels = 10, .slow_channel_mask = 0x3F0, .channel_offset = 2, .tdm_base = 4 },
+};
+#define NUM_CARDS (sizeof(cards) / sizeof(cards[0]))
+#define NUM_SLOW 10
+
+
+static int16_t fast_value(int frame, int device_channel) {
+  return (int16_t)(frame * 100 + device_channel);
+}
+
+static int16_t slow_value(int rotation, int slow_index) {
+  return (int16_t)(10000 + rotation * 1000 + slow_index);
+}
+
+
+// the Rack audio port's mux for one device frame
+static void mux_frame(int16_t *frame, int frame_num, int rotation) {
+  int phase = frame_num % TDM_SLOTS_PER_CHANNEL;
+  memset(frame, 0, DEVICE_CHANNELS * sizeof(int16_t));
+  for (int c = 0; c < 6; ++c) {
+    frame[c] = fast_value(frame_num, c);
+  }
+  frame[SYNC_CHANNEL] = phase * TDM_PHASE_SCALE;
+  for (int lane = 0; lane < tdm_num_lanes(NUM_SLOW); ++lane) {
+    int slow_index = lane * TDM_SLOTS_PER_CHANNEL + phase;
+    frame[SYNC_CHANNEL - 1 - lane] = slow_index < NUM_SLOW ? slow_value(rotation, slow_index) : 0;
+  }
+}
+
+
+static void check_phase() {
+  for (int phase = 0; phase < TDM_SLOTS_PER_CHANNEL; ++phase) {
+    for (int error = -1; error <= 1; ++error) {
+      int16_t sync = phase * TDM_PHASE_SCALE + error;
+      if (sync < 0) {
+        continue;
+      }
+      CHECK(tdm_phase(sync) == phase, "sync %d gave phase %d, not %d", sync, tdm_phase(sync), phase);
+    }
+  }
+
+  CHECK(tdm_num_lanes(0) == 0, "0 slow channels need no lanes");
+  CHECK(tdm_num_lanes(1) == 1, "1 slow channel needs a lane");
+  CHECK(tdm_num_lanes(TDM_SLOTS_PER_CHANNEL) == 1, "a full lane is one lane");
+  CHECK(tdm_num_lanes(TDM_SLOTS_PER_CHANNEL + 1) == 2, "one over a full lane is two");
+
+  CHECK(tdm_lane_channel(SYNC_CHANNEL, 0) == SYNC_CHANNEL - 1, "slow index 0 on the lane below sync");
+  CHECK(tdm_lane_channel(SYNC_CHANNEL, TDM_SLOTS_PER_CHANNEL - 1) == SYNC_CHANNEL - 1,
+        "last slot of the first lane");
+  CHECK(tdm_lane_channel(SYNC_CHANNEL, TDM_SLOTS_PER_CHANNEL) == SYNC_CHANNEL - 2,
+        "first slot of the second lane");
+}
+
+
+static void check_round_trip() {
+  int16_t frame[DEVICE_CHANNELS];
+  const char *device_samples[DEVICE_CHANNELS];
+  for (int c = 0; c < DEVICE_CHANNELS; ++c) {
+    device_samples[c] = (const char*)&frame[c];
+  }
+  for (size_t i = 0; i < NUM_CARDS; ++i) {
+    for (int c = 0; c < 32; ++c) {
+      cards[i].samples[c] = HELD;
+    }
+  }
+
+  // two full rotations with different slow values in each
+  for (int frame_num = 0; frame_num < 2 * TDM_SLOTS_PER_CHANNEL; ++frame_num) {
+    int rotation = frame_num / TDM_SLOTS_PER_CHANNEL;
+    int phase = frame_num % TDM_SLOTS_PER_CHANNEL;
+    mux_frame(frame, frame_num, rotation);
+
+    for (size_t i = 0; i < NUM_CARDS; ++i) {
+      struct test_card *card = &cards[i];
+      tdm_demux(device_samples, SYNC_CHANNEL, card->slow_channel_mask, card->num_channels,
+                card->channel_offset, card->tdm_base, card->samples);
+
+      int fast_index = 0;
+      int slow_index = card->tdm_base;
+      for (int c = 0; c < card->num_channels; ++c) {
+        if (card->slow_channel_mask & (1u << c)) {
+          int slot = slow_index % TDM_SLOTS_PER_CHANNEL;
+          // current once its slot has come round this rotation,
+          // otherwise holding the previous rotation's value
+          int16_t expected = slot <= phase ? slow_value(rotation, slow_index) :
+            rotation ? slow_value(rotation - 1, slow_index) : HELD;
+          CHECK(card->samples[c] == expected, "frame %d card %zu slow channel %d: %d, expected %d",
+                frame_num, i, c, card->samples[c], expected);
+          ++slow_index;
+        }
+        else {
+          int16_t expected = fast_value(frame_num, card->channel_offset + fast_index);
+          CHECK(card->samples[c] == expected, "frame %d card %zu fast channel %d: %d, expected %d",
+                frame_num, i, c, card->samples[c], expected);
+          ++fast_index;
+        }
+      }
+    }
+  }
+}
+
+
+// the 3372 as shipped: the mixer levels, channels 0, 5 and 6, slow and
+// the rest fast, on a device after a four channel card.  Each card
+// channel goes through the Rack side placement and mux and comes out
+// of the demux as sent, the slow ones as of their last slot.
+#define Z3372_NUM_CHANNELS 8
+#define Z3372_SLOW_CHANNEL_MASK 0x61
+#define Z3372_CHANNEL_OFFSET 4
+
+static void check_z3372_round_trip() {
+  int16_t frame[DEVICE_CHANNELS];
+  const char *device_samples[DEVICE_CHANNELS];
+  int16_t samples[Z3372_NUM_CHANNELS];
+  int16_t last_sent[Z3372_NUM_CHANNELS];
+  const int num_slow = __builtin_popcount(Z3372_SLOW_CHANNEL_MASK);
+
+  for (int c = 0; c < DEVICE_CHANNELS; ++c) {
+    device_samples[c] = (const char*)&frame[c];
+  }
+  for (int c = 0; c < Z3372_NUM_CHANNELS; ++c) {
+    samples[c] = HELD;
+    last_sent[c] = HELD;
+  }
+
+  for (int frame_num = 0; frame_num < 3 * TDM_SLOTS_PER_CHANNEL; ++frame_num) {
+    int phase = frame_num % TDM_SLOTS_PER_CHANNEL;
+    int16_t slow[TDM_SLOTS_PER_CHANNEL];
+    int fast_index = Z3372_CHANNEL_OFFSET;
+    int slow_index = 0;
+
+    // Rack: fast channels packed from the card's offset, slow ones to
+    // TDM indexes from its base (0), then the audio port's mux
+    memset(frame, 0, sizeof(frame));
+    for (int c = 0; c < Z3372_NUM_CHANNELS; ++c) {
+      if (Z3372_SLOW_CHANNEL_MASK & (1u << c)) {
+        slow[slow_index++] = fast_value(frame_num, c);
+      }
+      else {
+        frame[fast_index++] = fast_value(frame_num, c);
+      }
+    }
+    frame[SYNC_CHANNEL] = phase * TDM_PHASE_SCALE;
+    frame[SYNC_CHANNEL - 1] = phase < num_slow ? slow[phase] : 0;
+
+    tdm_demux(device_samples, SYNC_CHANNEL, Z3372_SLOW_CHANNEL_MASK, Z3372_NUM_CHANNELS,
+              Z3372_CHANNEL_OFFSET, 0, samples);
+
+    slow_index = 0;
+    for (int c = 0; c < Z3372_NUM_CHANNELS; ++c) {
+      int16_t expected = fast_value(frame_num, c);
+      if (Z3372_SLOW_CHANNEL_MASK & (1u << c)) {
+        if (slow_index++ == phase) {
+          last_sent[c] = expected;
+        }
+        expected = last_sent[c];
+      }
+      CHECK(samples[c] == expected, "frame %d 3372 channel %d: %d, expected %d",
+            frame_num, c, samples[c], expected);
+    }
+  }
+}
+
+
+int main() {
+  check_phase();
+  check_round_trip();
+  check_z3372_round_trip();
+
+  if (failures) {
+    printf("tdm_check: %d failures\n", failures);
+    return 1;
+  }
+  printf("tdm_check: ok\n");
+  return 0;
+}
@@ -1,7 +1,10 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
+#include <vector>
 #include "plugin.hpp"
 #include "constants.hpp"
+#include "Decimator.hpp"
 
 namespace zox {
   
@@ -27,23 +30,115 @@ namespace zox {
 
 
 
-// this ought to be chopped in half since it only really
-// uses the inputs.  Outputs could be removed.
-
-// NOTE: THIS DOES NOT CLAMP: User of this audio port should clamp all inputs.
-// Maybe I'll change that later... the unmeasurable effieciency gained
-// is perhaps the wrong optimization.  The inputs may have varying ranges
-// depending on the hardware and the particular signal, so it makes sense the
-// hardware module writer implementor better know the clamping
-// requirements for each signal.
+// Engine frames in, device frames out; the device's inputs aren't used.
+//
+// Rate conversion happens on the engine side as frames are pushed,
+// through the generic converter, a block of up to maxPushFrames at a
+// time.  The integer ratio decimator is opt in until it's been measured
+// against the converter with the Rack SDK (test/decimator_bench).
+// What's queued for the audio thread is device frames as the device
+// takes them, int16, only as wide as the channels in use.  Slow CV TDM
+// is muxed on the audio thread so the rotation keeps going through an
+// underrun.
+//
+// The ring is a jitter buffer: the fill left after each device block is
+// held near a target.  The master port steps the engine to it.  A port
+// whose device isn't clocking the engine drifts against it instead, so
+// a PI controller on the fill trims the device rate the engine side
+// converts to, by up to maxRateCorrection.  It's slow, half a minute or
+// so: the engine runs in blocks, so drift shows up as a block's worth of
+// frames at a time.  The target grows after an underrun and gives back
+// headroom the fill hasn't been using.
+//
+// Samples are clamped to [-1, 1] only by the conversion to int16: the
+// modules clamp each signal to the range its hardware wants.
   struct ZoxnoxiousAudioPort : audio::Port {
     Module* module;
 
-    dsp::DoubleRingBuffer<dsp::Frame<maxAudioChannels>, 32768> engineInputBuffer;
-    dsp::DoubleRingBuffer<dsp::Frame<maxAudioChannels>, 32768> engineOutputBuffer;
-
+    // device frame ring: the active channels, then the slow TDM channels.
+    // Storage for the largest ring is allocated once so the audio thread
+    // can resize without racing the engine; only capacity * stride of it
+    // is used.  One producer (pushEngineFrames), one consumer (processOutput).
+    static constexpr int minRingFrames = 256;
+    static constexpr int maxRingFrames = 4096;
+    static constexpr float int16Scale = 32768.f;
+    std::vector<int16_t> ring;
+    std::atomic<uint32_t> ringWrite { 0 };
+    std::atomic<uint32_t> ringRead { 0 };
+
+    // ring layout, set by the audio thread, then ringSerial moves.  The
+    // engine side adopts it on its next push, noting where its frames in
+    // the new layout start, and says so in producerSerial.
+    std::atomic<int> ringWidth { 0 };
+    std::atomic<int> ringSlow { 0 };
+    std::atomic<int> ringCapacity { 0 };
+    std::atomic<float> ringRate { 0.f };
+    std::atomic<uint32_t> ringSerial { 0 };
+    std::atomic<uint32_t> producerSerial { 0 };
+    std::atomic<uint32_t> producerStart { 0 };
+    std::atomic<bool> flushRequested { false };
+    bool consumerSynced = false;
+
+    // jitter buffer, audio thread but for the atomics.  Gains are per
+    // device block, on the fill error in blocks.
+    static constexpr int minTargetFill = 8;
+    static constexpr float maxRateCorrection = 0.005f;
+    static constexpr float rateCorrectionStep = 1e-5f;
+    static constexpr float fillProportionalGain = 7.5e-4f;
+    static constexpr float fillIntegralGain = 2.8e-7f;
+    static constexpr float fillSmoothing = 0.01f;
+    static constexpr int targetDecayBlocks = 4000;
+    int targetFill = minTargetFill;
+    float smoothedFill = 0.f;
+    float fillIntegral = 0.f;
+    int blocksSinceUnderrun = 0;
+    int lowestFill = 0;  // since the target last moved
+    bool primed = false;
+    int16_t heldFrame[maxAudioChannels] = {};  // last frame out, stride wide
+    bool holding = false;
+    std::atomic<bool> correctingDrift { false };
+    std::atomic<float> rateCorrection { 0.f };
+    std::atomic<int> underruns { 0 };
+    std::atomic<int> overruns { 0 };
+    std::atomic<int> reportedFill { 0 };
+    std::atomic<int> reportedTarget { 0 };
+
+    // engine side: the layout it's writing and the rate conversion
+    uint32_t adoptedSerial = 0;
+    int pushWidth = 0;
+    int pushSlow = 0;
+    int pushCapacity = 0;
+    float pushRate = 0.f;
+    bool overrunning = false;
+    Decimator inputDecimator;
     dsp::SampleRateConverter<maxAudioChannels> inputSrc;
-    dsp::SampleRateConverter<maxAudioChannels> outputSrc;
+    static constexpr int maxPushFrames = 16;
+    std::vector<dsp::Frame<maxAudioChannels>> convertFrames;
+
+    // the converter's rates as last set.  speex recomputes its filter on
+    // every ratio change, and reallocates it when the new one is longer,
+    // so the drift correction only reaches it once it has moved by
+    // srcCorrectionStep, and no more than once every srcRetunePushes.
+    static constexpr float srcCorrectionStep = 2e-5f;
+    static constexpr int srcRetunePushes = 1024;
+    int srcInRate = 0;
+    int srcOutRate = 0;
+    float srcCorrection = 0.f;
+    int srcPushesSinceRetune = srcRetunePushes;
+
+    // slow CV TDM, set from the discovery report.  When there's a sync
+    // channel the engine frame's slow CVs (tdmVirtualChannelBase on) are
+    // muxed onto the lanes below it after sample rate conversion, so
+    // the rotation runs on device frames.
+    std::atomic<int> tdmSyncChannel { tdmNoSyncChannel };
+    std::atomic<int> tdmNumSlow { 0 };
+    uint64_t tdmFrameCounter = 0;
+    float tdmSlowHold[tdmMaxSlowChannels] = {};
+
+    // channels up to the highest one discovery says is in use, -1 for
+    // all of them.  Only these are converted and queued; the rest go out
+    // at zero.
+    std::atomic<int> activeChannels { -1 };
 
     // Port variable caches
     int deviceNumInputs = 0;
@@ -51,12 +146,13 @@ namespace zox {
     float deviceSampleRate = 0.f;
     int requestedEngineFrames = 0;
 
-    ZoxnoxiousAudioPort(Module* module) {
+    ZoxnoxiousAudioPort(Module* module) :
+      ring(static_cast<size_t>(maxRingFrames) * maxAudioChannels),
+      convertFrames(8 * maxPushFrames) {
       this->module = module;
       maxOutputs = maxAudioChannels;
       maxInputs = maxAudioChannels;
       inputSrc.setQuality(6);
-      outputSrc.setQuality(6);
     }
 
     void setMaster(bool master = true) {
@@ -74,6 +170,10 @@ namespace zox {
       return APP->engine->getMasterModule() == module;
     }
 
+    int ringSize() const {
+      return static_cast<int>(ringWrite.load(std::memory_order_acquire) - ringRead.load(std::memory_order_relaxed));
+    }
+
     void processInput(const float* input, int inputStride, int frames) override {
       deviceNumInputs = std::min(getNumInputs(), static_cast<int>(maxAudioChannels));
       deviceNumOutputs = std::min(getNumOutputs(), static_cast<int>(maxAudioChannels));
@@ -94,97 +194,313 @@ namespace zox {
       float engineSampleRate = APP->engine->getSampleRate();
       float sampleRateRatio = engineSampleRate / deviceSampleRate;
 
-      // Consider engine buffers "too full" if they contain a bit more than the audio device's number of frames, converted to engine sample rate.
-      int maxEngineFrames = (int) std::ceil(frames * sampleRateRatio * 2.0) - 1;
-      // If the engine output buffer is too full, clear it to keep latency low. No need to clear if master because it's always cleared below.
-      if (!isMasterCached && (int) engineOutputBuffer.size() > maxEngineFrames) {
-        engineOutputBuffer.clear();
-        // DEBUG("%p: clearing engine output", this);
+      // enough engine frames for this block with the target left over
+      requestedEngineFrames = std::max((int) std::ceil((frames + targetFill - ringSize()) * sampleRateRatio), 0);
+    }
+
+    void processBuffer(const float* input, int inputStride, float* output, int outputStride, int frames) override {
+      // Step engine
+      if (isMaster() && requestedEngineFrames > 0) {
+        // DEBUG("%p: %d block, stepping %d", this, frames, requestedEngineFrames);
+        APP->engine->stepBlock(requestedEngineFrames);
+      }
+    }
+
+    void setTdm(int syncChannel, int numSlow) {
+      tdmNumSlow.store(std::min(numSlow, tdmMaxSlowChannels), std::memory_order_relaxed);
+      tdmSyncChannel.store(syncChannel, std::memory_order_release);
+    }
+
+    void setActiveChannels(int numChannels) {
+      activeChannels.store(numChannels, std::memory_order_relaxed);
+    }
+
+    int getActiveOutputs() const {
+      int numActive = activeChannels.load(std::memory_order_relaxed);
+      return numActive >= 0 ? std::min(numActive, deviceNumOutputs) : deviceNumOutputs;
+    }
+
+    // drop what's queued, from either side
+    void flush() {
+      flushRequested.store(true, std::memory_order_relaxed);
+    }
+
+    // engine side: a block of engine frames, at most maxPushFrames.
+    // decimate: take an integer ratio through the decimator.
+    void pushEngineFrames(const dsp::Frame<maxAudioChannels>* frames, int numFrames, float engineSampleRate,
+                          bool decimate) {
+      const uint32_t serial = ringSerial.load(std::memory_order_acquire);
+      if (serial != adoptedSerial) {
+        adoptedSerial = serial;
+        pushWidth = ringWidth.load(std::memory_order_relaxed);
+        pushSlow = ringSlow.load(std::memory_order_relaxed);
+        pushCapacity = ringCapacity.load(std::memory_order_relaxed);
+        pushRate = ringRate.load(std::memory_order_relaxed);
+        producerStart.store(ringWrite.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        producerSerial.store(serial, std::memory_order_release);
+      }
+
+      if (pushCapacity == 0 || pushRate <= 0.f) {
+        return;
+      }
+
+      int inputFrames = numFrames;
+      int outputFrames = convertFrames.size();
+
+      // the decimator's ratio is exact, so not on a port correcting for drift
+      const bool correcting = correctingDrift.load(std::memory_order_relaxed);
+      if (decimate && !correcting && inputDecimator.setRates(engineSampleRate, pushRate)) {
+        inputDecimator.setChannels(pushWidth, tdmVirtualChannelBase, pushSlow);
+        inputDecimator.process((const float*) frames, maxAudioChannels, &inputFrames,
+                               (float*) convertFrames.data(), maxAudioChannels, &outputFrames);
       }
+      else {
+        // the converter takes integer rates: scaled so the correction's
+        // steps come through
+        const float correction = correcting ? rateCorrection.load(std::memory_order_relaxed) : 0.f;
+        if (srcPushesSinceRetune < srcRetunePushes) {
+          ++srcPushesSinceRetune;
+        }
+        if (!correcting ||
+            (std::fabs(correction - srcCorrection) >= srcCorrectionStep && srcPushesSinceRetune >= srcRetunePushes)) {
+          srcCorrection = correction;
+        }
+        const int inRate = static_cast<int>(engineSampleRate * 100.f);
+        const int outRate = static_cast<int>(std::round(pushRate * (1.f - srcCorrection) * 100.f));
+        if (inRate != srcInRate || outRate != srcOutRate) {
+          inputSrc.setRates(inRate, outRate);
+          srcInRate = inRate;
+          srcOutRate = outRate;
+          srcPushesSinceRetune = 0;
+        }
+        inputSrc.setChannels(pushSlow ? tdmVirtualChannelBase + pushSlow : pushWidth);
+        inputSrc.process((const float*) frames, maxAudioChannels, &inputFrames,
+                         (float*) convertFrames.data(), maxAudioChannels, &outputFrames);
+      }
+      queueDeviceFrames(convertFrames.data(), outputFrames);
+    }
 
-      if (deviceNumInputs > 0) {
-        // Always clear engine output if master
-        if (isMasterCached) {
-          engineOutputBuffer.clear();
+    // clamp and pack converted frames onto the ring: one reserve, one
+    // commit.  What doesn't fit is dropped.
+    void queueDeviceFrames(const dsp::Frame<maxAudioChannels>* frames, int numFrames) {
+      if (numFrames == 0) {
+        return;
+      }
+      const uint32_t write = ringWrite.load(std::memory_order_relaxed);
+      const int space = pushCapacity - static_cast<int>(write - ringRead.load(std::memory_order_acquire));
+      const int count = clamp(space, 0, numFrames);
+      if (count < numFrames) {
+        if (!overrunning) {
+          overruns.fetch_add(1, std::memory_order_relaxed);
+          overrunning = true;
         }
-        // Set up sample rate converter
-        outputSrc.setRates(deviceSampleRate, engineSampleRate);
-        outputSrc.setChannels(deviceNumInputs);
-        int inputFrames = frames;
-        int outputFrames = engineOutputBuffer.capacity();
-        outputSrc.process(input, inputStride, &inputFrames, (float*) engineOutputBuffer.endData(), maxAudioChannels, &outputFrames);
-        engineOutputBuffer.endIncr(outputFrames);
-        // Request exactly as many frames as we have in the engine output buffer.
-        requestedEngineFrames = engineOutputBuffer.size();
       }
       else {
-        // Upper bound on number of frames so that `audioOutputFrames >= frames` when processOutput() is called.
-        requestedEngineFrames = std::max((int) std::ceil(frames * sampleRateRatio) - (int) engineInputBuffer.size(), 0);
+        overrunning = false;
+      }
+
+      const int stride = pushWidth + pushSlow;
+      const uint32_t mask = pushCapacity - 1;
+      for (int i = 0; i < count; i++) {
+        const float* samples = frames[i].samples;
+        int16_t* out = &ring[static_cast<size_t>((write + i) & mask) * stride];
+        for (int c = 0; c < pushWidth; c++) {
+          out[c] = toDevice(samples[c]);
+        }
+        for (int c = 0; c < pushSlow; c++) {
+          out[pushWidth + c] = toDevice(samples[tdmVirtualChannelBase + c]);
+        }
+      }
+      if (count > 0) {
+        ringWrite.store(write + count, std::memory_order_release);
       }
     }
 
-    void processBuffer(const float* input, int inputStride, float* output, int outputStride, int frames) override {
-      // Step engine
-      if (isMaster() && requestedEngineFrames > 0) {
-        // DEBUG("%p: %d block, stepping %d", this, frames, requestedEngineFrames);
-        APP->engine->stepBlock(requestedEngineFrames);
+    static int16_t toDevice(float v) {
+      const float scaled = std::round(clamp(v, -1.f, 1.f) * int16Scale);
+      return static_cast<int16_t>(std::min(scaled, int16Scale - 1.f));
+    }
+
+    // audio thread: the layout for the channels in use and this block
+    // size.  Room for four blocks, more than the latency limit below.
+    void configureRing(int frames, int width, int numSlow) {
+      int capacity = minRingFrames;
+      while (capacity < 4 * frames && capacity < maxRingFrames) {
+        capacity *= 2;
+      }
+      if (width == ringWidth.load(std::memory_order_relaxed) &&
+          numSlow == ringSlow.load(std::memory_order_relaxed) &&
+          capacity == ringCapacity.load(std::memory_order_relaxed) &&
+          deviceSampleRate == ringRate.load(std::memory_order_relaxed)) {
+        return;
       }
+      ringWidth.store(width, std::memory_order_relaxed);
+      ringSlow.store(numSlow, std::memory_order_relaxed);
+      ringCapacity.store(capacity, std::memory_order_relaxed);
+      ringRate.store(deviceSampleRate, std::memory_order_relaxed);
+      consumerSynced = false;
+      primed = false;
+      holding = false;
+      targetFill = std::max(minTargetFill, std::min(targetFill, capacity - 2 * frames));
+      ringSerial.fetch_add(1, std::memory_order_release);
+      INFO("audio port ring: %d frames of %d channels, %d KB", capacity, width + numSlow,
+           static_cast<int>(capacity * (width + numSlow) * sizeof(int16_t) / 1024));
     }
 
     void processOutput(float* output, int outputStride, int frames) override {
-      // bool isMasterCached = isMaster();
-      float engineSampleRate = APP->engine->getSampleRate();
-      float sampleRateRatio = engineSampleRate / deviceSampleRate;
+      int syncChannel = tdmSyncChannel.load(std::memory_order_acquire);
 
-      if (deviceNumOutputs > 0) {
-        // Set up sample rate converter
-        inputSrc.setRates(engineSampleRate, deviceSampleRate);
-        inputSrc.setChannels(deviceNumOutputs);
-        // Convert engine input -> audio output
-        int inputFrames = engineInputBuffer.size();
-        int outputFrames = frames;
-        inputSrc.process((const float*) engineInputBuffer.startData(), maxAudioChannels, &inputFrames, output, outputStride, &outputFrames);
-        engineInputBuffer.startIncr(inputFrames);
-        // Clamp output samples
-        for (int i = 0; i < outputFrames; i++) {
-          for (int j = 0; j < deviceNumOutputs; j++) {
-            float v = output[i * outputStride + j];
-            // strictly speaking the clamp isn't necessary
-            // if the user of this audioport does the
-            // clamping (and it does below).
-            // Uncomment to get belt & suspenders approach.
-            //v = clamp(v, -1.f, 1.f);
-            output[i * outputStride + j] = v;
+      if (deviceNumOutputs <= 0) {
+        return;
+      }
+
+      // the engine frame's TDM region has to sit above the device's channels
+      const bool multiplexed = syncChannel >= 0 && syncChannel < deviceNumOutputs &&
+        deviceNumOutputs <= tdmVirtualChannelBase;
+      const int numSlow = multiplexed ? tdmNumSlow.load(std::memory_order_relaxed) : 0;
+      configureRing(frames, getActiveOutputs(), numSlow);
+
+      // frames from before the engine side took up this layout are dropped
+      uint32_t read = ringRead.load(std::memory_order_relaxed);
+      const uint32_t write = ringWrite.load(std::memory_order_acquire);
+      if (producerSerial.load(std::memory_order_acquire) != ringSerial.load(std::memory_order_relaxed)) {
+        read = write;
+      }
+      else if (!consumerSynced) {
+        read = std::max(read, producerStart.load(std::memory_order_relaxed));
+        consumerSynced = true;
+      }
+      if (flushRequested.exchange(false, std::memory_order_relaxed)) {
+        read = write;
+        primed = false;
+        holding = false;
+      }
+
+      // wait for a block and the target before starting out, or again
+      // after an underrun.  Whatever came in over that is skipped so the
+      // fill starts on the target.
+      int available = static_cast<int>(write - read);
+      if (!primed && consumerSynced && available >= frames + targetFill) {
+        read = write - (frames + targetFill);
+        available = frames + targetFill;
+        smoothedFill = targetFill;
+        primed = true;
+      }
+      if (!primed) {
+        available = 0;
+      }
+      else if (available < frames) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        onUnderrun(frames);
+      }
+
+      const int width = ringWidth.load(std::memory_order_relaxed);
+      const int stride = width + numSlow;
+      const uint32_t mask = ringCapacity.load(std::memory_order_relaxed) - 1;
+      const int numLanes = multiplexed ?
+        std::min((numSlow + tdmSlotsPerChannel - 1) / tdmSlotsPerChannel, syncChannel) : 0;
+      for (int i = 0; i < frames; i++) {
+        float* out = &output[i * outputStride];
+        if (i < available) {
+          const int16_t* in = &ring[static_cast<size_t>(read & mask) * stride];
+          for (int c = 0; c < width; c++) {
+            out[c] = in[c] / int16Scale;
           }
+          std::fill(out + width, out + deviceNumOutputs, 0.f);
+          for (int c = 0; c < numSlow; c++) {
+            tdmSlowHold[c] = in[width + c] / int16Scale;
+          }
+          ++read;
         }
-        // Fill the rest of the audio output buffer with zeros
-        for (int i = outputFrames; i < frames; i++) {
-          for (int j = 0; j < deviceNumOutputs; j++) {
-            output[i * outputStride + j] = 0.f;
+        else if (holding) {
+          // short of frames: the CVs stay where they were
+          for (int c = 0; c < width; c++) {
+            out[c] = heldFrame[c] / int16Scale;
           }
+          std::fill(out + width, out + deviceNumOutputs, 0.f);
+        }
+        else {
+          // Fill the rest of the audio output buffer with zeros
+          std::fill(out, out + deviceNumOutputs, 0.f);
         }
+
+        // frames with nothing from the engine keep the rotation going
+        // with the last slow values
+        if (multiplexed) {
+          int phase = tdmFrameCounter++ % tdmSlotsPerChannel;
+          out[syncChannel] = phase * tdmPhaseScale;
+          for (int lane = 0; lane < numLanes; ++lane) {
+            int slowIndex = lane * tdmSlotsPerChannel + phase;
+            out[syncChannel - 1 - lane] = slowIndex < numSlow ? tdmSlowHold[slowIndex] : 0.f;
+          }
+        }
+      }
+
+      if (available > 0) {
+        const int16_t* last = &ring[static_cast<size_t>((read - 1) & mask) * stride];
+        std::copy(last, last + stride, heldFrame);
+        holding = true;
+      }
+      ringRead.store(read, std::memory_order_release);
+      if (primed) {
+        updateFill(static_cast<int>(write - read), frames);
       }
+    }
 
+    // the target goes up by a quarter block, to at most what the ring
+    // holds with two blocks' room
+    void onUnderrun(int frames) {
+      const int maxTarget = ringCapacity.load(std::memory_order_relaxed) - 2 * frames;
+      targetFill = std::max(minTargetFill, std::min(targetFill + std::max(frames / 4, 1), maxTarget));
+      blocksSinceUnderrun = 0;
+      lowestFill = targetFill;
+      primed = false;
+    }
 
-      // If the engine input buffer is too full, clear it to keep latency low.
-      int maxEngineFrames = (int) std::ceil(frames * sampleRateRatio * 2.0) - 1;
-      if ((int) engineInputBuffer.size() > maxEngineFrames) {
-        engineInputBuffer.clear();
+    // fill after a block: the target comes down by what wasn't needed,
+    // and the rate correction follows the smoothed error, but for the
+    // master port, which steps the engine to the target
+    void updateFill(int fill, int frames) {
+      lowestFill = std::min(lowestFill, fill);
+      if (++blocksSinceUnderrun >= targetDecayBlocks) {
+        const int spare = std::min(lowestFill / 2, std::max(frames / 16, 1));
+        targetFill = std::max(minTargetFill, targetFill - std::max(spare, 0));
+        blocksSinceUnderrun = 0;
+        lowestFill = targetFill;
       }
+      smoothedFill += fillSmoothing * (fill - smoothedFill);
+      reportedFill.store(fill, std::memory_order_relaxed);
+      reportedTarget.store(targetFill, std::memory_order_relaxed);
+
+      const bool correcting = !isMaster();
+      correctingDrift.store(correcting, std::memory_order_relaxed);
+      if (!correcting) {
+        fillIntegral = 0.f;
+        rateCorrection.store(0.f, std::memory_order_relaxed);
+        return;
+      }
+      const float error = (smoothedFill - targetFill) / frames;
+      fillIntegral = clamp(fillIntegral + fillIntegralGain * error, -maxRateCorrection, maxRateCorrection);
+      const float correction = clamp(fillProportionalGain * error + fillIntegral,
+                                     -maxRateCorrection, maxRateCorrection);
+      rateCorrection.store(std::round(correction / rateCorrectionStep) * rateCorrectionStep,
+                           std::memory_order_relaxed);
+    }
 
+    void resetCounters() {
+      underruns.store(0, std::memory_order_relaxed);
+      overruns.store(0, std::memory_order_relaxed);
     }
 
     void onStartStream() override {
-      engineInputBuffer.clear();
-      engineOutputBuffer.clear();
+      flush();
     }
 
     void onStopStream() override {
       deviceNumInputs = 0;
       deviceNumOutputs = 0;
       deviceSampleRate = 0.f;
-      engineInputBuffer.clear();
-      engineOutputBuffer.clear();
+      flush();
       // We can be in an Engine write-lock here (e.g. onReset() calls this indirectly), so use non-locking master module API.
       // setMaster(false);
       if (APP->engine->getMasterModule() == module) {
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cmath>
+#include "Decimator.hpp"
+
+namespace zox {
+
+// passband edge as a fraction of the output Nyquist: CV is mostly slow,
+// this leaves the transition band room to be down by the output Nyquist
+static constexpr float cutoffFraction = 0.76f;
+static constexpr float integerRatioTolerance = 1e-4f;
+static constexpr int maxGroups = maxAudioChannels / 4;
+
+
+bool Decimator::setRates(float newInRate, float newOutRate) {
+  if (newInRate == inRate && newOutRate == outRate) {
+    return factor > 0;
+  }
+  inRate = newInRate;
+  outRate = newOutRate;
+  factor = 0;
+
+  if (inRate <= 0.f || outRate <= 0.f) {
+    return false;
+  }
+  const float ratio = inRate / outRate;
+  const int newFactor = static_cast<int>(std::round(ratio));
+  if (newFactor < 1 || newFactor > maxFactor ||
+      std::fabs(ratio - newFactor) > integerRatioTolerance * ratio) {
+    return false;
+  }
+
+  // Blackman windowed sinc, unity gain at DC so CV levels are exact
+  factor = newFactor;
+  length = factor == 1 ? 1 : factor * tapsPerPhase;
+  taps.assign(length, 1.f);
+  if (length > 1) {
+    const float fc = cutoffFraction * 0.5f / factor;
+    const float center = 0.5f * (length - 1);
+    float sum = 0.f;
+    for (int k = 0; k < length; ++k) {
+      const float x = k - center;
+      const float sinc = x == 0.f ? 2.f * fc : std::sin(2.f * M_PI * fc * x) / (M_PI * x);
+      const float w = 2.f * M_PI * k / (length - 1);
+      taps[k] = sinc * (0.42f - 0.5f * std::cos(w) + 0.08f * std::cos(2.f * w));
+      sum += taps[k];
+    }
+    for (float& tap : taps) {
+      tap /= sum;
+    }
+  }
+
+  history.assign(2 * length * maxGroups, simd::float_4(0.f));
+  pos = 0;
+  phase = 0;
+  INFO("decimating by %d, %d taps", factor, length);
+  return true;
+}
+
+
+void Decimator::setChannels(int numChannels, int highBase, int numHigh) {
+  Group newGroups[maxGroups];
+  int count = 0;
+
+  for (int c = 0; c < numChannels && count < maxGroups; c += 4) {
+    newGroups[count++] = { c, std::min(4, numChannels - c) };
+  }
+  for (int c = 0; c < numHigh && count < maxGroups; c += 4) {
+    newGroups[count++] = { highBase + c, std::min(4, numHigh - c) };
+  }
+
+  bool same = count == numGroups;
+  for (int g = 0; same && g < count; ++g) {
+    same = newGroups[g].channel == groups[g].channel && newGroups[g].width == groups[g].width;
+  }
+  if (same) {
+    return;
+  }
+
+  // history is laid out by group: start it over
+  std::copy(newGroups, newGroups + count, groups);
+  numGroups = count;
+  std::fill(history.begin(), history.end(), simd::float_4(0.f));
+  pos = 0;
+  phase = 0;
+}
+
+
+void Decimator::process(const float* in, int inStride, int* inFrames, float* out, int outStride, int* outFrames) {
+  int i = 0;
+  int o = 0;
+
+  while (i < *inFrames && o < *outFrames) {
+    // engine frames are maxAudioChannels wide, so a full float_4 load is safe
+    const float* frame = &in[i * inStride];
+    simd::float_4* h0 = &history[pos * numGroups];
+    simd::float_4* h1 = &history[(pos + length) * numGroups];
+    for (int g = 0; g < numGroups; ++g) {
+      h0[g] = h1[g] = simd::float_4::load(&frame[groups[g].channel]);
+    }
+    pos = pos + 1 == length ? 0 : pos + 1;
+    ++i;
+
+    if (++phase < factor) {
+      continue;
+    }
+    phase = 0;
+
+    // oldest to newest: the frames from pos on
+    const simd::float_4* h = &history[pos * numGroups];
+    std::fill(sums, sums + numGroups, simd::float_4(0.f));
+    for (int k = 0; k < length; ++k, h += numGroups) {
+      const simd::float_4 tap = taps[k];
+      for (int g = 0; g < numGroups; ++g) {
+        sums[g] += tap * h[g];
+      }
+    }
+
+    // device frames are only as wide as the device, so store what fits
+    float* outFrame = &out[o * outStride];
+    for (int g = 0; g < numGroups; ++g) {
+      if (groups[g].width == 4) {
+        sums[g].store(&outFrame[groups[g].channel]);
+      }
+      else {
+        for (int c = 0; c < groups[g].width; ++c) {
+          outFrame[groups[g].channel + c] = sums[g][c];
+        }
+      }
+    }
+    ++o;
+  }
+
+  *inFrames = i;
+  *outFrames = o;
+}
+
+} // namespace zox
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include "plugin.hpp"
+#include "constants.hpp"
+
+
+namespace zox {
+
+// Engine to device rate conversion for the audio port when the ratio is
+// an integer, 48k to 4k or 96k to 8k say, which is the usual case.  A
+// windowed-sinc lowpass where only the kept output samples are computed,
+// four channels at a time.  Channels are the low ones up to numChannels
+// plus, for slow CV TDM, numHigh from highBase; the rest aren't touched.
+// Not thread safe: the engine side of the port owns it, as with the
+// generic converter.
+class Decimator {
+public:
+  static constexpr int tapsPerPhase = 24;
+  static constexpr int maxFactor = 48;  // 192k to 4k
+
+  // false when the rates aren't an integer ratio it handles: use the
+  // generic converter.  Filter and history are rebuilt on a change only.
+  bool setRates(float inRate, float outRate);
+  void setChannels(int numChannels, int highBase = 0, int numHigh = 0);
+
+  // as SampleRateConverter::process: inFrames and outFrames are the space
+  // available on the way in and the frames used on the way out
+  void process(const float* in, int inStride, int* inFrames, float* out, int outStride, int* outFrames);
+
+private:
+  struct Group {
+    int channel;  // first of up to four
+    int width;
+  };
+
+  float inRate = 0.f;
+  float outRate = 0.f;
+  int factor = 0;
+  int length = 0;     // taps
+  int pos = 0;        // history frame the next input goes to
+  int phase = 0;      // inputs since the last output
+  std::vector<float> taps;
+
+  Group groups[maxAudioChannels / 4];
+  int numGroups = 0;
+
+  // each input frame twice, at pos and pos + length, so the newest
+  // length frames are always contiguous.  Indexed [frame][group].
+  std::vector<simd::float_4> history;
+  simd::float_4 sums[maxAudioChannels / 4];
+};
+
+} // namespace zox
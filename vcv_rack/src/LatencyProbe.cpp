@@ -0,0 +1,103 @@
+#include <algorithm>
+#include "LatencyProbe.hpp"
+#include "modulehelpers.hpp"
+
+namespace zox {
+
+// a marker every quarter second or so, given up on after a second
+static constexpr float markerIntervalSec = 0.25f;
+static constexpr float markerJitterSec = 0.1f;
+static constexpr float markerTimeoutSec = 1.f;
+
+static constexpr int latencyReportSize = 17;
+static constexpr int latencyReportCountOffset = 3;
+static constexpr int latencyReportDelayOffset = 4;
+static constexpr int latencyReportBacklogOffset = 12;
+
+
+float LatencyProbe::process(int64_t frame, float sampleRate) {
+  if (clearRequested.load(std::memory_order_relaxed)) {
+    clearRequested.store(false, std::memory_order_relaxed);
+    numResults.store(0, std::memory_order_release);
+    timeouts.store(0, std::memory_order_relaxed);
+  }
+
+  if (!isEnabled()) {
+    markerHigh = false;
+    return 0.f;
+  }
+
+  if (markerHigh && frame - markerFrame > static_cast<int64_t>(markerTimeoutSec * sampleRate)) {
+    markerHigh = false;
+    timeouts.fetch_add(1, std::memory_order_relaxed);
+    scheduleNextMarker(frame, sampleRate);
+  }
+  else if (!markerHigh && frame >= nextMarkerFrame) {
+    markerHigh = true;
+    markerFrame = frame;
+  }
+
+  return markerHigh ? 1.f : 0.f;
+}
+
+
+void LatencyProbe::processReport(const midi::Message& msg, int64_t frame, float sampleRate, float deviceSampleRate) {
+  if (msg.getSize() < latencyReportSize) {
+    WARN("Latency report of %d bytes, expected %d", msg.getSize(), latencyReportSize);
+    return;
+  }
+
+  // the Pi counts every marker it sees; a repeat count is a late report
+  const int count = msg.bytes[latencyReportCountOffset];
+  if (!markerHigh || count == lastReportCount) {
+    return;
+  }
+  lastReportCount = count;
+
+  const float delayMs = decodeSysex28(&msg.bytes[latencyReportDelayOffset]) / 1000.f;
+  const int32_t backlog = decodeSysex28(&msg.bytes[latencyReportBacklogOffset]);
+
+  const int n = numResults.load(std::memory_order_relaxed);
+  latencyMs[n % maxResults] = (frame - markerFrame) * 1000.f / sampleRate - delayMs;
+  piBufferMs[n % maxResults] = deviceSampleRate > 0.f ? backlog * 1000.f / deviceSampleRate : 0.f;
+  numResults.store(n + 1, std::memory_order_release);
+
+  markerHigh = false;
+  scheduleNextMarker(frame, sampleRate);
+}
+
+
+void LatencyProbe::scheduleNextMarker(int64_t frame, float sampleRate) {
+  nextMarkerFrame = frame + static_cast<int64_t>((markerIntervalSec + markerJitterSec * random::uniform()) * sampleRate);
+}
+
+
+// results may be overwritten while they're copied; it's a display
+LatencyProbe::Summary LatencyProbe::getSummary() const {
+  Summary summary;
+  summary.timeouts = timeouts.load(std::memory_order_relaxed);
+  summary.count = std::min(numResults.load(std::memory_order_acquire), maxResults);
+  if (summary.count == 0) {
+    return summary;
+  }
+
+  float sorted[maxResults];
+  float latencySum = 0.f;
+  float piBufferSum = 0.f;
+  for (int i = 0; i < summary.count; ++i) {
+    sorted[i] = latencyMs[i];
+    latencySum += latencyMs[i];
+    piBufferSum += piBufferMs[i];
+  }
+  std::sort(sorted, sorted + summary.count);
+
+  summary.minMs = sorted[0];
+  summary.medianMs = sorted[summary.count / 2];
+  summary.p95Ms = sorted[(summary.count * 95) / 100];
+  summary.maxMs = sorted[summary.count - 1];
+  summary.meanMs = latencySum / summary.count;
+  summary.piBufferMs = piBufferSum / summary.count;
+  return summary;
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include "plugin.hpp"
+
+
+namespace zox {
+
+// Rack to DAC latency measurement.  A marker channel on audio device 0
+// is stepped to full scale; the Pi reports the frame it reached the
+// DACs with (Latency Report in midi.spec).  The time from the step to
+// the report, less the Pi's time holding the report, is one sample.
+// Markers are spaced irregularly so they don't lock to a period.
+//
+// process and processReport are audio thread only; the rest is for the UI.
+class LatencyProbe {
+public:
+  static constexpr int maxResults = 256;
+
+  struct Summary {
+    int count = 0;
+    int timeouts = 0;
+    float minMs = 0.f;
+    float medianMs = 0.f;
+    float p95Ms = 0.f;
+    float maxMs = 0.f;
+    float meanMs = 0.f;
+    float piBufferMs = 0.f;  // mean time captured on the Pi before the DACs
+  };
+
+  void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void clear() { clearRequested.store(true, std::memory_order_relaxed); }
+  Summary getSummary() const;
+
+  // value for the marker channel this frame
+  float process(int64_t frame, float sampleRate);
+  // the Pi's Latency Report, received at frame
+  void processReport(const midi::Message& msg, int64_t frame, float sampleRate, float deviceSampleRate);
+
+private:
+  std::atomic<bool> enabled {false};
+  std::atomic<bool> clearRequested {false};
+
+  bool markerHigh = false;
+  int64_t markerFrame = 0;
+  int64_t nextMarkerFrame = 0;
+  int lastReportCount = -1;
+
+  // ring of results; numResults counts every one written
+  float latencyMs[maxResults] = {};
+  float piBufferMs[maxResults] = {};
+  std::atomic<int> numResults {0};
+  std::atomic<int> timeouts {0};
+
+  void scheduleNextMarker(int64_t frame, float sampleRate);
+};
+
+}
@@ -7,24 +7,44 @@
 namespace zox {
 
 std::atomic<OutputInterface*> OutputInterface::instance { nullptr };
-
-static constexpr int midiPollRateHz = 100;
+AttachQueue OutputInterface::attachQueue;
+std::atomic<uint32_t> OutputInterface::attachGeneration { 1 };
+std::atomic<int> OutputInterface::controlRateDivision { 1 };
+
+// button changes are scanned for and sent at once; lights and the rest
+// of the UI run at a rate the eye can't tell from faster.  A scan only
+// looks at params marked changed, and every param is marked now and then
+// for values set around their quantities: undo, MIDI-Map and the like.
+static constexpr int midiScanRateHz = 2000;
+static constexpr int paramSweepRateHz = 20;
+static constexpr int lightPollRateHz = 100;
+static constexpr size_t midiMessagesPerScan = 16;
 static constexpr int graphPollRateHz = 30;
 
+// heartbeat every 20 ms, link lost after 100 ms without an ack.  Until a
+// discovery report comes back, requests go out 5 ms apart doubling to 1 s.
+static constexpr float heartbeatIntervalSec = 0.02f;
+static constexpr float heartbeatTimeoutSec = 0.1f;
+static constexpr float discoveryBackoffStartSec = 0.005f;
+static constexpr float discoveryBackoffMaxSec = 1.f;
+// programs in one Card State sysex, see midi.spec
+static constexpr size_t maxCardStatePrograms = 64;
+static constexpr int cardStateHeaderSize = 4;
+
 enum cvChannel {
     OUT2_CHANNEL = 0,
     OUT1_CHANNEL
 };
 
 
-OutputInterface::OutputInterface() : out1LevelClipTimer(0.f),
-                     out2LevelClipTimer(0.f),
-                     buttonStates(buttonMappings.size()),
+OutputInterface::OutputInterface() : buttonStates(buttonMappings.size()),
                      buttonMidiController(buttonMappings),
+                     engineBlocks(maxAudioDevices * engineBlockFrames),
+                     cardBlock(engineBlockFrames),
                      routes{
   {
-    {OUT1_LEVEL_KNOB_PARAM, OUT1_LEVEL_INPUT, OUT1_CHANNEL, 10.f, &out1LevelClipTimer, nullptr, CvOperation::Add},
-    {OUT2_LEVEL_KNOB_PARAM, OUT2_LEVEL_INPUT, OUT2_CHANNEL, 10.f, &out2LevelClipTimer, nullptr, CvOperation::Add}
+    {OUT1_LEVEL_KNOB_PARAM, OUT1_LEVEL_INPUT, OUT1_CHANNEL, 10.f, &out1LevelClip, nullptr, CvOperation::Add},
+    {OUT2_LEVEL_KNOB_PARAM, OUT2_LEVEL_INPUT, OUT2_CHANNEL, 10.f, &out2LevelClip, nullptr, CvOperation::Add}
   }}
 {
   for(int i = 0; i < maxAudioDevices; ++i) {
@@ -35,28 +55,35 @@ OutputInterface::OutputInterface() : out1LevelClipTimer(0.f),
   configParam(OUT1_LEVEL_KNOB_PARAM, 0.f, 1.f, 0.5f, "Out1 Level", " V", 0.f, 10.f);
   configParam(OUT2_LEVEL_KNOB_PARAM, 0.f, 1.f, 0.5f, "Out2 Level", " V", 0.f, 10.f);
 
-  configSwitch(CARD_A_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card A Out 1 to Audio Out");
-  configSwitch(CARD_A_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card A Out 2 to Audio Out");
-  configSwitch(CARD_B_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card B Out 1 to Audio Out");
-  configSwitch(CARD_B_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card B Out 2 to Audio Out");
-  configSwitch(CARD_C_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card C Out 1 to Audio Out");
-  configSwitch(CARD_C_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card C Out 2 to Audio Out");
-  configSwitch(CARD_D_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card D Out 1 to Audio Out");
-  configSwitch(CARD_D_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card D Out 2 to Audio Out");
-  configSwitch(CARD_E_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card E Out 1 to Audio Out");
-  configSwitch(CARD_E_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card E Out 2 to Audio Out");
-  configSwitch(CARD_F_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card F Out 1 to Audio Out");
-  configSwitch(CARD_F_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card F Out 2 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_A_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card A Out 1 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_A_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card A Out 2 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_B_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card B Out 1 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_B_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card B Out 2 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_C_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card C Out 1 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_C_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card C Out 2 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_D_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card D Out 1 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_D_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card D Out 2 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_E_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card E Out 1 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_E_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card E Out 2 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_F_MIX1_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card F Out 1 to Audio Out");
+  configSwitch<NotifyingSwitchQuantity>(CARD_F_MIX2_OUTPUT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Card F Out 2 to Audio Out");
 
   configInput(OUT1_LEVEL_INPUT, "Out1 VCA Level");
   configInput(OUT2_LEVEL_INPUT, "Out2 VCA Level");
 
   configLight(HARDWARE_LINK_LIGHT, "Connection Status");
+  watchParamChanges(this, buttonChanges);
 
   onReset();
 
+  discoveryBackoffSec = discoveryBackoffStartSec;
+  heartbeatMessage.bytes = { 0xF0, 0x7D, 0x08, 0x00, 0xF7 };
+  cardStateMessage.bytes.reserve(cardStateHeaderSize + maxCardStatePrograms + 1);
+
   orchestrationClockDivider.setDivision(APP->engine->getSampleRate());  // once per second
-  midiPollClockDivider.setDivision(static_cast<int>(APP->engine->getSampleRate()) / midiPollRateHz);
+  midiScanClockDivider.setDivision(std::max(static_cast<int>(APP->engine->getSampleRate()) / midiScanRateHz, 1));
+  paramSweepClockDivider.setDivision(midiScanRateHz / paramSweepRateHz);
+  lightPollClockDivider.setDivision(static_cast<int>(APP->engine->getSampleRate()) / lightPollRateHz);
   graphPollClockDivider.setDivision(static_cast<int>(APP->engine->getSampleRate()) / graphPollRateHz);
 
   rightExpander.producerMessage = &graphMessages[0];
@@ -77,12 +104,16 @@ void OutputInterface::onAdd(const AddEvent &e) {
 
   OutputInterface *expected = nullptr;
   OutputInterface::instance.compare_exchange_strong(expected, this, std::memory_order_release);
+  attachGeneration.fetch_add(1, std::memory_order_relaxed);
 }
 
 
 void OutputInterface::onRemove(const RemoveEvent &e) {
   OutputInterface *expected = this;
-  OutputInterface::instance.compare_exchange_strong(expected, nullptr, std::memory_order_release);
+  if (OutputInterface::instance.compare_exchange_strong(expected, nullptr, std::memory_order_release)) {
+    controlRateDivision.store(1, std::memory_order_relaxed);
+  }
+  attachGeneration.fetch_add(1, std::memory_order_relaxed);
   Module::onRemove(e);
 }
 
@@ -96,12 +127,12 @@ void OutputInterface::onReset() {
 
 void OutputInterface::onSampleRateChange(const SampleRateChangeEvent& e) {
   for (auto it = audioPorts.begin(); it != audioPorts.end(); ++it) {
-    (*it)->engineInputBuffer.clear();
-    (*it)->engineOutputBuffer.clear();
+    (*it)->flush();
   }
 
   graphPollClockDivider.setDivision(static_cast<int>(e.sampleRate) / graphPollRateHz);
-  midiPollClockDivider.setDivision(static_cast<int>(e.sampleRate) / midiPollRateHz);
+  midiScanClockDivider.setDivision(std::max(static_cast<int>(e.sampleRate) / midiScanRateHz, 1));
+  lightPollClockDivider.setDivision(static_cast<int>(e.sampleRate) / lightPollRateHz);
   orchestrationClockDivider.setDivision(static_cast<int>(e.sampleRate));
 }
 
@@ -149,13 +180,42 @@ static GraphSource makeOutputGraphSource(const Broker::Snapshot& snap,
 
 
 
+// a card with slow channels fills a scratch frame with its channels
+// contiguous.  Place fast channels packed from its offset and the slow
+// ones in the TDM region of the device frame for the audio port to mux.
+static void placeCardChannels(const float* cardSamples,
+                              int numChannels,
+                              int cvChannelOffset,
+                              int tdmBase,
+                              uint32_t slowChannelMask,
+                              dsp::Frame<maxAudioChannels>& deviceFrame) {
+  int fastIndex = cvChannelOffset;
+  int slowIndex = tdmVirtualChannelBase + tdmBase;
+
+  for (int channel = 0; channel < numChannels; ++channel) {
+    if (slowChannelMask & (1u << channel)) {
+      if (slowIndex < maxAudioChannels) {
+        deviceFrame.samples[slowIndex] = cardSamples[channel];
+      }
+      ++slowIndex;
+    }
+    else if (fastIndex < maxAudioChannels) {
+      deviceFrame.samples[fastIndex++] = cardSamples[channel];
+    }
+  }
+}
+
+
+
 void OutputInterface::process(const ProcessArgs& args) {
-  dsp::Frame<maxAudioChannels> sharedFrames[ audioPorts.size() ];
-  bool isMidiClockTick = midiPollClockDivider.process();
+  bool isMidiScanTick = midiScanClockDivider.process();
+  bool isLightClockTick = lightPollClockDivider.process();
   bool isOrchestrationClockTick = orchestrationClockDivider.process();
   bool isGraphPollClockTick = graphPollClockDivider.process();
 
-  const Broker::Snapshot snap = broker.snapshot();
+  // read in place: the broker won't reuse a pinned snapshot
+  const SnapshotPin pin(broker);
+  const Broker::Snapshot& snap = pin.snapshot;
 
   // check for incoming midi
   midi::Message midiInMsg;
@@ -200,86 +260,164 @@ void OutputInterface::process(const ProcessArgs& args) {
   }
 #endif
 
-  if (discoveryReportReceived == false) {
-    if (isOrchestrationClockTick) {
-      INFO("Sending MIDI message discovery request");
+  if (!linkUp.load(std::memory_order_relaxed)) {
+    if (args.frame >= nextDiscoveryFrame) {
       midiOutput.sendMidiMessage(MIDI_DISCOVERY_REQUEST_SYSEX);
+      nextDiscoveryFrame = args.frame + static_cast<int64_t>(discoveryBackoffSec * args.sampleRate);
+      discoveryBackoffSec = std::min(2.f * discoveryBackoffSec, discoveryBackoffMaxSec);
     }
-    return;
+    if (discoveryReportReceived == false) {
+      return;
+    }
+  }
+  else {
+    processHeartbeat(args);
   }
 
-  // walk the modules to see if anything should be attached
+  // attach anything that asked since the last sample
+  serviceParticipantAttachments();
+
   if (isOrchestrationClockTick) {
-    serviceParticipantAttachments();
+    if (linkUp.load(std::memory_order_relaxed)) {
+      linkStatsAge.fetch_add(1, std::memory_order_relaxed);
+      midiOutput.sendMidiMessage(MIDI_STATS_REQUEST_SYSEX);
+    }
+  }
+
+  dsp::Frame<maxAudioChannels> *sharedFrames[maxAudioDevices];
+  beginDeviceFrames(args, sharedFrames);
 
+  // control rate mode: the cards hold between device frames
+  if (controlRateCounter == 0) {
+    controlRateCounter = updateControlRateDivision(args.sampleRate);
+  }
+  const bool controlRate = controlRateMode.load(std::memory_order_relaxed);
+  const bool evaluateCards = --controlRateCounter == 0 || !controlRate || !heldFramesValid;
+  if (!evaluateCards) {
+    for (int deviceNum = 0; deviceNum < maxAudioDevices; ++deviceNum) {
+      *sharedFrames[deviceNum] = heldFrames[deviceNum];
+    }
+  }
+
+  // process all attached participants for samples
+  for (int a = 0; evaluateCards && a < snap.numActive; ++a) {
+    const Slot *slot = &snap.slots[snap.active[a]];
+    dsp::Frame<maxAudioChannels>& deviceFrame = *sharedFrames[slot->props.outputDeviceId];
+
+    if (slot->props.blockChannels > 0) {
+      pullParticipantBlock(args, *slot, snap.active[a]);
+    }
+    else if (slot->props.slowChannelMask) {
+      dsp::Frame<maxAudioChannels> cardFrame = {};
+      slot->participant->pullSamples(args, cardFrame, 0);
+      placeCardChannels(cardFrame.samples, slot->props.numChannels, slot->props.cvChannelOffset,
+                        slot->props.tdmBase, slot->props.slowChannelMask,
+                        deviceFrame);
+    }
+    else {
+      slot->participant->pullSamples(args, deviceFrame, slot->props.cvChannelOffset);
+    }
   }
 
-  // process all participants for samples
-  for (size_t i = 0; i < maxVoiceCards; ++i) {
-    const Slot *slot = &snap.slots[i];
-    if (slot->participant != nullptr && slot->props.isAllocated) {
-      slot->participant->pullSamples(args,
-                                     sharedFrames[slot->props.outputDeviceId],
-                                     slot->props.cvChannelOffset);
+  if (evaluateCards && controlRate) {
+    for (int deviceNum = 0; deviceNum < maxAudioDevices; ++deviceNum) {
+      heldFrames[deviceNum] = *sharedFrames[deviceNum];
     }
   }
+  heldFramesValid = controlRate;
 
 
-  static constexpr float clipTime = 0.25f;
+  dsp::Frame<maxAudioChannels> backplaneFrame = {};
+  float* backplaneSamples = slowChannelMask ?
+    backplaneFrame.samples : sharedFrames[outputDeviceId]->samples + cvChannelOffset;
   processCvRoutes(routes.data(),
                   routes.size(),
-                  clipTime,
-                  cvChannelOffset,
-                  sharedFrames[outputDeviceId].samples,
+                  0,
+                  backplaneSamples,
                   params.data(),
                   inputs.data());
 
   // cache the VCA levels for the GraphSource inputToOut1 and inputToOut2
-  input1Weight = sharedFrames[outputDeviceId].samples[cvChannelOffset + OUT1_CHANNEL];
-  input2Weight = sharedFrames[outputDeviceId].samples[cvChannelOffset + OUT2_CHANNEL];
+  input1Weight = backplaneSamples[OUT1_CHANNEL];
+  input2Weight = backplaneSamples[OUT2_CHANNEL];
 
-  sendFramesToDevices(sharedFrames, audioPorts.size());
+  if (slowChannelMask) {
+    placeCardChannels(backplaneSamples, numChannels, cvChannelOffset, tdmBase, slowChannelMask,
+                      *sharedFrames[outputDeviceId]);
+  }
 
-  if (isMidiClockTick) {
-    setStatusLight();
+  // the latency marker has a channel to itself; 0 unless measuring
+  if (latencyMarkerChannel >= 0) {
+    sharedFrames[0]->samples[latencyMarkerChannel] = latencyProbe.process(args.frame, args.sampleRate);
+  }
+
+  endDeviceFrames(args.sampleRate);
 
-    const float lightTime = args.sampleTime * midiPollClockDivider.getDivision();
-    const float brightnessDeltaTime = 1 / lightTime;
+  if (isMidiScanTick) {
+    // after a reconnect the Pi has its defaults: every card gets its
+    // whole state again in one message
+    if (cardStatePending.exchange(false, std::memory_order_relaxed)) {
+      for (int a = 0; a < snap.numActive; ++a) {
+        snap.slots[snap.active[a]].participant->requestCardState();
+      }
+      uint8_t programs[maxCardStatePrograms];
+      sendCardState(midiChannel, programs,
+                    buttonMidiController.pullPrograms(this, programs, maxCardStatePrograms));
+    }
+
+    // every participant with a param marked queues what changed, then
+    // it all goes out now
+    const bool isSweep = paramSweepClockDivider.process();
+    for (int a = 0; a < snap.numActive; ++a) {
+      const Slot *slot = &snap.slots[snap.active[a]];
+      Participant *participant = slot->participant;
+      ChangeMask& changes = participant->getParamChanges();
+      if (isSweep) {
+        changes.markAll();
+      }
+
+      if (participant->takeCardStateRequest()) {
+        // the whole state goes: anything marked is in it
+        changes.take();
+        uint8_t programs[maxCardStatePrograms];
+        sendCardState(slot->props.midiChannel, programs,
+                      participant->pullCardState(programs, maxCardStatePrograms));
+      }
+      else if (const uint64_t changed = changes.take()) {
+        participant->pullMidi(args, slot->props.midiChannel, changed, midiBatch);
+      }
+    }
+
+    if (isSweep) {
+      buttonChanges.markAll();
+    }
+    if (const uint64_t changed = buttonChanges.take()) {
+      buttonMidiController.process(this, midiChannel, changed, midiBatch, buttonChanges);
+    }
+
+    if (!midiBatch.empty()) {
+      midiBatch.flush(midiOutput, midiMessagesPerScan);
+    }
+  }
+
+  // the rest of the lights are the UI's, see updateLights()
+  if (isLightClockTick) {
+    setStatusLight();
 
     // reset all patch usage state to inactive, then selectively activate.
     for (size_t i = 0; i < maxVoiceCards; ++i) {
       lights[CARD_A_PATCH_USAGE_LIGHT + i ].setBrightness(0.f);
     }
 
-    // process all participants for MIDI
-    midi::Message midiOutMessage;
     for (size_t i = 0; i < maxVoiceCards; ++i) {
       const Slot *slot = &snap.slots[i];
       if (slot->participant != nullptr && slot->props.isAllocated) {
           lights[CARD_A_PATCH_USAGE_LIGHT + slot->props.slotNum ].setBrightness(0.85f);
-          if (slot->participant->pullMidi(args,
-                                          midiPollClockDivider.getDivision(),
-                                          slot->props.midiChannel,
-                                          midiOutMessage)) {
-            INFO("frame %" PRId64 ": midi: slot %ld module id %" PRId64 " send message %02X",
-                 args.frame, i, slot->participant->getModuleId(), midiOutMessage.getNote());
-            midiOutput.sendMidiMessage(midiOutMessage);
-          }
       }
       else if (slot->props.hardwareId) {
         lights[CARD_A_PATCH_USAGE_LIGHT + slot->props.slotNum ].setBrightness(0.25f);
       }
     }
-
-    if (buttonMidiController.process(this, midiChannel, midiOutMessage)) {
-      midiOutput.sendMidiMessage(midiOutMessage);
-    }
-    buttonMidiController.updateLights(this);
-
-    out1LevelClipTimer -= lightTime;
-    lights[OUT1_LEVEL_CLIP_LIGHT].setBrightnessSmooth(out1LevelClipTimer > 0.f, brightnessDeltaTime);
-    out2LevelClipTimer -= lightTime;
-    lights[OUT2_LEVEL_CLIP_LIGHT].setBrightnessSmooth(out2LevelClipTimer > 0.f, brightnessDeltaTime);
   }
 
   if (isGraphPollClockTick &&
@@ -295,23 +433,20 @@ void OutputInterface::process(const ProcessArgs& args) {
 
     // call each module to get the module's view of ParticipantGraphInfo--
     // this collects all edgges between voice cards (and the external input)
-    for (size_t i = 0; i < maxVoiceCards; ++i) {
-      const Slot &slot = snap.slots[i];
-      if (slot.participant != nullptr && slot.props.isAllocated) {
-        // Business section: call each module
-        ParticipantGraphInfo info = ParticipantGraphInfo{};
-        if (slot.participant->pullGraphInfo(info)) {
-          resolveGraphSource(snap, info.source1);
-          resolveGraphSource(snap, info.source2);
-
-          if (message->participantInfoCount < maxVoiceCards) {
-            message->participantInfos[message->participantInfoCount++] = info;
-          }
-          else {
-            WARN("participantInfos: maxVoiceCards reached");
-          }
+    for (int a = 0; a < snap.numActive; ++a) {
+      const Slot &slot = snap.slots[snap.active[a]];
+      // Business section: call each module
+      ParticipantGraphInfo info = ParticipantGraphInfo{};
+      if (slot.participant->pullGraphInfo(info)) {
+        resolveGraphSource(snap, info.source1);
+        resolveGraphSource(snap, info.source2);
+
+        if (message->participantInfoCount < maxVoiceCards) {
+          message->participantInfos[message->participantInfoCount++] = info;
+        }
+        else {
+          WARN("participantInfos: maxVoiceCards reached");
         }
-
       }
     }
     // collect all edges to the outputs for the output module
@@ -355,18 +490,17 @@ uint8_t OutputInterface::getHardwareId() {
 
 
 void OutputInterface::setStatusLight() {
-  if (discoveryReportReceived) {  // green
+  const bool up = discoveryReportReceived && linkUp.load(std::memory_order_relaxed);
+  if (up && isLinkDegraded()) {  // yellow
+    lights[HARDWARE_LINK_LIGHT + 0].setBrightness(1.f);
+    lights[HARDWARE_LINK_LIGHT + 1].setBrightness(1.f);
+    lights[HARDWARE_LINK_LIGHT + 2].setBrightness(0.f);
+  }
+  else if (up) {  // green
     lights[HARDWARE_LINK_LIGHT + 0].setBrightness(0.f);
     lights[HARDWARE_LINK_LIGHT + 1].setBrightness(0.5f);
     lights[HARDWARE_LINK_LIGHT + 2].setBrightness(0.f);
   }
-  /* yellow case
-     else if (validRightExpander) {
-     lights[HARDWARE_LINK_LIGHT + 0].setBrightness(1.f);
-     lights[HARDWARE_LINK_LIGHT + 1].setBrightness(1.f);
-     lights[HARDWARE_LINK_LIGHT + 2].setBrightness(0.f);
-     }
-  */
   else {  // red
     lights[HARDWARE_LINK_LIGHT + 0].setBrightness(1.f);
     lights[HARDWARE_LINK_LIGHT + 1].setBrightness(0.f);
@@ -375,17 +509,41 @@ void OutputInterface::setStatusLight() {
 
 }
 
+
+void OutputInterface::updateLights(float lightTime) {
+  const float brightnessDeltaTime = 1 / lightTime;
+
+  buttonMidiController.updateLights(this);
+
+  lights[OUT1_LEVEL_CLIP_LIGHT].setBrightnessSmooth(out1LevelClip.update(lightTime), brightnessDeltaTime);
+  lights[OUT2_LEVEL_CLIP_LIGHT].setBrightnessSmooth(out2LevelClip.update(lightTime), brightnessDeltaTime);
+}
+
 static const uint8_t midiManufacturerId = 0x7d;
 static const uint8_t midiSysexDiscoveryReport = 0x01;
+static const uint8_t midiSysexStatsReport = 0x06;
+static const uint8_t midiSysexLatencyReport = 0x07;
+static const uint8_t midiSysexHeartbeatAck = 0x09;
+static const uint8_t midiSysexCardState = 0x0A;
 
 
 void OutputInterface::processMidiInMessage(const midi::Message &msg) {
-  // the only thing being processed as of now is the Discovery Report
-  INFO("processing MIDI message");
+  // Discovery Report, and the Stats Report about once a second
   if (msg.getStatus() == 0xf && msg.getSize() > 3 && msg.bytes[1] == midiManufacturerId) {
     if (msg.bytes[2] == midiSysexDiscoveryReport) {
+      INFO("processing discovery report");
       processDiscoveryReport(msg);
     }
+    else if (msg.bytes[2] == midiSysexStatsReport) {
+      processStatsReport(msg);
+    }
+    else if (msg.bytes[2] == midiSysexLatencyReport) {
+      latencyProbe.processReport(msg, msg.frame >= 0 ? msg.frame : APP->engine->getFrame(),
+                                 APP->engine->getSampleRate(), audioPorts[0]->deviceSampleRate);
+    }
+    else if (msg.bytes[2] == midiSysexHeartbeatAck) {
+      processHeartbeatAck(msg);
+    }
     else {
       INFO("sysex: unknown");
     }
@@ -424,7 +582,16 @@ void OutputInterface::processMidiInMessage(const midi::Message &msg) {
  * 0x?? -- cardH id
  * 0x?? -- cardH channel offset
  * 0x?? -- cardH device id
+ * then for slow channel TDM, 7 bytes for each of cardA..cardH:
+ * 0x?? -- card num channels
+ * 0x?? -- card TDM base
+ * 0x?? x5 -- card slow channel mask, 7 bits per byte LSB first
+ * 0x?? -- device 0 TDM sync channel, 0x7F if none
+ * 0x?? -- device 1 TDM sync channel, 0x7F if none
+ * 0x?? -- device 0 latency marker channel, 0x7F if none
  * 0xF7
+ * The TDM section is optional: a 28 byte report has no slow channels.
+ * An 86 byte report is the same without a latency marker channel.
  * if the card Id isn't 0x00 or 0xFF then process it.
  * This report specifies exactly what cards are present in the
  * system and how the host (VCV Rack) is to communicate with each card.
@@ -433,8 +600,16 @@ void OutputInterface::processMidiInMessage(const midi::Message &msg) {
  * but it's there in the report anyway.  Only six are cold-swappable voice cards.
  */
 
-static constexpr int discoveryReportMessageSize = 28;
+static constexpr int discoveryReportMessageSize = 87;
+static constexpr int discoveryReportTdmMessageSize = 86;
+static constexpr int discoveryReportBaseMessageSize = 28;
 static constexpr int numReportsCards = 8;
+static constexpr int discoveryReportTdmOffset = 27;
+static constexpr int discoveryReportTdmCardBytes = 7;
+static constexpr int discoveryReportTdmSyncOffset = 83;
+static constexpr uint8_t discoveryReportTdmNoSync = 0x7F;
+static constexpr int discoveryReportLatencyMarkerOffset = 85;
+static constexpr uint8_t discoveryReportNoLatencyMarker = 0x7F;
 
 // to be mapped to ParticipantProperty
 struct DiscoveredCard {
@@ -443,6 +618,9 @@ struct DiscoveredCard {
   int8_t outputDeviceId;
   int8_t slotNum;
   bool valid;
+  int8_t numChannels;
+  int8_t tdmBase;
+  uint32_t slowChannelMask;
 };
 
 
@@ -451,13 +629,23 @@ void OutputInterface::processDiscoveryReport(const midi::Message &msg) {
   int msgSize = msg.getSize(); // cache
 
   if (discoveryReportReceived == true) {
-    INFO("ignoring duplicate Discovery Report");
+    // cards are only discovered at Pi boot, so the device tree stands.
+    // A report while the link is down is the Pi answering rediscovery.
+    if (!linkUp.load(std::memory_order_relaxed)) {
+      INFO("link restored, resending card state");
+      setLinkUp(true);
+    }
+    else {
+      INFO("ignoring duplicate Discovery Report");
+    }
     return;
   }
 
-  if (msgSize != discoveryReportMessageSize) {
+  if (msgSize != discoveryReportMessageSize && msgSize != discoveryReportTdmMessageSize &&
+      msgSize != discoveryReportBaseMessageSize) {
     WARN("Discovery report contains %d bytes, expected %d", msgSize, discoveryReportMessageSize);
   }
+  const bool hasTdm = msgSize >= discoveryReportTdmMessageSize;
 
   DiscoveredCard cards[numReportsCards] = {};
 
@@ -470,17 +658,244 @@ void OutputInterface::processDiscoveryReport(const midi::Message &msg) {
 
     // 0x00 and 0xFF are not valid hardware Ids
     if (hwId != 0x00 && hwId != 0xFF) {
-      cards[i] = { hwId, cvOffset, outputDev, i, true };
+      cards[i] = { hwId, cvOffset, outputDev, i, true, 0, 0, 0 };
     }
     else {
-      cards[i] = { 0, 0, 0, i, false };
+      cards[i] = { 0, 0, 0, i, false, 0, 0, 0 };
     }
 
+    if (hasTdm && cards[i].valid) {
+      int tdm = discoveryReportTdmOffset + (i * discoveryReportTdmCardBytes);
+      cards[i].numChannels = msg.bytes[tdm];
+      cards[i].tdmBase = msg.bytes[tdm + 1];
+      for (int b = 0; b < 5; ++b) {
+        cards[i].slowChannelMask |= static_cast<uint32_t>(msg.bytes[tdm + 2 + b] & 0x7F) << (7 * b);
+      }
+    }
   }
 
   // second pass: apply bizrules
   applyDiscoveryReport(cards);
+
+  if (msgSize >= discoveryReportMessageSize &&
+      msg.bytes[discoveryReportLatencyMarkerOffset] != discoveryReportNoLatencyMarker) {
+    latencyMarkerChannel = msg.bytes[discoveryReportLatencyMarkerOffset];
+    INFO("latency marker on device 0 channel %d", latencyMarkerChannel);
+  }
+
+  // the audio ports mux slow channels for any device with a sync channel
+  for (size_t deviceNum = 0; deviceNum < audioPorts.size(); ++deviceNum) {
+    int syncChannel = tdmNoSyncChannel;
+    int numSlow = 0;
+    if (hasTdm && msg.bytes[discoveryReportTdmSyncOffset + deviceNum] != discoveryReportTdmNoSync) {
+      syncChannel = msg.bytes[discoveryReportTdmSyncOffset + deviceNum];
+      for (const DiscoveredCard& card : cards) {
+        if (card.valid && card.outputDeviceId == static_cast<int8_t>(deviceNum) && card.slowChannelMask) {
+          numSlow = std::max(numSlow, card.tdmBase + __builtin_popcount(card.slowChannelMask));
+        }
+      }
+      INFO("device %zu: %d slow channels multiplexed, sync channel %d", deviceNum, numSlow, syncChannel);
+    }
+    audioPorts[deviceNum]->setTdm(syncChannel, numSlow);
+
+    // channels in use: each card's fast ones, the sync and marker
+    // channels.  Without the card channel counts, all of them.
+    int activeChannels = hasTdm ? 0 : -1;
+    for (const DiscoveredCard& card : cards) {
+      if (activeChannels < 0) {
+        break;
+      }
+      if (card.valid && card.outputDeviceId == static_cast<int8_t>(deviceNum)) {
+        activeChannels = card.numChannels == 0 ? -1 :
+          std::max(activeChannels, card.cvChannelOffset + card.numChannels - __builtin_popcount(card.slowChannelMask));
+      }
+    }
+    if (activeChannels >= 0) {
+      activeChannels = std::max(activeChannels, syncChannel + 1);
+      if (deviceNum == 0) {
+        activeChannels = std::max(activeChannels, latencyMarkerChannel + 1);
+      }
+      INFO("device %zu: %d channels in use", deviceNum, activeChannels);
+    }
+    audioPorts[deviceNum]->setActiveChannels(activeChannels);
+  }
+
   discoveryReportReceived = true;
+  setLinkUp(false);
+}
+
+
+/** setLinkUp
+ *
+ * a discovery report arrived: start the heartbeat.  On a reconnect the
+ * Pi may have restarted with every switch at its default, so every card
+ * gets a Card State on the next MIDI tick.
+ */
+void OutputInterface::setLinkUp(bool reconnect) {
+  const int64_t frame = APP->engine->getFrame();
+  lastHeartbeatAckFrame = frame;
+  nextHeartbeatFrame = frame;
+  lastPiSeq = -1;
+  if (reconnect) {
+    cardStatePending.store(true, std::memory_order_relaxed);
+  }
+  linkUp.store(true, std::memory_order_relaxed);
+}
+
+
+/** sendCardState
+ *
+ * 0xF0 0x7D 0x0A, the card's MIDI channel, its programs, 0xF7.  The
+ * message is preallocated for the most programs; nothing sent if none.
+ */
+void OutputInterface::sendCardState(int8_t channel, const uint8_t *programs, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  cardStateMessage.setSize(static_cast<int>(cardStateHeaderSize + count + 1));
+  cardStateMessage.bytes[0] = 0xF0;
+  cardStateMessage.bytes[1] = midiManufacturerId;
+  cardStateMessage.bytes[2] = midiSysexCardState;
+  cardStateMessage.bytes[3] = channel;
+  std::copy(programs, programs + count, cardStateMessage.bytes.begin() + cardStateHeaderSize);
+  cardStateMessage.bytes[cardStateHeaderSize + count] = 0xF7;
+  midiOutput.sendMidiMessage(cardStateMessage);
+}
+
+
+/** processHeartbeat
+ *
+ * send a Heartbeat every heartbeatIntervalSec and drop the link when no
+ * Heartbeat Ack has come back for heartbeatTimeoutSec.  Dropping the
+ * link restarts discovery with a short backoff.
+ */
+void OutputInterface::processHeartbeat(const ProcessArgs& args) {
+  if (args.frame >= nextHeartbeatFrame) {
+    heartbeatMessage.bytes[3] = heartbeatSeq;
+    heartbeatSentFrame[heartbeatSeq] = args.frame;
+    midiOutput.sendMidiMessage(heartbeatMessage);
+    heartbeatSeq = (heartbeatSeq + 1) & 0x7F;
+    nextHeartbeatFrame = args.frame + static_cast<int64_t>(heartbeatIntervalSec * args.sampleRate);
+  }
+
+  if (args.frame - lastHeartbeatAckFrame > static_cast<int64_t>(heartbeatTimeoutSec * args.sampleRate)) {
+    WARN("link lost: no heartbeat ack for %.0f ms, rediscovering",
+         (args.frame - lastHeartbeatAckFrame) * 1000.f / args.sampleRate);
+    linkUp.store(false, std::memory_order_relaxed);
+    linkDropCount.fetch_add(1, std::memory_order_relaxed);
+    discoveryBackoffSec = discoveryBackoffStartSec;
+    nextDiscoveryFrame = args.frame;
+  }
+}
+
+
+/** processHeartbeatAck
+ *
+ * 0xF0 0x7D 0x09, the echoed Heartbeat sequence, the Pi's own sequence,
+ * the Pi's session id, 0xF7.  A gap in the Pi's sequence is acks lost on
+ * the way back; a new session id is a daemon restart that never tripped
+ * the timeout, and needs the state resent the same as a reconnect.
+ */
+static constexpr int heartbeatAckSize = 7;
+
+void OutputInterface::processHeartbeatAck(const midi::Message &msg) {
+  if (msg.getSize() < heartbeatAckSize) {
+    WARN("Heartbeat ack of %d bytes, expected %d", msg.getSize(), heartbeatAckSize);
+    return;
+  }
+  if (!linkUp.load(std::memory_order_relaxed)) {
+    return;  // late; wait for the discovery report
+  }
+
+  const int64_t frame = msg.frame >= 0 ? msg.frame : APP->engine->getFrame();
+  const uint8_t echoSeq = msg.bytes[3] & 0x7F;
+  const int piSeq = msg.bytes[4] & 0x7F;
+  const int session = msg.bytes[5] & 0x7F;
+
+  if (lastPiSeq >= 0) {
+    heartbeatAcksLost.fetch_add((piSeq - lastPiSeq - 1) & 0x7F, std::memory_order_relaxed);
+  }
+  lastPiSeq = piSeq;
+
+  if (piSession >= 0 && session != piSession) {
+    INFO("Pi daemon restarted, resending card state");
+    cardStatePending.store(true, std::memory_order_relaxed);
+  }
+  piSession = session;
+
+  heartbeatRttMs.store((frame - heartbeatSentFrame[echoSeq]) * 1000.f / APP->engine->getSampleRate(),
+                       std::memory_order_relaxed);
+  lastHeartbeatAckFrame = frame;
+}
+
+
+/** processStatsReport
+ *
+ * runtime health of the Pi, see midi.spec for the layout:
+ * 0xF0 0x7D 0x06, a version byte, 14 values of four 7 bit bytes (28 bit
+ * two's complement, MSB first), a card count, then per card the slot,
+ * load and longest call (14 bits each) and tune state, then 0xF7.
+ */
+
+static constexpr uint8_t statsReportVersion = 1;
+static constexpr int statsReportValuesOffset = 4;
+static constexpr int statsReportValueBytes = 4;
+static constexpr int statsReportCardBytes = 6;
+static constexpr int statsReportCardsOffset =
+  statsReportValuesOffset + OutputInterface::LinkStats::NUM_VALUES * statsReportValueBytes;
+// reports are requested once a second; after this many unanswered the link is stale
+static constexpr int linkStatsStaleAge = 3;
+
+
+void OutputInterface::processStatsReport(const midi::Message &msg) {
+  const int msgSize = msg.getSize();
+  if (msgSize < statsReportCardsOffset + 2 || msg.bytes[3] != statsReportVersion) {
+    WARN("Stats report of %d bytes, version %d not understood", msgSize, msg.bytes[3]);
+    return;
+  }
+
+  const int published = linkStatsIndex.load(std::memory_order_relaxed);
+  const LinkStats& previous = linkStats[published];
+  LinkStats& stats = linkStats[1 - published];
+  stats = LinkStats();
+
+  for (int i = 0; i < LinkStats::NUM_VALUES; ++i) {
+    stats.values[i] = decodeSysex28(&msg.bytes[statsReportValuesOffset + i * statsReportValueBytes]);
+  }
+
+  const int reportedCards = msg.bytes[statsReportCardsOffset];
+  for (int i = 0; i < reportedCards && i < LinkStats::maxCards; ++i) {
+    const int base = statsReportCardsOffset + 1 + i * statsReportCardBytes;
+    if (base + statsReportCardBytes >= msgSize) {
+      break;
+    }
+    LinkStats::Card& card = stats.cards[stats.numCards++];
+    card.slotNum = msg.bytes[base];
+    card.loadPermille = (msg.bytes[base + 1] & 0x7F) << 7 | (msg.bytes[base + 2] & 0x7F);
+    card.maxUsec = (msg.bytes[base + 3] & 0x7F) << 7 | (msg.bytes[base + 4] & 0x7F);
+    card.tuneState = msg.bytes[base + 5];
+  }
+
+  // counters only go up; any movement since the last report is news
+  stats.trouble = previous.valid &&
+    (stats.values[LinkStats::XRUNS] > previous.values[LinkStats::XRUNS] ||
+     stats.values[LinkStats::MISSED_FEW] > previous.values[LinkStats::MISSED_FEW] ||
+     stats.values[LinkStats::MISSED_MANY] > previous.values[LinkStats::MISSED_MANY]);
+  stats.valid = true;
+
+  linkStatsIndex.store(1 - published, std::memory_order_release);
+  linkStatsAge.store(0, std::memory_order_relaxed);
+}
+
+
+OutputInterface::LinkStats OutputInterface::getLinkStats() const {
+  return linkStats[linkStatsIndex.load(std::memory_order_acquire)];
+}
+
+
+bool OutputInterface::isLinkDegraded() const {
+  return getLinkStatsAge() > linkStatsStaleAge ||
+    linkStats[linkStatsIndex.load(std::memory_order_acquire)].trouble;
 }
 
 
@@ -504,6 +919,9 @@ void OutputInterface::applyDiscoveryReport(DiscoveredCard *cards) {
       outputDeviceId = card.outputDeviceId;
       midiChannel = assignedMidiChannel++;
       slotNum = card.slotNum;
+      numChannels = card.numChannels;
+      tdmBase = card.tdmBase;
+      slowChannelMask = card.slowChannelMask;
     }
     else if (card.slotNum >= 0 && card.slotNum < maxVoiceCards) {
       // Voice card
@@ -515,6 +933,9 @@ void OutputInterface::applyDiscoveryReport(DiscoveredCard *cards) {
       slot.midiChannel = assignedMidiChannel++;
       slot.slotNum = card.slotNum;
       slot.isAllocated = false;
+      slot.numChannels = card.numChannels;
+      slot.tdmBase = card.tdmBase;
+      slot.slowChannelMask = card.slowChannelMask;
       INFO("registered hardware id %d midi channel %d", slot.hardwareId, slot.midiChannel);
     }
     else {
@@ -524,16 +945,99 @@ void OutputInterface::applyDiscoveryReport(DiscoveredCard *cards) {
   }
 
   broker.registerDevices(deviceTree, maxVoiceCards);
+  // participants turned away before the device tree can try again
+  attachGeneration.fetch_add(1, std::memory_order_relaxed);
 }
 
 
 
-// send all audio frames to the audio ports
-void OutputInterface::sendFramesToDevices(rack::dsp::Frame<maxAudioChannels> *sharedFrame, int numFrames) {
-  for (int deviceNum = 0; deviceNum < numFrames; ++deviceNum) {
-    if (!audioPorts[deviceNum]->engineInputBuffer.full()) {
-      audioPorts[deviceNum]->engineInputBuffer.push(sharedFrame[deviceNum]);
+// each audio port's frame for this sample in the engine block.  A new
+// block is cleared, channels without an attached participant go out at
+// zero, and runs to the end of the engine's step at the most.
+void OutputInterface::beginDeviceFrames(const ProcessArgs& args, rack::dsp::Frame<maxAudioChannels> **deviceFrames) {
+  if (args.frame >= engineStepEnd) {
+    // samples skipped mid-block: what's there goes with the old step
+    if (engineBlockPos > 0) {
+      pushEngineBlocks(args.sampleRate);
     }
+    engineStepEnd = APP->engine->getBlockFrame() + APP->engine->getBlockFrames();
+  }
+
+  if (engineBlockPos == 0) {
+    engineBlockLength = clamp(static_cast<int>(engineStepEnd - args.frame), 1, engineBlockFrames);
+    ++engineBlockSerial;
+    for (int deviceNum = 0; deviceNum < maxAudioDevices; ++deviceNum) {
+      auto block = engineBlocks.begin() + deviceNum * engineBlockFrames;
+      std::fill(block, block + engineBlockLength, dsp::Frame<maxAudioChannels>{});
+    }
+  }
+
+  for (int deviceNum = 0; deviceNum < maxAudioDevices; ++deviceNum) {
+    deviceFrames[deviceNum] = &engineBlocks[deviceNum * engineBlockFrames + engineBlockPos];
+  }
+}
+
+
+// this sample is done: a full block goes to the audio ports
+void OutputInterface::endDeviceFrames(float sampleRate) {
+  if (++engineBlockPos == engineBlockLength) {
+    pushEngineBlocks(sampleRate);
+  }
+}
+
+
+void OutputInterface::pushEngineBlocks(float sampleRate) {
+  for (int deviceNum = 0; deviceNum < maxAudioDevices; ++deviceNum) {
+    audioPorts[deviceNum]->pushEngineFrames(&engineBlocks[deviceNum * engineBlockFrames], engineBlockPos, sampleRate,
+                                            decimatorMode.load(std::memory_order_relaxed));
+  }
+  engineBlockPos = 0;
+}
+
+
+// engine samples per card evaluation, for control rate mode: the most
+// that still evaluates at least once per device frame.  The audio port's
+// converter does the rest.  Participants learn it for their prefilters.
+int OutputInterface::updateControlRateDivision(float engineSampleRate) {
+  const float deviceSampleRate = audioPorts[0]->deviceSampleRate;
+  int division = 1;
+
+  if (controlRateMode.load(std::memory_order_relaxed) && deviceSampleRate > 0.f) {
+    division = std::max(1, static_cast<int>(engineSampleRate / deviceSampleRate));
+  }
+  if (isPrimary() && controlRateDivision.load(std::memory_order_relaxed) != division) {
+    controlRateDivision.store(division, std::memory_order_relaxed);
+  }
+  return division;
+}
+
+
+// a block mode participant's frames from this sample to the end of the
+// engine block, in one call: on the block's first evaluated sample, or
+// the first one it's attached for.  Written in place but for a slow CV
+// TDM card, whose channels are placed frame by frame.
+void OutputInterface::pullParticipantBlock(const ProcessArgs& args, const Slot& slot, int slotIndex) {
+  if (participantBlockOwner[slotIndex] == slot.participant &&
+      participantBlockSerial[slotIndex] == engineBlockSerial) {
+    return;
+  }
+  participantBlockOwner[slotIndex] = slot.participant;
+  participantBlockSerial[slotIndex] = engineBlockSerial;
+
+  const int numFrames = engineBlockLength - engineBlockPos;
+  dsp::Frame<maxAudioChannels> *frames =
+    &engineBlocks[slot.props.outputDeviceId * engineBlockFrames + engineBlockPos];
+
+  if (!slot.props.slowChannelMask) {
+    slot.participant->pullSampleBlock(args, frames, numFrames, slot.props.cvChannelOffset);
+    return;
+  }
+
+  std::fill(cardBlock.begin(), cardBlock.begin() + numFrames, dsp::Frame<maxAudioChannels>{});
+  slot.participant->pullSampleBlock(args, cardBlock.data(), numFrames, 0);
+  for (int i = 0; i < numFrames; ++i) {
+    placeCardChannels(cardBlock[i].samples, slot.props.numChannels, slot.props.cvChannelOffset,
+                      slot.props.tdmBase, slot.props.slowChannelMask, frames[i]);
   }
 }
 
@@ -545,6 +1049,8 @@ json_t* OutputInterface::dataToJson() {
   json_t* rootJ = json_object();
   json_object_set_new(rootJ, "midiInput", midiInput.toJson());
   json_object_set_new(rootJ, "midiOutput", midiOutput.toJson());
+  json_object_set_new(rootJ, "controlRate", json_boolean(controlRateMode.load()));
+  json_object_set_new(rootJ, "decimator", json_boolean(decimatorMode.load()));
   for (std::size_t deviceNum = 0; deviceNum < audioPorts.size(); ++deviceNum) {
     std::string thisAudioPortNum = audioPortNum + std::to_string(deviceNum);
     json_object_set_new(rootJ, thisAudioPortNum.c_str(), audioPorts[deviceNum]->toJson());
@@ -554,6 +1060,9 @@ json_t* OutputInterface::dataToJson() {
 }
 
 void OutputInterface::dataFromJson(json_t* rootJ) {
+  // patch or preset load: send the backplane switches in one go
+  cardStatePending.store(true, std::memory_order_relaxed);
+
   json_t* midiInputJ = json_object_get(rootJ, "midiInput");
   if (midiInputJ) {
     midiInput.fromJson(midiInputJ);
@@ -564,6 +1073,16 @@ void OutputInterface::dataFromJson(json_t* rootJ) {
     midiOutput.fromJson(midiOutputJ);
   }
 
+  json_t* controlRateJ = json_object_get(rootJ, "controlRate");
+  if (controlRateJ) {
+    controlRateMode.store(json_boolean_value(controlRateJ));
+  }
+
+  json_t* decimatorJ = json_object_get(rootJ, "decimator");
+  if (decimatorJ) {
+    decimatorMode.store(json_boolean_value(decimatorJ));
+  }
+
   for (std::size_t deviceNum = 0; deviceNum < audioPorts.size(); ++deviceNum) {
     std::string thisAudioPortNum = audioPortNum + std::to_string(deviceNum);
     json_t* audioPortJ = json_object_get(rootJ, thisAudioPortNum.c_str());
@@ -581,28 +1100,60 @@ bool OutputInterface::isPrimary() const {
 }
 
 
+// drain the attach queue.  Only the primary: the participants attach to
+// the instance's broker.  Ids are looked up rather than queued as pointers,
+// since a module may be removed before its request is drained.  If a UI
+// thread detach holds the broker, stop and pick up from there next block.
 void OutputInterface::serviceParticipantAttachments() {
+  int64_t moduleId;
+
+  if (!isPrimary()) {
+    return;
+  }
 
-  for (int64_t moduleId : APP->engine->getModuleIds()) {
-    Module *m = APP->engine->getModule(moduleId);
-    auto* p = dynamic_cast<ParticipantAdapter*>(m);
-    if (!p) {
-      continue;
+  if (pendingAttachId >= 0) {
+    moduleId = pendingAttachId;
+    pendingAttachId = -1;
+    if (!serviceAttach(moduleId)) {
+      pendingAttachId = moduleId;
+      return;
     }
+  }
+
+  while (attachQueue.pop(moduleId)) {
+    if (!serviceAttach(moduleId)) {
+      pendingAttachId = moduleId;
+      return;
+    }
+  }
+}
 
-    auto& lifecycle = p->getLifecycle();
 
-    if (!p->getParticipant()) {
-      WARN("ParticipantAdapter points to null participant");
-      continue;
+// false if the broker was busy and the attach needs trying again
+bool OutputInterface::serviceAttach(int64_t moduleId) {
+  auto* p = dynamic_cast<ParticipantAdapter*>(APP->engine->getModule(moduleId));
+  if (!p) {
+    return true;
+  }
+
+  auto& lifecycle = p->getLifecycle();
+
+  if (!p->getParticipant()) {
+    WARN("ParticipantAdapter points to null participant");
+    return true;
+  }
+  if (lifecycle.wantAttach()) {
+    auto result = lifecycle.completeAttach(&broker, p->getParticipant());
+    if (result == ParticipantLifecycle::AttachResult::Busy) {
+      return false;
     }
-    if (lifecycle.wantAttach()) {
-      INFO("completing attach for module %" PRId64, moduleId);
-      if (lifecycle.completeAttach(&broker, p->getParticipant())) {
-        p->onAttach();
-      }
+    if (result == ParticipantLifecycle::AttachResult::Attached) {
+      INFO("attached module %" PRId64, moduleId);
+      p->onAttach();
+      p->getParticipant()->requestCardState();
     }
   }
+  return true;
 }
 
 //--------------------
@@ -764,6 +1315,15 @@ struct OutputInterfaceWidget : ModuleWidget {
   }
 
 
+  // lights before the light widgets read them, as ParticipantWidget
+  void step() override {
+    if (module) {
+      static_cast<OutputInterface*>(module)->updateLights(
+        clamp(static_cast<float>(APP->window->getLastFrameDuration()), 1e-3f, 0.1f));
+    }
+    ModuleWidget::step();
+  }
+
   void appendContextMenu(Menu *menu) override {
     OutputInterface *module = dynamic_cast<OutputInterface*>(this->module);
     if (!module) {
@@ -811,6 +1371,120 @@ struct OutputInterfaceWidget : ModuleWidget {
           }
         }));
 
+    menu->addChild(createBoolMenuItem("Run cards at the device CV rate", "",
+                                      [=]() { return module->controlRateMode.load(); },
+                                      [=](bool enable) { module->controlRateMode.store(enable); }));
+
+    menu->addChild(createBoolMenuItem("Integer ratio decimator (experimental)", "",
+                                      [=]() { return module->decimatorMode.load(); },
+                                      [=](bool enable) { module->decimatorMode.store(enable); }));
+
+    menu->addChild(createSubmenuItem("Link status", "",
+        [=](Menu* menu) {
+          const OutputInterface::LinkStats stats = module->getLinkStats();
+          if (!stats.valid) {
+            menu->addChild(createMenuLabel("No stats from the Pi yet"));
+            return;
+          }
+          using V = OutputInterface::LinkStats;
+
+          menu->addChild(createMenuLabel(string::f("Link: %s, Pi up %d min",
+                                                   module->getLinkStatsAge() > linkStatsStaleAge ? "stale" :
+                                                   stats.trouble ? "trouble" : "ok",
+                                                   stats.values[V::UPTIME_SEC] / 60)));
+
+          // CV to DAC: what's queued in the port, a USB block to the Pi,
+          // then what's queued in its capture buffer
+          const float piRate = stats.values[V::SAMPLING_RATE];
+          ZoxnoxiousAudioPort *port = module->audioPorts[0];
+          const float rackBufferMs = piRate > 0.f ? 1000.f * port->reportedFill.load() / piRate : 0.f;
+          const float blockMs = piRate > 0.f ? 1000.f * port->getBlockSize() / piRate : 0.f;
+          const float piBufferMs = piRate > 0.f ? 100.f * stats.values[V::PCM0_FILL_X10] / piRate : 0.f;
+          menu->addChild(createMenuLabel(string::f("CV to DAC latency: %.1f ms", rackBufferMs + blockMs + piBufferMs)));
+          menu->addChild(createMenuLabel(string::f("  Rack buffer %.1f ms, USB block %.1f ms, Pi buffer %.1f ms",
+                                                   rackBufferMs, blockMs, piBufferMs)));
+
+          menu->addChild(createMenuLabel(string::f("Pi load: %.1f%%", stats.values[V::PCM_BUSY_PERMILLE] / 10.f)));
+          menu->addChild(createMenuLabel(string::f("Missed frames: %d once, %d 2-9, %d 10+",
+                                                   stats.values[V::MISSED_ONE],
+                                                   stats.values[V::MISSED_FEW],
+                                                   stats.values[V::MISSED_MANY])));
+          menu->addChild(createMenuLabel(string::f("Xruns: %d, longest recovery %.1f ms",
+                                                   stats.values[V::XRUNS],
+                                                   stats.values[V::MAX_RECOVERY_USEC] / 1000.f)));
+          menu->addChild(createMenuLabel(string::f("Clock drift: %+.1f ppm, %d slips",
+                                                   stats.values[V::DRIFT_PPM_X10] / 10.f,
+                                                   stats.values[V::PCM1_SLIPS])));
+          menu->addChild(createMenuLabel(string::f("MIDI errors: %d", stats.values[V::MIDI_ERRORS])));
+          menu->addChild(createMenuLabel(string::f("Heartbeat: %s, round trip %.1f ms",
+                                                   module->isLinkUp() ? "up" : "lost",
+                                                   module->getHeartbeatRttMs())));
+          menu->addChild(createMenuLabel(string::f("  %d acks lost, %d link drops",
+                                                   module->getHeartbeatAcksLost(),
+                                                   module->getLinkDropCount())));
+
+          menu->addChild(new MenuSeparator);
+
+          static const char *tuneStates[] = { "not tuned", "tuned", "tune failed" };
+          for (int i = 0; i < stats.numCards; ++i) {
+            const V::Card& card = stats.cards[i];
+            menu->addChild(createMenuLabel(string::f("Card %c: load %.1f%%, max %d us, %s",
+                                                     'A' + card.slotNum,
+                                                     card.loadPermille / 10.f,
+                                                     card.maxUsec,
+                                                     tuneStates[card.tuneState < 3 ? card.tuneState : 2])));
+          }
+        }));
+
+    menu->addChild(createSubmenuItem("Audio buffer", "",
+        [=](Menu* menu) {
+          for (size_t d = 0; d < module->audioPorts.size(); ++d) {
+            ZoxnoxiousAudioPort *port = module->audioPorts[d];
+            if (module->audioPorts.size() > 1) {
+              menu->addChild(createMenuLabel(string::f("Audio device %d", (int) d)));
+            }
+            menu->addChild(createMenuLabel(string::f("Fill: %d frames, target %d",
+                                                     port->reportedFill.load(),
+                                                     port->reportedTarget.load())));
+            menu->addChild(createMenuLabel(string::f("Drift correction: %+.0f ppm",
+                                                     -1e6f * port->rateCorrection.load())));
+            menu->addChild(createMenuLabel(string::f("Underruns: %d, overruns: %d",
+                                                     port->underruns.load(),
+                                                     port->overruns.load())));
+          }
+          menu->addChild(createMenuItem("Reset counters", "", [=]() {
+                for (ZoxnoxiousAudioPort *port : module->audioPorts) {
+                  port->resetCounters();
+                }
+              }));
+        }));
+
+    menu->addChild(createSubmenuItem("Latency test", "",
+        [=](Menu* menu) {
+          if (!module->hasLatencyMarker()) {
+            menu->addChild(createMenuLabel("No channel free for the marker"));
+            return;
+          }
+
+          menu->addChild(createBoolMenuItem("Measure Rack to DAC latency", "",
+                                            [=]() { return module->latencyProbe.isEnabled(); },
+                                            [=](bool enable) { module->latencyProbe.setEnabled(enable); }));
+          menu->addChild(createMenuItem("Clear results", "", [=]() {
+                module->latencyProbe.clear();
+              }));
+
+          menu->addChild(new MenuSeparator);
+
+          const LatencyProbe::Summary summary = module->latencyProbe.getSummary();
+          menu->addChild(createMenuLabel(string::f("%d measurements, %d timed out", summary.count, summary.timeouts)));
+          if (summary.count) {
+            menu->addChild(createMenuLabel(string::f("min %.1f / median %.1f / 95%% %.1f / max %.1f ms",
+                                                     summary.minMs, summary.medianMs, summary.p95Ms, summary.maxMs)));
+            menu->addChild(createMenuLabel(string::f("mean %.1f ms, of which Pi buffer %.1f ms",
+                                                     summary.meanMs, summary.piBufferMs)));
+          }
+        }));
+
     menu->addChild(new MenuSeparator);
 
     InstantiateExpanderItem *expanderItem = createMenuItem<InstantiateExpanderItem>("Add visualizer (right side)", "");
@@ -908,6 +1582,12 @@ const midi::Message OutputInterface::MIDI_TUNE_REQUEST = []{
   return m;
 }();
 
+const midi::Message OutputInterface::MIDI_STATS_REQUEST_SYSEX = []{
+  midi::Message m;
+  m.bytes = { 0xF0, 0x7D, 0x05, 0xF7 };
+  return m;
+}();
+
 
 const std::vector<ButtonMapping<OutputInterface> > OutputInterface::buttonMappings = {
     { CARD_A_MIX1_OUTPUT_BUTTON_PARAM, CARD_A_MIX1_OUTPUT_BUTTON_LIGHT, { 0, 1} },
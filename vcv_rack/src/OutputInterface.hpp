@@ -6,6 +6,7 @@
 #include "ParticipantAdapter.hpp"
 #include "AudioMidi.hpp"
 #include "HardwareDiscovery.hpp"
+#include "LatencyProbe.hpp"
 #include "modulehelpers.hpp"
 
 namespace zox {
@@ -88,6 +89,16 @@ struct OutputInterface final : rack::engine::Module {
   // Global access point: no writes allowed from the audio thread
   static std::atomic<OutputInterface*> instance;
 
+  // participants wanting a slot post their module id; the primary drains
+  // it every process().  attachGeneration moves whenever a waiting
+  // participant could now succeed: a new primary, the device tree, a detach.
+  static AttachQueue attachQueue;
+  static std::atomic<uint32_t> attachGeneration;
+
+  // engine samples per card evaluation: 1 normally, about engine rate over
+  // device rate in control rate mode.  Set by the primary.
+  static std::atomic<int> controlRateDivision;
+
   // Broker access
   Broker& getBroker() { return broker; }
 
@@ -102,6 +113,9 @@ struct OutputInterface final : rack::engine::Module {
   json_t* dataToJson() override;
   void dataFromJson(json_t* rootJ) override;
 
+  // UI thread, from the widget: button and clip lights
+  void updateLights(float lightTime);
+
   std::vector<ZoxnoxiousAudioPort*> audioPorts;
   ZoxnoxiousMidiOutput midiOutput;
   midi::InputQueue midiInput;
@@ -111,20 +125,80 @@ struct OutputInterface final : rack::engine::Module {
   static const midi::Message MIDI_SHUTDOWN_SYSEX;
   static const midi::Message MIDI_RESTART_SYSEX;
   static const midi::Message MIDI_TUNE_REQUEST;
+  static const midi::Message MIDI_STATS_REQUEST_SYSEX;
 
   bool isPrimary() const;
 
+  // runtime health from the Pi's stats report, see midi.spec
+  struct LinkStats {
+    enum Value {
+      UPTIME_SEC,
+      SAMPLING_RATE,
+      PERIOD_SIZE,
+      PCM0_FILL_X10,
+      PCM_BUSY_PERMILLE,
+      MISSED_ONE,
+      MISSED_FEW,
+      MISSED_MANY,
+      XRUNS,
+      MAX_RECOVERY_USEC,
+      DRIFT_PPM_X10,
+      PCM1_SLIPS,
+      MIDI_ERRORS,
+      RT_LOG_DROPPED,
+      NUM_VALUES
+    };
+    static constexpr int maxCards = 8;
+    struct Card {
+      int8_t slotNum;
+      int16_t loadPermille;
+      int16_t maxUsec;
+      uint8_t tuneState;  // 0 not tuned, 1 tuned, 2 tune failed
+    };
+
+    bool valid = false;
+    bool trouble = false;  // xruns or missed deadlines since the previous report
+    int32_t values[NUM_VALUES] = {};
+    Card cards[maxCards] = {};
+    int numCards = 0;
+  };
+
+  // latest report, for the UI.  valid is false until one arrives.
+  LinkStats getLinkStats() const;
+  // true when reports stopped coming or the last one showed trouble
+  bool isLinkDegraded() const;
+  // stats requests since the last report arrived
+  int getLinkStatsAge() const { return linkStatsAge.load(std::memory_order_relaxed); }
+
+  // heartbeat: false once acks stop coming until a discovery report restores it
+  bool isLinkUp() const { return linkUp.load(std::memory_order_relaxed); }
+  float getHeartbeatRttMs() const { return heartbeatRttMs.load(std::memory_order_relaxed); }
+  int getHeartbeatAcksLost() const { return heartbeatAcksLost.load(std::memory_order_relaxed); }
+  int getLinkDropCount() const { return linkDropCount.load(std::memory_order_relaxed); }
+
+  // evaluate the cards once per device frame and hold, rather than every
+  // engine sample: the Pi only takes CV at the device rate
+  std::atomic<bool> controlRateMode {false};
+
+  // integer engine to device rate ratios through the audio ports'
+  // decimator instead of the generic converter.  Off until it's been
+  // benchmarked against the converter on the Rack SDK.
+  std::atomic<bool> decimatorMode {false};
+
   HardwareDiscovery hardwareDiscovery;
+  LatencyProbe latencyProbe;
+  bool hasLatencyMarker() const { return latencyMarkerChannel >= 0; }
 
 private:
   Broker broker;
 
-  float out1LevelClipTimer;
-  float out2LevelClipTimer;
+  ClipIndicator out1LevelClip;
+  ClipIndicator out2LevelClip;
 
   static const std::vector<ButtonMapping<OutputInterface> > buttonMappings;
   std::vector<ButtonState> buttonStates;
   ButtonMidiController<OutputInterface> buttonMidiController;
+  ChangeMask buttonChanges;
 
   uint8_t getHardwareId();
   void setStatusLight();
@@ -132,19 +206,85 @@ private:
   int8_t outputDeviceId;
   int8_t midiChannel;
   int8_t slotNum;
+  // slow channel TDM for the backplane's own channels
+  int8_t numChannels = 0;
+  int8_t tdmBase = 0;
+  uint32_t slowChannelMask = 0;
+  // device 0 channel reserved for the latency probe, -1 if none
+  int8_t latencyMarkerChannel = -1;
 
   bool discoveryReportReceived = false;
   dsp::ClockDivider orchestrationClockDivider;
-  dsp::ClockDivider midiPollClockDivider;
+  dsp::ClockDivider midiScanClockDivider;
+  dsp::ClockDivider paramSweepClockDivider;  // in scans
+  dsp::ClockDivider lightPollClockDivider;
+  MidiBatch midiBatch;
   dsp::ClockDivider graphPollClockDivider;
 
   void processMidiInMessage(const midi::Message &msg);
   void processDiscoveryReport(const midi::Message &msg);
   void applyDiscoveryReport(DiscoveredCard *cards);
-
-  void sendFramesToDevices(rack::dsp::Frame<maxAudioChannels> *sharedFrame, int numFrames);
-
+  void processStatsReport(const midi::Message &msg);
+  void processHeartbeat(const ProcessArgs& args);
+  void processHeartbeatAck(const midi::Message &msg);
+  void setLinkUp(bool reconnect);
+  void sendCardState(int8_t channel, const uint8_t *programs, size_t count);
+
+  // parsed on the audio thread into the unpublished half, then published
+  LinkStats linkStats[2];
+  std::atomic<int> linkStatsIndex {0};
+  std::atomic<int> linkStatsAge {0};
+
+  // heartbeat and rediscovery, audio thread only but for the atomics
+  std::atomic<bool> linkUp {false};
+  std::atomic<float> heartbeatRttMs {0.f};
+  std::atomic<int> heartbeatAcksLost {0};
+  std::atomic<int> linkDropCount {0};
+  std::atomic<bool> cardStatePending {false};  // a Card State for every card, the backplane too
+  float discoveryBackoffSec;
+  int64_t nextDiscoveryFrame = 0;
+  int64_t nextHeartbeatFrame = 0;
+  int64_t lastHeartbeatAckFrame = 0;
+  int64_t heartbeatSentFrame[128] = {};  // by sequence number, for the round trip
+  uint8_t heartbeatSeq = 0;
+  int lastPiSeq = -1;   // -1 until the first ack after the link comes up
+  int piSession = -1;
+  midi::Message heartbeatMessage;
+  midi::Message cardStateMessage;
+
+  // engine frames per port, a block at a time [device][frame], handed
+  // to the port in one push when the block is full.  A block ends with
+  // the engine's step, so the audio thread finds every frame stepped.
+  static constexpr int engineBlockFrames = ZoxnoxiousAudioPort::maxPushFrames;
+  std::vector<rack::dsp::Frame<maxAudioChannels>> engineBlocks;
+  int engineBlockPos = 0;
+  int engineBlockLength = 0;
+  uint32_t engineBlockSerial = 0;
+  int64_t engineStepEnd = 0;
+  void beginDeviceFrames(const ProcessArgs& args, rack::dsp::Frame<maxAudioChannels> **deviceFrames);
+  void endDeviceFrames(float sampleRate);
+  void pushEngineBlocks(float sampleRate);
+
+  // control rate mode: the cards' part of each device frame, as of the
+  // last evaluation
+  rack::dsp::Frame<maxAudioChannels> heldFrames[maxAudioDevices] = {};
+  int controlRateCounter = 0;
+  bool heldFramesValid = false;
+  int updateControlRateDivision(float engineSampleRate);
+
+  // block mode participants: the engine block each slot last filled
+  // and who filled it, so one attached mid-block fills the rest.  A
+  // slow CV TDM card fills cardBlock, then its channels are placed.
+  uint32_t participantBlockSerial[maxVoiceCards] = {};
+  const Participant *participantBlockOwner[maxVoiceCards] = {};
+  std::vector<rack::dsp::Frame<maxAudioChannels>> cardBlock;
+  void pullParticipantBlock(const ProcessArgs& args, const Slot& slot, int slotIndex);
+
+  // an attach that found the broker's writer lock taken, retried first
+  // next block; -1 for none
+  int64_t pendingAttachId = -1;
   void serviceParticipantAttachments();
+  bool serviceAttach(int64_t moduleId);
 
   std::array<CvRoute,2> routes;
 
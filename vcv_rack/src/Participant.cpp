@@ -7,8 +7,7 @@ namespace zox {
 
 
 Broker::Broker() : nameService(std::make_shared<HardwareNameService>()) {
-  // do not initialize published: nullptr value indicates no ParticipantProperties
-  // registered.
+  // nothing published: no ParticipantProperties registered yet
 }
 
 
@@ -16,9 +15,10 @@ bool Broker::registerDevices(ParticipantProperty *devices, size_t count) {
   size_t i = 0;
 
   for (; i < count; ++i) {
-    // store to both copies so it won't matter which one is actually used first
-    std::memcpy(&storageA.slots[i].props, &devices[i], sizeof(ParticipantProperty));
-    std::memcpy(&storageB.slots[i].props, &devices[i], sizeof(ParticipantProperty));
+    // store to every copy so it won't matter which one is actually used first
+    for (Snapshot& s : snapshots.storage) {
+      std::memcpy(&s.slots[i].props, &devices[i], sizeof(ParticipantProperty));
+    }
     // output table need to be indexed by slot number
     if (devices[i].slotNum >= 0 && devices[i].slotNum < maxVoiceCards) {
       nameService->setName(devices[i].slotNum * 2, getCardOutputName(devices[i].hardwareId, 1, devices[i].slotNum));
@@ -36,52 +36,54 @@ bool Broker::registerDevices(ParticipantProperty *devices, size_t count) {
 
   // flag anything not specified as invalid
   for (; i < maxVoiceCards; ++i) {
-    storageA.slots[i].props.hardwareId = invalidCardId;
-    storageA.slots[i].props.moduleId = -1;
-    storageB.slots[i].props.hardwareId = invalidCardId;
-    storageB.slots[i].props.moduleId = -1;
+    for (Snapshot& s : snapshots.storage) {
+      s.slots[i].props.hardwareId = invalidCardId;
+      s.slots[i].props.moduleId = -1;
+    }
   }
 
-  // set published non-null: allow the participant registrations to proceed
-  published.store(&storageA, std::memory_order_release);
+  // publish: allow the participant registrations to proceed
+  publish(snapshots.storage[0]);
 
   return true;
 }
 
-// register the participant Id.  Double buffer the storage, so UI and audio threads
-// can co-mingle.  Mutation is only to happen on UI thread.  Audio thread gets a
-// pointer to a published stable version.
-// On successful register returns the slot
+// register the participant Id.  Triple buffer the storage, so UI and audio threads
+// can co-mingle.  Mutation only happens on the buffer that is neither published
+// nor pinned.  Audio thread gets a pointer to a published stable version.
+// Called on the audio thread, so a detach holding the writer lock means
+// come back next block rather than wait for it.
 
-SlotAndNameService Broker::registerParticipant(int64_t moduleId, Participant *p) {
-  SlotAndNameService slotAndName = { invalidSlot, nameService };
+bool Broker::registerParticipant(int64_t moduleId, Participant *p, SlotAndNameService& slotAndName) {
+  slotAndName = { invalidSlot, nameService };
   if (p == nullptr) {
     WARN("Broker received a null pointer for registration: moduleId %" PRId64, moduleId);
-    return slotAndName;
+    return true;
   }
 
-  if (published.load(std::memory_order_acquire) == nullptr) {
+  if (snapshots.current() == nullptr) {
     WARN("registration denied for moduleId %" PRId64
          ": hardware detail pending", moduleId);
-    return slotAndName;
+    return true;
   }
 
-  // 1. Grab the "other" snapshot (the one the audio thread isn't using)
-  const Snapshot &current = *published.load(std::memory_order_acquire);
-  Snapshot &next = (&current == &storageA) ? storageB : storageA;
+  if (!snapshots.tryLockWriters()) {
+    return false;
+  }
 
-  // 2. Clone current state into the next snapshot
-  next = current;
+  // 1. Clone current state into a snapshot the audio thread isn't using
+  Snapshot &next = snapshots.beginUpdate();
 
-  // 3. Perform bizlogic to determine if we can register participant.
+  // 2. Perform bizlogic to determine if we can register participant.
   // Any manipulation is allowed on next since it is not used by audio thread.
   slotAndName.slotNum = findSlot(next, moduleId, p);
 
-  // 4. Atomic Swap: Now the audio thread sees the new participant
+  // 3. Atomic Swap: Now the audio thread sees the new participant
   // (and yes, still do this even if the previous step failed)
-  published.store(&next, std::memory_order_release);
+  publish(next);
+  snapshots.unlockWriters();
 
-  return slotAndName;
+  return true;
 }
 
 
@@ -89,12 +91,14 @@ SlotAndNameService Broker::registerParticipant(int64_t moduleId, Participant *p)
 bool Broker::unregisterParticipant(int64_t moduleId) {
   bool removed = false;
 
-  // select inactive snapshot
-  const Snapshot &current = *published.load(std::memory_order_acquire);
-  Snapshot &next = (&current == &storageA) ? storageB : storageA;
+  if (snapshots.current() == nullptr) {
+    return false;
+  }
 
-  // clone current state into next published state
-  next = current;
+  // clone current state into an unused snapshot.  UI thread: the audio
+  // thread only ever tries the lock, so the wait is a copy at most.
+  snapshots.lockWriters();
+  Snapshot &next = snapshots.beginUpdate();
 
   // find then remove moduleId by clearing isAllocated flag
   for (size_t i = 0; i < maxVoiceCards; ++i) {
@@ -106,7 +110,8 @@ bool Broker::unregisterParticipant(int64_t moduleId) {
     }
   }
 
-  published.store(&next, std::memory_order_release);
+  publish(next);
+  snapshots.unlockWriters();
   return removed;
 }
 
@@ -122,6 +127,7 @@ int8_t Broker::findSlot(Snapshot& s, int64_t moduleId, Participant* p) {
       s.slots[i].participant = p;
       s.slots[i].props.moduleId = moduleId;
       s.slots[i].props.isAllocated = true;
+      s.slots[i].props.blockChannels = p->sampleBlockChannels();
       return s.slots[i].props.slotNum;
     }
   }
@@ -131,13 +137,39 @@ int8_t Broker::findSlot(Snapshot& s, int64_t moduleId, Participant* p) {
 
 
 
-const Broker::Snapshot& Broker::snapshot() const {
-  auto* s = published.load(std::memory_order_acquire);
+// list the attached slots, then swap it in
+void Broker::publish(Snapshot& next) {
+  const Snapshot* current = snapshots.current();
+  next.generation = current ? current->generation + 1 : 1;
+  next.numActive = 0;
+  for (int i = 0; i < maxVoiceCards; ++i) {
+    if (next.slots[i].participant != nullptr && next.slots[i].props.isAllocated) {
+      next.active[next.numActive++] = i;
+    }
+  }
+  snapshots.publish(next);
+}
+
+
+
+const Broker::Snapshot& Broker::acquireSnapshot() {
   static const Snapshot empty{};  // safe fallback
+  const Snapshot* s = snapshots.acquire();
   return s ? *s : empty;
 }
 
 
+void Broker::releaseSnapshot() {
+  snapshots.release();
+}
+
+
+uint32_t Broker::getGeneration() const {
+  const Snapshot* s = snapshots.current();
+  return s ? s->generation : 0;
+}
+
+
 
 GraphPort graphPortFromBusSignalSource(int signalSource) {
   if (signalSource == maxVoiceCards * 2) {
@@ -165,8 +197,14 @@ bool ParticipantLifecycle::isAttached() const {
   return state.load(std::memory_order_acquire) == AttachState::Attached;
 }
 
-bool ParticipantLifecycle::heartbeat() {
+bool ParticipantLifecycle::heartbeat(int64_t moduleId) {
+  const uint32_t generation = OutputInterface::attachGeneration.load(std::memory_order_relaxed);
+  if (generation == seenGeneration) {
+    return true;
+  }
+
   OutputInterface* current = OutputInterface::instance.load(std::memory_order_acquire);
+  bool ok = true;
 
   if (isAttached() && (!current || &current->getBroker() != broker)) {
     // Orchestrator vanished or changed
@@ -175,29 +213,38 @@ bool ParticipantLifecycle::heartbeat() {
     participant = nullptr;
     broker = nullptr;
     state.store(AttachState::AttachRequested);
-    return false;
+    ok = false;
   }
-  return true;
+
+  // a full queue leaves seenGeneration alone, to try again next sample
+  if (wantAttach() && current && !OutputInterface::attachQueue.push(moduleId)) {
+    return ok;
+  }
+  seenGeneration = generation;
+  return ok;
 }
 
 
-// completeAttach() is called from the OutputInterface manager on scanning modules for those that
-// have an ATTACH_REQUESTED state.  This avoids the Participant modules calling attach themselves.
-// Return true on state change to attached.
-bool ParticipantLifecycle::completeAttach(Broker* b, Participant* p) {
+// completeAttach() is called from the OutputInterface manager on draining the attach
+// queue.  This avoids the Participant modules calling attach themselves.
+// Attached on state change to attached; Busy leaves the request standing.
+ParticipantLifecycle::AttachResult ParticipantLifecycle::completeAttach(Broker* b, Participant* p) {
   if (!b || !p) {
     WARN("completeAtttach received nullptr");
-    return false;
+    return AttachResult::NotAttached;
   }
 
   if (state.load(std::memory_order_acquire) != AttachState::AttachRequested) {
-    return false;
+    return AttachResult::NotAttached;
   }
 
-  SlotAndNameService slotAndName = b->registerParticipant(p->getModuleId(), p);
+  SlotAndNameService slotAndName;
+  if (!b->registerParticipant(p->getModuleId(), p, slotAndName)) {
+    return AttachResult::Busy;
+  }
 
   if (slotAndName.slotNum == invalidSlot) {
-    return false;
+    return AttachResult::NotAttached;
   }
 
   broker = b;
@@ -206,7 +253,7 @@ bool ParticipantLifecycle::completeAttach(Broker* b, Participant* p) {
   nameService = slotAndName.nameService;
 
   state.store(AttachState::Attached, std::memory_order_release);
-  return true;
+  return AttachResult::Attached;
 }
 
 
@@ -223,7 +270,117 @@ void ParticipantLifecycle::completeDetach() {
   participant = nullptr;
   broker = nullptr;
   state.store(AttachState::Detached, std::memory_order_release);
+
+  // the slot is free: anything waiting for one tries again
+  OutputInterface::attachGeneration.fetch_add(1, std::memory_order_relaxed);
 }
 
 
+
+AttachQueue::AttachQueue() {
+  for (size_t i = 0; i < capacity; ++i) {
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+
+// a cell is free for position pos when its sequence is pos, and
+// holds pos's id when its sequence is pos + 1
+bool AttachQueue::push(int64_t moduleId) {
+  size_t pos = tail.load(std::memory_order_relaxed);
+
+  for (;;) {
+    Cell& cell = cells[pos % capacity];
+    const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+    if (diff == 0) {
+      if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        cell.moduleId = moduleId;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0) {
+      return false;
+    }
+    else {
+      pos = tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+
+bool AttachQueue::pop(int64_t& moduleId) {
+  Cell& cell = cells[head % capacity];
+  const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+  if (sequence != head + 1) {
+    return false;
+  }
+  moduleId = cell.moduleId;
+  cell.sequence.store(head + capacity, std::memory_order_release);
+  ++head;
+  return true;
+}
+
+
+
+
+bool MidiBatch::push(uint8_t status, uint8_t data1, int selector, MidiPriority priority) {
+  if (selector != noSelector) {
+    for (size_t i = 0; i < count; ++i) {
+      Entry& entry = entries[i];
+      if (entry.selector == selector && entry.status == status) {
+        entry.data1 = data1;
+        entry.priority = priority;
+        return true;
+      }
+    }
+  }
+
+  if (count == capacity) {
+    ++dropped;
+    return false;
+  }
+  entries[count++] = { status, data1, selector, priority };
+  return true;
+}
+
+
+// the status byte carries the channel, so a selector is per channel
+bool MidiBatch::pushProgramChange(int8_t midiChannel, int8_t program, int selector, MidiPriority priority) {
+  return push(static_cast<uint8_t>((midiProgramChangeStatus << 4) | (midiChannel & 0x0f)),
+              static_cast<uint8_t>(program & 0x7f), selector, priority);
+}
+
+
+size_t MidiBatch::flush(rack::midi::Output& output, size_t budget) {
+  size_t sent = 0;
+  bool isSent[capacity] = {};
+
+  for (MidiPriority priority : { MidiPriority::Selector, MidiPriority::Background }) {
+    for (size_t i = 0; i < count && sent < budget; ++i) {
+      if (entries[i].priority == priority) {
+        message.setSize(2);
+        message.bytes[0] = entries[i].status;
+        message.bytes[1] = entries[i].data1;
+        output.sendMessage(message);
+        isSent[i] = true;
+        ++sent;
+      }
+    }
+  }
+
+  // what's left keeps its order
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (!isSent[i]) {
+      entries[kept++] = entries[i];
+    }
+  }
+  count = kept;
+  return sent;
+}
+
 } // namespace zox
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <rack.hpp>
 #include "constants.hpp"
+#include "SnapshotBuffer.hpp"
 
 
 namespace zox {
@@ -61,6 +63,15 @@ struct ParticipantProperty {
   int8_t midiChannel;
   int8_t slotNum = invalidSlot;
   bool isAllocated = false;
+
+  // slow channel TDM: when slowChannelMask is non-zero the card's
+  // numChannels aren't contiguous on the device, see OutputInterface
+  int8_t numChannels = 0;
+  int8_t tdmBase = 0;
+  uint32_t slowChannelMask = 0;
+
+  // the participant's sampleBlockChannels(), taken when it's allocated
+  int8_t blockChannels = 0;
 };
 
 struct Slot {
@@ -79,57 +90,70 @@ struct Broker {
   Broker();
 
   // Broker invariant:
-  // if published == nullptr  -> discovery report not yet latched
-  // if published != nullptr  -> device tree initialized and stable
+  // if no snapshot is published -> discovery report not yet latched
+  // if one is published         -> device tree initialized and stable
   // what that means:
-  // published is initialized to nullptr.
-  // registerDevices may be called once (and only once) to set published non-null.
-  // (un)registerParticipant returns false if published is nullptr.
-  //
-  // Broker snapshot ownership & threading model
-  // - The Broker maintains TWO Snapshot buffers (stoargeA and storageB)
-  // - Exactly ONE Snapshot is "published" at any time via the atomic `published`.
-  // - The AUDIO THREAD:
-  //     * May ONLY read from the Snapshot pointed to by `published` (which is initially null).
-  //     * Must never write to any Snapshot.
-  //
-  // - The UI THREAD:
-  //     * Must NEVER modify the Snapshot currently pointed to by `published`.
-  //     * Must copy the published Snapshot into the *other* buffer,
-  //       mutate that buffer, then publish it via an atomic store.
+  // registerDevices may be called once (and only once) to publish.
+  // (un)registerParticipant returns false until then.
   //
-  // Buffer selection rule (UI thread only):
-  //     const Snapshot* current = published.load(...);
-  //     Snapshot& next = (&current == &storageA) ? storageB : storageA;
-  //
-  // Violating this invariant results in bad things.
+  // Snapshots are triple buffered, see SnapshotBuffer for the threading
+  // model.  The AUDIO THREAD, the only reader, takes the newest
+  // published Snapshot with acquireSnapshot(), wait-free, and reads it
+  // in place until releaseSnapshot(); use SnapshotPin.  Attach writes from the audio thread too, detach from
+  // the UI thread: registerParticipant only tries the writer lock, so the
+  // audio thread never waits on a detach.
   // -----------------------------------------------------------------------------
 
-  // this should be able to be indexed by physical slot number
+  // this should be able to be indexed by physical slot number.
+  // active lists the indexes of the attached slots in slot order,
+  // compiled on publish so the per-sample loop skips the empty ones.
+  // generation counts publishes; 0 until registerDevices.
   struct Snapshot {
     Slot slots[maxVoiceCards];
-  } storageA, storageB;
-
-  // Audio-thread to accesses Snapshot via this pointer
-  std::atomic<const Snapshot*> published { nullptr };
+    int8_t active[maxVoiceCards];
+    int numActive = 0;
+    uint32_t generation = 0;
+  };
 
   bool registerDevices(ParticipantProperty *devices, size_t count);
 
-  SlotAndNameService registerParticipant(int64_t moduleId, Participant *p);
+  // audio thread.  false, with nothing done, if another writer holds the
+  // lock: try again next block.  Otherwise true and slotAndName says
+  // whether a slot was found.
+  bool registerParticipant(int64_t moduleId, Participant *p, SlotAndNameService& slotAndName);
   bool unregisterParticipant(int64_t moduleId);
 
-  // client on audio thread: use snapshot() to get view of data
-  const Snapshot& snapshot() const;
+  // client on audio thread: pin the published snapshot for a process() call.
+  // Valid until releaseSnapshot(); an empty snapshot before registerDevices.
+  const Snapshot& acquireSnapshot();
+  void releaseSnapshot();
+
+  // generation of the published snapshot, for a cheap change check
+  uint32_t getGeneration() const;
 
   // attached participants use HNS to discover names
   const std::shared_ptr<HardwareNameService> getHardwareNameService() const;
 
 private:
   int8_t findSlot(Snapshot& s, int64_t moduleId, Participant* p);
+  void publish(Snapshot& next);
+  SnapshotBuffer<Snapshot> snapshots;
   std::shared_ptr<HardwareNameService> nameService;
 };
 
 
+// scope guard for the audio thread's snapshot pin
+struct SnapshotPin {
+  explicit SnapshotPin(Broker& b) : broker(b), snapshot(b.acquireSnapshot()) {}
+  ~SnapshotPin() { broker.releaseSnapshot(); }
+  SnapshotPin(const SnapshotPin&) = delete;
+  SnapshotPin& operator=(const SnapshotPin&) = delete;
+
+  Broker& broker;
+  const Broker::Snapshot& snapshot;
+};
+
+
 //
 // Graph objects are purely for display of module connections
 //
@@ -167,6 +191,69 @@ GraphPort graphPortFromBusSignalSource(int signalSource);
 // end graph objects
 
 
+// MIDI out, gathered from every participant and the OutputInterface on
+// each scan and sent together.  Messages are short, program changes
+// mostly.  A program change naming a selector replaces one still queued
+// for the same selector on the same channel: only where it ended up
+// matters.  Selector priority is for the up/down selectors that pick a
+// source or mode; toggle switches (ButtonMidiController, the 5524's
+// saw/tri) are Background.  When a flush can't send everything, the
+// selectors go first, and each in the order queued.  Audio thread only.
+enum class MidiPriority : uint8_t { Selector, Background };
+
+struct MidiBatch {
+  static constexpr size_t capacity = 64;
+  static constexpr int noSelector = -1;
+
+  // false if full: the message is dropped
+  bool push(uint8_t status, uint8_t data1, int selector = noSelector,
+            MidiPriority priority = MidiPriority::Selector);
+  bool pushProgramChange(int8_t midiChannel, int8_t program, int selector,
+                         MidiPriority priority = MidiPriority::Selector);
+
+  // send up to budget messages, highest priority first.  Returns the
+  // number sent; the rest wait for the next flush.
+  size_t flush(rack::midi::Output& output, size_t budget);
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  uint32_t getDropped() const { return dropped; }
+
+private:
+  struct Entry {
+    uint8_t status;
+    uint8_t data1;
+    int selector;
+    MidiPriority priority;
+  };
+  Entry entries[capacity];
+  size_t count = 0;
+  uint32_t dropped = 0;
+  rack::midi::Message message;
+};
+
+
+// params changed since the MIDI scan last looked, a bit per ParamId (all
+// below 64 in these modules; one past that marks everything).  Marked from
+// any thread: the UI as a switch is set, see NotifyingQuantity, and the
+// scan's periodic sweep.  Taken by the scan on the audio thread.  Starts
+// all set so the first scan looks at everything.
+struct ChangeMask {
+  static constexpr int maxBits = 64;
+  static constexpr uint64_t all = ~uint64_t(0);
+  static constexpr uint64_t bit(int paramId) { return uint64_t(1) << paramId; }
+
+  void mark(int paramId) {
+    bits.fetch_or(paramId >= 0 && paramId < maxBits ? bit(paramId) : all, std::memory_order_release);
+  }
+  void markAll() { bits.fetch_or(all, std::memory_order_release); }
+  uint64_t take() { return bits.exchange(0, std::memory_order_acquire); }
+
+private:
+  std::atomic<uint64_t> bits { all };
+};
+
+
 struct Participant {
   virtual ~Participant() = default;
 
@@ -181,18 +268,82 @@ struct Participant {
   // fills in the sharedFrame with samples starting at the offset.
   virtual void pullSamples(const rack::engine::Module::ProcessArgs& args, rack::dsp::Frame<maxAudioChannels> &sharedFrame, int offset) = 0;
 
+  // Block mode, optional.  A participant returning its channel count from
+  // sampleBlockChannels() gets pullSampleBlock() once per engine block of
+  // up to 16 samples instead of pullSamples() every sample.  It fills the
+  // frames for the next numFrames samples, channels offset on, in place in
+  // the audio port's block, from its inputs as of now, so it may compute
+  // them together (ramps, vectorized across time).  The count is read once
+  // on attach and must not change.  The default fills each frame with
+  // pullSamples(), holding the inputs for the block.
+  virtual int sampleBlockChannels() const { return 0; }
+  virtual void pullSampleBlock(const rack::engine::Module::ProcessArgs& args, rack::dsp::Frame<maxAudioChannels> *frames, int numFrames, int offset) {
+    for (int i = 0; i < numFrames; ++i) {
+      pullSamples(args, frames[i], offset);
+    }
+  }
+
 
-  // pullMidi()  Client may set the midi::Message owned by the caller.  Return value of
-  // true signals midi message is set and to be returned.  Client to return
-  // false is no message is set.
-  // Called at 100-200 Hz (TBD).  Actual frequency can be inferred from clockDivision.
-  // This is also a good place to do any module state changes for UI elements such as lights.
-  virtual bool pullMidi(const rack::engine::Module::ProcessArgs& args, uint32_t clockDivision, int midiChannel, rack::midi::Message &midiMessage) = 0;
+  // pullMidi()  Client queues any MIDI messages for what changed since the
+  // last call onto batch, on midiChannel.  changedParams are the
+  // getParamChanges() bits taken for this call, never zero: the scan
+  // skips a participant with nothing marked.  Scanned a couple of
+  // thousand times a second, so a switch goes out within a millisecond.
+  virtual void pullMidi(const rack::engine::Module::ProcessArgs& args, int midiChannel,
+                        uint64_t changedParams, MidiBatch& batch) = 0;
+
+  // updateLights()  UI state: lights, clip timers, visualizer weights.
+  // UI thread, from the module widget's step(), deltaTime seconds since
+  // the last frame.  Runs attached or not.
+  virtual void updateLights(float deltaTime) {}
 
   // method to pull connection info: specify what modules this is connected _from_
   // at the very least this needs to set slotNum, moduleId, and hardwareId
   virtual bool pullGraphInfo(ParticipantGraphInfo& info) = 0;
 
+  // pullCardState()  Fill programs with the MIDI program of every switch and
+  // selector, for a Card State message, and consider them sent so pullMidi()
+  // doesn't repeat them.  Returns the number filled, zero if the card has no
+  // switches.  Called on the audio thread.
+  virtual size_t pullCardState(uint8_t *programs, size_t maxPrograms) { return 0; }
+
+  // ask for a Card State on the next MIDI poll: after attach, a patch or
+  // preset load, or a reconnect.  Any thread.
+  void requestCardState() { cardStateRequested.store(true, std::memory_order_relaxed); }
+  bool takeCardStateRequest() { return cardStateRequested.exchange(false, std::memory_order_relaxed); }
+
+  // what pullMidi() needs to look at
+  ChangeMask& getParamChanges() { return paramChanges; }
+
+private:
+  std::atomic<bool> cardStateRequested {true};
+  ChangeMask paramChanges;
+
+};
+
+
+
+// module ids of participants wanting a slot.  Any engine thread posts,
+// the primary OutputInterface drains it on its audio thread.  Bounded,
+// lock-free: a per-cell sequence number hands each cell between the
+// producers and the single consumer.
+struct AttachQueue {
+  static constexpr size_t capacity = 256;
+
+  AttachQueue();
+  // false if full
+  bool push(int64_t moduleId);
+  // consumer only.  false if empty
+  bool pop(int64_t& moduleId);
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    int64_t moduleId;
+  };
+  Cell cells[capacity];
+  std::atomic<size_t> tail { 0 };
+  size_t head = 0;
 };
 
 
@@ -208,6 +359,12 @@ struct ParticipantLifecycle {
     DetachRequested
   };
 
+  enum class AttachResult : uint8_t {
+    Attached,
+    NotAttached,
+    Busy        // broker writer lock held elsewhere, try next block
+  };
+
   // ALL reads of broker / participant / slotNum / nameService
   // must occur only after reading state with acquire.
   std::atomic<AttachState> state { AttachState::AttachRequested };
@@ -215,10 +372,16 @@ struct ParticipantLifecycle {
   int8_t slotNum = invalidSlot;
   std::shared_ptr<HardwareNameService> nameService = nullptr;
 
+  // OutputInterface::attachGeneration as of the last heartbeat that
+  // looked further.  Participant's process thread only.
+  uint32_t seenGeneration = 0;
+
   bool wantAttach() const;
   bool isAttached() const;
-  bool heartbeat();
-  bool completeAttach(Broker *b, Participant *p);
+  // called every sample: only a generation compare unless something
+  // changed, then detach from a vanished broker or post an attach request
+  bool heartbeat(int64_t moduleId);
+  AttachResult completeAttach(Broker *b, Participant *p);
   void completeDetach();
 };
 
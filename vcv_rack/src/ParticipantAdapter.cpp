@@ -1,4 +1,5 @@
 #include "ParticipantAdapter.hpp"
+#include "OutputInterface.hpp"
 
 
 namespace zox {
@@ -7,7 +8,7 @@ static constexpr int invalidLightEnum = -1;
 
 ParticipantAdapter::ParticipantAdapter() :
   participant(nullptr), myLightEnum(invalidLightEnum) {
-  lightDivider.setDivision(APP->engine->getSampleRate() / 120);
+  expanderDivider.setDivision(APP->engine->getSampleRate() / 120);
 }
 
 ParticipantAdapter::~ParticipantAdapter() {
@@ -26,12 +27,21 @@ Participant* ParticipantAdapter::getParticipant() {
 
 
 void ParticipantAdapter::process(const ProcessArgs& args) {
-  lifecycle.heartbeat();
+  lifecycle.heartbeat(getId());
+  prefilter.process(inputs.data(), OutputInterface::controlRateDivision.load(std::memory_order_relaxed));
 
-  if (lightDivider.process()) {
-    if (myLightEnum != invalidLightEnum) {
-      setAttachedLightStatus();
-    }
+  if (expanderDivider.process()) {
+    processExpanders(args);
+  }
+}
+
+
+void ParticipantAdapter::stepLights(float deltaTime) {
+  if (myLightEnum != invalidLightEnum) {
+    setAttachedLightStatus();
+  }
+  if (participant) {
+    participant->updateLights(deltaTime);
   }
 }
 
@@ -45,6 +55,14 @@ void ParticipantAdapter::onRemove(const RemoveEvent& e) {
   Module::onRemove(e);
 }
 
+// patch or preset load: any number of switches may have changed
+void ParticipantAdapter::fromJson(json_t* rootJ) {
+  Module::fromJson(rootJ);
+  if (participant) {
+    participant->requestCardState();
+  }
+}
+
 
 void ParticipantAdapter::onAttach() {}
 
@@ -81,4 +99,15 @@ void ParticipantAdapter::setAttachedLightStatus() {
 }
 
 
+
+// lights before the light widgets read them
+void ParticipantWidget::step() {
+  if (auto* adapter = dynamic_cast<ParticipantAdapter*>(module)) {
+    // a long first frame or a stall shouldn't jump the clip timers
+    adapter->stepLights(clamp(static_cast<float>(APP->window->getLastFrameDuration()), 1e-3f, 0.1f));
+  }
+  ModuleWidget::step();
+}
+
+
 } // namespace zox
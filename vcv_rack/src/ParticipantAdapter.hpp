@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Participant.hpp"
+#include "modulehelpers.hpp"
 
 namespace zox {
 
@@ -19,26 +20,44 @@ public:
 
   void onAdd(const AddEvent& e) override;
   void onRemove(const RemoveEvent& e) override;
+  void fromJson(json_t* rootJ) override;
 
   ParticipantLifecycle& getLifecycle();
 
   // override function available for callback on attaching to broker
   virtual void onAttach();
 
+  // UI thread, every frame: the attach light and the participant's
+  // updateLights().  Called by ParticipantWidget.
+  void stepLights(float deltaTime);
+
 protected:
   ParticipantLifecycle lifecycle;
   Participant* participant;
 
+  // inputs to smooth when cards run at the device rate, see modulehelpers
+  InputPrefilter prefilter;
+
   // shortcut function that takes the expander light enum to set it based on attached state.
   // May be overridden if you don't want to go with the flow.
   // setLightEnum to be called during initialization, and
-  // setAttachedLightStatus gets called during process()
+  // setAttachedLightStatus gets called from stepLights()
   virtual void setLightEnum(int lightEnum);
   virtual void setAttachedLightStatus();
 
+  // engine thread, about 120 times a second, attached or not: for
+  // expander messages, which have to be written from process()
+  virtual void processExpanders(const ProcessArgs& args) {}
+
 private:
-  rack::dsp::ClockDivider lightDivider;
+  rack::dsp::ClockDivider expanderDivider;
   int myLightEnum;
 };
 
+
+// widget for a participant's panel: drives ParticipantAdapter::stepLights()
+struct ParticipantWidget : rack::app::ModuleWidget {
+  void step() override;
+};
+
 } // namespace zox
@@ -113,13 +113,13 @@ struct PoleDancer final : ParticipantAdapter, Participant {
     LIGHTS_LEN
   };
 
-  float sourceOneLevelClipTimer = 0.f;
-  float sourceOneModAmountClipTimer = 0.f;
-  float sourceTwoLevelClipTimer = 0.f;
-  float sourceTwoModAmountClipTimer = 0.f;
-  float cutoffClipTimer = 0.f;
-  float resonanceClipTimer = 0.f;
-  float filterVcaClipTimer = 0.f;
+  ClipIndicator sourceOneLevelClip;
+  ClipIndicator sourceOneModAmountClip;
+  ClipIndicator sourceTwoLevelClip;
+  ClipIndicator sourceTwoModAmountClip;
+  ClipIndicator cutoffClip;
+  ClipIndicator resonanceClip;
+  ClipIndicator filterVcaClip;
 
   std::string source1NameString;
   std::string source2NameString;
@@ -130,6 +130,7 @@ struct PoleDancer final : ParticipantAdapter, Participant {
   static constexpr int8_t sourceOneSelectMidiPrograms[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
   static constexpr int8_t sourceTwoSelectMidiPrograms[] = { 8, 9, 10, 11, 12, 13, 14, 15 };
   static constexpr int8_t rezModeSelectMidiPrograms[] = { 24, 25, 26, 27, 28, 29, 30, 31 };
+  enum Selector { SOURCE_ONE_SELECTOR, SOURCE_TWO_SELECTOR, REZ_COMP_SELECTOR };
 
   std::array<CvRoute,5> routes;
 
@@ -149,26 +150,28 @@ struct PoleDancer final : ParticipantAdapter, Participant {
     output1NameString(invalidCardOutputName),
     output2NameString(invalidCardOutputName),
     routes{{
-      {CUTOFF_KNOB_PARAM, CUTOFF_INPUT, VCF_CUTOFF, 10.f, &cutoffClipTimer, nullptr, CvOperation::Add},
-      {SOURCE_ONE_LEVEL_KNOB_PARAM, SOURCE_ONE_LEVEL_INPUT, SOURCE_ONE_LEVEL, 10.f, &sourceOneLevelClipTimer, nullptr, CvOperation::Add},
-      {SOURCE_TWO_LEVEL_KNOB_PARAM, SOURCE_TWO_LEVEL_INPUT, SOURCE_TWO_LEVEL, 10.f, &sourceTwoLevelClipTimer, nullptr, CvOperation::Add},
-      {SOURCE_ONE_MOD_AMOUNT_KNOB_PARAM, SOURCE_ONE_MOD_AMOUNT_INPUT, SOURCE_ONE_MOD_AMOUNT, 10.f, &sourceOneModAmountClipTimer, nullptr, CvOperation::Add},
-      {SOURCE_TWO_MOD_AMOUNT_KNOB_PARAM, SOURCE_TWO_MOD_AMOUNT_INPUT, SOURCE_TWO_MOD_AMOUNT, 10.f, &sourceTwoModAmountClipTimer, nullptr, CvOperation::Add}
+      {CUTOFF_KNOB_PARAM, CUTOFF_INPUT, VCF_CUTOFF, 10.f, &cutoffClip, nullptr, CvOperation::Add},
+      {SOURCE_ONE_LEVEL_KNOB_PARAM, SOURCE_ONE_LEVEL_INPUT, SOURCE_ONE_LEVEL, 10.f, &sourceOneLevelClip, nullptr, CvOperation::Add},
+      {SOURCE_TWO_LEVEL_KNOB_PARAM, SOURCE_TWO_LEVEL_INPUT, SOURCE_TWO_LEVEL, 10.f, &sourceTwoLevelClip, nullptr, CvOperation::Add},
+      {SOURCE_ONE_MOD_AMOUNT_KNOB_PARAM, SOURCE_ONE_MOD_AMOUNT_INPUT, SOURCE_ONE_MOD_AMOUNT, 10.f, &sourceOneModAmountClip, nullptr, CvOperation::Add},
+      {SOURCE_TWO_MOD_AMOUNT_KNOB_PARAM, SOURCE_TWO_MOD_AMOUNT_INPUT, SOURCE_TWO_MOD_AMOUNT, 10.f, &sourceTwoModAmountClip, nullptr, CvOperation::Add}
     }} {
 
     setParticipant(this);
     setLightEnum(RIGHT_EXPANDER_LIGHT);
 
     config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+    // audio rate modulation targets, smoothed when cards run at the device rate
+    prefilter.inputMask = InputPrefilter::bit(CUTOFF_INPUT) | InputPrefilter::bit(RESONANCE_INPUT);
 
     // buttons for inputs select
-    configButton(SOURCE_ONE_DOWN_BUTTON_PARAM, "Previous");
-    configButton(SOURCE_ONE_UP_BUTTON_PARAM, "Next");
-    configButton(SOURCE_TWO_DOWN_BUTTON_PARAM, "Previous");
-    configButton(SOURCE_TWO_UP_BUTTON_PARAM, "Next");
+    configButton<NotifyingButtonQuantity>(SOURCE_ONE_DOWN_BUTTON_PARAM, "Previous");
+    configButton<NotifyingButtonQuantity>(SOURCE_ONE_UP_BUTTON_PARAM, "Next");
+    configButton<NotifyingButtonQuantity>(SOURCE_TWO_DOWN_BUTTON_PARAM, "Previous");
+    configButton<NotifyingButtonQuantity>(SOURCE_TWO_UP_BUTTON_PARAM, "Next");
 
-    configButton(REZ_COMP_DOWN_BUTTON_PARAM, "Up"); // semantics reversed
-    configButton(REZ_COMP_UP_BUTTON_PARAM, "Down");
+    configButton<NotifyingButtonQuantity>(REZ_COMP_DOWN_BUTTON_PARAM, "Up"); // semantics reversed
+    configButton<NotifyingButtonQuantity>(REZ_COMP_UP_BUTTON_PARAM, "Down");
 
     configParam(SOURCE_ONE_LEVEL_KNOB_PARAM, 0.f, 1.f, 0.5f, "Source One Level", "%", 0.f, 100.f);
     configParam(SOURCE_ONE_MOD_AMOUNT_KNOB_PARAM, 0.f, 1.f, 0.f, "Source One Mod", "%", 0.f, 100.f);
@@ -193,6 +196,7 @@ struct PoleDancer final : ParticipantAdapter, Participant {
     configSwitch(SOURCE_ONE_VALUE_HIDDEN_PARAM, 0.f, 7.f, 0.f, "Source One", {"0", "1", "2", "3", "4", "5", "6", "7"} );
     configSwitch(SOURCE_TWO_VALUE_HIDDEN_PARAM, 0.f, 7.f, 0.f, "Source Two", {"0", "1", "2", "3", "4", "5", "6", "7"} );
     configSwitch(REZ_COMP_VALUE_HIDDEN_PARAM, 0.f, 7.f, 0.f, "Rez Compensation", {"0", "1", "2", "3", "4", "5", "6", "7"} );
+    watchParamChanges(this, getParamChanges());
     source1NameString.reserve(16);
     source2NameString.reserve(16);
     output1NameString.reserve(16);
@@ -215,21 +219,20 @@ struct PoleDancer final : ParticipantAdapter, Participant {
 
     float v;
     bool clipped;
-    static constexpr float clipTime = 0.25f;
 
     processCvRoutes(routes.data(),
                     routes.size(),
-                    clipTime,
                     offset,
                     sharedFrame.samples,
                     params.data(),
-                    inputs.data());
+                    inputs.data(),
+                    &prefilter);
 
     // qvca
-    resonance = params[RESONANCE_KNOB_PARAM].getValue() + inputs[RESONANCE_INPUT].getVoltage() / 10.f;
+    resonance = params[RESONANCE_KNOB_PARAM].getValue() + prefilter.getVoltage(inputs.data(), RESONANCE_INPUT) / 10.f;
     clipped = (resonance < 0.f) || (resonance > 1.f);
     if (clipped) {
-      resonanceClipTimer = clipTime;
+      resonanceClip.set();
     }
     // Resonance slope & max will vary depending on Resonance Compensation mode
     // for consistency between modes, try to get oscillation to start around 80%.
@@ -261,7 +264,7 @@ struct PoleDancer final : ParticipantAdapter, Participant {
     clipped = (v < 0.f) || (v > 1.f);
     float filterVcaGain = clamp(v, 0.f, 1.f);
     if (clipped) {
-      filterVcaClipTimer = clipTime;
+      filterVcaClip.set();
     }
 
     if (inputs[POLE_MIX_INPUT].isConnected()) {
@@ -301,72 +304,42 @@ struct PoleDancer final : ParticipantAdapter, Participant {
   }
 
 
-  bool pullMidi(const rack::engine::Module::ProcessArgs &args, uint32_t clockDivision, int midiChannel, midi::Message &midiMessage) override {
-
-    // clipping
-    const float lightTime = args.sampleTime * clockDivision;
-    const float brightnessDeltaTime = 1 / lightTime;
-
-    // for clipping lights just keep subtracting every cycle
-    sourceOneLevelClipTimer -= lightTime;
-    lights[SOURCE_ONE_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceOneLevelClipTimer > 0.f, brightnessDeltaTime);
-
-    sourceOneModAmountClipTimer -= lightTime;
-    lights[SOURCE_ONE_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(sourceOneModAmountClipTimer > 0.f, brightnessDeltaTime);
-
-    sourceTwoLevelClipTimer -= lightTime;
-    lights[SOURCE_TWO_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceTwoLevelClipTimer > 0.f, brightnessDeltaTime);
-
-    sourceTwoModAmountClipTimer -= lightTime;
-    lights[SOURCE_TWO_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(sourceTwoModAmountClipTimer > 0.f, brightnessDeltaTime);
-
-    cutoffClipTimer -= lightTime;
-    lights[CUTOFF_CLIP_LIGHT].setBrightnessSmooth(cutoffClipTimer > 0.f, brightnessDeltaTime);
-
-    resonanceClipTimer -= lightTime;
-    lights[RESONANCE_CLIP_LIGHT].setBrightnessSmooth(resonanceClipTimer > 0.f, brightnessDeltaTime);
-
-    filterVcaClipTimer -= lightTime;
-    lights[FILTER_VCA_CLIP_LIGHT].setBrightnessSmooth(filterVcaClipTimer > 0.f, brightnessDeltaTime);
-
-
+  void pullMidi(const rack::engine::Module::ProcessArgs &args, int midiChannel, uint64_t changedParams, MidiBatch &batch) override {
     // light up any buttons-- processing of these is done immediately below
-    lights[SOURCE_ONE_DOWN_BUTTON_LIGHT].setBrightness(params[SOURCE_ONE_DOWN_BUTTON_PARAM].getValue());
-    lights[SOURCE_ONE_UP_BUTTON_LIGHT].setBrightness(params[SOURCE_ONE_UP_BUTTON_PARAM].getValue());
-    lights[SOURCE_TWO_DOWN_BUTTON_LIGHT].setBrightness(params[SOURCE_TWO_DOWN_BUTTON_PARAM].getValue());
-    lights[SOURCE_TWO_UP_BUTTON_LIGHT].setBrightness(params[SOURCE_TWO_UP_BUTTON_PARAM].getValue());
-    lights[REZ_COMP_DOWN_BUTTON_LIGHT].setBrightness(params[REZ_COMP_DOWN_BUTTON_PARAM].getValue());
-    lights[REZ_COMP_UP_BUTTON_LIGHT].setBrightness(params[REZ_COMP_UP_BUTTON_PARAM].getValue());
+    lightOnPress(params[SOURCE_ONE_DOWN_BUTTON_PARAM], lights[SOURCE_ONE_DOWN_BUTTON_LIGHT]);
+    lightOnPress(params[SOURCE_ONE_UP_BUTTON_PARAM], lights[SOURCE_ONE_UP_BUTTON_LIGHT]);
+    lightOnPress(params[SOURCE_TWO_DOWN_BUTTON_PARAM], lights[SOURCE_TWO_DOWN_BUTTON_LIGHT]);
+    lightOnPress(params[SOURCE_TWO_UP_BUTTON_PARAM], lights[SOURCE_TWO_UP_BUTTON_LIGHT]);
+    lightOnPress(params[REZ_COMP_DOWN_BUTTON_PARAM], lights[REZ_COMP_DOWN_BUTTON_LIGHT]);
+    lightOnPress(params[REZ_COMP_UP_BUTTON_PARAM], lights[REZ_COMP_UP_BUTTON_LIGHT]);
 
 
     // add/subtract the up/down buttons and set a string that
     // the UI can use.  There ought to be some todos here to
     // make/fix this.
-    if (handleUpDownSelector(
-          params[SOURCE_ONE_UP_BUTTON_PARAM],
-          params[SOURCE_ONE_DOWN_BUTTON_PARAM],
-          params[SOURCE_ONE_VALUE_HIDDEN_PARAM],
-          7,
-          [&](int i){ return *lifecycle.nameService->getNamePtr(source1Sources[i]); },
-          source1NameString,
-          sourceOneSelectMidiPrograms,
-          midiMessage,
-          midiChannel)) {
-      return true;
-    }
-
-    if (handleUpDownSelector(
-          params[SOURCE_TWO_UP_BUTTON_PARAM],
-          params[SOURCE_TWO_DOWN_BUTTON_PARAM],
-          params[SOURCE_TWO_VALUE_HIDDEN_PARAM],
-          7,
-          [&](int i){ return *lifecycle.nameService->getNamePtr(source2Sources[i]); },
-          source2NameString,
-          sourceTwoSelectMidiPrograms,
-          midiMessage,
-          midiChannel)) {
-      return true;
-    }
+    handleUpDownSelector(
+      params[SOURCE_ONE_UP_BUTTON_PARAM],
+      params[SOURCE_ONE_DOWN_BUTTON_PARAM],
+      params[SOURCE_ONE_VALUE_HIDDEN_PARAM],
+      7,
+      [&](int i){ return *lifecycle.nameService->getNamePtr(source1Sources[i]); },
+      source1NameString,
+      sourceOneSelectMidiPrograms,
+      batch,
+      midiChannel,
+      SOURCE_ONE_SELECTOR);
+
+    handleUpDownSelector(
+      params[SOURCE_TWO_UP_BUTTON_PARAM],
+      params[SOURCE_TWO_DOWN_BUTTON_PARAM],
+      params[SOURCE_TWO_VALUE_HIDDEN_PARAM],
+      7,
+      [&](int i){ return *lifecycle.nameService->getNamePtr(source2Sources[i]); },
+      source2NameString,
+      sourceTwoSelectMidiPrograms,
+      batch,
+      midiChannel,
+      SOURCE_TWO_SELECTOR);
 
     if (handleUpDownSelector(
           params[REZ_COMP_UP_BUTTON_PARAM],
@@ -376,21 +349,43 @@ struct PoleDancer final : ParticipantAdapter, Participant {
           [&](int i){ return rezCompModes[i]; },
           rezCompModeNameString,
           rezModeSelectMidiPrograms,
-          midiMessage,
-          midiChannel)) {
-      lights[REZ_COMP_LIGHT0].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT1].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT2].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT3].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT4].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT5].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT6].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT7].setBrightness(0.f);
-      lights[REZ_COMP_LIGHT0 + static_cast<int>(std::round(params[ REZ_COMP_VALUE_HIDDEN_PARAM ].getValue()))].setBrightness(0.5f);
-      return true;
+          batch,
+          midiChannel,
+          REZ_COMP_SELECTOR)) {
+      setRezCompLights();
     }
+  }
+
+
+  void updateLights(float lightTime) override {
+    // clipping
+    const float brightnessDeltaTime = 1 / lightTime;
+
+    // for clipping lights just keep subtracting every cycle
+    lights[SOURCE_ONE_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceOneLevelClip.update(lightTime), brightnessDeltaTime);
+
+    lights[SOURCE_ONE_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(sourceOneModAmountClip.update(lightTime), brightnessDeltaTime);
+
+    lights[SOURCE_TWO_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceTwoLevelClip.update(lightTime), brightnessDeltaTime);
+
+    lights[SOURCE_TWO_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(sourceTwoModAmountClip.update(lightTime), brightnessDeltaTime);
 
+    lights[CUTOFF_CLIP_LIGHT].setBrightnessSmooth(cutoffClip.update(lightTime), brightnessDeltaTime);
 
+    lights[RESONANCE_CLIP_LIGHT].setBrightnessSmooth(resonanceClip.update(lightTime), brightnessDeltaTime);
+
+    lights[FILTER_VCA_CLIP_LIGHT].setBrightnessSmooth(filterVcaClip.update(lightTime), brightnessDeltaTime);
+
+    lights[SOURCE_ONE_DOWN_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[SOURCE_ONE_UP_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[SOURCE_TWO_DOWN_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[SOURCE_TWO_UP_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[REZ_COMP_DOWN_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[REZ_COMP_UP_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+  }
+
+
+  void processExpanders(const ProcessArgs &args) override {
     // Expander handling.  This does not read from analyzer.  Write only.
     bool analyzerPresent = rightExpander.module && rightExpander.module->model == modelPoleDancerWorkbenchForPoleDancer;
     if (analyzerPresent) {
@@ -465,8 +460,6 @@ struct PoleDancer final : ParticipantAdapter, Participant {
 
       rightExpander.module->leftExpander.messageFlipRequested = true;
     }
-
-    return false;
   }
 
 
@@ -495,20 +488,31 @@ struct PoleDancer final : ParticipantAdapter, Participant {
     auto *ptrSource2 = lifecycle.nameService->getNamePtr( source2Sources[sourceTwoIndex] );
     source1NameString = ptrSource1 ? *ptrSource1 : invalidCardOutputName;
     source2NameString = ptrSource2 ? *ptrSource2 : invalidCardOutputName;
+  }
 
-    // fake out the handleUpDownSelector() to force a MIDI message to be sent
-    params[SOURCE_ONE_VALUE_HIDDEN_PARAM].setValue(
-      params[SOURCE_ONE_VALUE_HIDDEN_PARAM].getValue() - 1.f);
-    params[SOURCE_ONE_UP_BUTTON_PARAM].setValue(1.f);
 
-    params[SOURCE_TWO_VALUE_HIDDEN_PARAM].setValue(
-      params[SOURCE_TWO_VALUE_HIDDEN_PARAM].getValue() - 1.f);
-    params[SOURCE_TWO_UP_BUTTON_PARAM].setValue(1.f);
+  size_t pullCardState(uint8_t *programs, size_t maxPrograms) override {
+    if (maxPrograms < 3) {
+      return 0;
+    }
+    programs[0] = sourceOneSelectMidiPrograms[ static_cast<int>(params[SOURCE_ONE_VALUE_HIDDEN_PARAM].getValue()) ];
+    programs[1] = sourceTwoSelectMidiPrograms[ static_cast<int>(params[SOURCE_TWO_VALUE_HIDDEN_PARAM].getValue()) ];
+    programs[2] = rezModeSelectMidiPrograms[ static_cast<int>(params[REZ_COMP_VALUE_HIDDEN_PARAM].getValue()) ];
+    setRezCompLights();
+    return 3;
+  }
 
-    params[REZ_COMP_VALUE_HIDDEN_PARAM].setValue(
-      params[REZ_COMP_VALUE_HIDDEN_PARAM].getValue() - 1.f);
-    params[REZ_COMP_UP_BUTTON_PARAM].setValue(1.f);
 
+  void setRezCompLights() {
+    lights[REZ_COMP_LIGHT0].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT1].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT2].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT3].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT4].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT5].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT6].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT7].setBrightness(0.f);
+    lights[REZ_COMP_LIGHT0 + static_cast<int>(std::round(params[ REZ_COMP_VALUE_HIDDEN_PARAM ].getValue()))].setBrightness(0.5f);
   }
 
 
@@ -556,7 +560,7 @@ struct PoleDancer final : ParticipantAdapter, Participant {
 
 
 
-struct PoleDancerWidget : ModuleWidget {
+struct PoleDancerWidget : ParticipantWidget {
   PoleDancerWidget(PoleDancer* module) {
     setModule(module);
     setPanel(createPanel(asset::plugin(pluginInstance, "res/PoleDancer.svg")));
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+
+namespace zox {
+
+// Triple buffered state for one reader on the audio thread and writers
+// on any thread, the Broker's storage.  No rack dependencies so the
+// scheme can be stress tested on its own, see test/broker_stress.cpp.
+//
+// The three buffers are in three roles, each held by one side:
+// - front: the reader's.  acquire() swaps it for the shared one if a
+//   newer snapshot has been published there, then reads it in place
+//   until the next acquire().  release() marks the end of the read.
+// - shared: the last published snapshot, or the one the reader gave
+//   back, with a flag saying it's newer than front.
+// - back: the writers'.  beginUpdate() copies the last published
+//   snapshot into it; the writer mutates it and publish() swaps it in
+//   as the shared one, taking whatever was there as the next back.
+//
+// Each side's swap is a single exchange on `shared`, so acquire() is
+// wait-free: one load and at most one exchange, with no retry.  The
+// reader never writes a buffer.  Writers hold the writer lock from
+// beginUpdate() through publish(), there being only the one back
+// buffer.  A writer on the audio thread uses tryLockWriters() and comes
+// back later rather than wait behind another thread.
+template <typename T>
+struct SnapshotBuffer {
+  T storage[3];
+
+  // the last published, nullptr until the first publish.  Not pinned:
+  // only the pointer and the writer side's own reads are safe.
+  const T* current() const {
+    return published.load(std::memory_order_acquire);
+  }
+
+  // reader: the newest published buffer, the reader's until the next
+  // acquire().  nullptr before the first publish.
+  const T* acquire() {
+    if (shared.load(std::memory_order_relaxed) & fresh) {
+      front = shared.exchange(front, std::memory_order_acq_rel) & ~fresh;
+      taken = true;
+    }
+    return taken ? &storage[front] : nullptr;
+  }
+
+  // the front buffer stays the reader's until it swaps it: nothing to
+  // give back
+  void release() {}
+
+  // held by a writer for a few hundred bytes of copying, so spin
+  void lockWriters() {
+    while (writeLock.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+
+  bool tryLockWriters() {
+    return !writeLock.test_and_set(std::memory_order_acquire);
+  }
+
+  void unlockWriters() {
+    writeLock.clear(std::memory_order_release);
+  }
+
+  // the back buffer, holding a copy of the last published one: that's
+  // the shared or the front buffer, which only ever get read.  Call
+  // with the writer lock held, after a publish.
+  T& beginUpdate() {
+    T& next = storage[back];
+    next = *published.load(std::memory_order_relaxed);
+    return next;
+  }
+
+  // with the writer lock held: next is the back buffer.  The first
+  // publish, before any beginUpdate(), is storage[0].
+  void publish(T& next) {
+    published.store(&next, std::memory_order_release);
+    back = shared.exchange(static_cast<int>(&next - storage) | fresh, std::memory_order_acq_rel) & ~fresh;
+  }
+
+private:
+  static constexpr int fresh = 4;
+
+  std::atomic<const T*> published { nullptr };
+  std::atomic<int> shared { 1 };
+  int back = 0;        // writers', under the lock
+  int front = 2;       // reader's
+  bool taken = false;  // reader's: front has been published
+  std::atomic_flag writeLock = ATOMIC_FLAG_INIT;
+};
+
+} // namespace zox
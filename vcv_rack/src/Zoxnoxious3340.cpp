@@ -85,14 +85,14 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
   };
 
 
-  float syncPhaseClipTimer = 0.f;
-  float freqClipTimer = 0.f;
-  float mix1PulseVcaClipTimer = 0.f;
-  float extModAmountClipTimer = 0.f;
-  float mix1TriangleVcaClipTimer = 0.f;
-  float mix1SawVcaClipTimer = 0.f;
-  float pulseWidthClipTimer = 0.f;
-  float linearClipTimer = 0.f;
+  ClipIndicator syncPhaseClip;
+  ClipIndicator freqClip;
+  ClipIndicator mix1PulseVcaClip;
+  ClipIndicator extModAmountClip;
+  ClipIndicator mix1TriangleVcaClip;
+  ClipIndicator mix1SawVcaClip;
+  ClipIndicator pulseWidthClip;
+  ClipIndicator linearClip;
 
   std::string output1NameString;
   std::string output2NameString;
@@ -119,20 +119,23 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
   Zoxnoxious3340() :
     buttonMidiController(buttonMappings),
     routes{{
-      {LINEAR_KNOB_PARAM, LINEAR_INPUT, LINEAR_CHANNEL, 10.f, &linearClipTimer, nullptr, CvOperation::Add},
-      {PULSE_WIDTH_KNOB_PARAM, PULSE_WIDTH_INPUT, PULSE_WIDTH_CHANNEL, 10.f, &pulseWidthClipTimer, nullptr, CvOperation::Add},
-      {MIX1_SAW_KNOB_PARAM, MIX1_SAW_VCA_INPUT, MIX1_SAW_VCA_CHANNEL, 10.f, &mix1SawVcaClipTimer, nullptr, CvOperation::MultiplyNormalled},
-      {MIX1_TRIANGLE_KNOB_PARAM, MIX1_TRIANGLE_VCA_INPUT, MIX1_TRIANGLE_VCA_CHANNEL, 10.f, &mix1TriangleVcaClipTimer, nullptr, CvOperation::MultiplyNormalled},
-      {EXT_MOD_AMOUNT_KNOB_PARAM, EXT_MOD_AMOUNT_INPUT, EXT_MOD_AMOUNT_CHANNEL, 10.f, &extModAmountClipTimer, nullptr, CvOperation::MultiplyNormalled},
-      {MIX1_PULSE_KNOB_PARAM, MIX1_PULSE_VCA_INPUT, MIX1_PULSE_VCA_CHANNEL, 10.f, &mix1PulseVcaClipTimer, nullptr, CvOperation::MultiplyNormalled},
-      {SYNC_PHASE_KNOB_PARAM, SYNC_PHASE_INPUT, SYNC_PHASE_CHANNEL, 10.f, &syncPhaseClipTimer, nullptr, CvOperation::Add},
-      {FREQ_KNOB_PARAM, FREQ_INPUT, FREQ_CHANNEL, 8.f, &freqClipTimer, nullptr, CvOperation::Add}
+      {LINEAR_KNOB_PARAM, LINEAR_INPUT, LINEAR_CHANNEL, 10.f, &linearClip, nullptr, CvOperation::Add},
+      {PULSE_WIDTH_KNOB_PARAM, PULSE_WIDTH_INPUT, PULSE_WIDTH_CHANNEL, 10.f, &pulseWidthClip, nullptr, CvOperation::Add},
+      {MIX1_SAW_KNOB_PARAM, MIX1_SAW_VCA_INPUT, MIX1_SAW_VCA_CHANNEL, 10.f, &mix1SawVcaClip, nullptr, CvOperation::MultiplyNormalled},
+      {MIX1_TRIANGLE_KNOB_PARAM, MIX1_TRIANGLE_VCA_INPUT, MIX1_TRIANGLE_VCA_CHANNEL, 10.f, &mix1TriangleVcaClip, nullptr, CvOperation::MultiplyNormalled},
+      {EXT_MOD_AMOUNT_KNOB_PARAM, EXT_MOD_AMOUNT_INPUT, EXT_MOD_AMOUNT_CHANNEL, 10.f, &extModAmountClip, nullptr, CvOperation::MultiplyNormalled},
+      {MIX1_PULSE_KNOB_PARAM, MIX1_PULSE_VCA_INPUT, MIX1_PULSE_VCA_CHANNEL, 10.f, &mix1PulseVcaClip, nullptr, CvOperation::MultiplyNormalled},
+      {SYNC_PHASE_KNOB_PARAM, SYNC_PHASE_INPUT, SYNC_PHASE_CHANNEL, 10.f, &syncPhaseClip, nullptr, CvOperation::Add},
+      {FREQ_KNOB_PARAM, FREQ_INPUT, FREQ_CHANNEL, 8.f, &freqClip, nullptr, CvOperation::Add}
     }} {
 
     setParticipant(this);
     setLightEnum(LINK_STATUS_LIGHT);
 
     config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+    // audio rate modulation targets, smoothed when cards run at the device rate
+    prefilter.inputMask = InputPrefilter::bit(FREQ_INPUT) | InputPrefilter::bit(LINEAR_INPUT) |
+      InputPrefilter::bit(PULSE_WIDTH_INPUT);
     configParam(FREQ_KNOB_PARAM, 0.f, 1.f, 0.5f, "Frequency", " V", 0.f, 8.f);
     configParam(PULSE_WIDTH_KNOB_PARAM, 0.f, 1.f, 0.5f, "Pulse Width", "%", 0.f, 100.f);
     configParam(LINEAR_KNOB_PARAM, 0.f, 1.f, 0.5f, "Linear Mod", " V", 0.f, 10.f, -5.f);
@@ -141,21 +144,21 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
     configParam(MIX1_TRIANGLE_KNOB_PARAM, 0.f, 1.f, 0.f, "Mix1 Triangle", "%", 0.f, 100.f);
     configParam(MIX1_SAW_KNOB_PARAM, 0.f, 1.f, 0.f, "Mix1 Saw", "%", 0.f, 100.f);
 
-    configSwitch(MIX2_PULSE_BUTTON_PARAM, 0.f, 1.f, 0.f, "Mix2 Pulse", {"Off", "On"});
-    configSwitch(MIX2_SAW_BUTTON_PARAM, 0.f, 1.f, 0.f, "Mix2 Saw", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(MIX2_PULSE_BUTTON_PARAM, 0.f, 1.f, 0.f, "Mix2 Pulse", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(MIX2_SAW_BUTTON_PARAM, 0.f, 1.f, 0.f, "Mix2 Saw", {"Off", "On"});
 
-    configButton(EXT_MOD_SELECT_SWITCH_UP_PARAM, "Next");
-    configButton(EXT_MOD_SELECT_SWITCH_DOWN_PARAM, "Previous");
+    configButton<NotifyingButtonQuantity>(EXT_MOD_SELECT_SWITCH_UP_PARAM, "Next");
+    configButton<NotifyingButtonQuantity>(EXT_MOD_SELECT_SWITCH_DOWN_PARAM, "Previous");
     configParam(EXT_MOD_AMOUNT_KNOB_PARAM, 0.f, 1.f, 1.f, "External Mod Level", "%", 0.f, 100.f);
-    configSwitch(EXT_MOD_PWM_BUTTON_PARAM, 0.f, 1.f, 0.f, "Ext Mod to PWM", {"Off", "On"});
-    configSwitch(EXP_FM_BUTTON_PARAM, 0.f, 1.f, 0.f, "Ext Mod to Exp FM", {"Off", "On"});
-    configSwitch(LINEAR_FM_BUTTON_PARAM, 0.f, 1.f, 0.f, "Ext Mod to Linear FM", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(EXT_MOD_PWM_BUTTON_PARAM, 0.f, 1.f, 0.f, "Ext Mod to PWM", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(EXP_FM_BUTTON_PARAM, 0.f, 1.f, 0.f, "Ext Mod to Exp FM", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(LINEAR_FM_BUTTON_PARAM, 0.f, 1.f, 0.f, "Ext Mod to Linear FM", {"Off", "On"});
 
     configParam(SYNC_PHASE_KNOB_PARAM, 0.f, 1.f, 0.5f, "Sync Phase", "%", 0.f, 100.f);
-    configSwitch(SYNC_NEG_BUTTON_PARAM, 0.f, 1.f, 0.f, "Neg", {"Off", "On"});
-    configSwitch(SYNC_POS_BUTTON_PARAM, 0.f, 1.f, 0.f, "Pos", {"Off", "On"});
-    configSwitch(SYNC_HARD_BUTTON_PARAM, 0.f, 1.f, 0.f, "Hard", {"Off", "On"});
-    configSwitch(SYNC_SOFT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Soft", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(SYNC_NEG_BUTTON_PARAM, 0.f, 1.f, 0.f, "Neg", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(SYNC_POS_BUTTON_PARAM, 0.f, 1.f, 0.f, "Pos", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(SYNC_HARD_BUTTON_PARAM, 0.f, 1.f, 0.f, "Hard", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(SYNC_SOFT_BUTTON_PARAM, 0.f, 1.f, 0.f, "Soft", {"Off", "On"});
 
     configInput(SYNC_PHASE_INPUT, "Sync Phase");
     configInput(FREQ_INPUT, "Pitch CV");
@@ -167,6 +170,7 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
     configInput(LINEAR_INPUT, "Linear FM");
 
     configLight(LINK_STATUS_LIGHT, "Connection Status");
+    watchParamChanges(this, getParamChanges());
 
     output1NameString.reserve(16);
     output1NameString = invalidCardOutputName;
@@ -184,15 +188,13 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
   }
 
   void pullSamples(const rack::engine::Module::ProcessArgs &args, dsp::Frame<maxAudioChannels> &sharedFrame, int offset) override {
-    static constexpr float clipTime = 0.25f;
-
     processCvRoutes(routes.data(),
                     routes.size(),
-                    clipTime,
                     offset,
                     sharedFrame.samples,
                     params.data(),
-                    inputs.data());
+                    inputs.data(),
+                    &prefilter);
 
     inputModWeight = sharedFrame.samples[offset + EXT_MOD_AMOUNT_CHANNEL];
     output1Weight = std::max(sharedFrame.samples[offset + MIX1_PULSE_VCA_CHANNEL],
@@ -201,28 +203,19 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
   }
 
 
-  bool pullMidi(const rack::engine::Module::ProcessArgs &args, uint32_t clockDivision, int midiChannel, midi::Message &midiMessage) override {
-    bool midiMsgSet = false;
-
-    // check if selector gets the midi message.  If not the button controller runs.
-    // actually -- maybe that's backwards.  Try button controller first.
-
-    // the last entry of buttonParamToMidiProgramList is handled here:
+  void pullMidi(const rack::engine::Module::ProcessArgs &args, int midiChannel, uint64_t changedParams, MidiBatch &batch) override {
+    // the ext mod selector is handled here, the buttons by the controller:
     // add/subtract the up/down buttons
-    int up_param = params[EXT_MOD_SELECT_SWITCH_UP_PARAM].getValue();
-    int down_param = params[EXT_MOD_SELECT_SWITCH_DOWN_PARAM].getValue();
-    // lights will get lit for one frame-- once they're set they
-    // are immediately unset on the next pullMidi()
-    lights[EXT_MOD_SELECT_SWITCH_UP_LIGHT].setBrightness(up_param);
-    lights[EXT_MOD_SELECT_SWITCH_DOWN_LIGHT].setBrightness(down_param);
-
-    if (up_param) {
+    lightOnPress(params[EXT_MOD_SELECT_SWITCH_UP_PARAM], lights[EXT_MOD_SELECT_SWITCH_UP_LIGHT]);
+    lightOnPress(params[EXT_MOD_SELECT_SWITCH_DOWN_PARAM], lights[EXT_MOD_SELECT_SWITCH_DOWN_LIGHT]);
+
+    if (params[EXT_MOD_SELECT_SWITCH_UP_PARAM].getValue()) {
       params[EXT_MOD_SELECT_SWITCH_UP_PARAM].setValue(0);
       extModSelectSwitchValue =
         extModSelectSwitchValue >= 12 ? 0 : extModSelectSwitchValue + 1;
       extModSelectChanged = true;
     }
-    if (down_param) {
+    if (params[EXT_MOD_SELECT_SWITCH_DOWN_PARAM].getValue()) {
       params[EXT_MOD_SELECT_SWITCH_DOWN_PARAM].setValue(0);
       extModSelectSwitchValue =
         extModSelectSwitchValue <= 0 ? 12 : extModSelectSwitchValue - 1;
@@ -230,20 +223,22 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
     }
 
     if (extModSelectChanged) {
-      extModSelectChanged = false;
-      setMidiProgramChangeMessage(midiMessage, midiChannel, extModSelectMidiPrograms[extModSelectSwitchValue]);
-      midiMsgSet = true;
+      // kept for the next scan if the batch is full
+      extModSelectChanged = !batch.pushProgramChange(midiChannel, extModSelectMidiPrograms[extModSelectSwitchValue],
+                                                     buttonMidiController.numSelectors());
+      if (extModSelectChanged) {
+        getParamChanges().mark(EXT_MOD_SELECT_SWITCH_UP_PARAM);
+      }
       if (lifecycle.nameService != nullptr) {
         modulationInputNameString = *lifecycle.nameService->getNamePtr(extModSelectSwitchValue);
       }
     }
 
+    buttonMidiController.process(this, midiChannel, changedParams, batch, getParamChanges());
+  }
+
 
-    // all buttons outside of the above selector are handled here
-    if (!midiMsgSet) {
-      midiMsgSet = buttonMidiController.process(this, midiChannel, midiMessage);
-    }
-    // lights may lead midi messages if above buttons are skipped on this clock.  oh well.
+  void updateLights(float lightTime) override {
     buttonMidiController.updateLights(this);
 
     // weight for the visualizer
@@ -257,34 +252,26 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
 
     // Then clipping lights.
     // clipping light timer
-    const float lightTime = args.sampleTime * clockDivision;
     const float brightnessDeltaTime = 1 / lightTime;
 
-    syncPhaseClipTimer -= lightTime;
-    lights[SYNC_PHASE_CLIP_LIGHT].setBrightnessSmooth(syncPhaseClipTimer > 0.f, brightnessDeltaTime);
+    lights[EXT_MOD_SELECT_SWITCH_UP_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[EXT_MOD_SELECT_SWITCH_DOWN_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
 
-    freqClipTimer -= lightTime;
-    lights[FREQ_CLIP_LIGHT].setBrightnessSmooth(freqClipTimer > 0.f, brightnessDeltaTime);
+    lights[SYNC_PHASE_CLIP_LIGHT].setBrightnessSmooth(syncPhaseClip.update(lightTime), brightnessDeltaTime);
 
-    mix1PulseVcaClipTimer -= lightTime;
-    lights[MIX1_PULSE_CLIP_LIGHT].setBrightnessSmooth(mix1PulseVcaClipTimer > 0.f, brightnessDeltaTime);
+    lights[FREQ_CLIP_LIGHT].setBrightnessSmooth(freqClip.update(lightTime), brightnessDeltaTime);
 
-    extModAmountClipTimer -= lightTime;
-    lights[EXT_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(extModAmountClipTimer > 0.f, brightnessDeltaTime);
+    lights[MIX1_PULSE_CLIP_LIGHT].setBrightnessSmooth(mix1PulseVcaClip.update(lightTime), brightnessDeltaTime);
 
-    mix1TriangleVcaClipTimer -= lightTime;
-    lights[MIX1_TRIANGLE_CLIP_LIGHT].setBrightnessSmooth(mix1TriangleVcaClipTimer > 0.f, brightnessDeltaTime);
+    lights[EXT_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(extModAmountClip.update(lightTime), brightnessDeltaTime);
 
-    mix1SawVcaClipTimer -= lightTime;
-    lights[MIX1_SAW_CLIP_LIGHT].setBrightnessSmooth(mix1SawVcaClipTimer > 0.f, brightnessDeltaTime);
+    lights[MIX1_TRIANGLE_CLIP_LIGHT].setBrightnessSmooth(mix1TriangleVcaClip.update(lightTime), brightnessDeltaTime);
 
-    pulseWidthClipTimer -= lightTime;
-    lights[PULSE_WIDTH_CLIP_LIGHT].setBrightnessSmooth(pulseWidthClipTimer > 0.f, brightnessDeltaTime);
+    lights[MIX1_SAW_CLIP_LIGHT].setBrightnessSmooth(mix1SawVcaClip.update(lightTime), brightnessDeltaTime);
 
-    linearClipTimer -= lightTime;
-    lights[LINEAR_CLIP_LIGHT].setBrightnessSmooth(linearClipTimer > 0.f, brightnessDeltaTime);
+    lights[PULSE_WIDTH_CLIP_LIGHT].setBrightnessSmooth(pulseWidthClip.update(lightTime), brightnessDeltaTime);
 
-    return midiMsgSet;
+    lights[LINEAR_CLIP_LIGHT].setBrightnessSmooth(linearClip.update(lightTime), brightnessDeltaTime);
   }
 
 
@@ -331,6 +318,19 @@ struct Zoxnoxious3340 final : ParticipantAdapter, Participant {
   }
 
 
+  size_t pullCardState(uint8_t *programs, size_t maxPrograms) override {
+    size_t count = buttonMidiController.pullPrograms(this, programs, maxPrograms);
+    if (count < maxPrograms) {
+      programs[count++] = extModSelectMidiPrograms[extModSelectSwitchValue];
+      extModSelectChanged = false;
+      if (lifecycle.nameService != nullptr) {
+        modulationInputNameString = *lifecycle.nameService->getNamePtr(extModSelectSwitchValue);
+      }
+    }
+    return count;
+  }
+
+
 
 private:
 
@@ -355,7 +355,7 @@ private:
 
 
 
-struct Zoxnoxious3340Widget : ModuleWidget {
+struct Zoxnoxious3340Widget : ParticipantWidget {
 
   Zoxnoxious3340Widget(Zoxnoxious3340* module) {
     setModule(module);
@@ -103,14 +103,14 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
   };
 
 
-  float noiseClipTimer = 0.f;
-  float modAmountClipTimer = 0.f;
-  float sourceOneLevelClipTimer = 0.f;
-  float sourceTwoLevelClipTimer = 0.f;
-  float outputPanClipTimer = 0.f;
-  float cutoffClipTimer = 0.f;
-  float resonanceClipTimer = 0.f;
-  float outputVcaClipTimer = 0.f;
+  ClipIndicator noiseClip;
+  ClipIndicator modAmountClip;
+  ClipIndicator sourceOneLevelClip;
+  ClipIndicator sourceTwoLevelClip;
+  ClipIndicator outputPanClip;
+  ClipIndicator cutoffClip;
+  ClipIndicator resonanceClip;
+  ClipIndicator outputVcaClip;
 
   std::string source1NameString;
   std::string source2NameString;
@@ -137,24 +137,26 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
     output1NameString(invalidCardOutputName), output2NameString(invalidCardOutputName),
     buttonMidiController(buttonMappings),
     routes{{
-      {NOISE_KNOB_PARAM, NOISE_LEVEL_INPUT, NOISE_LEVEL, 10.f, &noiseClipTimer, nullptr, CvOperation::Add},
-      {OUTPUT_PAN_KNOB_PARAM, OUTPUT_PAN_INPUT, OUTPUT_PAN, 10.f, &outputPanClipTimer, nullptr, CvOperation::Add},
-      {RESONANCE_KNOB_PARAM, RESONANCE_INPUT, RESONANCE, 10.f, &resonanceClipTimer, dualLinearSwitch0_8, CvOperation::Add},
-      {FILTER_VCA_KNOB_PARAM, FILTER_VCA_INPUT, FILTER_VCA, 10.f, &outputVcaClipTimer, nullptr, CvOperation::Add},
-      {CUTOFF_KNOB_PARAM, CUTOFF_INPUT, CUTOFF, 10.f, &cutoffClipTimer, nullptr, CvOperation::Add},
-      {SOURCE_ONE_LEVEL_KNOB_PARAM, SOURCE_ONE_LEVEL_INPUT, SOURCE_ONE_LEVEL, 10.f, &sourceOneLevelClipTimer, nullptr, CvOperation::Add},
-      {SOURCE_TWO_LEVEL_KNOB_PARAM, SOURCE_TWO_LEVEL_INPUT, SOURCE_TWO_LEVEL, 10.f, &sourceTwoLevelClipTimer, nullptr, CvOperation::Add},
-      {MOD_AMOUNT_KNOB_PARAM, MOD_AMOUNT_INPUT, MOD_AMOUNT, 10.f, &modAmountClipTimer, nullptr, CvOperation::Add} }} {
+      {NOISE_KNOB_PARAM, NOISE_LEVEL_INPUT, NOISE_LEVEL, 10.f, &noiseClip, nullptr, CvOperation::Add},
+      {OUTPUT_PAN_KNOB_PARAM, OUTPUT_PAN_INPUT, OUTPUT_PAN, 10.f, &outputPanClip, nullptr, CvOperation::Add},
+      {RESONANCE_KNOB_PARAM, RESONANCE_INPUT, RESONANCE, 10.f, &resonanceClip, dualLinearSwitch0_8, CvOperation::Add},
+      {FILTER_VCA_KNOB_PARAM, FILTER_VCA_INPUT, FILTER_VCA, 10.f, &outputVcaClip, nullptr, CvOperation::Add},
+      {CUTOFF_KNOB_PARAM, CUTOFF_INPUT, CUTOFF, 10.f, &cutoffClip, nullptr, CvOperation::Add},
+      {SOURCE_ONE_LEVEL_KNOB_PARAM, SOURCE_ONE_LEVEL_INPUT, SOURCE_ONE_LEVEL, 10.f, &sourceOneLevelClip, nullptr, CvOperation::Add},
+      {SOURCE_TWO_LEVEL_KNOB_PARAM, SOURCE_TWO_LEVEL_INPUT, SOURCE_TWO_LEVEL, 10.f, &sourceTwoLevelClip, nullptr, CvOperation::Add},
+      {MOD_AMOUNT_KNOB_PARAM, MOD_AMOUNT_INPUT, MOD_AMOUNT, 10.f, &modAmountClip, nullptr, CvOperation::Add} }} {
 
     setParticipant(this);
     setLightEnum(RIGHT_EXPANDER_LIGHT);
 
 
     config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
-    configButton(SOURCE_ONE_DOWN_BUTTON_PARAM, "Previous");
-    configButton(SOURCE_ONE_UP_BUTTON_PARAM, "Next");
-    configButton(SOURCE_TWO_DOWN_BUTTON_PARAM, "Previous");
-    configButton(SOURCE_TWO_UP_BUTTON_PARAM, "Next");
+    // audio rate modulation targets, smoothed when cards run at the device rate
+    prefilter.inputMask = InputPrefilter::bit(CUTOFF_INPUT) | InputPrefilter::bit(RESONANCE_INPUT);
+    configButton<NotifyingButtonQuantity>(SOURCE_ONE_DOWN_BUTTON_PARAM, "Previous");
+    configButton<NotifyingButtonQuantity>(SOURCE_ONE_UP_BUTTON_PARAM, "Next");
+    configButton<NotifyingButtonQuantity>(SOURCE_TWO_DOWN_BUTTON_PARAM, "Previous");
+    configButton<NotifyingButtonQuantity>(SOURCE_TWO_UP_BUTTON_PARAM, "Next");
 
     configParam(MOD_AMOUNT_KNOB_PARAM, 0.f, 1.f, 0.f, "Modulation Amount", "%", 0.f, 100.f);
     configParam(NOISE_KNOB_PARAM, 0.f, 1.f, 0.f, "White Noise", "%", 0.f, 100.f);
@@ -165,10 +167,10 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
     configParam(RESONANCE_KNOB_PARAM, 0.f, 1.f, 0.f, "Resonance", "%", 0.f, 100.f);
     configParam(FILTER_VCA_KNOB_PARAM, 0.f, 1.f, 0.f, "Level", "%", 0.f, 100.f);
 
-    configSwitch(FILTER_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "Filter Mod", {"Off", "On"});
-    configSwitch(VCA_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "VCA Mod", {"Off", "On"});
-    configSwitch(REZ_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "Rez Mod", {"Off", "On"});
-    configSwitch(PAN_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "Pan Mod", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(FILTER_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "Filter Mod", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(VCA_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "VCA Mod", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(REZ_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "Rez Mod", {"Off", "On"});
+    configSwitch<NotifyingSwitchQuantity>(PAN_MOD_SWITCH_PARAM, 0.f, 1.f, 0.f, "Pan Mod", {"Off", "On"});
 
     configInput(MOD_AMOUNT_INPUT, "Modulation Amount");
     configInput(NOISE_LEVEL_INPUT, "Noise Level");
@@ -183,93 +185,113 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
     configSwitch(SOURCE_ONE_VALUE_HIDDEN_PARAM, 0.f, 7.f, 0.f, "Source One", {"0", "1", "2", "3", "4", "5", "6", "7"} );
     configSwitch(SOURCE_TWO_VALUE_HIDDEN_PARAM, 0.f, 7.f, 0.f, "Source Two", {"0", "1", "2", "3", "4", "5", "6", "7"} );
 
+    watchParamChanges(this, getParamChanges());
   }
 
   void pullSamples(const rack::engine::Module::ProcessArgs &args, dsp::Frame<maxAudioChannels> &sharedFrame, int offset) override {
-    // clipping
-    static constexpr float clipTime = 0.25f;
+    evaluateRoutes(sharedFrame.samples, offset);
+  }
+
+  // block mode: the routes once a block, ramped from where the last
+  // block ended so a cutoff sweep doesn't step at the block rate
+  static constexpr int numCvChannels = MOD_AMOUNT + 1;
+  float blockEnd[numCvChannels] = {};
+
+  int sampleBlockChannels() const override {
+    return numCvChannels;
+  }
+
+  void pullSampleBlock(const rack::engine::Module::ProcessArgs &args, dsp::Frame<maxAudioChannels> *frames, int numFrames, int offset) override {
+    float target[numCvChannels];
+    evaluateRoutes(target, 0);
+
+    const float step = 1.f / numFrames;
+    for (int i = 0; i < numFrames; ++i) {
+      const float t = (i + 1) * step;
+      float *out = frames[i].samples + offset;
+      for (int c = 0; c < numCvChannels; ++c) {
+        out[c] = blockEnd[c] + t * (target[c] - blockEnd[c]);
+      }
+    }
+    std::copy(target, target + numCvChannels, blockEnd);
+  }
 
+  void evaluateRoutes(float *samples, int offset) {
     processCvRoutes(routes.data(),
                     routes.size(),
-                    clipTime,
                     offset,
-                    sharedFrame.samples,
+                    samples,
                     params.data(),
-                    inputs.data());
+                    inputs.data(),
+                    &prefilter);
 
     // cache for reporting weights.
-    input1Weight = std::max(sharedFrame.samples[offset + SOURCE_ONE_LEVEL],
-                            sharedFrame.samples[offset + MOD_AMOUNT]);
-    input2Weight = sharedFrame.samples[offset + SOURCE_TWO_LEVEL];
-    output1Weight = sharedFrame.samples[offset + FILTER_VCA] *
-      (1.f - sharedFrame.samples[offset + OUTPUT_PAN]);
-    output2Weight = sharedFrame.samples[offset + FILTER_VCA] *
-      sharedFrame.samples[offset + OUTPUT_PAN];
+    input1Weight = std::max(samples[offset + SOURCE_ONE_LEVEL],
+                            samples[offset + MOD_AMOUNT]);
+    input2Weight = samples[offset + SOURCE_TWO_LEVEL];
+    output1Weight = samples[offset + FILTER_VCA] *
+      (1.f - samples[offset + OUTPUT_PAN]);
+    output2Weight = samples[offset + FILTER_VCA] *
+      samples[offset + OUTPUT_PAN];
   }
 
-  bool pullMidi(const rack::engine::Module::ProcessArgs &args, uint32_t clockDivision, int midiChannel, midi::Message &midiMessage) override {
-    const float lightTime = args.sampleTime * clockDivision;
-    const float brightnessDeltaTime = 1 / lightTime;
-
-    // lights first then MIDI messages
-    modAmountClipTimer -= lightTime;
-    lights[MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(modAmountClipTimer > 0.f, brightnessDeltaTime);
+  void pullMidi(const rack::engine::Module::ProcessArgs &args, int midiChannel, uint64_t changedParams, MidiBatch &batch) override {
+    lightOnPress(params[SOURCE_ONE_DOWN_BUTTON_PARAM], lights[SOURCE_ONE_DOWN_BUTTON_LIGHT]);
+    lightOnPress(params[SOURCE_ONE_UP_BUTTON_PARAM], lights[SOURCE_ONE_UP_BUTTON_LIGHT]);
+    lightOnPress(params[SOURCE_TWO_DOWN_BUTTON_PARAM], lights[SOURCE_TWO_DOWN_BUTTON_LIGHT]);
+    lightOnPress(params[SOURCE_TWO_UP_BUTTON_PARAM], lights[SOURCE_TWO_UP_BUTTON_LIGHT]);
+
+    buttonMidiController.process(this, midiChannel, changedParams, batch, getParamChanges());
+
+    handleUpDownSelector(
+      params[SOURCE_ONE_UP_BUTTON_PARAM],
+      params[SOURCE_ONE_DOWN_BUTTON_PARAM],
+      params[SOURCE_ONE_VALUE_HIDDEN_PARAM],
+      7,
+      [&](int i){ return *lifecycle.nameService->getNamePtr(source1Sources[i]); },
+      source1NameString,
+      sourceOneSelectMidiPrograms,
+      batch,
+      midiChannel,
+      buttonMidiController.numSelectors());
+
+    handleUpDownSelector(
+      params[SOURCE_TWO_UP_BUTTON_PARAM],
+      params[SOURCE_TWO_DOWN_BUTTON_PARAM],
+      params[SOURCE_TWO_VALUE_HIDDEN_PARAM],
+      7,
+      [&](int i){ return *lifecycle.nameService->getNamePtr(source2Sources[i]); },
+      source2NameString,
+      sourceTwoSelectMidiPrograms,
+      batch,
+      midiChannel,
+      buttonMidiController.numSelectors() + 1);
+  }
 
-    sourceOneLevelClipTimer -= lightTime;
-    lights[SOURCE_ONE_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceOneLevelClipTimer > 0.f, brightnessDeltaTime);
 
-    sourceTwoLevelClipTimer -= lightTime;
-    lights[SOURCE_TWO_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceTwoLevelClipTimer > 0.f, brightnessDeltaTime);
+  void updateLights(float lightTime) override {
+    const float brightnessDeltaTime = 1 / lightTime;
 
-    outputPanClipTimer -= lightTime;
-    lights[OUTPUT_PAN_CLIP_LIGHT].setBrightnessSmooth(outputPanClipTimer > 0.f, brightnessDeltaTime);
+    lights[MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(modAmountClip.update(lightTime), brightnessDeltaTime);
 
-    cutoffClipTimer -= lightTime;
-    lights[CUTOFF_CLIP_LIGHT].setBrightnessSmooth(cutoffClipTimer > 0.f, brightnessDeltaTime);
+    lights[SOURCE_ONE_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceOneLevelClip.update(lightTime), brightnessDeltaTime);
 
-    resonanceClipTimer -= lightTime;
-    lights[RESONANCE_CLIP_LIGHT].setBrightnessSmooth(resonanceClipTimer > 0.f, brightnessDeltaTime);
+    lights[SOURCE_TWO_LEVEL_CLIP_LIGHT].setBrightnessSmooth(sourceTwoLevelClip.update(lightTime), brightnessDeltaTime);
 
-    outputVcaClipTimer -= lightTime;
-    lights[OUTPUT_VCA_CLIP_LIGHT].setBrightnessSmooth(outputVcaClipTimer > 0.f, brightnessDeltaTime);
+    lights[OUTPUT_PAN_CLIP_LIGHT].setBrightnessSmooth(outputPanClip.update(lightTime), brightnessDeltaTime);
 
-    lights[SOURCE_ONE_DOWN_BUTTON_LIGHT].setBrightness(params[SOURCE_ONE_DOWN_BUTTON_PARAM].getValue());
-    lights[SOURCE_ONE_UP_BUTTON_LIGHT].setBrightness(params[SOURCE_ONE_UP_BUTTON_PARAM].getValue());
-    lights[SOURCE_TWO_DOWN_BUTTON_LIGHT].setBrightness(params[SOURCE_TWO_DOWN_BUTTON_PARAM].getValue());
-    lights[SOURCE_TWO_UP_BUTTON_LIGHT].setBrightness(params[SOURCE_TWO_UP_BUTTON_PARAM].getValue());
+    lights[CUTOFF_CLIP_LIGHT].setBrightnessSmooth(cutoffClip.update(lightTime), brightnessDeltaTime);
 
-    buttonMidiController.updateLights(this);
-    if (buttonMidiController.process(this, midiChannel, midiMessage)) {
-      return true;
-    }
+    lights[RESONANCE_CLIP_LIGHT].setBrightnessSmooth(resonanceClip.update(lightTime), brightnessDeltaTime);
 
-    if (handleUpDownSelector(
-          params[SOURCE_ONE_UP_BUTTON_PARAM],
-          params[SOURCE_ONE_DOWN_BUTTON_PARAM],
-          params[SOURCE_ONE_VALUE_HIDDEN_PARAM],
-          7,
-          [&](int i){ return *lifecycle.nameService->getNamePtr(source1Sources[i]); },
-          source1NameString,
-          sourceOneSelectMidiPrograms,
-          midiMessage,
-          midiChannel)) {
-      return true;
-    }
+    lights[OUTPUT_VCA_CLIP_LIGHT].setBrightnessSmooth(outputVcaClip.update(lightTime), brightnessDeltaTime);
 
-    if (handleUpDownSelector(
-          params[SOURCE_TWO_UP_BUTTON_PARAM],
-          params[SOURCE_TWO_DOWN_BUTTON_PARAM],
-          params[SOURCE_TWO_VALUE_HIDDEN_PARAM],
-          7,
-          [&](int i){ return *lifecycle.nameService->getNamePtr(source2Sources[i]); },
-          source2NameString,
-          sourceTwoSelectMidiPrograms,
-          midiMessage,
-          midiChannel)) {
-      return true;
-    }
+    lights[SOURCE_ONE_DOWN_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[SOURCE_ONE_UP_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[SOURCE_TWO_DOWN_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
+    lights[SOURCE_TWO_UP_BUTTON_LIGHT].setBrightnessSmooth(0.f, brightnessDeltaTime);
 
-    return false;
+    buttonMidiController.updateLights(this);
   }
 
 
@@ -287,6 +309,9 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
   }
 
   void onAttach() override {
+    // the channels were at zero until now: ramp up from there
+    std::fill(std::begin(blockEnd), std::end(blockEnd), 0.f);
+
     if (lifecycle.nameService == nullptr) {
       return;
     }
@@ -301,15 +326,16 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
     auto *ptrSource2 = lifecycle.nameService->getNamePtr( source2Sources[sourceTwoIndex] );
     source1NameString = ptrSource1 ? *ptrSource1 : invalidCardOutputName;
     source2NameString = ptrSource2 ? *ptrSource2 : invalidCardOutputName;
+  }
 
-    // fake out the handleUpDownSelector() to force a MIDI message to be sent
-    params[SOURCE_ONE_VALUE_HIDDEN_PARAM].setValue(
-      params[SOURCE_ONE_VALUE_HIDDEN_PARAM].getValue() - 1.f);
-    params[SOURCE_ONE_UP_BUTTON_PARAM].setValue(1.f);
 
-    params[SOURCE_TWO_VALUE_HIDDEN_PARAM].setValue(
-      params[SOURCE_TWO_VALUE_HIDDEN_PARAM].getValue() - 1.f);
-    params[SOURCE_TWO_UP_BUTTON_PARAM].setValue(1.f);
+  size_t pullCardState(uint8_t *programs, size_t maxPrograms) override {
+    size_t count = buttonMidiController.pullPrograms(this, programs, maxPrograms);
+    if (count + 2 <= maxPrograms) {
+      programs[count++] = sourceOneSelectMidiPrograms[ static_cast<int>(params[SOURCE_ONE_VALUE_HIDDEN_PARAM].getValue()) ];
+      programs[count++] = sourceTwoSelectMidiPrograms[ static_cast<int>(params[SOURCE_TWO_VALUE_HIDDEN_PARAM].getValue()) ];
+    }
+    return count;
   }
 
 
@@ -340,7 +366,7 @@ struct Zoxnoxious3372 final : ParticipantAdapter, Participant {
 
 
 
-struct Zoxnoxious3372Widget : ModuleWidget {
+struct Zoxnoxious3372Widget : ParticipantWidget {
     Zoxnoxious3372Widget(Zoxnoxious3372* module) {
         setModule(module);
         setPanel(createPanel(asset::plugin(pluginInstance, "res/Zoxnoxious3372.svg")));
@@ -34,27 +34,31 @@ Zoxnoxious5524::Zoxnoxious5524() : output1NameString(invalidCardOutputName),
                                output2NameString(invalidCardOutputName),
                                buttonMidiController(buttonMappings),
                                routes{{
-    {VCO_ONE_SAW_KNOB_PARAM, VCO_ONE_SAW_INPUT, VCO_ONE_SAW, 10.f, &vcoOneSawClipTimer, nullptr, CvOperation::MultiplyNormalled},
-    {VCO_ONE_PULSE_KNOB_PARAM, VCO_ONE_PULSE_INPUT, VCO_ONE_PULSE, 10.f, &vcoOnePulseClipTimer, nullptr, CvOperation::MultiplyNormalled},
-    {VCO_TWO_MOD_AMOUNT_KNOB_PARAM, VCO_TWO_MOD_AMOUNT_INPUT, VCO_TWO_MOD_AMOUNT, 10.f, &vcoTwoModAmountClipTimer, nullptr, CvOperation::Add},
-    {VCO_TWO_WAVESHAPE_TZFM_KNOB_PARAM, VCO_TWO_WAVESHAPE_TZFM_INPUT, VCO_TWO_WAVESHAPE_TZFM, 10.f, &vcoTwoWaveshapeTzfmClipTimer, nullptr, CvOperation::Add},
-    {VCO_ONE_PW_KNOB_PARAM,VCO_ONE_PW_INPUT, VCO_ONE_PW, 10.f, &vcoOnePwClipTimer, nullptr, CvOperation::Add},
-    {VCO_ONE_VOCT_KNOB_PARAM, VCO_ONE_VOCT_INPUT, VCO_ONE_VOCT, 8.f, &vcoOneVoctClipTimer, nullptr, CvOperation::Add},
-    {VCO_ONE_LINEAR_KNOB_PARAM, VCO_ONE_LINEAR_INPUT, VCO_ONE_LINEAR, 10.f, &vcoOneLinearClipTimer, nullptr, CvOperation::Add},
-    {VCO_ONE_TRIANGLE_KNOB_PARAM, VCO_ONE_TRIANGLE_INPUT, VCO_ONE_TRIANGLE, 10.f, &vcoOneTriangleClipTimer, nullptr, CvOperation::MultiplyNormalled},
-    {VCF_CUTOFF_KNOB_PARAM,VCF_CUTOFF_INPUT, VCF_CUTOFF, 10.f, &vcfCutoffClipTimer, nullptr, CvOperation::Add},
-    {VCO_TWO_VOCT_KNOB_PARAM, VCO_TWO_VOCT_INPUT, VCO_TWO_VOCT, 6.f, &vcoTwoVoctClipTimer, nullptr, CvOperation::Add},
-    {VCO_ONE_MOD_AMOUNT_KNOB_PARAM, VCO_ONE_MOD_AMOUNT_INPUT, VCO_ONE_MOD_AMOUNT, 10.f, &vcoOneModAmountClipTimer, nullptr, CvOperation::Add},
-    {VCF_RESONANCE_KNOB_PARAM, VCF_RESONANCE_INPUT, VCF_RESONANCE, 10.f, &vcfResonanceClipTimer, dualLinearSwitch0_8, CvOperation::Add},
-    {VCO_TWO_TRI_VCF_KNOB_PARAM, VCO_TWO_TRI_VCF_INPUT, VCO_TWO_TRI_VCF, 10.f, &vcoTwoTriVcfClipTimer, nullptr, CvOperation::Add},
-    {FINAL_GAIN_KNOB_PARAM, FINAL_GAIN_INPUT, FINAL_GAIN, 10.f, &finalGainClipTimer, nullptr, CvOperation::Add},
-    {VCO_TWO_PW_KNOB_PARAM,VCO_TWO_PW_INPUT, VCO_TWO_PW, 10.f, &vcoTwoPwClipTimer, nullptr, CvOperation::Add},
-    {VCO_MIX_KNOB_PARAM, VCO_MIX_INPUT, VCO_MIX, 10.f, &vcoMixClipTimer, nullptr, CvOperation::Add} }} {
+    {VCO_ONE_SAW_KNOB_PARAM, VCO_ONE_SAW_INPUT, VCO_ONE_SAW, 10.f, &vcoOneSawClip, nullptr, CvOperation::MultiplyNormalled},
+    {VCO_ONE_PULSE_KNOB_PARAM, VCO_ONE_PULSE_INPUT, VCO_ONE_PULSE, 10.f, &vcoOnePulseClip, nullptr, CvOperation::MultiplyNormalled},
+    {VCO_TWO_MOD_AMOUNT_KNOB_PARAM, VCO_TWO_MOD_AMOUNT_INPUT, VCO_TWO_MOD_AMOUNT, 10.f, &vcoTwoModAmountClip, nullptr, CvOperation::Add},
+    {VCO_TWO_WAVESHAPE_TZFM_KNOB_PARAM, VCO_TWO_WAVESHAPE_TZFM_INPUT, VCO_TWO_WAVESHAPE_TZFM, 10.f, &vcoTwoWaveshapeTzfmClip, nullptr, CvOperation::Add},
+    {VCO_ONE_PW_KNOB_PARAM,VCO_ONE_PW_INPUT, VCO_ONE_PW, 10.f, &vcoOnePwClip, nullptr, CvOperation::Add},
+    {VCO_ONE_VOCT_KNOB_PARAM, VCO_ONE_VOCT_INPUT, VCO_ONE_VOCT, 8.f, &vcoOneVoctClip, nullptr, CvOperation::Add},
+    {VCO_ONE_LINEAR_KNOB_PARAM, VCO_ONE_LINEAR_INPUT, VCO_ONE_LINEAR, 10.f, &vcoOneLinearClip, nullptr, CvOperation::Add},
+    {VCO_ONE_TRIANGLE_KNOB_PARAM, VCO_ONE_TRIANGLE_INPUT, VCO_ONE_TRIANGLE, 10.f, &vcoOneTriangleClip, nullptr, CvOperation::MultiplyNormalled},
+    {VCF_CUTOFF_KNOB_PARAM,VCF_CUTOFF_INPUT, VCF_CUTOFF, 10.f, &vcfCutoffClip, nullptr, CvOperation::Add},
+    {VCO_TWO_VOCT_KNOB_PARAM, VCO_TWO_VOCT_INPUT, VCO_TWO_VOCT, 6.f, &vcoTwoVoctClip, nullptr, CvOperation::Add},
+    {VCO_ONE_MOD_AMOUNT_KNOB_PARAM, VCO_ONE_MOD_AMOUNT_INPUT, VCO_ONE_MOD_AMOUNT, 10.f, &vcoOneModAmountClip, nullptr, CvOperation::Add},
+    {VCF_RESONANCE_KNOB_PARAM, VCF_RESONANCE_INPUT, VCF_RESONANCE, 10.f, &vcfResonanceClip, dualLinearSwitch0_8, CvOperation::Add},
+    {VCO_TWO_TRI_VCF_KNOB_PARAM, VCO_TWO_TRI_VCF_INPUT, VCO_TWO_TRI_VCF, 10.f, &vcoTwoTriVcfClip, nullptr, CvOperation::Add},
+    {FINAL_GAIN_KNOB_PARAM, FINAL_GAIN_INPUT, FINAL_GAIN, 10.f, &finalGainClip, nullptr, CvOperation::Add},
+    {VCO_TWO_PW_KNOB_PARAM,VCO_TWO_PW_INPUT, VCO_TWO_PW, 10.f, &vcoTwoPwClip, nullptr, CvOperation::Add},
+    {VCO_MIX_KNOB_PARAM, VCO_MIX_INPUT, VCO_MIX, 10.f, &vcoMixClip, nullptr, CvOperation::Add} }} {
 
   setParticipant(this);
   setLightEnum(LINK_STATUS_LIGHT);
 
   config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+  // audio rate modulation targets, smoothed when cards run at the device rate
+  prefilter.inputMask = InputPrefilter::bit(VCO_ONE_VOCT_INPUT) | InputPrefilter::bit(VCO_TWO_VOCT_INPUT) |
+    InputPrefilter::bit(VCO_ONE_LINEAR_INPUT) | InputPrefilter::bit(VCO_ONE_PW_INPUT) |
+    InputPrefilter::bit(VCO_TWO_PW_INPUT) | InputPrefilter::bit(VCF_CUTOFF_INPUT);
   configParam(VCO_ONE_VOCT_KNOB_PARAM, 0.f, 1.f, 0.5f, "Frequency", " V", 0.f, 8.f);
   configParam(VCO_ONE_PW_KNOB_PARAM, 0.f, 1.f, 0.5f, "Pulse Width", "%", 0.f, 100.f);
   configParam(VCO_ONE_LINEAR_KNOB_PARAM, 0.f, 1.f, 0.5f, "Linear Mod", " V", 0.f, 10.f -5.f);
@@ -73,20 +77,20 @@ Zoxnoxious5524::Zoxnoxious5524() : output1NameString(invalidCardOutputName),
   configParam(VCO_TWO_WAVESHAPE_TZFM_KNOB_PARAM, 0.f, 1.f, 0.f, "Waveshape TZFM", "%", 0.f, 100.f);
   configParam(VCO_TWO_TRI_VCF_KNOB_PARAM, 0.f, 1.f, 0.f, "Tri to VCF", "%", 0.f, 100.f);
 
-  configSwitch(VCO_ONE_TO_EXP_FM_VCO_TWO_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to Exp FM VCO Two", {"Off", "On"});
-  configSwitch(VCO_ONE_TO_WAVE_SELECT_VCO_TWO_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to Wave Select VCO Two", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_ONE_TO_EXP_FM_VCO_TWO_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to Exp FM VCO Two", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_ONE_TO_WAVE_SELECT_VCO_TWO_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to Wave Select VCO Two", {"Off", "On"});
 
-  configSwitch(VCO_TWO_TO_FREQ_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two to TZ-FM VCO One", {"Off", "On"});
-  configSwitch(VCO_TWO_TO_SOFT_SYNC_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "Soft Sync VCO One from VCO Two", {"Off", "On"});
-  configSwitch(VCO_TWO_TO_HARD_SYNC_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "Hard Sub Sync VCO One from VCO Two", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_TO_FREQ_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two to TZ-FM VCO One", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_TO_SOFT_SYNC_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "Soft Sync VCO One from VCO Two", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_TO_HARD_SYNC_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "Hard Sub Sync VCO One from VCO Two", {"Off", "On"});
 
-  configSwitch(VCO_ONE_TO_PW_VCO_TWO_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to VCO Two Pulse Width", {"Off", "On"});
-  configSwitch(VCO_ONE_TO_VCF_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to VCF Freq Cutoff", {"Off", "On"});
-  configSwitch(VCO_TWO_TO_PW_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two to VCO One Pulse Width", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_ONE_TO_PW_VCO_TWO_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to VCO Two Pulse Width", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_ONE_TO_VCF_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO One to VCF Freq Cutoff", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_TO_PW_VCO_ONE_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two to VCO One Pulse Width", {"Off", "On"});
 
-  configSwitch(VCO_TWO_WAVE_PULSE_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two Pulse Enable", {"Off", "On"});
-  configSwitch(VCO_TWO_WAVE_SAW_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two Sawtooth Enable", {"Off", "On"});
-  configSwitch(VCO_TWO_WAVE_TRI_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two Triangle Enable", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_WAVE_PULSE_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two Pulse Enable", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_WAVE_SAW_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two Sawtooth Enable", {"Off", "On"});
+  configSwitch<NotifyingSwitchQuantity>(VCO_TWO_WAVE_TRI_BUTTON_PARAM, 0.f, 1.f, 0.f, "VCO Two Triangle Enable", {"Off", "On"});
 
   configInput(VCO_ONE_VOCT_INPUT, "VCO One V/Oct");
   configInput(VCO_ONE_PW_INPUT, "VCO One Pulse Width");
@@ -104,6 +108,7 @@ Zoxnoxious5524::Zoxnoxious5524() : output1NameString(invalidCardOutputName),
   configInput(VCO_TWO_MOD_AMOUNT_INPUT, "VCO Two Mod Level");
   configInput(VCO_TWO_WAVESHAPE_TZFM_INPUT, "VCO Two Waveshape to VCO One TZFM");
   configInput(VCO_TWO_TRI_VCF_INPUT, "VCO Two Triangle to VCF Cutoff Frequency");
+  watchParamChanges(this, getParamChanges());
 
   output1NameString.reserve(16);
   output2NameString.reserve(16);
@@ -111,16 +116,14 @@ Zoxnoxious5524::Zoxnoxious5524() : output1NameString(invalidCardOutputName),
 
 
 void Zoxnoxious5524::pullSamples(const rack::engine::Module::ProcessArgs &args, dsp::Frame<maxAudioChannels> &sharedFrame, int offset) {
-  const float clipTime = 0.25f;
-
   // match the channels to what the Pi expects on the other side and it's all good
   processCvRoutes(routes.data(),
                   routes.size(),
-                  clipTime,
                   offset,
                   sharedFrame.samples,
                   params.data(),
-                  inputs.data());
+                  inputs.data(),
+                  &prefilter);
 
   // VCO Two PW
   // Note Pulse Width handles enable/disable
@@ -143,14 +146,34 @@ void Zoxnoxious5524::pullSamples(const rack::engine::Module::ProcessArgs &args,
 }
 
 
-bool Zoxnoxious5524::pullMidi(const rack::engine::Module::ProcessArgs &args, uint32_t clockDivision, int midiChannel, midi::Message &midiMessage) {
-  bool midiMsgSet = false;
+void Zoxnoxious5524::pullMidi(const rack::engine::Module::ProcessArgs &args, int midiChannel, uint64_t changedParams, MidiBatch &batch) {
+  // convert the saw & tri params to the MIDI prog change number with four options
+  if (changedParams & (ChangeMask::bit(VCO_TWO_WAVE_SAW_BUTTON_PARAM) | ChangeMask::bit(VCO_TWO_WAVE_TRI_BUTTON_PARAM))) {
+    int vcoTwoSaw = params[VCO_TWO_WAVE_SAW_BUTTON_PARAM].getValue() > 0.f ? 2 : 0;
+    int vcoTwoTri = params[VCO_TWO_WAVE_TRI_BUTTON_PARAM].getValue() > 0.f ? 1 : 0;
+    int vcoTwoTriSawCurrentState = vcoTwoSaw + vcoTwoTri + vcoTwoSawTriMidiProgramOffset;
+    if (vcoTwoTriSawCurrentState != vcoTwoTriSawPrevState) {
+      // latched once queued, else tried again next scan
+      if (batch.pushProgramChange(midiChannel, vcoTwoTriSawCurrentState, buttonMidiController.numSelectors(),
+                                  MidiPriority::Background)) {
+        vcoTwoTriSawPrevState = vcoTwoTriSawCurrentState;
+      }
+      else {
+        getParamChanges().mark(VCO_TWO_WAVE_SAW_BUTTON_PARAM);
+      }
+    }
+  }
+
+  // all buttons outside of the above selector are handled here
+  buttonMidiController.process(this, midiChannel, changedParams, batch, getParamChanges());
+}
+
+
+void Zoxnoxious5524::updateLights(float lightTime) {
   bool shapedOn = (params[VCO_TWO_WAVESHAPE_TZFM_KNOB_PARAM].getValue() + inputs[VCO_TWO_WAVESHAPE_TZFM_INPUT].getVoltage() / 10.f) > 0.f;
   bool tzfmDirectOn = params[VCO_TWO_TO_FREQ_VCO_ONE_BUTTON_PARAM].getValue() > 0.5f &&
     (params[VCO_TWO_MOD_AMOUNT_KNOB_PARAM].getValue() + inputs[VCO_TWO_MOD_AMOUNT_INPUT].getVoltage() / 10.f) > 0.f;
 
-  // pullMidi runs at something better than display frame rate, so all UI visual stuff is here
-
   // the pulse doesn't send any midi-- it just allows or limits the pulse width
   if (params[VCO_TWO_WAVE_PULSE_BUTTON_PARAM].getValue() > 0.f) {
     lights[VCO_TWO_WAVE_PULSE_BUTTON_LIGHT].setBrightness(1.f);
@@ -163,101 +186,63 @@ bool Zoxnoxious5524::pullMidi(const rack::engine::Module::ProcessArgs &args, uin
     lights[WAVESHAPE_PULSE_STATUS_LIGHT].setBrightness(0.f);
   }
 
-  int vcoTwoSaw;
-  int vcoTwoTri;
   if (params[VCO_TWO_WAVE_SAW_BUTTON_PARAM].getValue() > 0.f) {
-    vcoTwoSaw = 2;
     lights[VCO_TWO_WAVE_SAW_BUTTON_LIGHT].setBrightness(1.f);
     lights[TZFM_SAW_STATUS_LIGHT].setBrightness( tzfmDirectOn ? 1.f : 0.25f );
     lights[WAVESHAPE_HALFSINE_STATUS_LIGHT].setBrightness( shapedOn ? 1.f : 0.25f );
   } else {
-    vcoTwoSaw = 0;
     lights[VCO_TWO_WAVE_SAW_BUTTON_LIGHT].setBrightness(0.f);
     lights[TZFM_SAW_STATUS_LIGHT].setBrightness(0.f);
     lights[WAVESHAPE_HALFSINE_STATUS_LIGHT].setBrightness(0.f);
   }
 
   if (params[VCO_TWO_WAVE_TRI_BUTTON_PARAM].getValue() > 0.f) {
-    vcoTwoTri = 1;
     lights[VCO_TWO_WAVE_TRI_BUTTON_LIGHT].setBrightness(1.f);
     lights[TZFM_TRI_STATUS_LIGHT].setBrightness( tzfmDirectOn ? 1.f : 0.25f );
     lights[WAVESHAPE_SINE_STATUS_LIGHT].setBrightness( shapedOn ? 1.f : 0.25f );
   } else {
-    vcoTwoTri = 0;
     lights[VCO_TWO_WAVE_TRI_BUTTON_LIGHT].setBrightness(0.f);
     lights[TZFM_TRI_STATUS_LIGHT].setBrightness(0.f);
     lights[WAVESHAPE_SINE_STATUS_LIGHT].setBrightness(0.f);
   }
 
-  // convert the saw & tri params to the MIDI prog change number with four options
-  int vcoTwoTriSawCurrentState = vcoTwoSaw + vcoTwoTri + vcoTwoSawTriMidiProgramOffset;
-  if (vcoTwoTriSawCurrentState != vcoTwoTriSawPrevState) {
-    vcoTwoTriSawPrevState = vcoTwoTriSawCurrentState;
-    setMidiProgramChangeMessage(midiMessage, midiChannel, vcoTwoTriSawCurrentState);
-    midiMsgSet = true;
-  }
-
-
-  // all buttons outside of the above selector are handled here
-  if (!midiMsgSet) {
-    midiMsgSet = buttonMidiController.process(this, midiChannel, midiMessage);
-  }
   buttonMidiController.updateLights(this);
 
 
   // clipping lights and timers
-  const float lightTime = args.sampleTime * clockDivision;
   const float brightnessDeltaTime = 1 / lightTime;
 
-  vcoOneVoctClipTimer -= lightTime;
-  lights[VCO_ONE_VOCT_CLIP_LIGHT].setBrightnessSmooth(vcoOneVoctClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_VOCT_CLIP_LIGHT].setBrightnessSmooth(vcoOneVoctClip.update(lightTime), brightnessDeltaTime);
 
-  vcoOnePwClipTimer -= lightTime;
-  lights[VCO_ONE_PW_CLIP_LIGHT].setBrightnessSmooth(vcoOnePwClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_PW_CLIP_LIGHT].setBrightnessSmooth(vcoOnePwClip.update(lightTime), brightnessDeltaTime);
 
-  vcoOneLinearClipTimer -= lightTime;
-  lights[VCO_ONE_LINEAR_CLIP_LIGHT].setBrightnessSmooth(vcoOneLinearClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_LINEAR_CLIP_LIGHT].setBrightnessSmooth(vcoOneLinearClip.update(lightTime), brightnessDeltaTime);
 
-  vcoTwoVoctClipTimer -= lightTime;
-  lights[VCO_TWO_VOCT_CLIP_LIGHT].setBrightnessSmooth(vcoTwoVoctClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_TWO_VOCT_CLIP_LIGHT].setBrightnessSmooth(vcoTwoVoctClip.update(lightTime), brightnessDeltaTime);
 
-  vcoTwoPwClipTimer -= lightTime;
-  lights[VCO_TWO_PW_CLIP_LIGHT].setBrightnessSmooth(vcoTwoPwClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_TWO_PW_CLIP_LIGHT].setBrightnessSmooth(vcoTwoPwClip.update(lightTime), brightnessDeltaTime);
 
-  vcfCutoffClipTimer -= lightTime;
-  lights[VCF_CUTOFF_CLIP_LIGHT].setBrightnessSmooth(vcfCutoffClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCF_CUTOFF_CLIP_LIGHT].setBrightnessSmooth(vcfCutoffClip.update(lightTime), brightnessDeltaTime);
 
-  vcfResonanceClipTimer -= lightTime;
-  lights[VCF_RESONANCE_CLIP_LIGHT].setBrightnessSmooth(vcfResonanceClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCF_RESONANCE_CLIP_LIGHT].setBrightnessSmooth(vcfResonanceClip.update(lightTime), brightnessDeltaTime);
 
-  vcoMixClipTimer -= lightTime;
-  lights[VCO_MIX_CLIP_LIGHT].setBrightnessSmooth(vcoMixClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_MIX_CLIP_LIGHT].setBrightnessSmooth(vcoMixClip.update(lightTime), brightnessDeltaTime);
 
-  finalGainClipTimer -= lightTime;
-  lights[FINAL_GAIN_CLIP_LIGHT].setBrightnessSmooth(finalGainClipTimer > 0.f, brightnessDeltaTime);
+  lights[FINAL_GAIN_CLIP_LIGHT].setBrightnessSmooth(finalGainClip.update(lightTime), brightnessDeltaTime);
 
-  vcoOnePulseClipTimer -= lightTime;
-  lights[VCO_ONE_PULSE_CLIP_LIGHT].setBrightnessSmooth(vcoOnePulseClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_PULSE_CLIP_LIGHT].setBrightnessSmooth(vcoOnePulseClip.update(lightTime), brightnessDeltaTime);
 
-  vcoOneTriangleClipTimer -= lightTime;
-  lights[VCO_ONE_TRIANGLE_CLIP_LIGHT].setBrightnessSmooth(vcoOneTriangleClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_TRIANGLE_CLIP_LIGHT].setBrightnessSmooth(vcoOneTriangleClip.update(lightTime), brightnessDeltaTime);
 
-  vcoOneSawClipTimer -= lightTime;
-  lights[VCO_ONE_SAW_CLIP_LIGHT].setBrightnessSmooth(vcoOneSawClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_SAW_CLIP_LIGHT].setBrightnessSmooth(vcoOneSawClip.update(lightTime), brightnessDeltaTime);
 
-  vcoOneModAmountClipTimer -= lightTime;
-  lights[VCO_ONE_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(vcoOneModAmountClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_ONE_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(vcoOneModAmountClip.update(lightTime), brightnessDeltaTime);
 
-  vcoTwoModAmountClipTimer -= lightTime;
-  lights[VCO_TWO_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(vcoTwoModAmountClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_TWO_MOD_AMOUNT_CLIP_LIGHT].setBrightnessSmooth(vcoTwoModAmountClip.update(lightTime), brightnessDeltaTime);
 
-  vcoTwoWaveshapeTzfmClipTimer -= lightTime;
-  lights[VCO_TWO_WAVESHAPE_TZFM_CLIP_LIGHT].setBrightnessSmooth(vcoTwoWaveshapeTzfmClipTimer > 0.f, brightnessDeltaTime);
+  lights[VCO_TWO_WAVESHAPE_TZFM_CLIP_LIGHT].setBrightnessSmooth(vcoTwoWaveshapeTzfmClip.update(lightTime), brightnessDeltaTime);
 
-  vcoTwoTriVcfClipTimer -= lightTime;
-  lights[VCO_TWO_TRI_VCF_CLIP_LIGHT].setBrightnessSmooth(vcoTwoTriVcfClipTimer > 0.f, brightnessDeltaTime);
-
-  return midiMsgSet;
+  lights[VCO_TWO_TRI_VCF_CLIP_LIGHT].setBrightnessSmooth(vcoTwoTriVcfClip.update(lightTime), brightnessDeltaTime);
 }
 
 
@@ -302,6 +287,18 @@ void Zoxnoxious5524::onAttach() {
 }
 
 
+size_t Zoxnoxious5524::pullCardState(uint8_t *programs, size_t maxPrograms) {
+  size_t count = buttonMidiController.pullPrograms(this, programs, maxPrograms);
+  if (count < maxPrograms) {
+    int vcoTwoSaw = params[VCO_TWO_WAVE_SAW_BUTTON_PARAM].getValue() > 0.f ? 2 : 0;
+    int vcoTwoTri = params[VCO_TWO_WAVE_TRI_BUTTON_PARAM].getValue() > 0.f ? 1 : 0;
+    vcoTwoTriSawPrevState = vcoTwoSaw + vcoTwoTri + vcoTwoSawTriMidiProgramOffset;
+    programs[count++] = vcoTwoTriSawPrevState;
+  }
+  return count;
+}
+
+
 json_t* Zoxnoxious5524::dataToJson() {
   json_t* rootJ = json_object();
   json_object_set_new(rootJ, "pwLimit", json_integer(pwLimit));
@@ -348,7 +345,7 @@ CouplingDisplayState Zoxnoxious5524::getCouplingDisplayState() {
 }
 
 
-struct Zoxnoxious5524Widget : ModuleWidget {
+struct Zoxnoxious5524Widget : ParticipantWidget {
   Zoxnoxious5524Widget(Zoxnoxious5524* module) {
     setModule(module);
     setPanel(createPanel(asset::plugin(pluginInstance, "res/Zoxnoxious5524.svg")));
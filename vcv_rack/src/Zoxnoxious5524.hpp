@@ -129,22 +129,22 @@ struct Zoxnoxious5524 final : ParticipantAdapter, Participant {
     LIGHTS_LEN
   };
 
-  float vcoOneVoctClipTimer = 0.f;
-  float vcoOnePwClipTimer = 0.f;
-  float vcoOneLinearClipTimer = 0.f;
-  float vcoTwoVoctClipTimer = 0.f;
-  float vcoTwoPwClipTimer = 0.f;
-  float vcfCutoffClipTimer = 0.f;
-  float vcfResonanceClipTimer = 0.f;
-  float vcoMixClipTimer = 0.f;
-  float finalGainClipTimer = 0.f;
-  float vcoOnePulseClipTimer = 0.f;
-  float vcoOneTriangleClipTimer = 0.f;
-  float vcoOneSawClipTimer = 0.f;
-  float vcoOneModAmountClipTimer = 0.f;
-  float vcoTwoModAmountClipTimer = 0.f;
-  float vcoTwoWaveshapeTzfmClipTimer = 0.f;
-  float vcoTwoTriVcfClipTimer = 0.f;
+  ClipIndicator vcoOneVoctClip;
+  ClipIndicator vcoOnePwClip;
+  ClipIndicator vcoOneLinearClip;
+  ClipIndicator vcoTwoVoctClip;
+  ClipIndicator vcoTwoPwClip;
+  ClipIndicator vcfCutoffClip;
+  ClipIndicator vcfResonanceClip;
+  ClipIndicator vcoMixClip;
+  ClipIndicator finalGainClip;
+  ClipIndicator vcoOnePulseClip;
+  ClipIndicator vcoOneTriangleClip;
+  ClipIndicator vcoOneSawClip;
+  ClipIndicator vcoOneModAmountClip;
+  ClipIndicator vcoTwoModAmountClip;
+  ClipIndicator vcoTwoWaveshapeTzfmClip;
+  ClipIndicator vcoTwoTriVcfClip;
 
   std::string output1NameString;
   std::string output2NameString;
@@ -180,13 +180,15 @@ struct Zoxnoxious5524 final : ParticipantAdapter, Participant {
 
   Zoxnoxious5524();
   void pullSamples(const rack::engine::Module::ProcessArgs &args, dsp::Frame<maxAudioChannels> &sharedFrame, int offset) override;
-  bool pullMidi(const rack::engine::Module::ProcessArgs &args, uint32_t clockDivision, int midiChannel, midi::Message &midiMessage) override;
+  void pullMidi(const rack::engine::Module::ProcessArgs &args, int midiChannel, uint64_t changedParams, MidiBatch &batch) override;
+  void updateLights(float lightTime) override;
   bool pullGraphInfo(ParticipantGraphInfo& info) override;
 
   uint8_t getHardwareId() const override;
   int64_t getModuleId() override;
   void onReset(const ResetEvent& e) override;
   void onAttach() override;
+  size_t pullCardState(uint8_t *programs, size_t maxPrograms) override;
 
   json_t* dataToJson() override;
   void dataFromJson(json_t* rootJ) override;
@@ -18,6 +18,16 @@ static constexpr int invalidPrimaryDepth = -1;
 
 static const std::string invalidCardOutputName = "----";
 
+// slow CV time-division multiplexing, see the Pi's midi.spec.  Slow
+// CVs ride in engine frame channels from tdmVirtualChannelBase up until
+// the audio port muxes them onto TDM lanes at the device rate.
+static constexpr int tdmSlotsPerChannel = 8;
+static constexpr int tdmVirtualChannelBase = 32;
+static constexpr int tdmMaxSlowChannels = maxAudioChannels - tdmVirtualChannelBase;
+static constexpr int8_t tdmNoSyncChannel = -1;
+// sync channel value for phase 1: phase * 2048 once the driver converts to int16
+static constexpr float tdmPhaseScale = 1.f / 16.f;
+
 static constexpr uint8_t midiProgramChangeStatus = 0xC;
 
 // for pole mixing modules
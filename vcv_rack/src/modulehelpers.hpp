@@ -1,7 +1,10 @@
 #pragma once
+#include <atomic>
+#include <cmath>
 #include <string>
 #include "constants.hpp"
 #include "plugin.hpp"
+#include "Participant.hpp"
 
 namespace zox {
 
@@ -25,9 +28,15 @@ namespace zox {
 //   buttonStates(buttonMappings.size()),
 //   buttonMidiController(buttonMappings),
 //
-// Then at business time to check the buttons and possibly get midi message set use:
-//    buttonMidiController.process(this, midiChannel, midiMessage);
+// The buttons are configured with NotifyingSwitchQuantity so a click
+// marks them changed, see below.
+// Then at business time to queue a program change for each button that changed:
+//    buttonMidiController.process(this, midiChannel, changedParams, batch, getParamChanges());
+// and in updateLights():
 //    buttonMidiController.updateLights(this);
+// Each button is a selector, numbered by its mapping: selectors of the
+// module's own start from buttonMidiController.numSelectors().  They're
+// queued at Background priority, behind the up/down source selectors.
 
 
 template <typename ModuleT>
@@ -54,32 +63,65 @@ public:
   explicit ButtonMidiController(const std::vector<Mapping>& mappings) :
     mappings(mappings), states(mappings.size()) {}
 
+  // true if anything was queued.  Only buttons with their ChangeMask
+  // bit in changedParams are looked at.  A button is latched once its
+  // program change is queued; with the batch full it's marked in changes
+  // again for the next scan.
   bool process(rack::engine::Module* module,
                int8_t midiChannel,
-               midi::Message& midiOut) {
+               uint64_t changedParams,
+               MidiBatch& batch,
+               ChangeMask& changes) {
+    bool queued = false;
 
     for (size_t i = 0; i < mappings.size(); ++i) {
       const auto& map = mappings[i];
+      if (!(changedParams & ChangeMask::bit(map.param))) {
+        continue;
+      }
       auto& state = states[i];
 
       int curValue = static_cast<int>(module->params[map.param].getValue() + 0.5f);
 
       if (state.latchedValue != curValue) {
-        state.latchedValue = curValue;
-
         if (curValue >= 0 && curValue < static_cast<int>(map.midiPrograms.size())) {
           int8_t program = map.midiPrograms[curValue];
-          setMidiProgramChangeMessage(midiOut, midiChannel, program);
           //INFO("new: button param %zu latched value %d MIDI program %d", i, curValue, program);
-          return true; // only single midi::Message is set per call, so early return here
+          if (batch.pushProgramChange(midiChannel, program, static_cast<int>(i), MidiPriority::Background)) {
+            state.latchedValue = curValue;
+            queued = true;
+          }
+          else {
+            changes.mark(map.param);
+          }
         }
         else {
+          state.latchedValue = curValue;
           WARN("value %d out of range: expected %d : %zu",
                curValue, 0, map.midiPrograms.size() - 1);
         }
       }
     }
-    return false;
+    return queued;
+  }
+
+  int numSelectors() const {
+    return static_cast<int>(mappings.size());
+  }
+
+  // every button's current program, for a Card State.  These count as
+  // sent; process() only sends what changes afterwards.
+  size_t pullPrograms(rack::engine::Module* module, uint8_t* programs, size_t maxPrograms) {
+    size_t count = 0;
+    for (size_t i = 0; i < mappings.size() && count < maxPrograms; ++i) {
+      const auto& map = mappings[i];
+      int curValue = static_cast<int>(module->params[map.param].getValue() + 0.5f);
+      if (curValue >= 0 && curValue < static_cast<int>(map.midiPrograms.size())) {
+        states[i].latchedValue = curValue;
+        programs[count++] = map.midiPrograms[curValue];
+      }
+    }
+    return count;
   }
 
   void updateLights(rack::engine::Module* m) {
@@ -99,13 +141,85 @@ private:
 
 
 //----------------------------------------------------------------------------
-// helper to read jack+knob and output to an audio frame + manage clip timer.
+// param quantity that marks its param in a ChangeMask when it's set, so
+// the MIDI scan looks at a switch only after a click.  Config the
+// switches and buttons that send MIDI with it:
+//   configSwitch<NotifyingSwitchQuantity>(SYNC_HARD_BUTTON_PARAM, ...);
+//   configButton<NotifyingButtonQuantity>(SOURCE_ONE_UP_BUTTON_PARAM, ...);
+// and once config is done point them at the mask:
+//   watchParamChanges(this, getParamChanges());
+// Values set around the quantity (undo, MIDI-Map, another module through
+// the engine) aren't seen; OutputInterface's sweep catches those.
+
+struct ChangeNotifier {
+  ChangeMask* changes = nullptr;
+};
+
+template <typename BaseQuantity>
+struct NotifyingQuantity : BaseQuantity, ChangeNotifier {
+  void setValue(float value) override {
+    BaseQuantity::setValue(value);
+    if (changes) {
+      changes->mark(this->paramId);
+    }
+  }
+};
+
+using NotifyingSwitchQuantity = NotifyingQuantity<rack::engine::SwitchQuantity>;
+using NotifyingButtonQuantity = NotifyingQuantity<rack::engine::ParamQuantity>;
+
+inline void watchParamChanges(rack::engine::Module* module, ChangeMask& changes) {
+  for (rack::engine::ParamQuantity* pq : module->paramQuantities) {
+    if (auto* notifier = dynamic_cast<ChangeNotifier*>(pq)) {
+      notifier->changes = &changes;
+    }
+  }
+}
+
+
+
+//----------------------------------------------------------------------------
+// a clip light.  The audio thread says the signal clipped with set(), the
+// UI thread lights it for holdTime after in updateLights():
+//   lights[CUTOFF_CLIP_LIGHT].setBrightnessSmooth(cutoffClip.update(lightTime), ...);
+// Only the flag is shared; the timer is the UI thread's.
+
+struct ClipIndicator {
+  static constexpr float holdTime = 0.25f;
+
+  // audio thread, every sample it clips: a store only when it changes
+  void set() {
+    if (!clipped.load(std::memory_order_relaxed)) {
+      clipped.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  // UI thread, deltaTime seconds since the last call: true while lit
+  bool update(float deltaTime) {
+    if (clipped.exchange(false, std::memory_order_relaxed)) {
+      timer = holdTime;
+    }
+    else if (timer > 0.f) {
+      timer -= deltaTime;
+    }
+    return timer > 0.f;
+  }
+
+private:
+  std::atomic<bool> clipped { false };
+  float timer = 0.f;
+};
+
+
+
+//----------------------------------------------------------------------------
+// helper to read jack+knob and output to an audio frame + manage clip light.
 // I had this sprinkled all over:
 //
 //  v = params[CUTOFF_KNOB_PARAM].getValue() + inputs[CUTOFF_INPUT].getVoltage() / 10.f;
 //  controlMsg->frame[outputDeviceId].samples[cvChannelOffset + CUTOFF] = clamp(v, 0.f, 1.f);
 //  if (controlMsg->frame[outputDeviceId].samples[cvChannelOffset + CUTOFF] != v) {
-//      cutoffClipTimer = clipTime;
+//      cutoffClip.set();
 //  }
 //
 // This helper avoid the pattern.  To use:
@@ -113,11 +227,10 @@ private:
 //   std::array<CvRoute,8> routes;
 // then initialize it:
 //    routes{{
-//      {LINEAR_KNOB_PARAM, LINEAR_INPUT, LINEAR_CHANNEL, &linearClipTimer, nullptr} ...
+//      {LINEAR_KNOB_PARAM, LINEAR_INPUT, LINEAR_CHANNEL, 10.f, &linearClip, nullptr, CvOperation::Add} ...
 // call it to fill in samples in audio frame:
 // processCvRoutes(routes.data(),
 //             routes.size(),
-//             clipTime,
 //             offset,
 //             sharedFrame.samples,
 //             params.data(),
@@ -136,24 +249,81 @@ struct CvRoute {
   int inputId;
   int channel;
   float divisor;
-  float* timer;
+  ClipIndicator* clip;
   CvTransform transform; // may be nullptr for identity transform
   CvOperation op;
 };
 
+//----------------------------------------------------------------------------
+// anti-alias prefilter for inputs that may carry audio rate modulation
+// (pitch, pulse width, cutoff), for when OutputInterface evaluates cards
+// once per device frame instead of every engine sample.  A one-pole
+// lowpass at a quarter of the device rate, run every engine sample by
+// ParticipantAdapter::process().  Inputs without it are read as-is.
+// To use, mark the inputs in the module's constructor:
+//   prefilter.inputMask = InputPrefilter::bit(FREQ_INPUT) | ...
+// and pass &prefilter as processCvRoutes' last argument.
+
+struct InputPrefilter {
+  static constexpr int maxInputs = 32;
+  static constexpr uint32_t bit(int inputId) { return 1u << inputId; }
+
+  uint32_t inputMask = 0;
+
+  // engine samples per card evaluation, 1 when off
+  void process(const Input* inputs, int division) {
+    if (division <= 1 || inputMask == 0) {
+      if (lastDivision != 1) {
+        lastDivision = 1;
+        active.store(false, std::memory_order_relaxed);
+      }
+      return;
+    }
+
+    const bool restart = division != lastDivision;
+    if (restart) {
+      lastDivision = division;
+      coefficient = 1.f - std::exp(-2.f * static_cast<float>(M_PI) * 0.25f / division);
+    }
+    for (uint32_t mask = inputMask; mask; mask &= mask - 1) {
+      const int id = __builtin_ctz(mask);
+      const float v = inputs[id].getVoltage();
+      state[id] = restart ? v : state[id] + coefficient * (v - state[id]);
+      filtered[id].store(state[id], std::memory_order_relaxed);
+    }
+    active.store(true, std::memory_order_relaxed);
+  }
+
+  // any thread: the card pulling samples may run beside the module
+  float getVoltage(const Input* inputs, int inputId) const {
+    if (active.load(std::memory_order_relaxed) && (inputMask & bit(inputId))) {
+      return filtered[inputId].load(std::memory_order_relaxed);
+    }
+    return inputs[inputId].getVoltage();
+  }
+
+private:
+  int lastDivision = 1;
+  float coefficient = 1.f;
+  float state[maxInputs] = {};
+  std::atomic<float> filtered[maxInputs] = {};
+  std::atomic<bool> active { false };
+};
+
+
 inline void processCvRoutes(
     const CvRoute* routes,
     int count,
-    float clipTime,
     int cvChannelOffset,
     float* frame,
     Param* params,
-    Input* inputs)
+    Input* inputs,
+    const InputPrefilter* prefilter = nullptr)
 {
   for (int i = 0; i < count; ++i) {
     const auto& r = routes[i];
     float knob = params[r.knobParam].getValue();
-    float in = inputs[r.inputId].getVoltage() / r.divisor;
+    float in = (prefilter ? prefilter->getVoltage(inputs, r.inputId) : inputs[r.inputId].getVoltage()) / r.divisor;
     float v;
     switch (r.op) {
       case CvOperation::Add:
@@ -175,7 +345,7 @@ inline void processCvRoutes(
     frame[cvChannelOffset + r.channel] = clamped;
 
     if (clipped) {
-      *r.timer = clipTime;
+      r.clip->set();
     }
   }
 }
@@ -186,13 +356,25 @@ inline float dualLinearSwitch0_8(float v) {
 
 
 
+//----------------------------------------------------------------------------
+// sysex reports from the Pi carry 28 bit two's complement values as four
+// 7 bit bytes, most significant first (see midi.spec)
+
+inline int32_t decodeSysex28(const uint8_t *bytes) {
+  uint32_t bits = (bytes[0] & 0x7F) << 21 | (bytes[1] & 0x7F) << 14 | (bytes[2] & 0x7F) << 7 | (bytes[3] & 0x7F);
+  return static_cast<int32_t>(bits << 4) >> 4;
+}
+
+
+
 
 //----------------------------------------------------------------------------
 // Helper functions for up/down param selector switching.
 // used where an up button/down button combo sets a +1/-1 to a state.
-// A string is set based on the new value, and the passed on midi
-// message populated with a payload.  Unlike other helpers this does
-// not take the light arg; any button lights to be lit by the caller
+// A string is set based on the new value, and the program change
+// queued on the batch as selector; nothing moves until it's queued.
+// Unlike other helpers this does not take the light arg; any button
+// lights to be lit by the caller
 //
 
 inline int wrapIncrement(int value, int delta, int max) {
@@ -214,27 +396,29 @@ template <typename NameLookup> inline bool handleUpDownSelector(
   NameLookup nameLookup,
   std::string& nameString,
   const int8_t* midiPrograms,
-  rack::midi::Message& midiMessage,
-  int8_t midiChannel) {
+  MidiBatch& batch,
+  int8_t midiChannel,
+  int selector) {
 
-  int delta = 0;
+  const bool up = upButton.getValue();
+  const bool down = downButton.getValue();
 
-  if (upButton.getValue()) {
-    upButton.setValue(0.f);
-    delta += 1;
+  if (!up && !down) {
+    return false;
   }
 
-  if (downButton.getValue()) {
-    downButton.setValue(0.f);
-    delta -= 1;
-  }
+  int value = static_cast<int>(valueParam.getValue());
+  int newValue = wrapIncrement(value, up - down, maxIndex);
 
-  if (delta == 0) {
+  // queued first: with the batch full the presses stay for the next
+  // scan, rather than the value moving without the card hearing of it
+  if (newValue != value &&
+      !batch.pushProgramChange(midiChannel, midiPrograms[newValue], selector)) {
     return false;
   }
 
-  int value = static_cast<int>(valueParam.getValue());
-  int newValue = wrapIncrement(value, delta, maxIndex);
+  upButton.setValue(0.f);
+  downButton.setValue(0.f);
 
   if (newValue == value) {
     return false;
@@ -244,11 +428,21 @@ template <typename NameLookup> inline bool handleUpDownSelector(
 
   nameString = nameLookup(newValue);
 
-  setMidiProgramChangeMessage(midiMessage, midiChannel, midiPrograms[newValue]);
   return true;
 }
 
 
+// momentary buttons are cleared as soon as they're handled, quicker than
+// a light shows: light on the press and let updateLights() fade it.
+// The audio thread lights it, the UI fades it: a lost write only
+// shortens a flash.
+inline void lightOnPress(const Param& button, Light& light) {
+  if (button.getValue() > 0.f) {
+    light.setBrightness(1.f);
+  }
+}
+
+
 
 // filter vector:
 // struct that gets passed between modules via expander interface
@@ -0,0 +1,194 @@
+// Stress test for the Broker's snapshot scheme (SnapshotBuffer): an
+// audio thread pinning and reading snapshots, and attaching through the
+// writer try-lock, against UI threads publishing through the blocking
+// writer lock.  Fails if the reader ever sees a snapshot change under
+// its pin, a torn snapshot, or generations going backwards.
+//
+//   make broker_stress && ./broker_stress [seconds]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "SnapshotBuffer.hpp"
+
+namespace {
+
+// a few hundred bytes, like the Broker's Snapshot.  Every value is the
+// generation, so a reader can tell a torn or rewritten one.
+struct TestSnapshot {
+  uint32_t generation = 0;
+  uint32_t values[96] = {};
+};
+
+constexpr int uiWriters = 2;
+constexpr int audioAttachEvery = 64;      // reads per attach attempt
+
+zox::SnapshotBuffer<TestSnapshot> snapshots;
+std::atomic<bool> running { true };
+std::atomic<uint64_t> failures { 0 };
+
+
+bool consistent(const TestSnapshot& s) {
+  for (uint32_t v : s.values) {
+    if (v != s.generation) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void update(TestSnapshot& next) {
+  next.generation++;
+  std::fill(std::begin(next.values), std::end(next.values), next.generation);
+}
+
+
+struct AudioStats {
+  uint64_t reads = 0;
+  uint64_t attaches = 0;
+  uint64_t busy = 0;
+  int64_t maxAcquireNs = 0;
+  // acquire times by power of two ns: the max is whatever preemption
+  // landed in the timed window, the tail shows what acquire() costs
+  uint64_t acquireHistogram[64] = {};
+};
+
+
+// ns that fraction of the acquires took no longer than, to a power of two
+int64_t acquireQuantileNs(const AudioStats& stats, double fraction) {
+  const uint64_t wanted = static_cast<uint64_t>(fraction * stats.reads);
+  uint64_t seen = 0;
+  for (int b = 0; b < 64; ++b) {
+    seen += stats.acquireHistogram[b];
+    if (seen >= wanted) {
+      return int64_t(1) << b;
+    }
+  }
+  return stats.maxAcquireNs;
+}
+
+
+void audioThread(AudioStats& stats) {
+  uint32_t lastGeneration = 0;
+
+  while (running.load(std::memory_order_relaxed)) {
+    auto start = std::chrono::steady_clock::now();
+    const TestSnapshot* s = snapshots.acquire();
+    auto acquired = std::chrono::steady_clock::now();
+    const int64_t acquireNs = std::chrono::duration_cast<std::chrono::nanoseconds>(acquired - start).count();
+    stats.maxAcquireNs = std::max(stats.maxAcquireNs, acquireNs);
+    stats.acquireHistogram[acquireNs > 1 ? 64 - __builtin_clzll(acquireNs - 1) : 0]++;
+
+    // read it twice with a gap for writers to land in
+    const uint32_t generation = s->generation;
+    if (!consistent(*s) || generation < lastGeneration) {
+      failures.fetch_add(1);
+    }
+    for (int i = 0; i < 200; ++i) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    if (s->generation != generation || !consistent(*s)) {
+      failures.fetch_add(1);
+    }
+    lastGeneration = generation;
+    snapshots.release();
+    ++stats.reads;
+
+    // attach: a writer on the audio thread, never waits
+    if (stats.reads % audioAttachEvery == 0) {
+      if (snapshots.tryLockWriters()) {
+        TestSnapshot& next = snapshots.beginUpdate();
+        update(next);
+        snapshots.publish(next);
+        snapshots.unlockWriters();
+        ++stats.attaches;
+      }
+      else {
+        ++stats.busy;
+      }
+    }
+  }
+}
+
+
+struct UiStats {
+  uint64_t publishes = 0;
+  int64_t maxLockWaitNs = 0;
+};
+
+
+void uiThread(UiStats& stats) {
+  while (running.load(std::memory_order_relaxed)) {
+    auto start = std::chrono::steady_clock::now();
+    snapshots.lockWriters();
+    auto locked = std::chrono::steady_clock::now();
+    TestSnapshot& next = snapshots.beginUpdate();
+    update(next);
+    snapshots.publish(next);
+    snapshots.unlockWriters();
+
+    stats.maxLockWaitNs = std::max<int64_t>(stats.maxLockWaitNs,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(locked - start).count());
+    ++stats.publishes;
+  }
+}
+
+} // namespace
+
+
+int main(int argc, char** argv) {
+  const double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+
+  snapshots.publish(snapshots.storage[0]);
+
+  AudioStats audio;
+  UiStats ui[uiWriters];
+  std::vector<std::thread> threads;
+  threads.emplace_back(audioThread, std::ref(audio));
+  for (int i = 0; i < uiWriters; ++i) {
+    threads.emplace_back(uiThread, std::ref(ui[i]));
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  running.store(false);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  uint64_t uiPublishes = 0;
+  int64_t uiMaxWaitNs = 0;
+  for (const UiStats& s : ui) {
+    uiPublishes += s.publishes;
+    uiMaxWaitNs = std::max(uiMaxWaitNs, s.maxLockWaitNs);
+  }
+
+  std::printf("broker_stress: %.1f s, %" PRIu64 " reads, max acquire %" PRId64 " ns\n",
+              seconds, audio.reads, audio.maxAcquireNs);
+  std::printf("  acquire: 99.9%% within %" PRId64 " ns, 99.999%% within %" PRId64 " ns\n",
+              acquireQuantileNs(audio, 0.999), acquireQuantileNs(audio, 0.99999));
+  std::printf("  audio attaches: %" PRIu64 ", busy (retried next block): %" PRIu64 "\n",
+              audio.attaches, audio.busy);
+  std::printf("  ui publishes: %" PRIu64 ", max writer lock wait %" PRId64 " us\n",
+              uiPublishes, uiMaxWaitNs / 1000);
+
+  const TestSnapshot* last = snapshots.acquire();
+  if (last->generation != audio.attaches + uiPublishes || !consistent(*last)) {
+    std::printf("FAIL: final generation %" PRIu32 ", expected %" PRIu64 "\n",
+                last->generation, audio.attaches + uiPublishes);
+    failures.fetch_add(1);
+  }
+  snapshots.release();
+
+  if (failures.load()) {
+    std::printf("broker_stress: %" PRIu64 " failures\n", failures.load());
+    return 1;
+  }
+  std::printf("broker_stress: ok\n");
+  return 0;
+}
@@ -0,0 +1,177 @@
+// Benchmark and check of the audio port's integer ratio Decimator
+// against the generic converter it replaces, SampleRateConverter at
+// quality 6 as the port sets it up.  For 48k to 4k and 96k to 8k: the
+// time per 16 frame engine block for each, then the decimator's output
+// against the converter's, lined up on its delay, on slow CV.  Fails if
+// they differ by more than tolerance anywhere after the filters settle.
+//
+//   make decimator_bench && ./decimator_bench [seconds per case]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Decimator.hpp"
+
+using namespace zox;
+
+namespace {
+
+constexpr int blockFrames = 16;        // as OutputInterface pushes them
+constexpr int activeChannels = 24;     // three cards' worth
+constexpr float tolerance = 0.01f;
+constexpr int settleFrames = 256;      // device frames skipped before comparing
+constexpr int maxLag = 128;            // device frames, either way, between the two
+
+using Frame = dsp::Frame<maxAudioChannels>;
+
+struct Case {
+  float inRate;
+  float outRate;
+};
+
+
+// slow CV, different on each channel: an offset and two sines well
+// inside the passband.  Slow enough that the two filters' delays, which
+// differ by a fraction of a device frame, stay inside the tolerance.
+void fillBlock(Frame* frames, int64_t start, float rate) {
+  for (int i = 0; i < blockFrames; ++i) {
+    const float t = (start + i) / rate;
+    for (int c = 0; c < activeChannels; ++c) {
+      frames[i].samples[c] = 0.4f + 0.3f * std::sin(2.f * M_PI * (1.f + 0.25f * c) * t)
+        + 0.1f * std::sin(2.f * M_PI * (10.f + c) * t);
+    }
+  }
+}
+
+
+void setupSrc(dsp::SampleRateConverter<maxAudioChannels>& src, const Case& rates) {
+  src.setQuality(6);
+  src.setRates(static_cast<int>(rates.inRate * 100.f), static_cast<int>(rates.outRate * 100.f));
+  src.setChannels(activeChannels);
+}
+
+
+// engine blocks through each path, output frames appended to out
+double runDecimator(const Case& rates, int numBlocks, std::vector<Frame>* out) {
+  Decimator decimator;
+  decimator.setRates(rates.inRate, rates.outRate);
+  decimator.setChannels(activeChannels);
+  std::vector<Frame> in(blockFrames);
+  std::vector<Frame> converted(8 * blockFrames);
+  double seconds = 0.0;
+
+  for (int b = 0; b < numBlocks; ++b) {
+    fillBlock(in.data(), static_cast<int64_t>(b) * blockFrames, rates.inRate);
+    int inFrames = blockFrames;
+    int outFrames = converted.size();
+    auto start = std::chrono::steady_clock::now();
+    decimator.process((const float*) in.data(), maxAudioChannels, &inFrames,
+                      (float*) converted.data(), maxAudioChannels, &outFrames);
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (out) {
+      out->insert(out->end(), converted.begin(), converted.begin() + outFrames);
+    }
+  }
+  return seconds;
+}
+
+
+double runSrc(const Case& rates, int numBlocks, std::vector<Frame>* out) {
+  dsp::SampleRateConverter<maxAudioChannels> src;
+  setupSrc(src, rates);
+  std::vector<Frame> in(blockFrames);
+  std::vector<Frame> converted(8 * blockFrames);
+  double seconds = 0.0;
+
+  for (int b = 0; b < numBlocks; ++b) {
+    fillBlock(in.data(), static_cast<int64_t>(b) * blockFrames, rates.inRate);
+    int inFrames = blockFrames;
+    int outFrames = converted.size();
+    auto start = std::chrono::steady_clock::now();
+    src.process((const float*) in.data(), maxAudioChannels, &inFrames,
+                (float*) converted.data(), maxAudioChannels, &outFrames);
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (out) {
+      out->insert(out->end(), converted.begin(), converted.begin() + outFrames);
+    }
+  }
+  return seconds;
+}
+
+
+// largest difference with the converter's output lag frames later
+float maxError(const std::vector<Frame>& decimated, const std::vector<Frame>& reference, int lag) {
+  float worst = 0.f;
+  const int n = std::min(static_cast<int>(decimated.size()), static_cast<int>(reference.size()) - lag);
+  for (int i = settleFrames; i < n; ++i) {
+    for (int c = 0; c < activeChannels; ++c) {
+      worst = std::max(worst, std::fabs(decimated[i].samples[c] - reference[i + lag].samples[c]));
+    }
+  }
+  return worst;
+}
+
+
+bool runCase(const Case& rates, double seconds) {
+  // the check: a couple of seconds of output, the converter's delay
+  // found as the lag that lines them up best
+  const int checkBlocks = static_cast<int>(2.f * rates.inRate / blockFrames);
+  std::vector<Frame> decimated;
+  std::vector<Frame> reference;
+  runDecimator(rates, checkBlocks, &decimated);
+  runSrc(rates, checkBlocks, &reference);
+
+  int bestLag = 0;
+  float bestError = INFINITY;
+  for (int lag = -maxLag; lag <= maxLag; ++lag) {
+    const float error = maxError(decimated, reference, lag);
+    if (error < bestError) {
+      bestError = error;
+      bestLag = lag;
+    }
+  }
+
+  // the benchmark
+  const int benchBlocks = std::max(1, static_cast<int>(seconds * rates.inRate / blockFrames));
+  const double decimatorSeconds = runDecimator(rates, benchBlocks, nullptr);
+  const double srcSeconds = runSrc(rates, benchBlocks, nullptr);
+  const double decimatorNs = 1e9 * decimatorSeconds / benchBlocks;
+  const double srcNs = 1e9 * srcSeconds / benchBlocks;
+
+  const bool ok = bestError <= tolerance;
+  std::printf("%.0fk to %.0fk, %d channels, %d frame blocks:\n",
+              rates.inRate / 1000.f, rates.outRate / 1000.f, activeChannels, blockFrames);
+  std::printf("  decimator %.0f ns/block, SRC %.0f ns/block, %.1fx\n",
+              decimatorNs, srcNs, decimatorNs > 0.0 ? srcNs / decimatorNs : 0.0);
+  std::printf("  %zu device frames, SRC %d frames behind, max difference %.5f (tolerance %.3f)%s\n",
+              decimated.size(), bestLag, bestError, tolerance, ok ? "" : "  FAIL");
+  return ok;
+}
+
+} // namespace
+
+
+int main(int argc, char** argv) {
+  const double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+  const Case cases[] = {
+    { 48000.f, 4000.f },
+    { 96000.f, 8000.f },
+  };
+
+  int failures = 0;
+  for (const Case& rates : cases) {
+    if (!runCase(rates, seconds)) {
+      ++failures;
+    }
+  }
+
+  if (failures) {
+    std::printf("decimator_bench: %d failures\n", failures);
+    return 1;
+  }
+  std::printf("decimator_bench: ok\n");
+  return 0;
+}